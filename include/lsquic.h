@@ -269,6 +269,36 @@ struct lsquic_stream_if {
 /** Default clock granularity is 1000 microseconds */
 #define LSQUIC_DF_CLOCK_GRANULARITY      1000
 
+/** By default, packet trains are disabled */
+#define LSQUIC_DF_MAX_TRAIN_LEN     0
+
+/** Maximum number of packets in a packet train */
+#define LSQUIC_MAX_TRAIN_LEN        64
+
+/** By default, advisory tick time queue is a binary heap */
+#define LSQUIC_DF_TIMER_WHEEL       0
+
+/** By default, Cubic congestion controller is used */
+#define LSQUIC_DF_CC_ALGO           1
+
+/** By default, RACK loss detection is off */
+#define LSQUIC_DF_RACK              0
+
+/** By default, packets are released at most one clock tick early */
+#define LSQUIC_DF_PACE_HORIZON      0
+
+/** By default, ACK decimation is off */
+#define LSQUIC_DF_ACK_DECIMATION    0
+
+/** By default, the amount of cached memory is not capped */
+#define LSQUIC_DF_MM_MAX_CACHED     0
+
+/** By default, there is no per-connection memory budget */
+#define LSQUIC_DF_CONN_MEM_BUDGET   0
+
+/** By default, buffers are allocated using malloc(3) */
+#define LSQUIC_DF_MM_HUGE_PAGES     0
+
 struct lsquic_engine_settings {
     /**
      * This is a bit mask wherein each bit corresponds to a value in
@@ -461,6 +491,150 @@ struct lsquic_engine_settings {
      * is in microseconds; default is @ref LSQUIC_DF_CLOCK_GRANULARITY.
      */
     unsigned        es_clock_granularity;
+
+    /**
+     * If set to a non-zero value, the engine places consecutive packets
+     * belonging to the same connection into a single buffer -- a packet
+     * train -- and passes it to the @ref ea_packets_out callback as one
+     * @ref lsquic_out_spec.  This is the number of packets a train may
+     * contain.  It must not exceed @ref LSQUIC_MAX_TRAIN_LEN.
+     *
+     * When packet trains are enabled, specs passed to the callback are
+     * grouped by connection.  Only turn this on if the callback knows how
+     * to send trains (see `segment_sz' in @ref lsquic_out_spec), for
+     * example by using UDP GSO.
+     *
+     * The default value is @ref LSQUIC_DF_MAX_TRAIN_LEN.
+     */
+    unsigned        es_max_train_len;
+
+    /**
+     * If set to true, the engine keeps connections waiting to be ticked
+     * in a hierarchical timer wheel instead of a binary heap.  The wheel
+     * uses @ref es_clock_granularity as its tick: scheduling and
+     * unscheduling a connection take constant time, but connections
+     * whose advisory tick times fall into the same tick are not ordered
+     * among themselves.  This helps engines with many mostly idle
+     * connections.
+     *
+     * The default value is @ref LSQUIC_DF_TIMER_WHEEL.
+     */
+    int             es_timer_wheel;
+
+    /**
+     * Congestion control algorithm to use:
+     *
+     *  0:  Use default (@ref LSQUIC_DF_CC_ALGO)
+     *  1:  Cubic
+     *  2:  BBR (version 1)
+     *
+     * BBR paces packets at the estimated bottleneck bandwidth and does
+     * not back off on random loss.  It works best when packet pacing
+     * (@ref es_pace_packets) is on.
+     */
+    unsigned        es_cc_algo;
+
+    /**
+     * If set to true, packet loss is detected by time (RACK) instead of
+     * by packet number: a packet is declared lost if it was sent earlier
+     * than an acknowledged packet by more than one RTT plus the reordering
+     * window.  The reordering window starts at a quarter of min RTT and
+     * grows, up to smoothed RTT, each time a packet declared lost turns
+     * out to have been delivered.
+     *
+     * This makes the connection tolerate packet reordering, for example
+     * on paths where packets are spread over several links.
+     *
+     * The default value is @ref LSQUIC_DF_RACK.
+     */
+    int             es_rack;
+
+    /**
+     * If set to a non-zero value, the pacer releases packets whose
+     * departure times are up to this many microseconds in the future.
+     * This lets the engine hand over a whole burst of packets in one tick
+     * instead of waking up every @ref es_clock_granularity microseconds.
+     *
+     * Only set this if @ref ea_packets_out callback honors `txtime' in
+     * @ref lsquic_out_spec -- for example, by using SO_TXTIME -- as
+     * otherwise the packets go out in bursts.  When this is set, sent
+     * time of a packet is taken to be its departure time and packet
+     * trains only contain packets with the same departure time.
+     *
+     * The default value is @ref LSQUIC_DF_PACE_HORIZON.
+     */
+    unsigned        es_pace_horizon;
+
+    /**
+     * If set to a non-zero value, ACK decimation is used: once the peer
+     * has likely left slow start (after 100 packets are received), an
+     * ACK is sent for every this many ackable packets or after a quarter
+     * of min RTT, whichever comes first.  Otherwise, and for a while
+     * after a packet loss is detected, an ACK is sent for every other
+     * ackable packet.  A value of 10 is reasonable.  With decimation,
+     * the ACK delay is counted from the first unacknowledged packet
+     * rather than from the latest one.
+     *
+     * Fewer ACKs save CPU and uplink bandwidth on the receiver and CPU on
+     * the sender.  A sender that paces its packets does not become bursty
+     * because of this.
+     *
+     * The default value is @ref LSQUIC_DF_ACK_DECIMATION.
+     */
+    unsigned        es_ack_decimation;
+
+    /**
+     * The engine keeps released packets and buffers on free lists for
+     * reuse.  If set to a non-zero value, no more than this many bytes
+     * are kept on free lists: objects released beyond that are freed
+     * immediately.
+     *
+     * Independent of this setting, objects that have not been reused
+     * for a second or so are freed periodically from
+     * lsquic_engine_process_conns(), so that memory used during a
+     * traffic spike is returned to the system.
+     *
+     * The default value is @ref LSQUIC_DF_MM_MAX_CACHED.
+     */
+    unsigned        es_mm_max_cached;
+
+    /**
+     * If set to a non-zero value, this is the number of bytes a
+     * connection may use to buffer incoming stream data, outgoing packets
+     * that are waiting to be sent, and HTTP header blocks.
+     *
+     * The budget is enforced by flow control: receive windows are capped
+     * at what is left of the budget (but no lower than 16 KB) and do not
+     * grow while the connection is over budget.  Over budget, the
+     * connection also stops buffering more outgoing packets, so that
+     * stream writes return zero bytes.
+     *
+     * This keeps a single misbehaving peer from using up the memory of
+     * a process that has many connections open.
+     *
+     * The default value is @ref LSQUIC_DF_CONN_MEM_BUDGET.
+     */
+    unsigned        es_conn_mem_budget;
+
+    /**
+     * If set to true, memory that outgoing packets are built and encrypted
+     * in is backed by huge pages.  This reduces TLB misses when many
+     * packets are in flight.  If explicit huge pages are not available,
+     * transparent huge pages are requested instead.
+     *
+     * Packet payload buffers, as well as the rest of the buffers handed
+     * out by the engine's memory manager, are carved out of 2 MB arenas.
+     * Buffers that encrypted packets are written to come from a ring of
+     * huge pages, unless a custom @ref lsquic_packout_mem_if is used, in
+     * which case that allocator is responsible for this memory.
+     *
+     * Buffers allocated from arenas are not returned to the system until
+     * the engine is destroyed: @ref es_mm_max_cached does not apply to
+     * them.
+     *
+     * The default value is @ref LSQUIC_DF_MM_HUGE_PAGES.
+     */
+    int             es_mm_huge_pages;
 };
 
 /* Initialize `settings' to default values */
@@ -496,6 +670,25 @@ struct lsquic_out_spec
     const struct sockaddr *local_sa;
     const struct sockaddr *dest_sa;
     void                  *peer_ctx;
+    /**
+     * If non-zero, `buf' contains a packet train: several packets laid out
+     * back to back.  Each packet is `segment_sz' bytes long, except for the
+     * last packet, which may be shorter.  This matches the layout expected
+     * by UDP GSO.  Packet train fits into a single UDP datagram.  If zero,
+     * `buf' contains a single packet.
+     *
+     * @see es_max_train_len
+     */
+    unsigned short         segment_sz;
+    /**
+     * Earliest departure time in microseconds, on the same monotonic clock
+     * the library uses (CLOCK_MONOTONIC on POSIX systems).  It is set by
+     * the pacer; zero means that the packet can be sent immediately.  The
+     * callback may pass it to the kernel -- for example, using SO_TXTIME --
+     * so that packets are paced precisely.  If `buf' contains a packet
+     * train, this is the departure time of the first packet.
+     */
+    uint64_t               txtime;
 };
 
 /**
@@ -539,6 +732,24 @@ struct lsquic_packout_mem_if
                                                                 char is_ipv6);
 };
 
+/**
+ * The packet in memory interface is used to hand ownership of incoming
+ * packet buffers over to the library.  If it is specified, the library
+ * takes ownership of every buffer passed to @ref lsquic_engine_packet_in()
+ * and @ref lsquic_engine_packets_in(), even if the packet is dropped.  The
+ * buffer must be writable: the packet is decrypted in place, avoiding a
+ * copy.  The application may not modify or reuse the buffer until the
+ * library releases it.
+ */
+struct lsquic_packin_mem_if
+{
+    /**
+     * Release buffer once the library no longer needs it.  `buf' is the
+     * pointer the packet was passed to the library with.
+     */
+    void    (*pimi_release) (void *pimi_ctx, void *buf);
+};
+
 struct stack_st_X509;
 
 /**
@@ -621,6 +832,21 @@ typedef struct lsquic_engine_api
      */
     const struct lsquic_packout_mem_if  *ea_pmi;
     void                                *ea_pmi_ctx;
+    /**
+     * Packet in memory interface is optional.  If set, the library takes
+     * ownership of incoming packet buffers and decrypts packets in place.
+     */
+    const struct lsquic_packin_mem_if   *ea_pimi;
+    void                                *ea_pimi_ctx;
+    /**
+     * Optional.  This function is called by @ref lsquic_engine_post_cmd()
+     * -- in the thread that posts the command -- when the command queue
+     * was empty.  Use it to wake up the engine thread, for example by
+     * writing to an eventfd(2) watched by the event loop.  The engine
+     * thread should then call @ref lsquic_engine_process_conns().
+     */
+    void                               (*ea_cmd_notify)(void *cmd_notify_ctx);
+    void                                *ea_cmd_notify_ctx;
     /**
      * Function to verify server certificate.  The chain contains at least
      * one element.  The first element in the chain is the server
@@ -683,6 +909,9 @@ lsquic_engine_connect (lsquic_engine_t *, const struct sockaddr *local_sa,
  *
  * @retval -1   Some error occurred.  Possible reasons are invalid packet
  *              size or failure to allocate memory.
+ *
+ * If @ref ea_pimi is set, the library takes ownership of the packet buffer
+ * regardless of the return value.
  */
 int
 lsquic_engine_packet_in (lsquic_engine_t *,
@@ -690,13 +919,123 @@ lsquic_engine_packet_in (lsquic_engine_t *,
         const struct sockaddr *sa_local, const struct sockaddr *sa_peer,
         void *peer_ctx);
 
+/**
+ * Same as @ref lsquic_engine_packet_in(), but with the time the packet
+ * was received.  This is meant to be used with kernel or hardware receive
+ * timestamps (for example, SO_TIMESTAMPNS), so that time the packet spent
+ * in the socket queue is not counted towards RTT and ACK delay.
+ *
+ * `received' is in microseconds, on the same monotonic clock the library
+ * uses (CLOCK_MONOTONIC on POSIX systems).  Zero or a time in the future
+ * means that the packet was received now.
+ */
+int
+lsquic_engine_packet_in_ts (lsquic_engine_t *,
+        const unsigned char *packet_in_data, size_t packet_in_size,
+        const struct sockaddr *sa_local, const struct sockaddr *sa_peer,
+        void *peer_ctx, uint64_t received);
+
+/**
+ * Incoming packet specification used by @ref lsquic_engine_packets_in().
+ * The fields have the same meaning as the arguments to
+ * @ref lsquic_engine_packet_in_ts().
+ */
+struct lsquic_in_spec
+{
+    const unsigned char   *buf;
+    size_t                 sz;
+    const struct sockaddr *local_sa;
+    const struct sockaddr *peer_sa;
+    void                  *peer_ctx;
+    uint64_t               received;
+};
+
+/**
+ * Pass a batch of incoming packets to the QUIC engine.  This is the vectored
+ * version of @ref lsquic_engine_packet_in() meant to be used with calls
+ * such as recvmmsg(2).  Packets whose `received' field is not set are
+ * stamped with the same receive time, connection lookups are shared by
+ * consecutive packets destined to the same connection, and packets that
+ * belong to the same connection are passed to it back to back.  The
+ * relative order of packets within each connection is preserved.
+ *
+ * A packet that cannot be processed does not abort the batch: it is skipped
+ * just like lsquic_engine_packet_in() would skip it.
+ *
+ * @retval  Number of packets that were processed by real connections.
+ */
+unsigned
+lsquic_engine_packets_in (lsquic_engine_t *,
+        const struct lsquic_in_spec *in_specs, unsigned n_packets_in);
+
 /**
  * Process tickable connections.  This function must be called often enough so
  * that packets and connections do not expire.
+ *
+ * Commands posted using @ref lsquic_engine_post_cmd() are executed first.
  */
 void
 lsquic_engine_process_conns (lsquic_engine_t *engine);
 
+/**
+ * Command types.  See @ref lsquic_cmd.
+ */
+enum lsquic_cmd_type
+{
+    /** Write `cmd_buf' to stream `cmd_stream_id' */
+    LSQCMD_WRITE,
+    /** Create new stream on the connection: see lsquic_conn_make_stream() */
+    LSQCMD_MAKE_STREAM,
+    /** Close stream `cmd_stream_id' */
+    LSQCMD_CLOSE_STREAM,
+    /** Close the connection */
+    LSQCMD_CLOSE_CONN,
+};
+
+/**
+ * Command posted to the engine from another thread using
+ * @ref lsquic_engine_post_cmd().  Connection is identified by its ID (see
+ * @ref lsquic_conn_id()), so that it is safe to post commands to
+ * connections that may have been closed in the meantime.
+ *
+ * The command and the buffer belong to the application, which may not
+ * modify or free them until `cmd_done' is called.
+ */
+struct lsquic_cmd
+{
+    enum lsquic_cmd_type    cmd_type;
+    lsquic_cid_t            cmd_cid;
+    uint32_t                cmd_stream_id;
+    const void             *cmd_buf;
+    size_t                  cmd_sz;
+    /**
+     * Optional.  Called in the engine thread after the command has been
+     * executed.  `result' is -1 if the connection or the stream was not
+     * found or if an error occurred.  Otherwise, it is the number of bytes
+     * written for LSQCMD_WRITE -- this may be fewer than `cmd_sz', in which
+     * case the application may post the rest later -- and 0 for other
+     * commands.
+     */
+    void                  (*cmd_done)(struct lsquic_cmd *, ssize_t result);
+    void                   *cmd_ctx;
+    /** Used by the library */
+    struct lsquic_cmd      *cmd_next;
+};
+
+/**
+ * Post command to the engine.  This function may be called from any thread
+ * without locking: the commands are placed onto a lock-free queue.  They
+ * are executed in order they were posted at the beginning of the next call
+ * to @ref lsquic_engine_process_conns().
+ *
+ * If the command queue was empty, @ref ea_cmd_notify is called.
+ *
+ * Commands that are still queued when the engine is destroyed complete
+ * with result -1.
+ */
+void
+lsquic_engine_post_cmd (lsquic_engine_t *, struct lsquic_cmd *);
+
 /**
  * Returns true if engine has some unsent packets.  This happens if
  * @ref ea_packets_out() could not send everything out.
@@ -936,6 +1275,51 @@ lsquic_conn_get_engine (lsquic_conn_t *c);
 int lsquic_conn_get_sockaddr(const lsquic_conn_t *c,
                 const struct sockaddr **local, const struct sockaddr **peer);
 
+/**
+ * Connection information returned by @ref lsquic_conn_get_info().  Rates
+ * are in bytes per second and times are in microseconds.  Zero means that
+ * the value is not known yet.
+ */
+struct lsquic_conn_info
+{
+    /**
+     * Bandwidth estimate: the maximum delivery rate measured over the last
+     * few round trips.  Delivery rate samples taken while the application
+     * did not have enough data to fill the congestion window are only
+     * used if they exceed the current estimate.
+     */
+    uint64_t    lci_bw_estimate;
+    /** The most recent delivery rate sample */
+    uint64_t    lci_bw_sample;
+    /** Total number of bytes acknowledged by peer */
+    uint64_t    lci_bytes_delivered;
+    uint64_t    lci_bytes_in_flight;
+    uint64_t    lci_cwnd;
+    /** Pacing rate derived by the congestion controller */
+    uint64_t    lci_pacing_rate;
+    uint64_t    lci_srtt;
+    uint64_t    lci_rttvar;
+    /** Minimum RTT seen over the last ten seconds */
+    uint64_t    lci_min_rtt;
+    /** The most recent RTT sample */
+    uint64_t    lci_latest_rtt;
+    /**
+     * Number of packets declared lost which peer acknowledged later.  This
+     * happens when packets are reordered or delayed.
+     */
+    unsigned    lci_n_spurious_losses;
+};
+
+/**
+ * Get connection information: bandwidth estimate, RTT, congestion window,
+ * and so on.
+ *
+ * @retval   0  Success.
+ * @retval  -1  Error: `info' is NULL.
+ */
+int
+lsquic_conn_get_info (lsquic_conn_t *, struct lsquic_conn_info *info);
+
 struct lsquic_logger_if {
     int     (*vprintf)(void *logger_ctx, const char *fmt, va_list args);
 };
@@ -1014,6 +1398,21 @@ lsquic_logger_lopt (const char *optarg);
  */
 unsigned lsquic_engine_quic_versions (const lsquic_engine_t *);
 
+#if LSQUIC_CONN_STATS
+/**
+ * Add cumulative connection statistics collected by engine `src' to those
+ * collected by `engine'.  Statistics of a connection are collected when it
+ * is destroyed.
+ *
+ * This is useful when several engines are run in parallel -- for example,
+ * one per thread -- and the statistics should be printed in aggregate.  The
+ * engines must not be in use at the time of the call.  The statistics are
+ * printed to `ea_stats_fh' of `engine' when it is destroyed.
+ */
+void
+lsquic_engine_add_stats (lsquic_engine_t *engine, const lsquic_engine_t *src);
+#endif
+
 /**
  * This is one of the flags that can be passed to @ref lsquic_global_init.
  * Use it to initialize LSQUIC for use in client mode.
@@ -1030,6 +1429,10 @@ unsigned lsquic_engine_quic_versions (const lsquic_engine_t *);
  * Initialize LSQUIC.  This must be called before any other LSQUIC function
  * is called.  Returns 0 on success and -1 on failure.
  *
+ * Engines do not share state, so several engines may be used at the same
+ * time, each in its own thread, provided this function has been called
+ * before the threads are started.
+ *
  * @param flags     This a bitmask of @ref LSQUIC_GLOBAL_CLIENT and
  *                    @ref LSQUIC_GLOBAL_SERVER.  At least one of these
  *                    flags should be specified.
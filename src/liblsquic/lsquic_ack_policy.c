@@ -0,0 +1,79 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_ack_policy.c -- Decide when to send ACK frames.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "lsquic_int_types.h"
+#include "lsquic_types.h"
+#include "lsquic_rechist.h"
+#include "lsquic_ack_policy.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+#define MAX_RETR_PACKETS_SINCE_LAST_ACK 2
+
+/* Peer is likely in slow start until this many packets are received: ACK
+ * frequently to let its congestion window grow.  This is the same value
+ * Chromium uses.
+ */
+#define DECIMATION_START                100
+
+
+void
+lsquic_ack_policy_init (struct ack_policy *ap, unsigned decimation)
+{
+    memset(ap, 0, sizeof(*ap));
+    ap->ap_decimation = decimation;
+}
+
+
+enum ack_decision
+lsquic_ack_policy_packet_in (struct ack_policy *ap,
+            struct lsquic_rechist *rechist, lsquic_packno_t packno,
+            int ackable, int had_miss, lsquic_time_t min_rtt,
+            lsquic_time_t *ack_delay)
+{
+    const struct lsquic_packno_range *range;
+    unsigned threshold;
+    int was_missing;
+
+    ap->ap_n_slack_all  += 1;
+    ap->ap_n_slack_akbl += !!ackable;
+
+    was_missing = packno != lsquic_rechist_largest_packno(rechist);
+    if (had_miss && was_missing)
+        return AD_NOW;
+
+    if (ap->ap_n_slack_akbl == 0)
+        return AD_NONE;
+
+    *ack_delay = ACK_TIMEOUT;
+    threshold = MAX_RETR_PACKETS_SINCE_LAST_ACK;
+    if (ap->ap_decimation && packno >= DECIMATION_START)
+    {
+        range = lsquic_rechist_first(rechist);
+        if (range->high - range->low + 1 >= ap->ap_decimation
+                                        || !lsquic_rechist_next(rechist))
+        {
+            threshold = ap->ap_decimation;
+            if (min_rtt)
+                *ack_delay = MIN(*ack_delay, min_rtt / 4);
+        }
+        else if (!was_missing && range->low == packno)
+        {
+            /* This packet opened a new gap.  Allow some time for reordered
+             * packets to arrive, but not much.
+             */
+            if (min_rtt)
+                *ack_delay = MIN(*ack_delay, min_rtt / 8);
+        }
+    }
+
+    if (ap->ap_n_slack_akbl >= threshold)
+        return AD_NOW;
+    else
+        return AD_TIMER;
+}
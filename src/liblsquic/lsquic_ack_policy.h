@@ -0,0 +1,57 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_ack_policy.h -- Decide when to send ACK frames.
+ *
+ * By default, an ACK is sent for every other ackable packet.  With ACK
+ * decimation, once the peer is likely out of slow start, an ACK is sent
+ * for every N ackable packets or after a quarter of min RTT, whichever
+ * comes first.  When a new gap appears in the receive history, decimation
+ * is suspended until that many packets have been received since the gap,
+ * so that the peer learns about losses quickly.
+ */
+
+#ifndef LSQUIC_ACK_POLICY_H
+#define LSQUIC_ACK_POLICY_H 1
+
+struct lsquic_rechist;
+
+/* Maximum ACK delay, in microseconds */
+#define ACK_TIMEOUT                     25000
+
+struct ack_policy
+{
+    /* Number of packets received since last ACK sent: */
+    unsigned                     ap_n_slack_all;
+    /* Number ackable packets received since last ACK was sent: */
+    unsigned                     ap_n_slack_akbl;
+    /* Send ACK every this many ackable packets; zero means decimation
+     * is off.
+     */
+    unsigned                     ap_decimation;
+};
+
+enum ack_decision
+{
+    AD_NONE,        /* Nothing to acknowledge */
+    AD_TIMER,       /* Send ACK when ACK timer expires */
+    AD_NOW,         /* Send ACK now */
+};
+
+void
+lsquic_ack_policy_init (struct ack_policy *, unsigned decimation);
+
+/* Called after packet `packno' has been added to receive history.  If
+ * AD_TIMER is returned, `ack_delay' is set to the maximum ACK delay.
+ * `had_miss' is true if the last ACK frame had missing packets.
+ */
+enum ack_decision
+lsquic_ack_policy_packet_in (struct ack_policy *, struct lsquic_rechist *,
+            lsquic_packno_t packno, int ackable, int had_miss,
+            lsquic_time_t min_rtt, lsquic_time_t *ack_delay);
+
+#define lsquic_ack_policy_reset(ap) do {                                    \
+    (ap)->ap_n_slack_all  = 0;                                              \
+    (ap)->ap_n_slack_akbl = 0;                                              \
+} while (0)
+
+#endif
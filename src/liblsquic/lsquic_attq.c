@@ -6,10 +6,27 @@
  * element having the minimum advsory time.  To speed up removal, each
  * element has an index it has in the heap array.  The index is updated
  * as elements are moved around in the array when heap is updated.
+ *
+ * Alternatively, the queue can be backed by a hierarchical timer wheel.
+ * Advisory times are converted to ticks of clock granularity.  There are
+ * AW_NLEVELS levels of AW_NSLOTS slots each; a slot at level L covers
+ * AW_NSLOTS^L ticks.  An element is placed at the lowest level at which
+ * its tick shares all higher-level digits with the current tick.  As the
+ * current tick advances, slots at higher levels are cascaded to lower
+ * levels.  Ticks too far in the future are kept on the overflow list.
+ *
+ * Insertion and removal are O(1).  Within the same tick, connections are
+ * popped in the order they were added, not strictly by advisory time.
+ * Each slot keeps the number of its elements, so that counting elements
+ * before a cutoff visits elements of at most one slot below the overflow
+ * list.  Each slot also remembers its earliest element.  When that element
+ * is removed, the slot is scanned again only when its minimum is needed.
  */
 
 #include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <sys/queue.h>
 #ifdef WIN32
 #include <vc_compat.h>
 #endif
@@ -22,20 +39,37 @@
 #include "lsquic_conn.h"
 
 
+#define AW_LEVEL_BITS 6
+#define AW_NSLOTS (1U << AW_LEVEL_BITS)
+#define AW_NLEVELS 4
+#define AW_OVERFLOW (AW_NLEVELS * AW_NSLOTS)
+#define AW_NONE (AW_OVERFLOW + 1)
+
+TAILQ_HEAD(attq_slot, attq_elem);
+
 struct attq
 {
     struct malo        *aq_elem_malo;
     struct attq_elem  **aq_heap;
     unsigned            aq_nelem;
     unsigned            aq_nalloc;
+    /* The rest is used by the timer wheel, when aq_granularity is set: */
+    unsigned            aq_granularity;
+    uint64_t            aq_now;         /* Current tick */
+    uint64_t            aq_bitmaps[AW_NLEVELS];
+    struct attq_slot    aq_slots[AW_OVERFLOW + 1];
+    unsigned            aq_slot_nelem[AW_OVERFLOW + 1];
+    /* Earliest element in each slot, NULL if not known: */
+    struct attq_elem   *aq_slot_min[AW_OVERFLOW + 1];
 };
 
 
-struct attq *
-attq_create (void)
+static struct attq *
+attq_new (unsigned granularity)
 {
     struct attq *q;
     struct malo *malo;
+    unsigned i;
 
     malo = lsquic_malo_create(sizeof(struct attq_elem));
     if (!malo)
@@ -49,10 +83,27 @@ attq_create (void)
     }
 
     q->aq_elem_malo = malo;
+    q->aq_granularity = granularity;
+    for (i = 0; i < sizeof(q->aq_slots) / sizeof(q->aq_slots[0]); ++i)
+        TAILQ_INIT(&q->aq_slots[i]);
     return q;
 }
 
 
+struct attq *
+attq_create (void)
+{
+    return attq_new(0);
+}
+
+
+struct attq *
+attq_create_wheel (unsigned granularity)
+{
+    return attq_new(granularity ? granularity : 1);
+}
+
+
 void
 attq_destroy (struct attq *q)
 {
@@ -103,6 +154,225 @@ attq_swap (struct attq *q, unsigned a, unsigned b)
 }
 
 
+#if __GNUC__
+#   define ctz __builtin_ctzll
+#else
+static unsigned
+ctz (unsigned long long x)
+{
+    unsigned n = 0;
+    if (0 == (x & ((1ULL << 32) - 1))) { n += 32; x >>= 32; }
+    if (0 == (x & ((1ULL << 16) - 1))) { n += 16; x >>= 16; }
+    if (0 == (x & ((1ULL <<  8) - 1))) { n +=  8; x >>=  8; }
+    if (0 == (x & ((1ULL <<  4) - 1))) { n +=  4; x >>=  4; }
+    if (0 == (x & ((1ULL <<  2) - 1))) { n +=  2; x >>=  2; }
+    if (0 == (x & ((1ULL <<  1) - 1))) { n +=  1; x >>=  1; }
+    return n;
+}
+
+
+#endif
+
+
+#define AW_SHIFT(level) (AW_LEVEL_BITS * (level))
+
+
+static unsigned
+wheel_slot (const struct attq *q, lsquic_time_t advisory_time)
+{
+    uint64_t tick;
+    unsigned level;
+
+    tick = advisory_time / q->aq_granularity;
+    if (tick < q->aq_now)
+        tick = q->aq_now;
+
+    for (level = 0; level < AW_NLEVELS; ++level)
+        if ((tick >> AW_SHIFT(level + 1)) == (q->aq_now >> AW_SHIFT(level + 1)))
+            return level * AW_NSLOTS
+                            + ((tick >> AW_SHIFT(level)) & (AW_NSLOTS - 1));
+
+    return AW_OVERFLOW;
+}
+
+
+static void
+wheel_insert (struct attq *q, struct attq_elem *el)
+{
+    unsigned slot;
+
+    slot = wheel_slot(q, el->ae_adv_time);
+    el->ae_heap_idx = slot;
+    TAILQ_INSERT_TAIL(&q->aq_slots[slot], el, ae_next_slot);
+    if (q->aq_slot_nelem[slot]++ == 0
+            || (q->aq_slot_min[slot]
+                    && el->ae_adv_time < q->aq_slot_min[slot]->ae_adv_time))
+        q->aq_slot_min[slot] = el;
+    if (slot < AW_OVERFLOW)
+        q->aq_bitmaps[ slot / AW_NSLOTS ] |= 1ULL << (slot % AW_NSLOTS);
+}
+
+
+static void
+wheel_unlink (struct attq *q, struct attq_elem *el)
+{
+    unsigned slot;
+
+    slot = el->ae_heap_idx;
+    TAILQ_REMOVE(&q->aq_slots[slot], el, ae_next_slot);
+    --q->aq_slot_nelem[slot];
+    /* Recalculated when needed: see wheel_slot_min() */
+    if (q->aq_slot_min[slot] == el)
+        q->aq_slot_min[slot] = NULL;
+    if (slot < AW_OVERFLOW && TAILQ_EMPTY(&q->aq_slots[slot]))
+        q->aq_bitmaps[ slot / AW_NSLOTS ] &= ~(1ULL << (slot % AW_NSLOTS));
+}
+
+
+/* Slots that precede the current tick are always empty, so the first
+ * non-empty slot contains the earliest elements.
+ */
+static unsigned
+wheel_first_slot (const struct attq *q)
+{
+    unsigned level;
+
+    for (level = 0; level < AW_NLEVELS; ++level)
+        if (q->aq_bitmaps[level])
+            return level * AW_NSLOTS + ctz(q->aq_bitmaps[level]);
+
+    if (!TAILQ_EMPTY(&q->aq_slots[AW_OVERFLOW]))
+        return AW_OVERFLOW;
+    else
+        return AW_NONE;
+}
+
+
+/* Return the first tick covered by the slot */
+static uint64_t
+wheel_slot_start (const struct attq *q, unsigned slot)
+{
+    const struct attq_elem *el;
+    uint64_t tick, min_tick;
+    unsigned level;
+
+    if (slot < AW_OVERFLOW)
+    {
+        level = slot / AW_NSLOTS;
+        return ((q->aq_now >> AW_SHIFT(level + 1) << AW_LEVEL_BITS)
+                                    | (slot % AW_NSLOTS)) << AW_SHIFT(level);
+    }
+
+    min_tick = UINT64_MAX;
+    TAILQ_FOREACH(el, &q->aq_slots[AW_OVERFLOW], ae_next_slot)
+    {
+        tick = el->ae_adv_time / q->aq_granularity;
+        if (tick < min_tick)
+            min_tick = tick;
+    }
+    return min_tick >> AW_SHIFT(AW_NLEVELS) << AW_SHIFT(AW_NLEVELS);
+}
+
+
+/* Advance current tick up to `target', cascading elements from higher
+ * levels.  Stop early if a level-zero slot that is due is reached.
+ */
+static void
+wheel_advance (struct attq *q, uint64_t target)
+{
+    struct attq_slot cascade;
+    struct attq_elem *el;
+    uint64_t start;
+    unsigned slot;
+
+    while (q->aq_now < target)
+    {
+        slot = wheel_first_slot(q);
+        if (slot == AW_NONE)
+        {
+            q->aq_now = target;
+            break;
+        }
+        start = wheel_slot_start(q, slot);
+        if (start > target)
+        {
+            q->aq_now = target;
+            break;
+        }
+        q->aq_now = start;
+        if (slot < AW_NSLOTS)
+            break;
+        TAILQ_INIT(&cascade);
+        while ((el = TAILQ_FIRST(&q->aq_slots[slot])))
+        {
+            wheel_unlink(q, el);
+            TAILQ_INSERT_TAIL(&cascade, el, ae_next_slot);
+        }
+        while ((el = TAILQ_FIRST(&cascade)))
+        {
+            TAILQ_REMOVE(&cascade, el, ae_next_slot);
+            wheel_insert(q, el);
+        }
+    }
+}
+
+
+/* The slot is only scanned if its earliest element has been removed since
+ * the last scan.
+ */
+static struct attq_elem *
+wheel_slot_min (struct attq *q, unsigned slot)
+{
+    struct attq_elem *el, *min;
+
+    if (q->aq_slot_min[slot])
+        return q->aq_slot_min[slot];
+
+    min = TAILQ_FIRST(&q->aq_slots[slot]);
+    TAILQ_FOREACH(el, &q->aq_slots[slot], ae_next_slot)
+        if (el->ae_adv_time < min->ae_adv_time)
+            min = el;
+    q->aq_slot_min[slot] = min;
+    return min;
+}
+
+
+static struct lsquic_conn *
+wheel_pop (struct attq *q, lsquic_time_t cutoff)
+{
+    struct lsquic_conn *conn;
+    struct attq_elem *el;
+    uint64_t target;
+    unsigned slot;
+
+    target = cutoff / q->aq_granularity;
+    wheel_advance(q, target);
+
+    slot = wheel_first_slot(q);
+    if (slot >= AW_NSLOTS)
+        return NULL;
+
+    if (wheel_slot_start(q, slot) < target)
+        el = TAILQ_FIRST(&q->aq_slots[slot]);
+    else
+    {
+        /* The slot straddles the cutoff: look for the element that is due */
+        if (q->aq_slot_min[slot]
+                        && q->aq_slot_min[slot]->ae_adv_time >= cutoff)
+            return NULL;
+        TAILQ_FOREACH(el, &q->aq_slots[slot], ae_next_slot)
+            if (el->ae_adv_time < cutoff)
+                break;
+        if (!el)
+            return NULL;
+    }
+
+    conn = el->ae_conn;
+    attq_remove(q, conn);
+    return conn;
+}
+
+
 int
 attq_add (struct attq *q, struct lsquic_conn *conn,
                                             lsquic_time_t advisory_time)
@@ -110,6 +380,19 @@ attq_add (struct attq *q, struct lsquic_conn *conn,
     struct attq_elem *el, **heap;
     unsigned n, i;
 
+    if (q->aq_granularity)
+    {
+        el = lsquic_malo_get(q->aq_elem_malo);
+        if (!el)
+            return -1;
+        el->ae_adv_time = advisory_time;
+        el->ae_conn = conn;
+        conn->cn_attq_elem = el;
+        wheel_insert(q, el);
+        ++q->aq_nelem;
+        return 0;
+    }
+
     if (q->aq_nelem >= q->aq_nalloc)
     {
         if (q->aq_nalloc > 0)
@@ -158,6 +441,9 @@ attq_pop (struct attq *q, lsquic_time_t cutoff)
     if (q->aq_nelem == 0)
         return NULL;
 
+    if (q->aq_granularity)
+        return wheel_pop(q, cutoff);
+
     el = q->aq_heap[0];
     if (el->ae_adv_time >= cutoff)
         return NULL;
@@ -208,9 +494,18 @@ attq_remove (struct attq *q, struct lsquic_conn *conn)
     idx = el->ae_heap_idx;
 
     assert(q->aq_nelem > 0);
-    assert(q->aq_heap[idx] == el);
+    assert(q->aq_granularity || q->aq_heap[idx] == el);
     assert(conn->cn_attq_elem == el);
 
+    if (q->aq_granularity)
+    {
+        wheel_unlink(q, el);
+        conn->cn_attq_elem = NULL;
+        lsquic_malo_put(el);
+        --q->aq_nelem;
+        return;
+    }
+
     conn->cn_attq_elem = NULL;
     lsquic_malo_put(el);
 
@@ -233,11 +528,59 @@ attq_remove (struct attq *q, struct lsquic_conn *conn)
 }
 
 
+static unsigned
+wheel_count_in_slot (const struct attq *q, unsigned slot,
+                                                    lsquic_time_t cutoff)
+{
+    const struct attq_elem *el;
+    unsigned count;
+
+    count = 0;
+    TAILQ_FOREACH(el, &q->aq_slots[slot], ae_next_slot)
+        count += el->ae_adv_time < cutoff;
+    return count;
+}
+
+
+/* Slots are visited in time order.  Slots that end before the cutoff are
+ * counted whole; elements are compared only in the slot that straddles it.
+ * The slot of the current tick may contain elements whose advisory time
+ * has passed, so it is never skipped.
+ */
+static unsigned
+wheel_count_before (const struct attq *q, lsquic_time_t cutoff)
+{
+    uint64_t bitmap, start, end;
+    unsigned level, slot, count;
+
+    count = 0;
+    for (level = 0; level < AW_NLEVELS; ++level)
+        for (bitmap = q->aq_bitmaps[level]; bitmap; bitmap &= bitmap - 1)
+        {
+            slot = level * AW_NSLOTS + ctz(bitmap);
+            start = wheel_slot_start(q, slot);
+            end = start + (1ULL << AW_SHIFT(level));
+            if (end * q->aq_granularity <= cutoff)
+                count += q->aq_slot_nelem[slot];
+            else if (start > q->aq_now
+                                && start * q->aq_granularity >= cutoff)
+                return count;
+            else
+                count += wheel_count_in_slot(q, slot, cutoff);
+        }
+
+    return count + wheel_count_in_slot(q, AW_OVERFLOW, cutoff);
+}
+
+
 unsigned
 attq_count_before (struct attq *q, lsquic_time_t cutoff)
 {
     unsigned level, total_count, level_count, i, level_max;
 
+    if (q->aq_granularity)
+        return wheel_count_before(q, cutoff);
+
     total_count = 0;
     for (i = 0, level = 0;; ++level)
     {
@@ -256,6 +599,13 @@ attq_count_before (struct attq *q, lsquic_time_t cutoff)
 const lsquic_time_t *
 attq_next_time (struct attq *q)
 {
+    if (q->aq_granularity)
+    {
+        if (q->aq_nelem == 0)
+            return NULL;
+        return &wheel_slot_min(q, wheel_first_slot(q))->ae_adv_time;
+    }
+
     if (q->aq_nelem > 0)
         return &q->aq_heap[0]->ae_adv_time;
     else
@@ -17,13 +17,23 @@ struct attq_elem
 {
     struct lsquic_conn  *ae_conn;
     lsquic_time_t        ae_adv_time;
-    unsigned             ae_heap_idx;
+    unsigned             ae_heap_idx;   /* Heap index or timer wheel slot */
+    TAILQ_ENTRY(attq_elem)
+                         ae_next_slot;  /* Used by timer wheel only */
 };
 
 
+/* Create queue backed by a binary heap */
 struct attq *
 attq_create (void);
 
+/* Create queue backed by a hierarchical timer wheel.  Connections whose
+ * advisory times fall into the same `granularity' microseconds are kept
+ * in the same slot, which makes insertion and removal O(1).
+ */
+struct attq *
+attq_create_wheel (unsigned granularity);
+
 void
 attq_destroy (struct attq *);
 
@@ -37,6 +47,10 @@ attq_remove (struct attq *, struct lsquic_conn *);
 struct lsquic_conn *
 attq_pop (struct attq *, lsquic_time_t cutoff);
 
+/* The timer wheel counts whole slots that end before the cutoff, so the
+ * cost depends on the number of non-empty slots, not on the number of
+ * connections.
+ */
 unsigned
 attq_count_before (struct attq *, lsquic_time_t cutoff);
 
@@ -0,0 +1,684 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_bbr.c -- BBR (version 1) congestion control
+ *
+ * The logic follows the BBR draft and the sender in Chromium, without
+ * the ACK aggregation heuristics.
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/queue.h>
+#ifdef WIN32
+#include <vc_compat.h>
+#endif
+
+#include "lsquic.h"
+#include "lsquic_int_types.h"
+#include "lsquic_types.h"
+#include "lsquic_packet_common.h"
+#include "lsquic_packet_out.h"
+#include "lsquic_rtt.h"
+#include "lsquic_conn_flow.h"
+#include "lsquic_sfcw.h"
+#include "lsquic_stream.h"
+#include "lsquic_conn_public.h"
+#include "lsquic_conn.h"
+#include "lsquic_cong_ctl.h"
+#include "lsquic_minmax.h"
+#include "lsquic_bw_sampler.h"
+#include "lsquic_bbr.h"
+
+#define LSQUIC_LOGGER_MODULE LSQLM_BBR
+#define LSQUIC_LOG_CONN_ID bbr->bbr_conn_pub->lconn->cn_cid
+#include "lsquic_logger.h"
+
+#define BBR_UNIT                256
+/* Startup gain of 2/ln(2) doubles the sending rate each round trip */
+#define BBR_HIGH_GAIN           (BBR_UNIT * 2885 / 1000 + 1)
+#define BBR_DRAIN_GAIN          (BBR_UNIT * 1000 / 2885)
+#define BBR_CWND_GAIN           (BBR_UNIT * 2)
+#define BBR_STARTUP_GROWTH      (BBR_UNIT * 5 / 4)
+#define BBR_STARTUP_ROUNDS      3           /* Rounds without growth */
+#define BBR_BW_FILTER_LEN       10          /* Round trips */
+#define BBR_MIN_RTT_EXPIRY      10000000    /* Microseconds */
+#define BBR_PROBE_RTT_TIME      200000      /* Microseconds */
+#define BBR_DEFAULT_RTT         50000       /* Microseconds */
+#define BBR_INIT_CWND_PACKETS   32
+#define BBR_MIN_CWND_PACKETS    4
+#define BBR_MAX_CWND_PACKETS    10000
+
+#ifndef MAX
+#   define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+#ifndef MIN
+#   define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+
+/* In PROBE_BW mode, the sender cycles through these pacing gains, one
+ * phase per min RTT: probe for more bandwidth, drain the queue created
+ * by probing, and cruise at the estimated bandwidth.
+ */
+static const unsigned pacing_gain_cycle[] =
+{
+    BBR_UNIT * 5 / 4, BBR_UNIT * 3 / 4,
+    BBR_UNIT, BBR_UNIT, BBR_UNIT, BBR_UNIT, BBR_UNIT, BBR_UNIT,
+};
+
+#define GAIN_CYCLE_LEN (sizeof(pacing_gain_cycle) / sizeof(pacing_gain_cycle[0]))
+
+
+static const char *const mode2str[] =
+{
+    [BBR_MODE_STARTUP]   = "STARTUP",
+    [BBR_MODE_DRAIN]     = "DRAIN",
+    [BBR_MODE_PROBE_BW]  = "PROBE_BW",
+    [BBR_MODE_PROBE_RTT] = "PROBE_RTT",
+};
+
+
+static void
+set_mode (struct lsquic_bbr *bbr, enum bbr_mode mode)
+{
+    if (bbr->bbr_mode != mode)
+    {
+        LSQ_DEBUG("mode change %s -> %s", mode2str[bbr->bbr_mode],
+                                                            mode2str[mode]);
+        bbr->bbr_mode = mode;
+    }
+}
+
+
+static void
+enter_startup_mode (struct lsquic_bbr *bbr)
+{
+    set_mode(bbr, BBR_MODE_STARTUP);
+    bbr->bbr_pacing_gain = BBR_HIGH_GAIN;
+    bbr->bbr_cwnd_gain = BBR_HIGH_GAIN;
+}
+
+
+static void
+enter_probe_bw_mode (struct lsquic_bbr *bbr, lsquic_time_t now)
+{
+    set_mode(bbr, BBR_MODE_PROBE_BW);
+    bbr->bbr_cwnd_gain = BBR_CWND_GAIN;
+
+    /* Pick a random phase other than the draining one, so that flows
+     * sharing a bottleneck do not probe in lockstep.  Connection ID is
+     * random enough for this.
+     */
+    bbr->bbr_cycle_idx = bbr->bbr_conn_pub->lconn->cn_cid
+                                                    % (GAIN_CYCLE_LEN - 1);
+    if (bbr->bbr_cycle_idx >= 1)
+        ++bbr->bbr_cycle_idx;
+
+    bbr->bbr_cycle_start = now;
+    bbr->bbr_pacing_gain = pacing_gain_cycle[bbr->bbr_cycle_idx];
+}
+
+
+static void
+lsquic_bbr_init (void *cong_ctl, const struct lsquic_conn_public *conn_pub,
+                                        struct bw_sampler *sampler)
+{
+    struct lsquic_bbr *const bbr = cong_ctl;
+
+    memset(bbr, 0, sizeof(*bbr));
+    bbr->bbr_conn_pub = conn_pub;
+    bbr->bbr_bw_sampler = sampler;
+    minmax_init(&bbr->bbr_max_bandwidth, BBR_BW_FILTER_LEN);
+
+    bbr->bbr_mss = conn_pub->lconn->cn_pack_size;
+    bbr->bbr_init_cwnd = BBR_INIT_CWND_PACKETS * bbr->bbr_mss;
+    bbr->bbr_min_cwnd  = BBR_MIN_CWND_PACKETS  * bbr->bbr_mss;
+    bbr->bbr_max_cwnd  = BBR_MAX_CWND_PACKETS  * bbr->bbr_mss;
+    bbr->bbr_cwnd = bbr->bbr_init_cwnd;
+    enter_startup_mode(bbr);
+
+    LSQ_DEBUG("initialized");
+}
+
+
+static lsquic_time_t
+get_min_rtt (const struct lsquic_bbr *bbr)
+{
+    lsquic_time_t min_rtt;
+
+    if (bbr->bbr_min_rtt)
+        return bbr->bbr_min_rtt;
+    min_rtt = lsquic_rtt_stats_get_srtt(&bbr->bbr_conn_pub->rtt_stats);
+    if (min_rtt)
+        return min_rtt;
+    return BBR_DEFAULT_RTT;
+}
+
+
+static uint64_t
+get_target_cwnd (const struct lsquic_bbr *bbr, unsigned gain)
+{
+    uint64_t bdp, cwnd;
+
+    bdp = lsquic_bbr_bandwidth(bbr) * get_min_rtt(bbr) / 1000000;
+    if (bdp == 0)
+        cwnd = bbr->bbr_init_cwnd * gain / BBR_UNIT;
+    else
+        cwnd = bdp * gain / BBR_UNIT;
+
+    return MAX(cwnd, bbr->bbr_min_cwnd);
+}
+
+
+static int
+in_recovery (const struct lsquic_bbr *bbr)
+{
+    return bbr->bbr_recovery_state != BBR_RS_NOT_IN_RECOVERY;
+}
+
+
+static void
+lsquic_bbr_begin_ack (void *cong_ctl, lsquic_time_t ack_time,
+                                                            uint64_t in_flight)
+{
+    struct lsquic_bbr *const bbr = cong_ctl;
+
+    assert(!(bbr->bbr_flags & BBR_FLAG_IN_ACK));
+    bbr->bbr_flags |= BBR_FLAG_IN_ACK;
+    bbr->bbr_ack_state.ack_time = ack_time;
+    bbr->bbr_ack_state.sample_min_rtt = 0;
+    bbr->bbr_ack_state.in_flight = in_flight;
+    bbr->bbr_ack_state.acked_before =
+                        lsquic_bw_sampler_total_acked(bbr->bbr_bw_sampler);
+    bbr->bbr_ack_state.max_packno = 0;
+    bbr->bbr_ack_state.round_start = 0;
+}
+
+
+static void
+lsquic_bbr_ack (void *cong_ctl, struct lsquic_packet_out *packet_out,
+                unsigned packet_sz, lsquic_time_t now, int app_limited,
+                const struct bw_sample *sample)
+{
+    struct lsquic_bbr *const bbr = cong_ctl;
+
+    assert(bbr->bbr_flags & BBR_FLAG_IN_ACK);
+
+    /* A round trip ends when a packet sent after the round started is
+     * acked.
+     */
+    if (packet_out->po_packno > bbr->bbr_round_end_packno)
+    {
+        ++bbr->bbr_round_count;
+        bbr->bbr_round_end_packno = bbr->bbr_last_sent_packno;
+        bbr->bbr_ack_state.round_start = 1;
+    }
+    bbr->bbr_ack_state.max_packno = packet_out->po_packno;
+
+    if (!sample)
+        return;
+
+    if (sample->is_app_limited)
+        bbr->bbr_flags |= BBR_FLAG_LAST_SAMPLE_APP_LIMITED;
+    else
+        bbr->bbr_flags &= ~BBR_FLAG_LAST_SAMPLE_APP_LIMITED;
+
+    if (sample->rtt && (bbr->bbr_ack_state.sample_min_rtt == 0
+                            || sample->rtt < bbr->bbr_ack_state.sample_min_rtt))
+        bbr->bbr_ack_state.sample_min_rtt = sample->rtt;
+
+    /* App-limited samples underestimate the bandwidth unless they exceed
+     * the current estimate.
+     */
+    if (!sample->is_app_limited
+                        || sample->bandwidth > lsquic_bbr_bandwidth(bbr))
+        minmax_upmax(&bbr->bbr_max_bandwidth, bbr->bbr_round_count,
+                                                        sample->bandwidth);
+}
+
+
+/* Returns true if min RTT has expired */
+static int
+update_min_rtt (struct lsquic_bbr *bbr)
+{
+    const lsquic_time_t sample_min_rtt = bbr->bbr_ack_state.sample_min_rtt;
+    const lsquic_time_t now = bbr->bbr_ack_state.ack_time;
+    int expired;
+
+    if (sample_min_rtt == 0)
+        return 0;
+
+    expired = bbr->bbr_min_rtt != 0
+                && now > bbr->bbr_min_rtt_stamp + BBR_MIN_RTT_EXPIRY;
+    if (expired || sample_min_rtt < bbr->bbr_min_rtt || bbr->bbr_min_rtt == 0)
+    {
+        LSQ_DEBUG("min rtt updated from %"PRIu64" to %"PRIu64" usec",
+                                            bbr->bbr_min_rtt, sample_min_rtt);
+        bbr->bbr_min_rtt = sample_min_rtt;
+        bbr->bbr_min_rtt_stamp = now;
+    }
+
+    return expired;
+}
+
+
+static void
+update_recovery_state (struct lsquic_bbr *bbr, int has_losses)
+{
+    if (has_losses)
+        bbr->bbr_end_recovery_at = bbr->bbr_last_sent_packno;
+
+    switch (bbr->bbr_recovery_state)
+    {
+    case BBR_RS_NOT_IN_RECOVERY:
+        if (has_losses)
+        {
+            LSQ_DEBUG("enter recovery");
+            bbr->bbr_recovery_state = BBR_RS_CONSERVATION;
+            /* The window is set when congestion window is calculated */
+            bbr->bbr_recovery_window = 0;
+            /* Start a new round so that conservation lasts one round */
+            bbr->bbr_round_end_packno = bbr->bbr_last_sent_packno;
+        }
+        break;
+    case BBR_RS_CONSERVATION:
+        if (bbr->bbr_ack_state.round_start)
+            bbr->bbr_recovery_state = BBR_RS_GROWTH;
+        /* Fall-through */
+    case BBR_RS_GROWTH:
+        if (!has_losses
+                && bbr->bbr_ack_state.max_packno > bbr->bbr_end_recovery_at)
+        {
+            LSQ_DEBUG("exit recovery");
+            bbr->bbr_recovery_state = BBR_RS_NOT_IN_RECOVERY;
+        }
+        break;
+    }
+}
+
+
+static void
+update_gain_cycle_phase (struct lsquic_bbr *bbr, uint64_t prior_in_flight,
+                                                            int has_losses)
+{
+    const lsquic_time_t now = bbr->bbr_ack_state.ack_time;
+    int should_advance;
+
+    should_advance = now - bbr->bbr_cycle_start > get_min_rtt(bbr);
+
+    /* When probing, stay in this phase until losses occur or enough data
+     * is in flight to fill the larger window.
+     */
+    if (bbr->bbr_pacing_gain > BBR_UNIT && !has_losses
+            && prior_in_flight < get_target_cwnd(bbr, bbr->bbr_pacing_gain))
+        should_advance = 0;
+
+    /* When draining, leave as soon as the queue is drained */
+    if (bbr->bbr_pacing_gain < BBR_UNIT
+                        && prior_in_flight <= get_target_cwnd(bbr, BBR_UNIT))
+        should_advance = 1;
+
+    if (should_advance)
+    {
+        bbr->bbr_cycle_idx = (bbr->bbr_cycle_idx + 1) % GAIN_CYCLE_LEN;
+        bbr->bbr_cycle_start = now;
+        bbr->bbr_pacing_gain = pacing_gain_cycle[bbr->bbr_cycle_idx];
+        LSQ_DEBUG("advance to gain cycle phase %u", bbr->bbr_cycle_idx);
+    }
+}
+
+
+/* Startup is over when the bandwidth estimate has not grown by 25% in
+ * three round trips.
+ */
+static void
+check_if_full_bw_reached (struct lsquic_bbr *bbr)
+{
+    uint64_t target;
+
+    if (bbr->bbr_flags & BBR_FLAG_LAST_SAMPLE_APP_LIMITED)
+        return;
+
+    target = bbr->bbr_bw_at_last_round * BBR_STARTUP_GROWTH / BBR_UNIT;
+    if (lsquic_bbr_bandwidth(bbr) >= target)
+    {
+        bbr->bbr_bw_at_last_round = lsquic_bbr_bandwidth(bbr);
+        bbr->bbr_rounds_wo_bw_gain = 0;
+        return;
+    }
+
+    if (++bbr->bbr_rounds_wo_bw_gain >= BBR_STARTUP_ROUNDS)
+    {
+        LSQ_DEBUG("reached full bandwidth: %"PRIu64" B/s",
+                                                lsquic_bbr_bandwidth(bbr));
+        bbr->bbr_flags |= BBR_FLAG_FULL_BW;
+    }
+}
+
+
+static void
+maybe_exit_startup_or_drain (struct lsquic_bbr *bbr, uint64_t in_flight)
+{
+    if (bbr->bbr_mode == BBR_MODE_STARTUP
+                                    && (bbr->bbr_flags & BBR_FLAG_FULL_BW))
+    {
+        set_mode(bbr, BBR_MODE_DRAIN);
+        bbr->bbr_pacing_gain = BBR_DRAIN_GAIN;
+        bbr->bbr_cwnd_gain = BBR_HIGH_GAIN;
+    }
+
+    if (bbr->bbr_mode == BBR_MODE_DRAIN
+                                && in_flight <= get_target_cwnd(bbr, BBR_UNIT))
+        enter_probe_bw_mode(bbr, bbr->bbr_ack_state.ack_time);
+}
+
+
+static void
+maybe_enter_or_exit_probe_rtt (struct lsquic_bbr *bbr, uint64_t in_flight,
+                                                        int min_rtt_expired)
+{
+    const lsquic_time_t now = bbr->bbr_ack_state.ack_time;
+
+    if (min_rtt_expired
+            && !(bbr->bbr_flags & BBR_FLAG_EXITING_QUIESCENCE)
+                && bbr->bbr_mode != BBR_MODE_PROBE_RTT)
+    {
+        set_mode(bbr, BBR_MODE_PROBE_RTT);
+        bbr->bbr_pacing_gain = BBR_UNIT;
+        bbr->bbr_exit_probe_rtt_at = 0;
+    }
+
+    if (bbr->bbr_mode == BBR_MODE_PROBE_RTT)
+    {
+        /* Samples taken while draining the pipe do not reflect bandwidth */
+        lsquic_bw_sampler_app_limited(bbr->bbr_bw_sampler);
+
+        if (bbr->bbr_exit_probe_rtt_at == 0)
+        {
+            /* Wait until in-flight data drains to the minimum window */
+            if (in_flight < bbr->bbr_min_cwnd + bbr->bbr_mss)
+            {
+                bbr->bbr_exit_probe_rtt_at = now + BBR_PROBE_RTT_TIME;
+                bbr->bbr_flags &= ~BBR_FLAG_PROBE_RTT_ROUND_PASSED;
+            }
+        }
+        else
+        {
+            if (bbr->bbr_ack_state.round_start)
+                bbr->bbr_flags |= BBR_FLAG_PROBE_RTT_ROUND_PASSED;
+            if (now >= bbr->bbr_exit_probe_rtt_at
+                    && (bbr->bbr_flags & BBR_FLAG_PROBE_RTT_ROUND_PASSED))
+            {
+                bbr->bbr_min_rtt_stamp = now;
+                if (bbr->bbr_flags & BBR_FLAG_FULL_BW)
+                    enter_probe_bw_mode(bbr, now);
+                else
+                    enter_startup_mode(bbr);
+            }
+        }
+    }
+
+    bbr->bbr_flags &= ~BBR_FLAG_EXITING_QUIESCENCE;
+}
+
+
+static void
+calculate_pacing_rate (struct lsquic_bbr *bbr)
+{
+    uint64_t bw, target_rate;
+
+    bw = lsquic_bbr_bandwidth(bbr);
+    if (bw == 0)
+        return;
+
+    target_rate = bw * bbr->bbr_pacing_gain / BBR_UNIT;
+    if (bbr->bbr_flags & BBR_FLAG_FULL_BW)
+    {
+        bbr->bbr_pacing_rate = target_rate;
+        return;
+    }
+
+    /* Pace at the rate of initial window per RTT as soon as the first
+     * RTT measurement is available.
+     */
+    if (bbr->bbr_pacing_rate == 0 && bbr->bbr_min_rtt)
+    {
+        bbr->bbr_pacing_rate = bbr->bbr_init_cwnd * 1000000 / bbr->bbr_min_rtt;
+        return;
+    }
+
+    /* Do not decrease pacing rate during startup */
+    bbr->bbr_pacing_rate = MAX(bbr->bbr_pacing_rate, target_rate);
+}
+
+
+static void
+calculate_cwnd (struct lsquic_bbr *bbr, uint64_t bytes_acked)
+{
+    uint64_t target_window;
+
+    if (bbr->bbr_mode == BBR_MODE_PROBE_RTT)
+        return;
+
+    target_window = get_target_cwnd(bbr, bbr->bbr_cwnd_gain);
+    if (bbr->bbr_flags & BBR_FLAG_FULL_BW)
+        /* Grow towards the target, but do not exceed it */
+        bbr->bbr_cwnd = MIN(target_window, bbr->bbr_cwnd + bytes_acked);
+    else if (bbr->bbr_cwnd < target_window
+                || lsquic_bw_sampler_total_acked(bbr->bbr_bw_sampler)
+                                                        < bbr->bbr_init_cwnd)
+        /* Do not shrink the window before startup is over */
+        bbr->bbr_cwnd += bytes_acked;
+
+    bbr->bbr_cwnd = MAX(bbr->bbr_cwnd, bbr->bbr_min_cwnd);
+    bbr->bbr_cwnd = MIN(bbr->bbr_cwnd, bbr->bbr_max_cwnd);
+}
+
+
+static void
+calculate_recovery_window (struct lsquic_bbr *bbr, uint64_t bytes_acked,
+                                uint64_t bytes_lost, uint64_t in_flight)
+{
+    if (!in_recovery(bbr))
+        return;
+
+    /* Set up the initial recovery window */
+    if (bbr->bbr_recovery_window == 0)
+    {
+        bbr->bbr_recovery_window = in_flight + bytes_acked;
+        bbr->bbr_recovery_window = MAX(bbr->bbr_min_cwnd,
+                                                    bbr->bbr_recovery_window);
+        return;
+    }
+
+    /* Remove lost bytes from the window.  Packet conservation: send one
+     * packet for every packet acked.  In the growth phase, send two.
+     */
+    if (bbr->bbr_recovery_window >= bytes_lost)
+        bbr->bbr_recovery_window -= bytes_lost;
+    else
+        bbr->bbr_recovery_window = bbr->bbr_mss;
+
+    if (bbr->bbr_recovery_state == BBR_RS_GROWTH)
+        bbr->bbr_recovery_window += bytes_acked;
+
+    bbr->bbr_recovery_window = MAX(bbr->bbr_recovery_window,
+                                                    in_flight + bytes_acked);
+    bbr->bbr_recovery_window = MAX(bbr->bbr_min_cwnd,
+                                                    bbr->bbr_recovery_window);
+}
+
+
+static void
+lsquic_bbr_end_ack (void *cong_ctl, uint64_t in_flight)
+{
+    struct lsquic_bbr *const bbr = cong_ctl;
+    uint64_t bytes_acked, bytes_lost;
+    int has_losses, min_rtt_expired;
+
+    assert(bbr->bbr_flags & BBR_FLAG_IN_ACK);
+    bbr->bbr_flags &= ~BBR_FLAG_IN_ACK;
+
+    bytes_acked = lsquic_bw_sampler_total_acked(bbr->bbr_bw_sampler)
+                                            - bbr->bbr_ack_state.acked_before;
+    bytes_lost = bbr->bbr_ack_state.lost_bytes;
+    bbr->bbr_ack_state.lost_bytes = 0;
+    has_losses = bytes_lost > 0;
+
+    if (bbr->bbr_ack_state.max_packno)
+    {
+        min_rtt_expired = update_min_rtt(bbr);
+        update_recovery_state(bbr, has_losses);
+    }
+    else
+        min_rtt_expired = 0;
+
+    if (bbr->bbr_mode == BBR_MODE_PROBE_BW)
+        update_gain_cycle_phase(bbr, bbr->bbr_ack_state.in_flight,
+                                                                has_losses);
+
+    if (bbr->bbr_ack_state.round_start
+                                    && !(bbr->bbr_flags & BBR_FLAG_FULL_BW))
+        check_if_full_bw_reached(bbr);
+
+    maybe_exit_startup_or_drain(bbr, in_flight);
+
+    maybe_enter_or_exit_probe_rtt(bbr, in_flight, min_rtt_expired);
+
+    calculate_pacing_rate(bbr);
+    calculate_cwnd(bbr, bytes_acked);
+    calculate_recovery_window(bbr, bytes_acked, bytes_lost, in_flight);
+
+    LSQ_DEBUG("end ACK: mode: %s; bw: %"PRIu64" B/s; min rtt: %"PRIu64
+        "; cwnd: %"PRIu64"; pacing rate: %"PRIu64" B/s; round: %"PRIu64
+        "; in recovery: %d", mode2str[bbr->bbr_mode],
+        lsquic_bbr_bandwidth(bbr), bbr->bbr_min_rtt, bbr->bbr_cwnd,
+        bbr->bbr_pacing_rate, bbr->bbr_round_count, in_recovery(bbr));
+}
+
+
+static void
+lsquic_bbr_sent (void *cong_ctl, struct lsquic_packet_out *packet_out,
+                                        unsigned packet_sz, uint64_t in_flight)
+{
+    struct lsquic_bbr *const bbr = cong_ctl;
+
+    if (in_flight == 0 && lsquic_bw_sampler_is_app_limited(
+                                                    bbr->bbr_bw_sampler))
+        bbr->bbr_flags |= BBR_FLAG_EXITING_QUIESCENCE;
+
+    bbr->bbr_last_sent_packno = packet_out->po_packno;
+}
+
+
+static void
+lsquic_bbr_lost (void *cong_ctl, struct lsquic_packet_out *packet_out,
+                                                        unsigned packet_sz)
+{
+    struct lsquic_bbr *const bbr = cong_ctl;
+
+    bbr->bbr_ack_state.lost_bytes += packet_sz;
+}
+
+
+static void
+lsquic_bbr_loss (void *cong_ctl)
+{
+    /* BBR does not respond to loss events per se: lost bytes are taken
+     * into account by the recovery logic when the ACK is processed.
+     */
+}
+
+
+static void
+lsquic_bbr_undo (void *cong_ctl)
+{
+    struct lsquic_bbr *const bbr = cong_ctl;
+
+    /* Recovery is the only reaction to loss that BBR has */
+    if (in_recovery(bbr))
+    {
+        LSQ_DEBUG("undo: exit recovery");
+        bbr->bbr_recovery_state = BBR_RS_NOT_IN_RECOVERY;
+        bbr->bbr_recovery_window = 0;
+    }
+}
+
+
+/* BBR takes no action on these events: they are only logged */
+static void
+bbr_log_event (const struct lsquic_bbr *bbr, const char *event)
+{
+    LSQ_DEBUG("%s", event);
+}
+
+
+static void
+lsquic_bbr_timeout (void *cong_ctl)
+{
+    bbr_log_event(cong_ctl, "timeout");
+}
+
+
+static void
+lsquic_bbr_was_quiet (void *cong_ctl, lsquic_time_t now)
+{
+    bbr_log_event(cong_ctl, "was quiet");
+}
+
+
+static uint64_t
+lsquic_bbr_get_cwnd (void *cong_ctl)
+{
+    struct lsquic_bbr *const bbr = cong_ctl;
+
+    if (bbr->bbr_mode == BBR_MODE_PROBE_RTT)
+        return bbr->bbr_min_cwnd;
+    else if (in_recovery(bbr) && bbr->bbr_recovery_window)
+        return MIN(bbr->bbr_cwnd, bbr->bbr_recovery_window);
+    else
+        return bbr->bbr_cwnd;
+}
+
+
+static uint64_t
+lsquic_bbr_pacing_rate (void *cong_ctl, int in_recovery)
+{
+    struct lsquic_bbr *const bbr = cong_ctl;
+    lsquic_time_t srtt;
+
+    if (bbr->bbr_pacing_rate)
+        return bbr->bbr_pacing_rate;
+
+    /* No bandwidth estimate yet: pace the initial window at high gain */
+    srtt = lsquic_rtt_stats_get_srtt(&bbr->bbr_conn_pub->rtt_stats);
+    if (srtt == 0)
+        srtt = BBR_DEFAULT_RTT;
+    return bbr->bbr_init_cwnd * 1000000 / srtt * BBR_HIGH_GAIN / BBR_UNIT;
+}
+
+
+static void
+lsquic_bbr_cleanup (void *cong_ctl)
+{
+    bbr_log_event(cong_ctl, "cleanup");
+}
+
+
+const struct cong_ctl_if lsquic_cong_bbr_if =
+{
+    .cci_init        = lsquic_bbr_init,
+    .cci_begin_ack   = lsquic_bbr_begin_ack,
+    .cci_ack         = lsquic_bbr_ack,
+    .cci_end_ack     = lsquic_bbr_end_ack,
+    .cci_sent        = lsquic_bbr_sent,
+    .cci_lost        = lsquic_bbr_lost,
+    .cci_loss        = lsquic_bbr_loss,
+    .cci_undo        = lsquic_bbr_undo,
+    .cci_timeout     = lsquic_bbr_timeout,
+    .cci_was_quiet   = lsquic_bbr_was_quiet,
+    .cci_get_cwnd    = lsquic_bbr_get_cwnd,
+    .cci_pacing_rate = lsquic_bbr_pacing_rate,
+    .cci_cleanup     = lsquic_bbr_cleanup,
+};
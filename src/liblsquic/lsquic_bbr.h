@@ -0,0 +1,92 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_bbr.h -- BBR (version 1) congestion control
+ *
+ * BBR builds a model of the network path -- its bottleneck bandwidth and
+ * round-trip propagation time -- and paces at the estimated bandwidth
+ * instead of reacting to packet loss.  See
+ * draft-cardwell-iccrg-bbr-congestion-control-00.
+ *
+ * Requires lsquic_bw_sampler.h and lsquic_minmax.h.
+ */
+
+#ifndef LSQUIC_BBR_H
+#define LSQUIC_BBR_H 1
+
+struct lsquic_conn_public;
+
+struct lsquic_bbr
+{
+    /* The sampler belongs to the send controller */
+    struct bw_sampler        *bbr_bw_sampler;
+
+    /* Maximum bandwidth in the last few round trips; time is measured in
+     * round trips.
+     */
+    struct minmax                   bbr_max_bandwidth;
+
+    const struct lsquic_conn_public *bbr_conn_pub;
+
+    enum bbr_mode {
+        BBR_MODE_STARTUP,
+        BBR_MODE_DRAIN,
+        BBR_MODE_PROBE_BW,
+        BBR_MODE_PROBE_RTT,
+    }                               bbr_mode;
+
+    enum bbr_recovery_state {
+        BBR_RS_NOT_IN_RECOVERY,
+        BBR_RS_CONSERVATION,
+        BBR_RS_GROWTH,
+    }                               bbr_recovery_state;
+
+    enum bbr_flags {
+        BBR_FLAG_IN_ACK                  = 1 << 0,
+        BBR_FLAG_FULL_BW                 = 1 << 1,
+        BBR_FLAG_LAST_SAMPLE_APP_LIMITED = 1 << 2,
+        BBR_FLAG_EXITING_QUIESCENCE      = 1 << 3,
+        BBR_FLAG_PROBE_RTT_ROUND_PASSED  = 1 << 4,
+    }                               bbr_flags;
+
+    /* Gains are fixed-point values; BBR_UNIT is 1.0 */
+    unsigned                        bbr_pacing_gain;
+    unsigned                        bbr_cwnd_gain;
+    unsigned                        bbr_cycle_idx;
+    unsigned                        bbr_rounds_wo_bw_gain;
+    unsigned                        bbr_mss;
+
+    uint64_t                        bbr_round_count;
+    lsquic_packno_t                 bbr_round_end_packno;
+    lsquic_packno_t                 bbr_last_sent_packno;
+    lsquic_packno_t                 bbr_end_recovery_at;
+
+    lsquic_time_t                   bbr_min_rtt;
+    lsquic_time_t                   bbr_min_rtt_stamp;
+    lsquic_time_t                   bbr_exit_probe_rtt_at;
+    lsquic_time_t                   bbr_cycle_start;
+
+    uint64_t                        bbr_cwnd;
+    uint64_t                        bbr_init_cwnd;
+    uint64_t                        bbr_min_cwnd;
+    uint64_t                        bbr_max_cwnd;
+    uint64_t                        bbr_recovery_window;
+    uint64_t                        bbr_pacing_rate;
+    uint64_t                        bbr_bw_at_last_round;
+
+    /* State accumulated while processing a single ACK frame */
+    struct {
+        lsquic_time_t       ack_time;
+        lsquic_time_t       sample_min_rtt;
+        uint64_t            in_flight;
+        uint64_t            acked_before;
+        uint64_t            lost_bytes;
+        lsquic_packno_t     max_packno;
+        int                 round_start;
+    }                               bbr_ack_state;
+};
+
+extern const struct cong_ctl_if lsquic_cong_bbr_if;
+
+#define lsquic_bbr_bandwidth(bbr) minmax_get(&(bbr)->bbr_max_bandwidth)
+
+#endif
@@ -0,0 +1,184 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_bw_sampler.c -- Delivery rate (bandwidth) sampler
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/queue.h>
+#ifdef WIN32
+#include <vc_compat.h>
+#endif
+
+#include "lsquic_int_types.h"
+#include "lsquic_types.h"
+#include "lsquic_malo.h"
+#include "lsquic_packet_common.h"
+#include "lsquic_packet_out.h"
+#include "lsquic_minmax.h"
+#include "lsquic_bw_sampler.h"
+
+#define LSQUIC_LOGGER_MODULE LSQLM_BW_SAMPLER
+#define LSQUIC_LOG_CONN_ID sampler->bws_cid
+#include "lsquic_logger.h"
+
+#define BW_FILTER_LEN   10  /* Round trips */
+
+
+int
+lsquic_bw_sampler_init (struct bw_sampler *sampler, struct malo *malo,
+                                                            lsquic_cid_t cid)
+{
+    memset(sampler, 0, sizeof(*sampler));
+    sampler->bws_cid = cid;
+    minmax_init(&sampler->bws_max_bw, BW_FILTER_LEN);
+    sampler->bws_malo = malo;
+    if (!sampler->bws_malo)
+    {
+        LSQ_WARN("packet state allocator is not available");
+        return -1;
+    }
+    LSQ_DEBUG("initialized");
+    return 0;
+}
+
+
+void
+lsquic_bw_sampler_packet_sent (struct bw_sampler *sampler,
+                    struct lsquic_packet_out *packet_out, unsigned packet_sz,
+                    uint64_t in_flight)
+{
+    struct bwp_state *state;
+
+    assert(!packet_out->po_bwp_state);
+    sampler->bws_last_sent_packno = packet_out->po_packno;
+
+    if (!sampler->bws_malo)
+        return;
+
+    /* Delivery rate is not measured over periods of quiescence */
+    if (in_flight == 0)
+    {
+        sampler->bws_first_sent_time = packet_out->po_sent;
+        sampler->bws_delivered_time  = packet_out->po_sent;
+    }
+
+    state = lsquic_malo_get(sampler->bws_malo);
+    if (!state)
+    {
+        LSQ_WARN("cannot allocate state for packet %"PRIu64,
+                                                    packet_out->po_packno);
+        return;
+    }
+
+    state->bwps_delivered       = sampler->bws_delivered;
+    state->bwps_delivered_time  = sampler->bws_delivered_time;
+    state->bwps_first_sent_time = sampler->bws_first_sent_time;
+    state->bwps_packet_sz       = packet_sz;
+    state->bwps_is_app_limited  = !!(sampler->bws_flags & BWS_APP_LIMITED);
+    packet_out->po_bwp_state    = state;
+}
+
+
+int
+lsquic_bw_sampler_packet_acked (struct bw_sampler *sampler,
+                struct lsquic_packet_out *packet_out, lsquic_time_t ack_time,
+                struct bw_sample *sample)
+{
+    struct bwp_state *const state = packet_out->po_bwp_state;
+    lsquic_time_t send_elapsed, ack_elapsed, interval;
+    uint64_t delivered;
+
+    if (packet_out->po_packno > sampler->bws_round_end_packno)
+    {
+        ++sampler->bws_round_count;
+        sampler->bws_round_end_packno = sampler->bws_last_sent_packno;
+    }
+
+    if (!state)
+        return -1;
+
+    sampler->bws_delivered += state->bwps_packet_sz;
+    sampler->bws_delivered_time = ack_time;
+    sampler->bws_first_sent_time = packet_out->po_sent;
+    if ((sampler->bws_flags & BWS_APP_LIMITED)
+                && packet_out->po_packno > sampler->bws_end_of_app_limited)
+    {
+        sampler->bws_flags &= ~BWS_APP_LIMITED;
+        LSQ_DEBUG("exit app-limited phase due to packet %"PRIu64" being "
+            "acked", packet_out->po_packno);
+    }
+
+    /* The rate is limited by the slower of the send and the ack rates: the
+     * ack rate may be inflated by ACK compression and the send rate by
+     * bursts.
+     */
+    send_elapsed = packet_out->po_sent - state->bwps_first_sent_time;
+    ack_elapsed = ack_time - state->bwps_delivered_time;
+    interval = send_elapsed > ack_elapsed ? send_elapsed : ack_elapsed;
+    delivered = sampler->bws_delivered - state->bwps_delivered;
+
+    sample->prior_delivered = state->bwps_delivered;
+    sample->is_app_limited = state->bwps_is_app_limited;
+    packet_out->po_bwp_state = NULL;
+    lsquic_malo_put(state);
+
+    if (interval == 0)
+    {
+        LSQ_DEBUG("packet %"PRIu64": zero interval, no sample",
+                                                    packet_out->po_packno);
+        return -1;
+    }
+
+    sample->bandwidth = delivered * 1000000 / interval;
+    sample->rtt = ack_time - packet_out->po_sent;
+    sample->packno = packet_out->po_packno;
+
+    /* App-limited samples underestimate the bandwidth unless they exceed
+     * the current estimate.
+     */
+    sampler->bws_last_bw = sample->bandwidth;
+    if (!sample->is_app_limited
+            || sample->bandwidth > lsquic_bw_sampler_estimate(sampler))
+        minmax_upmax(&sampler->bws_max_bw, sampler->bws_round_count,
+                                                            sample->bandwidth);
+    LSQ_DEBUG("packet %"PRIu64": delivered %"PRIu64" bytes in %"PRIu64
+        " usec: bandwidth %"PRIu64" B/s; rtt: %"PRIu64"; app-limited: %d",
+        packet_out->po_packno, delivered, interval, sample->bandwidth,
+        sample->rtt, sample->is_app_limited);
+    return 0;
+}
+
+
+void
+lsquic_bw_sampler_packet_lost (struct bw_sampler *sampler,
+                                        struct lsquic_packet_out *packet_out)
+{
+    if (packet_out->po_bwp_state)
+    {
+        lsquic_malo_put(packet_out->po_bwp_state);
+        packet_out->po_bwp_state = NULL;
+    }
+}
+
+
+void
+lsquic_bw_sampler_app_limited (struct bw_sampler *sampler)
+{
+    sampler->bws_flags |= BWS_APP_LIMITED;
+    sampler->bws_end_of_app_limited = sampler->bws_last_sent_packno;
+    LSQ_DEBUG("app-limited until packet %"PRIu64" is acked",
+                                            sampler->bws_end_of_app_limited);
+}
+
+
+/* State of packets that are still outstanding is released when they are
+ * destroyed: see lsquic_packet_out_destroy().
+ */
+void
+lsquic_bw_sampler_cleanup (struct bw_sampler *sampler)
+{
+    sampler->bws_malo = NULL;
+}
@@ -0,0 +1,108 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_bw_sampler.h -- Delivery rate (bandwidth) sampler
+ *
+ * When a packet is sent, the sampler records how many bytes have been
+ * delivered so far and when.  When the packet is acknowledged, the
+ * difference between the two snapshots gives the delivery rate over the
+ * lifetime of the packet.  See draft-cheng-iccrg-delivery-rate-estimation.
+ *
+ * The sampler also keeps the maximum delivery rate seen over the last few
+ * round trips: this is the connection's bandwidth estimate.
+ *
+ * Requires lsquic_minmax.h.
+ */
+
+#ifndef LSQUIC_BW_SAMPLER_H
+#define LSQUIC_BW_SAMPLER_H 1
+
+struct lsquic_packet_out;
+struct malo;
+
+
+/* Bandwidth sample produced when a packet is acked */
+struct bw_sample
+{
+    uint64_t            bandwidth;      /* Bytes per second */
+    lsquic_time_t       rtt;
+    /* Number of bytes delivered when the acked packet was sent.  This is
+     * used to count round trips.
+     */
+    uint64_t            prior_delivered;
+    lsquic_packno_t     packno;
+    int                 is_app_limited;
+};
+
+
+/* Per-packet state allocated when packet is sent */
+struct bwp_state
+{
+    uint64_t            bwps_delivered;
+    lsquic_time_t       bwps_delivered_time;
+    lsquic_time_t       bwps_first_sent_time;
+    unsigned            bwps_packet_sz;
+    int                 bwps_is_app_limited;
+};
+
+
+struct bw_sampler
+{
+    struct malo        *bws_malo;       /* Shared by all connections */
+    lsquic_cid_t        bws_cid;        /* Used for logging */
+    uint64_t            bws_delivered;
+    lsquic_time_t       bws_delivered_time;
+    lsquic_time_t       bws_first_sent_time;
+    lsquic_packno_t     bws_last_sent_packno;
+    lsquic_packno_t     bws_end_of_app_limited;
+    /* Round trips are counted using packet numbers: a round trip ends when
+     * a packet sent after the round started is acked.
+     */
+    uint64_t            bws_round_count;
+    lsquic_packno_t     bws_round_end_packno;
+    uint64_t            bws_last_bw;        /* Latest sample */
+    struct minmax       bws_max_bw;         /* Time is round trip count */
+    enum {
+        BWS_APP_LIMITED = 1 << 0,
+    }                   bws_flags;
+};
+
+
+/* Per-packet state is allocated from `malo', which is shared by all
+ * connections of the engine: see lsquic_mm.
+ */
+int
+lsquic_bw_sampler_init (struct bw_sampler *, struct malo *, lsquic_cid_t);
+
+void
+lsquic_bw_sampler_packet_sent (struct bw_sampler *, struct lsquic_packet_out *,
+                                    unsigned packet_sz, uint64_t in_flight);
+
+/* Returns 0 and fills in `sample' if a sample was taken */
+int
+lsquic_bw_sampler_packet_acked (struct bw_sampler *, struct lsquic_packet_out *,
+                                lsquic_time_t ack_time, struct bw_sample *);
+
+void
+lsquic_bw_sampler_packet_lost (struct bw_sampler *, struct lsquic_packet_out *);
+
+/* Packets sent from now until a packet sent after this call is acked are
+ * marked as app-limited.
+ */
+void
+lsquic_bw_sampler_app_limited (struct bw_sampler *);
+
+void
+lsquic_bw_sampler_cleanup (struct bw_sampler *);
+
+#define lsquic_bw_sampler_total_acked(sampler_) (+(sampler_)->bws_delivered)
+
+#define lsquic_bw_sampler_is_app_limited(sampler_) \
+                            ((sampler_)->bws_flags & BWS_APP_LIMITED)
+
+/* Bandwidth estimate in bytes per second; zero if not known yet */
+#define lsquic_bw_sampler_estimate(sampler_) \
+                                        minmax_get(&(sampler_)->bws_max_bw)
+
+#define lsquic_bw_sampler_last_sample(sampler_) (+(sampler_)->bws_last_bw)
+
+#endif
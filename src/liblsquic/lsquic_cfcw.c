@@ -23,6 +23,11 @@
 #define LSQUIC_LOG_CONN_ID fc->cf_conn_pub->lconn->cn_cid
 #include "lsquic_logger.h"
 
+/* When over memory budget, the window does not shrink below this size, so
+ * that the connection can make progress.
+ */
+#define MIN_BUDGET_WINDOW 0x4000
+
 
 void
 lsquic_cfcw_init (struct lsquic_cfcw *fc, struct lsquic_conn_public *cpub,
@@ -61,12 +66,32 @@ cfcw_maybe_increase_max_window (struct lsquic_cfcw *fc)
 }
 
 
+unsigned
+lsquic_conn_budget_window (const struct lsquic_conn_public *cpub,
+                                                            unsigned window)
+{
+    unsigned avail;
+
+    if (cpub->mem_budget == 0)
+        return window;
+
+    if (cpub->mem_used + MIN_BUDGET_WINDOW < cpub->mem_budget)
+        avail = cpub->mem_budget - cpub->mem_used;
+    else
+        avail = MIN_BUDGET_WINDOW;
+
+    return avail < window ? avail : window;
+}
+
+
 int
 lsquic_cfcw_fc_offsets_changed (struct lsquic_cfcw *fc)
 {
     lsquic_time_t now, since_last_update, srtt;
+    unsigned window;
 
-    if (fc->cf_recv_off - fc->cf_read_off >= fc->cf_max_recv_win / 2)
+    window = lsquic_conn_budget_window(fc->cf_conn_pub, fc->cf_max_recv_win);
+    if (fc->cf_recv_off - fc->cf_read_off >= window / 2)
         return 0;
 
     now = lsquic_time_now();
@@ -75,9 +100,18 @@ lsquic_cfcw_fc_offsets_changed (struct lsquic_cfcw *fc)
 
     srtt = lsquic_rtt_stats_get_srtt(&fc->cf_conn_pub->rtt_stats);
     if (since_last_update < srtt * 2)
-        cfcw_maybe_increase_max_window(fc);
+    {
+        if (window < fc->cf_max_recv_win)
+            LSQ_DEBUG("over memory budget, do not increase max window");
+        else
+        {
+            cfcw_maybe_increase_max_window(fc);
+            window = lsquic_conn_budget_window(fc->cf_conn_pub,
+                                                        fc->cf_max_recv_win);
+        }
+    }
 
-    fc->cf_recv_off = fc->cf_read_off + fc->cf_max_recv_win;
+    fc->cf_recv_off = fc->cf_read_off + window;
     LSQ_DEBUG("recv_off changed: read_off: %"PRIu64"; recv_off: %"
         PRIu64"", fc->cf_read_off, fc->cf_recv_off);
     return 1;
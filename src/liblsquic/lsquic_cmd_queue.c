@@ -0,0 +1,77 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_cmd_queue.c -- Lock-free multiple-producer, single-consumer queue
+ *                       of commands posted to the engine.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/queue.h>
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+#include "lsquic.h"
+#include "lsquic_cmd_queue.h"
+
+
+#ifdef WIN32
+/* Interlocked functions are full barriers */
+#define load_head(cmdq) ((struct lsquic_cmd *) \
+        InterlockedCompareExchangePointer((PVOID volatile *) \
+                                    &(cmdq)->cq_head, NULL, NULL))
+#define cas_head(cmdq, expected, desired) \
+        (InterlockedCompareExchangePointer((PVOID volatile *) \
+            &(cmdq)->cq_head, (desired), *(expected)) == *(expected) \
+        || (*(expected) = load_head(cmdq), 0))
+#define take_head(cmdq) ((struct lsquic_cmd *) \
+        InterlockedExchangePointer((PVOID volatile *) &(cmdq)->cq_head, NULL))
+#else
+#define load_head(cmdq) __atomic_load_n(&(cmdq)->cq_head, __ATOMIC_RELAXED)
+/* Release: the command must be fully written before it is visible */
+#define cas_head(cmdq, expected, desired) \
+        __atomic_compare_exchange_n(&(cmdq)->cq_head, (expected), (desired), \
+                                    1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)
+/* Acquire: pairs with the release above */
+#define take_head(cmdq) \
+        __atomic_exchange_n(&(cmdq)->cq_head, NULL, __ATOMIC_ACQUIRE)
+#endif
+
+
+int
+lsquic_cmdq_push (struct cmd_queue *cmdq, struct lsquic_cmd *cmd)
+{
+    struct lsquic_cmd *head;
+
+    head = load_head(cmdq);
+    do
+        cmd->cmd_next = head;
+    while (!cas_head(cmdq, &head, cmd));
+
+    return head == NULL;
+}
+
+
+struct lsquic_cmd *
+lsquic_cmdq_pop_all (struct cmd_queue *cmdq)
+{
+    struct lsquic_cmd *cmd, *next, *prev;
+
+    /* The stack is in reverse order */
+    prev = NULL;
+    for (cmd = take_head(cmdq); cmd; cmd = next)
+    {
+        next = cmd->cmd_next;
+        cmd->cmd_next = prev;
+        prev = cmd;
+    }
+
+    return prev;
+}
+
+
+int
+lsquic_cmdq_empty (struct cmd_queue *cmdq)
+{
+    return load_head(cmdq) == NULL;
+}
@@ -0,0 +1,42 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_cmd_queue.h -- Lock-free multiple-producer, single-consumer queue
+ *                       of commands posted to the engine.
+ *
+ * Producers push commands onto a stack using compare-and-swap.  The
+ * consumer takes the whole stack at once using atomic exchange and
+ * reverses it, which restores the order in which the commands were pushed.
+ * As the consumer never removes individual elements, there is no ABA
+ * problem.
+ */
+
+#ifndef LSQUIC_CMD_QUEUE_H
+#define LSQUIC_CMD_QUEUE_H 1
+
+struct lsquic_cmd;
+
+struct cmd_queue
+{
+    struct lsquic_cmd  *cq_head;    /* Most recently pushed command */
+};
+
+#define lsquic_cmdq_init(cmdq) do { (cmdq)->cq_head = NULL; } while (0)
+
+/* May be called from any thread.  Returns true if the queue was empty. */
+int
+lsquic_cmdq_push (struct cmd_queue *, struct lsquic_cmd *);
+
+/* Remove all commands from the queue and return them in the order in which
+ * they were pushed, linked via `cmd_next'.  Only the consumer thread may
+ * call this function.
+ */
+struct lsquic_cmd *
+lsquic_cmdq_pop_all (struct cmd_queue *);
+
+/* Cheap check performed by the consumer before calling
+ * lsquic_cmdq_pop_all().
+ */
+int
+lsquic_cmdq_empty (struct cmd_queue *);
+
+#endif
@@ -0,0 +1,78 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_cong_ctl.h -- congestion controller interface
+ */
+
+#ifndef LSQUIC_CONG_CTL_H
+#define LSQUIC_CONG_CTL_H 1
+
+struct bw_sample;
+struct bw_sampler;
+struct lsquic_conn_public;
+struct lsquic_packet_out;
+
+
+/* The send controller feeds events into the congestion controller via this
+ * interface.  Packets acked by a single ACK frame are reported between calls
+ * to cci_begin_ack() and cci_end_ack().  Lost packets are reported one by
+ * one using cci_lost(); cci_loss() is called once per congestion event.
+ * The `in_flight' argument of cci_begin_ack() and cci_sent() is the number
+ * of bytes in flight before the ACK is processed or the packet is sent.
+ *
+ * The send controller owns the delivery-rate sampler and feeds it sent,
+ * acked, and lost packets.  The sampler is passed to cci_init(); the sample
+ * taken when a packet is acked, if any, is passed to cci_ack().
+ *
+ * All byte counts are in bytes and rates are in bytes per second.
+ */
+struct cong_ctl_if
+{
+    void
+    (*cci_init) (void *cong_ctl, const struct lsquic_conn_public *,
+                                                struct bw_sampler *);
+
+    void
+    (*cci_begin_ack) (void *cong_ctl, lsquic_time_t ack_time,
+                                                        uint64_t in_flight);
+
+    void
+    (*cci_ack) (void *cong_ctl, struct lsquic_packet_out *, unsigned packet_sz,
+                lsquic_time_t now, int app_limited, const struct bw_sample *);
+
+    void
+    (*cci_end_ack) (void *cong_ctl, uint64_t in_flight);
+
+    void
+    (*cci_sent) (void *cong_ctl, struct lsquic_packet_out *,
+                                        unsigned packet_sz, uint64_t in_flight);
+
+    void
+    (*cci_lost) (void *cong_ctl, struct lsquic_packet_out *,
+                                                        unsigned packet_sz);
+
+    void
+    (*cci_loss) (void *cong_ctl);
+
+    /* Called when all packets lost in the last loss event turn out to have
+     * been delivered: the reaction to the loss event should be undone.
+     */
+    void
+    (*cci_undo) (void *cong_ctl);
+
+    void
+    (*cci_timeout) (void *cong_ctl);
+
+    void
+    (*cci_was_quiet) (void *cong_ctl, lsquic_time_t now);
+
+    uint64_t
+    (*cci_get_cwnd) (void *cong_ctl);
+
+    uint64_t
+    (*cci_pacing_rate) (void *cong_ctl, int in_recovery);
+
+    void
+    (*cci_cleanup) (void *cong_ctl);
+};
+
+#endif
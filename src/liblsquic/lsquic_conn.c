@@ -72,6 +72,8 @@ lsquic_conn_copy_and_release_pi_data (const lsquic_conn_t *conn,
           struct lsquic_engine_public *enpub, lsquic_packet_in_t *packet_in)
 {
     assert(!(packet_in->pi_flags & PI_OWN_DATA));
+    if (packet_in->pi_flags & PI_APP_DATA)
+        return 0;   /* Library already owns the buffer */
     /* The size should be guarded in lsquic_engine_packet_in(): */
     assert(packet_in->pi_data_sz <= QUIC_MAX_PACKET_SZ);
     unsigned char *const copy = lsquic_mm_get_1370(&enpub->enp_mm);
@@ -87,6 +89,53 @@ lsquic_conn_copy_and_release_pi_data (const lsquic_conn_t *conn,
 }
 
 
+/* If the application handed packet buffer over to the library, there is
+ * no need to copy: the packet is decrypted in place.
+ */
+static int
+decrypt_packet_in_place (lsquic_conn_t *lconn, lsquic_packet_in_t *packet_in)
+{
+    size_t header_len, data_len;
+    enum enc_level enc_level;
+    size_t out_len = 0;
+    unsigned char tail[SRST_LENGTH];
+    int save_tail;
+
+    /* Failed decryption may overwrite the ciphertext.  The tail of the
+     * packet is preserved: it is checked for stateless reset token.
+     */
+    save_tail = packet_in->pi_data_sz > SRST_LENGTH;
+    if (save_tail)
+        memcpy(tail, packet_in->pi_data + packet_in->pi_data_sz - SRST_LENGTH,
+                                                                SRST_LENGTH);
+    header_len = packet_in->pi_header_sz;
+    data_len   = packet_in->pi_data_sz - packet_in->pi_header_sz;
+    enc_level = lconn->cn_esf->esf_decrypt(lconn->cn_enc_session,
+                        lconn->cn_version, 0,
+                        packet_in->pi_packno, packet_in->pi_data,
+                        &header_len, data_len,
+                        lsquic_packet_in_nonce(packet_in),
+                        packet_in->pi_data, packet_in->pi_data_sz, &out_len);
+    if ((enum enc_level) -1 == enc_level)
+    {
+        if (save_tail)
+            memcpy(packet_in->pi_data + packet_in->pi_data_sz - SRST_LENGTH,
+                                                        tail, SRST_LENGTH);
+        EV_LOG_CONN_EVENT(lconn->cn_cid, "could not decrypt packet %"PRIu64,
+                                                        packet_in->pi_packno);
+        return -1;
+    }
+
+    assert(header_len + out_len <= packet_in->pi_data_sz);
+    packet_in->pi_flags |= PI_DECRYPTED | (enc_level << PIBIT_ENC_LEV_SHIFT);
+    packet_in->pi_header_sz = header_len;
+    packet_in->pi_data_sz   = out_len + header_len;
+    EV_LOG_CONN_EVENT(lconn->cn_cid, "decrypted packet %"PRIu64" in place, "
+        "crypto: %s", packet_in->pi_packno, lsquic_enclev2str[ enc_level ]);
+    return 0;
+}
+
+
 int
 lsquic_conn_decrypt_packet (lsquic_conn_t *lconn,
                             struct lsquic_engine_public *enpub,
@@ -95,7 +144,12 @@ lsquic_conn_decrypt_packet (lsquic_conn_t *lconn,
     size_t header_len, data_len;
     enum enc_level enc_level;
     size_t out_len = 0;
-    unsigned char *copy = lsquic_mm_get_1370(&enpub->enp_mm);
+    unsigned char *copy;
+
+    if (packet_in->pi_flags & PI_APP_DATA)
+        return decrypt_packet_in_place(lconn, packet_in);
+
+    copy = lsquic_mm_get_1370(&enpub->enp_mm);
     if (!copy)
     {
         LSQ_WARN("cannot allocate memory to copy incoming packet data");
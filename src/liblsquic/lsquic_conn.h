@@ -106,8 +106,7 @@ struct lsquic_conn
     lsquic_cid_t                 cn_cid;
     STAILQ_ENTRY(lsquic_conn)    cn_next_closed_conn;
     TAILQ_ENTRY(lsquic_conn)     cn_next_ticked;
-    TAILQ_ENTRY(lsquic_conn)     cn_next_out,
-                                 cn_next_hash;
+    TAILQ_ENTRY(lsquic_conn)     cn_next_out;
     const struct conn_iface     *cn_if;
     const struct parse_funcs    *cn_pf;
     struct attq_elem            *cn_attq_elem;
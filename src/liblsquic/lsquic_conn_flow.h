@@ -63,4 +63,10 @@ lsquic_cfcw_incr_max_recv_off (lsquic_cfcw_t *, uint64_t);
 void
 lsquic_cfcw_incr_read_off (lsquic_cfcw_t *, uint64_t);
 
+/* Returns receive window no larger than `window' that keeps connection's
+ * memory use within its budget.
+ */
+unsigned
+lsquic_conn_budget_window (const struct lsquic_conn_public *, unsigned window);
+
 #endif
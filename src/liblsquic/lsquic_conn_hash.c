@@ -14,9 +14,9 @@
 #include "lsquic_logger.h"
 
 
-#define n_buckets(nbits) (1U << (nbits))
-#define conn_hash_mask(conn_hash) ((1 << (conn_hash)->ch_nbits) - 1)
-#define conn_hash_bucket_no(conn_hash, hash) (hash & conn_hash_mask(conn_hash))
+#define n_slots(nbits) (1U << (nbits))
+#define slot_mask(nbits) (n_slots(nbits) - 1)
+#define conn_hash_mask(conn_hash) slot_mask((conn_hash)->ch_nbits)
 
 #if FULL_LOCAL_ADDR_SUPPORTED
 #define HASHBUF_SZ (2 + sizeof(((struct sockaddr_in6 *) 0)->sin6_addr))
@@ -71,22 +71,66 @@ conn2hash_by_addr (const struct lsquic_conn *lconn, unsigned char *buf,
 }
 
 
+/* Fibonacci hashing: the multiplication mixes all bits of the key into
+ * the high bits of the product.
+ */
+static unsigned
+conn_hash_home (const struct conn_hash *conn_hash, uint64_t key,
+                                                            unsigned nbits)
+{
+    return ((key ^ conn_hash->ch_seed) * 0x9E3779B97F4A7C15ULL)
+                                                            >> (64 - nbits);
+}
+
+
+static uint64_t
+conn_hash_key (const struct conn_hash *conn_hash,
+                                            const struct lsquic_conn *lconn)
+{
+    if (conn_hash->ch_flags & CHF_USE_ADDR)
+        return lconn->cn_hash;
+    else
+        return lconn->cn_cid;
+}
+
+
+/* Distance of slot `idx' from the home slot of its key */
+static unsigned
+conn_hash_dist (const struct conn_hash *conn_hash,
+        const struct conn_hash_slot *slots, unsigned nbits, unsigned idx)
+{
+    return (idx - conn_hash_home(conn_hash, slots[idx].chs_key, nbits))
+                                                        & slot_mask(nbits);
+}
+
+
 int
 conn_hash_init (struct conn_hash *conn_hash, enum conn_hash_flags flags)
 {
-    unsigned n;
-
     memset(conn_hash, 0, sizeof(*conn_hash));
-    conn_hash->ch_nbits = 1;  /* Start small */
-    conn_hash->ch_buckets = malloc(sizeof(conn_hash->ch_buckets[0]) *
-                                                n_buckets(conn_hash->ch_nbits));
-    if (!conn_hash->ch_buckets)
+    conn_hash->ch_nbits = 4;  /* Start small */
+    conn_hash->ch_slots = calloc(n_slots(conn_hash->ch_nbits),
+                                            sizeof(conn_hash->ch_slots[0]));
+    if (!conn_hash->ch_slots)
         return -1;
-    for (n = 0; n < n_buckets(conn_hash->ch_nbits); ++n)
-        TAILQ_INIT(&conn_hash->ch_buckets[n]);
+    conn_hash->ch_seed = (uintptr_t) conn_hash;
     conn_hash->ch_flags = flags;
     if (flags & CHF_USE_ADDR)
+    {
         conn_hash->ch_conn2hash = conn2hash_by_addr;
+        conn_hash->ch_cid_index = malloc(sizeof(*conn_hash->ch_cid_index));
+        if (!conn_hash->ch_cid_index)
+        {
+            free(conn_hash->ch_slots);
+            return -1;
+        }
+        if (0 != conn_hash_init(conn_hash->ch_cid_index, 0))
+        {
+            free(conn_hash->ch_cid_index);
+            free(conn_hash->ch_slots);
+            return -1;
+        }
+    }
     else
         conn_hash->ch_conn2hash = conn2hash_by_cid;
     LSQ_INFO("initialized");
@@ -97,82 +141,269 @@ conn_hash_init (struct conn_hash *conn_hash, enum conn_hash_flags flags)
 void
 conn_hash_cleanup (struct conn_hash *conn_hash)
 {
-    free(conn_hash->ch_buckets);
+    if (conn_hash->ch_cid_index)
+    {
+        conn_hash_cleanup(conn_hash->ch_cid_index);
+        free(conn_hash->ch_cid_index);
+    }
+    free(conn_hash->ch_old_slots);
+    free(conn_hash->ch_slots);
+}
+
+
+/* Robin Hood invariant lets unsuccessful lookup stop as soon as it reaches
+ * a slot closer to its home than we are to ours.
+ */
+static inline struct lsquic_conn *
+find_by_cid (const struct conn_hash *conn_hash,
+        const struct conn_hash_slot *slots, unsigned nbits, lsquic_cid_t cid)
+{
+    const struct conn_hash_slot *slot;
+    unsigned idx, dist;
+
+    idx = conn_hash_home(conn_hash, cid, nbits);
+    for (dist = 0; ; ++dist)
+    {
+        slot = &slots[idx];
+        if (!slot->chs_conn)
+            return NULL;
+        if (slot->chs_key == cid)
+            return slot->chs_conn;
+        if (conn_hash_dist(conn_hash, slots, nbits, idx) < dist)
+            return NULL;
+        idx = (idx + 1) & slot_mask(nbits);
+    }
 }
 
 
+static struct lsquic_conn *
+find_by_addr (const struct conn_hash *conn_hash,
+        const struct conn_hash_slot *slots, unsigned nbits, unsigned hash,
+        const unsigned char *addr_buf, size_t addr_sz)
+{
+    unsigned char hash_buf[HASHBUF_SZ];
+    const struct conn_hash_slot *slot;
+    struct lsquic_conn *lconn;
+    unsigned idx, dist;
+    size_t hash_sz;
+
+    idx = conn_hash_home(conn_hash, hash, nbits);
+    for (dist = 0; ; ++dist)
+    {
+        slot = &slots[idx];
+        if (!slot->chs_conn)
+            return NULL;
+        if (slot->chs_key == hash)
+        {
+            lconn = slot->chs_conn;
+            sockaddr2hash((struct sockaddr *) lconn->cn_local_addr, hash_buf,
+                          &hash_sz);
+            if (addr_sz == hash_sz && 0 == memcmp(addr_buf, hash_buf, addr_sz))
+                return lconn;
+        }
+        else if (conn_hash_dist(conn_hash, slots, nbits, idx) < dist)
+            return NULL;
+        idx = (idx + 1) & slot_mask(nbits);
+    }
+}
+
+
+static void
+insert_slot (struct conn_hash *conn_hash, struct conn_hash_slot new_slot)
+{
+    struct conn_hash_slot *const slots = conn_hash->ch_slots;
+    const unsigned nbits = conn_hash->ch_nbits;
+    struct conn_hash_slot *slot, tmp;
+    unsigned idx, dist, slot_dist;
+
+    idx = conn_hash_home(conn_hash, new_slot.chs_key, nbits);
+    for (dist = 0; ; ++dist)
+    {
+        slot = &slots[idx];
+        if (!slot->chs_conn)
+        {
+            *slot = new_slot;
+            return;
+        }
+        slot_dist = conn_hash_dist(conn_hash, slots, nbits, idx);
+        if (slot_dist < dist)
+        {
+            tmp = *slot;
+            *slot = new_slot;
+            new_slot = tmp;
+            dist = slot_dist;
+        }
+        idx = (idx + 1) & slot_mask(nbits);
+    }
+}
+
+
+/* Backward shift deletion: entries following the removed one are moved
+ * back until an empty slot or an entry in its home slot is reached.  This
+ * way, no tombstones are necessary.
+ */
+static void
+delete_slot (const struct conn_hash *conn_hash, struct conn_hash_slot *slots,
+                                                unsigned nbits, unsigned idx)
+{
+    unsigned next;
+
+    while (next = (idx + 1) & slot_mask(nbits),
+            slots[next].chs_conn
+                    && conn_hash_dist(conn_hash, slots, nbits, next) > 0)
+    {
+        slots[idx] = slots[next];
+        idx = next;
+    }
+    slots[idx].chs_conn = NULL;
+}
+
+
+/* Return 0 if connection was found and removed, -1 otherwise */
+static int
+remove_conn (const struct conn_hash *conn_hash, struct conn_hash_slot *slots,
+                        unsigned nbits, const struct lsquic_conn *lconn)
+{
+    unsigned idx, dist;
+
+    idx = conn_hash_home(conn_hash, conn_hash_key(conn_hash, lconn), nbits);
+    for (dist = 0; ; ++dist)
+    {
+        if (!slots[idx].chs_conn)
+            return -1;
+        if (slots[idx].chs_conn == lconn)
+        {
+            delete_slot(conn_hash, slots, nbits, idx);
+            return 0;
+        }
+        if (conn_hash_dist(conn_hash, slots, nbits, idx) < dist)
+            return -1;
+        idx = (idx + 1) & slot_mask(nbits);
+    }
+}
+
+
+/* Move entries from the old table to the new one, `n_steps' old slots at
+ * a time.  When an entry is moved out of the old table, the entries after
+ * it shift back into its slot, so a slot is only done once it is empty.
+ * Since the slots before the migration index are empty, entries left in
+ * the old table remain reachable from their home slots.
+ */
+static void
+migrate_slots (struct conn_hash *conn_hash, unsigned n_steps)
+{
+    struct conn_hash_slot *const old_slots = conn_hash->ch_old_slots;
+    const unsigned old_nbits = conn_hash->ch_old_nbits;
+    unsigned idx;
+
+    idx = conn_hash->ch_migrate_idx;
+    for ( ; n_steps > 0 && idx < n_slots(old_nbits); --n_steps, ++idx)
+        while (old_slots[idx].chs_conn)
+        {
+            insert_slot(conn_hash, old_slots[idx]);
+            delete_slot(conn_hash, old_slots, old_nbits, idx);
+        }
+
+    if (idx < n_slots(old_nbits))
+        conn_hash->ch_migrate_idx = idx;
+    else
+    {
+        LSQ_DEBUG("migration to %u slots complete",
+                                                n_slots(conn_hash->ch_nbits));
+        free(old_slots);
+        conn_hash->ch_old_slots = NULL;
+        conn_hash->ch_migrate_idx = 0;
+    }
+}
+
+
+#define maybe_migrate_slots(conn_hash, n_steps) do {                    \
+    if ((conn_hash)->ch_old_slots)                                      \
+        migrate_slots(conn_hash, n_steps);                              \
+} while (0)
+
+
 struct lsquic_conn *
 conn_hash_find_by_cid (struct conn_hash *conn_hash, lsquic_cid_t cid)
 {
-    const unsigned hash = XXH32(&cid, sizeof(cid), (uintptr_t) conn_hash);
-    const unsigned buckno = conn_hash_bucket_no(conn_hash, hash);
     struct lsquic_conn *lconn;
-    TAILQ_FOREACH(lconn, &conn_hash->ch_buckets[buckno], cn_next_hash)
-        if (lconn->cn_cid == cid)
-            return lconn;
-    return NULL;
+
+    maybe_migrate_slots(conn_hash, 1);
+    lconn = find_by_cid(conn_hash, conn_hash->ch_slots, conn_hash->ch_nbits,
+                                                                        cid);
+    if (lconn || !conn_hash->ch_old_slots)
+        return lconn;
+    else
+        return find_by_cid(conn_hash, conn_hash->ch_old_slots,
+                                            conn_hash->ch_old_nbits, cid);
 }
 
 
 struct lsquic_conn *
 conn_hash_find_by_addr (struct conn_hash *conn_hash, const struct sockaddr *sa)
 {
-    unsigned char hash_buf[HASHBUF_SZ][2];
+    unsigned char addr_buf[HASHBUF_SZ];
+    struct lsquic_conn *lconn;
+    unsigned hash;
+    size_t addr_sz;
+
+    maybe_migrate_slots(conn_hash, 1);
+    sockaddr2hash(sa, addr_buf, &addr_sz);
+    hash = XXH32(addr_buf, addr_sz, (uintptr_t) conn_hash);
+    lconn = find_by_addr(conn_hash, conn_hash->ch_slots, conn_hash->ch_nbits,
+                                                    hash, addr_buf, addr_sz);
+    if (lconn || !conn_hash->ch_old_slots)
+        return lconn;
+    else
+        return find_by_addr(conn_hash, conn_hash->ch_old_slots,
+                        conn_hash->ch_old_nbits, hash, addr_buf, addr_sz);
+}
+
+
+struct lsquic_conn *
+conn_hash_lookup_cid (const struct conn_hash *conn_hash, lsquic_cid_t cid)
+{
     struct lsquic_conn *lconn;
-    unsigned hash, buckno;
-    size_t hash_sz[2];
-
-    sockaddr2hash(sa, hash_buf[0], &hash_sz[0]);
-    hash = XXH32(hash_buf, hash_sz[0], (uintptr_t) conn_hash);
-    buckno = conn_hash_bucket_no(conn_hash, hash);
-    TAILQ_FOREACH(lconn, &conn_hash->ch_buckets[buckno], cn_next_hash)
-        if (lconn->cn_hash == hash)
-        {
-            sockaddr2hash((struct sockaddr *) lconn->cn_local_addr, hash_buf[1],
-                          &hash_sz[1]);
-            if (hash_sz[0] == hash_sz[1]
-                        && 0 == memcmp(hash_buf[0], hash_buf[1], hash_sz[0]))
-                return lconn;
-        }
 
-    return NULL;
+    if (conn_hash->ch_cid_index)
+        return conn_hash_lookup_cid(conn_hash->ch_cid_index, cid);
+
+    lconn = find_by_cid(conn_hash, conn_hash->ch_slots, conn_hash->ch_nbits,
+                                                                        cid);
+    if (lconn || !conn_hash->ch_old_slots)
+        return lconn;
+    return find_by_cid(conn_hash, conn_hash->ch_old_slots,
+                                            conn_hash->ch_old_nbits, cid);
 }
 
 
+/* The new table is allocated right away, but entries are moved to it
+ * gradually: see migrate_slots().
+ */
 static int
-double_conn_hash_buckets (struct conn_hash *conn_hash)
+double_conn_hash_slots (struct conn_hash *conn_hash)
 {
-    struct lsquic_conn_head *new_buckets, *new[2];
-    struct lsquic_conn *lconn;
-    unsigned n, old_nbits;
-    int idx;
-
-    old_nbits = conn_hash->ch_nbits;
-    LSQ_INFO("doubling number of buckets to %u", n_buckets(old_nbits + 1));
-    new_buckets = malloc(sizeof(conn_hash->ch_buckets[0])
-                                                * n_buckets(old_nbits + 1));
-    if (!new_buckets)
+    struct conn_hash_slot *new_slots;
+    unsigned new_nbits;
+
+    /* Should not happen given the migration rate, but be safe: */
+    while (conn_hash->ch_old_slots)
+        migrate_slots(conn_hash, n_slots(conn_hash->ch_old_nbits));
+
+    new_nbits = conn_hash->ch_nbits + 1;
+    LSQ_INFO("doubling number of slots to %u", n_slots(new_nbits));
+    new_slots = calloc(n_slots(new_nbits), sizeof(new_slots[0]));
+    if (!new_slots)
     {
         LSQ_WARN("malloc failed: potential trouble ahead");
         return -1;
     }
 
-    for (n = 0; n < n_buckets(old_nbits); ++n)
-    {
-        new[0] = &new_buckets[n];
-        new[1] = &new_buckets[n + n_buckets(old_nbits)];
-        TAILQ_INIT(new[0]);
-        TAILQ_INIT(new[1]);
-        while ((lconn = TAILQ_FIRST(&conn_hash->ch_buckets[n])))
-        {
-            TAILQ_REMOVE(&conn_hash->ch_buckets[n], lconn, cn_next_hash);
-            idx = (lconn->cn_hash >> old_nbits) & 1;
-            TAILQ_INSERT_TAIL(new[idx], lconn, cn_next_hash);
-        }
-    }
-    free(conn_hash->ch_buckets);
-    conn_hash->ch_nbits   = old_nbits + 1;
-    conn_hash->ch_buckets = new_buckets;
+    conn_hash->ch_old_slots   = conn_hash->ch_slots;
+    conn_hash->ch_old_nbits   = conn_hash->ch_nbits;
+    conn_hash->ch_migrate_idx = 0;
+    conn_hash->ch_slots       = new_slots;
+    conn_hash->ch_nbits       = new_nbits;
     return 0;
 }
 
@@ -183,21 +414,33 @@ conn_hash_add (struct conn_hash *conn_hash, struct lsquic_conn *lconn)
     unsigned char hash_buf[HASHBUF_SZ];
     const unsigned char *key;
     size_t key_sz;
-    unsigned hash, buckno;
+    unsigned hash;
+
+    if (conn_hash->ch_cid_index
+                && 0 != conn_hash_add(conn_hash->ch_cid_index, lconn))
+        return -1;
 
     key = conn_hash->ch_conn2hash(lconn, hash_buf, &key_sz);
     hash = XXH32(key, key_sz, (uintptr_t) conn_hash);
-    if (conn_hash->ch_count >=
-                n_buckets(conn_hash->ch_nbits) * CONN_HASH_MAX_PER_BUCKET &&
-        conn_hash->ch_nbits < sizeof(hash) * 8 - 1                        &&
-        0 != double_conn_hash_buckets(conn_hash))
+    if (conn_hash->ch_count + 1 >
+                    n_slots(conn_hash->ch_nbits) / 8 * CONN_HASH_MAX_LOAD)
     {
+        if (conn_hash->ch_nbits >= sizeof(hash) * 8 - 1
+                                || 0 != double_conn_hash_slots(conn_hash))
+        {
+            if (conn_hash->ch_cid_index)
+                conn_hash_remove(conn_hash->ch_cid_index, lconn);
             return -1;
+        }
     }
-    buckno = conn_hash_bucket_no(conn_hash, hash);
-    lconn->cn_hash = hash;
-    TAILQ_INSERT_TAIL(&conn_hash->ch_buckets[buckno], lconn, cn_next_hash);
+    if (conn_hash->ch_flags & CHF_USE_ADDR)
+        lconn->cn_hash = hash;
+    insert_slot(conn_hash, (struct conn_hash_slot) {
+        .chs_key    = conn_hash_key(conn_hash, lconn),
+        .chs_conn   = lconn,
+    });
     ++conn_hash->ch_count;
+    maybe_migrate_slots(conn_hash, CONN_HASH_MIGRATE_STEP);
     return 0;
 }
 
@@ -205,17 +448,43 @@ conn_hash_add (struct conn_hash *conn_hash, struct lsquic_conn *lconn)
 void
 conn_hash_remove (struct conn_hash *conn_hash, struct lsquic_conn *lconn)
 {
-    const unsigned buckno = conn_hash_bucket_no(conn_hash, lconn->cn_hash);
-    TAILQ_REMOVE(&conn_hash->ch_buckets[buckno], lconn, cn_next_hash);
+    int s;
+
+    s = remove_conn(conn_hash, conn_hash->ch_slots, conn_hash->ch_nbits,
+                                                                    lconn);
+    if (s != 0)
+    {
+        assert(conn_hash->ch_old_slots);
+        s = remove_conn(conn_hash, conn_hash->ch_old_slots,
+                                            conn_hash->ch_old_nbits, lconn);
+        assert(s == 0);
+    }
     --conn_hash->ch_count;
+    if (conn_hash->ch_cid_index)
+        conn_hash_remove(conn_hash->ch_cid_index, lconn);
 }
 
 
+/* The iterator starts right after an empty slot and goes around the table
+ * once.  Entries never move past an empty slot, so when the current entry
+ * is removed and the following entries shift back, they are not skipped
+ * or visited twice.  Migration, if in progress, is completed first, as
+ * the iterator only knows about one table.
+ */
 void
 conn_hash_reset_iter (struct conn_hash *conn_hash)
 {
-    conn_hash->ch_iter.cur_buckno = 0;
-    conn_hash->ch_iter.next_conn  = TAILQ_FIRST(&conn_hash->ch_buckets[0]);
+    unsigned idx;
+
+    if (conn_hash->ch_old_slots)
+        migrate_slots(conn_hash, n_slots(conn_hash->ch_old_nbits));
+
+    for (idx = 0; conn_hash->ch_slots[idx].chs_conn; ++idx)
+        ;
+    conn_hash->ch_iter.start     = idx;
+    conn_hash->ch_iter.cur_slot  = idx;
+    conn_hash->ch_iter.n_left    = n_slots(conn_hash->ch_nbits);
+    conn_hash->ch_iter.last_conn = NULL;
 }
 
 
@@ -230,16 +499,26 @@ conn_hash_first (struct conn_hash *conn_hash)
 struct lsquic_conn *
 conn_hash_next (struct conn_hash *conn_hash)
 {
-    struct lsquic_conn *lconn = conn_hash->ch_iter.next_conn;
-    while (!lconn)
-    {
-        ++conn_hash->ch_iter.cur_buckno;
-        if (conn_hash->ch_iter.cur_buckno >= n_buckets(conn_hash->ch_nbits))
-            return NULL;
-        lconn = TAILQ_FIRST(&conn_hash->ch_buckets[
-                                            conn_hash->ch_iter.cur_buckno]);
-    }
-    if (lconn)
-        conn_hash->ch_iter.next_conn = TAILQ_NEXT(lconn, cn_next_hash);
+    struct lsquic_conn *lconn;
+    unsigned idx;
+
+    idx = conn_hash->ch_iter.cur_slot;
+    lconn = conn_hash->ch_slots[idx].chs_conn;
+    /* Advance unless previously returned connection has been removed and
+     * the next entry has shifted into its place.
+     */
+    if (!(lconn && lconn != conn_hash->ch_iter.last_conn))
+        do
+        {
+            if (conn_hash->ch_iter.n_left == 0)
+                return NULL;
+            --conn_hash->ch_iter.n_left;
+            idx = (idx + 1) & conn_hash_mask(conn_hash);
+            lconn = conn_hash->ch_slots[idx].chs_conn;
+        }
+        while (!lconn);
+
+    conn_hash->ch_iter.cur_slot  = idx;
+    conn_hash->ch_iter.last_conn = lconn;
     return lconn;
 }
@@ -6,19 +6,32 @@
 #ifndef LSQUIC_MC_SET_H
 #define LSQUIC_MC_SET_H
 
-#include <sys/queue.h>
+/* The hash is an open-addressing table with linear probing and Robin Hood
+ * insertion.  Once the table is this full (in eighths), the number of
+ * slots is doubled.
+ */
+#define CONN_HASH_MAX_LOAD 6
 
-/* Once we reach this many per bucket on average, double the number of
- * buckets and redistribute entries.
- *
- * This value should be a power of two for speed.
+/* When the table grows, entries are migrated from the old table to the
+ * new one incrementally: this many old slots on each addition, and one
+ * slot on each lookup.  Both tables are searched until migration is done.
+ * Each addition must migrate at least two slots for the migration to
+ * complete before the new table fills up.
  */
-#define CONN_HASH_MAX_PER_BUCKET 2
+#define CONN_HASH_MIGRATE_STEP 4
 
 struct lsquic_conn;
 struct sockaddr;
 
-TAILQ_HEAD(lsquic_conn_head, lsquic_conn);
+/* The key is stored inline, so that lookup by CID does not need to touch
+ * the connection object.  When hashing by address, the key is the hash of
+ * the address and the address itself is compared in the connection.
+ */
+struct conn_hash_slot
+{
+    uint64_t                 chs_key;
+    struct lsquic_conn      *chs_conn;  /* NULL if slot is empty */
+};
 
 enum conn_hash_flags
 {
@@ -28,11 +41,19 @@ enum conn_hash_flags
 
 struct conn_hash
 {
-    struct lsquic_conn_head *ch_buckets;
+    struct conn_hash_slot   *ch_slots;
     struct {
-        unsigned             cur_buckno;
-        struct lsquic_conn  *next_conn;
+        unsigned             start;     /* Index of an empty slot */
+        unsigned             n_left;
+        unsigned             cur_slot;
+        struct lsquic_conn  *last_conn;
     }                        ch_iter;
+    struct conn_hash_slot   *ch_old_slots;  /* Non-NULL while migrating */
+    unsigned                 ch_old_nbits;
+    unsigned                 ch_migrate_idx;
+    /* When hashing by address, connections are also indexed by CID: */
+    struct conn_hash        *ch_cid_index;
+    uint64_t                 ch_seed;
     unsigned                 ch_count;
     unsigned                 ch_nbits;
     enum conn_hash_flags     ch_flags;
@@ -55,6 +76,13 @@ conn_hash_find_by_cid (struct conn_hash *, lsquic_cid_t);
 struct lsquic_conn *
 conn_hash_find_by_addr (struct conn_hash *, const struct sockaddr *);
 
+/* Find connection by CID no matter how the hash is keyed.  If it is keyed
+ * by address, the secondary CID index is used.  Neither the iterator nor
+ * migration state is affected.
+ */
+struct lsquic_conn *
+conn_hash_lookup_cid (const struct conn_hash *, lsquic_cid_t);
+
 /* Returns -1 if limit has been reached or if malloc fails */
 int
 conn_hash_add (struct conn_hash *, struct lsquic_conn *);
@@ -62,7 +90,10 @@ conn_hash_add (struct conn_hash *, struct lsquic_conn *);
 void
 conn_hash_remove (struct conn_hash *, struct lsquic_conn *);
 
-/* Two ways to use the iterator:
+/* The connection returned by the iterator may be removed from the hash
+ * while iterating.  Adding connections while iterating is not allowed.
+ *
+ * Two ways to use the iterator:
  *  1.
  *      for (conn = conn_hash_first(hash); conn;
  *                      conn = conn_hash_next(hash))
@@ -38,6 +38,17 @@ struct lsquic_conn_public {
 #if LSQUIC_CONN_STATS
     struct conn_stats              *conn_stats;
 #endif
+    /* Memory budget (see es_conn_mem_budget); zero means no budget. */
+    unsigned                        mem_budget;
+    /* Memory used by buffered outgoing packets and by header blocks that
+     * are being read.  Incoming stream data is not counted here: it is
+     * limited by flow control windows, which are sized to fit into what
+     * is left of the budget.
+     */
+    unsigned                        mem_used;
 };
 
+#define lsquic_conn_pub_over_budget(pub) ((pub)->mem_budget &&             \
+                                    (pub)->mem_used >= (pub)->mem_budget)
+
 #endif
@@ -12,8 +12,18 @@
 #include <vc_compat.h>
 #endif
 
+#include "lsquic.h"
 #include "lsquic_int_types.h"
 #include "lsquic_types.h"
+#include "lsquic_packet_common.h"
+#include "lsquic_packet_out.h"
+#include "lsquic_rtt.h"
+#include "lsquic_conn_flow.h"
+#include "lsquic_sfcw.h"
+#include "lsquic_stream.h"
+#include "lsquic_conn_public.h"
+#include "lsquic_conn.h"
+#include "lsquic_cong_ctl.h"
 #include "lsquic_cubic.h"
 #include "lsquic_util.h"
 
@@ -101,6 +111,7 @@ lsquic_cubic_init_ext (struct lsquic_cubic *cubic, lsquic_cid_t cid,
     cubic_reset(cubic);
     cubic->cu_ssthresh = 10000 * TCP_MSS; /* Emulate "unbounded" slow start */
     cubic->cu_cid   = cid;
+    cubic->cu_rtt_stats = NULL;
     cubic->cu_flags = flags;
 #ifndef NDEBUG
     const char *s;
@@ -166,6 +177,9 @@ void
 lsquic_cubic_loss (struct lsquic_cubic *cubic)
 {
     LSQ_DEBUG("%s(cubic)", __func__);
+    cubic->cu_prior_cwnd          = cubic->cu_cwnd;
+    cubic->cu_prior_ssthresh      = cubic->cu_ssthresh;
+    cubic->cu_prior_last_max_cwnd = cubic->cu_last_max_cwnd;
     cubic->cu_epoch_start = 0;
     if (FAST_CONVERGENCE && cubic->cu_cwnd < cubic->cu_last_max_cwnd)
         cubic->cu_last_max_cwnd = cubic->cu_cwnd * TWO_MINUS_BETA_OVER_TWO / 1024;
@@ -194,3 +208,163 @@ lsquic_cubic_timeout (struct lsquic_cubic *cubic)
     LSQ_INFO("timeout, cwnd: %lu", cubic->cu_cwnd);
     LOG_CWND(cubic);
 }
+
+
+void
+lsquic_cubic_undo (struct lsquic_cubic *cubic)
+{
+    LSQ_DEBUG("%s(cubic)", __func__);
+    if (0 == cubic->cu_prior_cwnd)
+        return;
+
+    /* The window may have grown since the loss event */
+    if (cubic->cu_cwnd < cubic->cu_prior_cwnd)
+        cubic->cu_cwnd = cubic->cu_prior_cwnd;
+    if (cubic->cu_ssthresh < cubic->cu_prior_ssthresh)
+        cubic->cu_ssthresh = cubic->cu_prior_ssthresh;
+    cubic->cu_last_max_cwnd = cubic->cu_prior_last_max_cwnd;
+    cubic->cu_tcp_cwnd = cubic->cu_cwnd;
+    cubic->cu_epoch_start = 0;
+    cubic->cu_prior_cwnd = 0;
+    LSQ_INFO("loss undone, last_max_cwnd: %lu, cwnd: %lu",
+        cubic->cu_last_max_cwnd, cubic->cu_cwnd);
+    LOG_CWND(cubic);
+}
+
+
+static void
+cubic_cci_init (void *cong_ctl, const struct lsquic_conn_public *conn_pub,
+                                        struct bw_sampler *sampler)
+{
+    struct lsquic_cubic *const cubic = cong_ctl;
+
+    lsquic_cubic_init(cubic, conn_pub->lconn->cn_cid);
+    cubic->cu_rtt_stats = &conn_pub->rtt_stats;
+}
+
+
+static void
+cubic_cci_begin_ack (void *cong_ctl, lsquic_time_t ack_time,
+                                                        uint64_t in_flight)
+{
+}
+
+
+static void
+cubic_cci_ack (void *cong_ctl, struct lsquic_packet_out *packet_out,
+               unsigned packet_sz, lsquic_time_t now, int app_limited,
+               const struct bw_sample *sample)
+{
+    lsquic_cubic_ack(cong_ctl, now, now - packet_out->po_sent, app_limited,
+                                                                packet_sz);
+}
+
+
+static void
+cubic_cci_end_ack (void *cong_ctl, uint64_t in_flight)
+{
+}
+
+
+static void
+cubic_cci_sent (void *cong_ctl, struct lsquic_packet_out *packet_out,
+                                    unsigned packet_sz, uint64_t in_flight)
+{
+}
+
+
+static void
+cubic_cci_lost (void *cong_ctl, struct lsquic_packet_out *packet_out,
+                                                        unsigned packet_sz)
+{
+}
+
+
+static void
+cubic_cci_loss (void *cong_ctl)
+{
+    lsquic_cubic_loss(cong_ctl);
+}
+
+
+static void
+cubic_cci_undo (void *cong_ctl)
+{
+    lsquic_cubic_undo(cong_ctl);
+}
+
+
+static void
+cubic_cci_timeout (void *cong_ctl)
+{
+    lsquic_cubic_timeout(cong_ctl);
+}
+
+
+static void
+cubic_cci_was_quiet (void *cong_ctl, lsquic_time_t now)
+{
+    lsquic_cubic_was_quiet(cong_ctl, now);
+}
+
+
+static uint64_t
+cubic_cci_get_cwnd (void *cong_ctl)
+{
+    struct lsquic_cubic *const cubic = cong_ctl;
+
+    return lsquic_cubic_get_cwnd(cubic);
+}
+
+
+/* Pacing rate is derived from the congestion window: pace faster in
+ * slow start so that the window can grow.
+ */
+static uint64_t
+cubic_cci_pacing_rate (void *cong_ctl, int in_recovery)
+{
+    struct lsquic_cubic *const cubic = cong_ctl;
+    uint64_t bandwidth, pacing_rate;
+    lsquic_time_t srtt;
+
+    srtt = lsquic_rtt_stats_get_srtt(cubic->cu_rtt_stats);
+    if (srtt == 0)
+        srtt = 50000;
+    bandwidth = (uint64_t) cubic->cu_cwnd * 1000000 / srtt;
+    if (lsquic_cubic_in_slow_start(cubic))
+        pacing_rate = bandwidth * 2;
+    else if (in_recovery)
+        pacing_rate = bandwidth;
+    else
+        pacing_rate = bandwidth + bandwidth / 4;
+
+    LSQ_DEBUG("srtt: %"PRIu64"; ss: %d; rec: %d; cwnd: %lu; bandwidth: "
+        "%"PRIu64"; pacing rate: %"PRIu64, srtt,
+        lsquic_cubic_in_slow_start(cubic), in_recovery, cubic->cu_cwnd,
+        bandwidth, pacing_rate);
+    return pacing_rate;
+}
+
+
+static void
+cubic_cci_cleanup (void *cong_ctl)
+{
+}
+
+
+const struct cong_ctl_if lsquic_cong_cubic_if =
+{
+    .cci_init        = cubic_cci_init,
+    .cci_begin_ack   = cubic_cci_begin_ack,
+    .cci_ack         = cubic_cci_ack,
+    .cci_end_ack     = cubic_cci_end_ack,
+    .cci_sent        = cubic_cci_sent,
+    .cci_lost        = cubic_cci_lost,
+    .cci_loss        = cubic_cci_loss,
+    .cci_undo        = cubic_cci_undo,
+    .cci_timeout     = cubic_cci_timeout,
+    .cci_was_quiet   = cubic_cci_was_quiet,
+    .cci_get_cwnd    = cubic_cci_get_cwnd,
+    .cci_pacing_rate = cubic_cci_pacing_rate,
+    .cci_cleanup     = cubic_cci_cleanup,
+};
@@ -6,6 +6,8 @@
 #ifndef LSQUIC_CUBIC_H
 #define LSQUIC_CUBIC_H 1
 
+struct lsquic_rtt_stats;
+
 struct lsquic_cubic {
     lsquic_time_t   cu_min_delay;
     lsquic_time_t   cu_epoch_start;
@@ -15,7 +17,15 @@ struct lsquic_cubic {
     unsigned long   cu_cwnd;
     unsigned long   cu_tcp_cwnd;
     unsigned long   cu_ssthresh;
+    /* State saved at loss event in case the loss turns out to be spurious.
+     * Zero cu_prior_cwnd means there is nothing to undo.
+     */
+    unsigned long   cu_prior_cwnd;
+    unsigned long   cu_prior_ssthresh;
+    unsigned long   cu_prior_last_max_cwnd;
     lsquic_cid_t    cu_cid;            /* Used for logging */
+    const struct lsquic_rtt_stats
+                   *cu_rtt_stats;      /* Used for pacing */
     enum cubic_flags {
         CU_TCP_FRIENDLY = (1 << 0),
     }               cu_flags;
@@ -43,6 +53,9 @@ lsquic_cubic_loss (struct lsquic_cubic *cubic);
 void
 lsquic_cubic_timeout (struct lsquic_cubic *cubic);
 
+void
+lsquic_cubic_undo (struct lsquic_cubic *cubic);
+
 void
 lsquic_cubic_was_quiet (struct lsquic_cubic *, lsquic_time_t now);
 
@@ -51,4 +64,6 @@ lsquic_cubic_was_quiet (struct lsquic_cubic *, lsquic_time_t now);
 #define lsquic_cubic_in_slow_start(cubic) \
                         ((cubic)->cu_cwnd < (cubic)->cu_ssthresh)
 
+extern const struct cong_ctl_if lsquic_cong_cubic_if;
+
 #endif
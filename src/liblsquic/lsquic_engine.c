@@ -35,6 +35,9 @@
 #include "lsquic_senhist.h"
 #include "lsquic_rtt.h"
 #include "lsquic_cubic.h"
+#include "lsquic_minmax.h"
+#include "lsquic_bw_sampler.h"
+#include "lsquic_bbr.h"
 #include "lsquic_pacer.h"
 #include "lsquic_send_ctl.h"
 #include "lsquic_set.h"
@@ -57,11 +60,14 @@
 #include "lsquic_attq.h"
 #include "lsquic_min_heap.h"
 #include "lsquic_http1x_if.h"
+#include "lsquic_pkt_ring.h"
+#include "lsquic_cmd_queue.h"
 
 #define LSQUIC_LOGGER_MODULE LSQLM_ENGINE
 #include "lsquic_logger.h"
 
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
 
 
 /* The batch of outgoing packets grows and shrinks dynamically */
@@ -69,11 +75,41 @@
 #define MIN_OUT_BATCH_SIZE 4
 #define INITIAL_OUT_BATCH_SIZE 32
 
+/* lsquic_engine_packets_in() processes incoming packets in chunks of this
+ * size.
+ */
+#define MAX_IN_BATCH_SIZE 64
+
+/* Packet train must fit into a single UDP datagram over IPv4 or IPv6 */
+#define MAX_TRAIN_SZ (0xFFFF - 48)
+
+/* When packet trains are enabled, consecutive packets belonging to the
+ * same connection are encrypted into a single buffer.  The buffer belongs
+ * to the engine: it is released after the batch is sent.
+ */
+struct packet_train
+{
+    unsigned char           *buf;
+    void                    *peer_ctx;
+    unsigned                 first;     /* Index of first packet in batch */
+    unsigned short           bufsz;
+    unsigned short           off;       /* Number of bytes used */
+    char                     ipv6;
+};
+
 struct out_batch
 {
     lsquic_conn_t           *conns  [MAX_OUT_BATCH_SIZE];
     lsquic_packet_out_t     *packets[MAX_OUT_BATCH_SIZE];
     struct lsquic_out_spec   outs   [MAX_OUT_BATCH_SIZE];
+    /* Number of packets in each element of `outs' */
+    unsigned short           n_packets[MAX_OUT_BATCH_SIZE];
+    struct packet_train      trains [MAX_OUT_BATCH_SIZE];
+    unsigned                 n_trains;
+    /* Train new packets are added to.  NULL if a new train is to be
+     * started.
+     */
+    struct packet_train     *cur_train;
 };
 
 typedef struct lsquic_conn * (*conn_iter_f)(struct lsquic_engine *);
@@ -158,6 +194,10 @@ struct lsquic_engine
     lsquic_packets_out_f               packets_out;
     void                              *packets_out_ctx;
     void                              *bad_handshake_ctx;
+    void                             (*cmd_notify)(void *);
+    void                              *cmd_notify_ctx;
+    /* Commands posted from other threads */
+    struct cmd_queue                   cmd_queue;
     struct conn_hash                   conns_hash;
     struct min_heap                    conns_tickable;
     struct min_heap                    conns_out;
@@ -179,6 +219,8 @@ struct lsquic_engine
     FILE                              *stats_fh;
 #endif
     struct out_batch                   out_batch;
+    /* Used by the stock packet out memory interface */
+    struct pkt_ring                    packout_ring;
 };
 
 
@@ -220,6 +262,15 @@ lsquic_engine_init_settings (struct lsquic_engine_settings *settings,
     settings->es_proc_time_thresh= LSQUIC_DF_PROC_TIME_THRESH;
     settings->es_pace_packets    = LSQUIC_DF_PACE_PACKETS;
     settings->es_clock_granularity = LSQUIC_DF_CLOCK_GRANULARITY;
+    settings->es_max_train_len   = LSQUIC_DF_MAX_TRAIN_LEN;
+    settings->es_timer_wheel     = LSQUIC_DF_TIMER_WHEEL;
+    settings->es_cc_algo         = LSQUIC_DF_CC_ALGO;
+    settings->es_rack            = LSQUIC_DF_RACK;
+    settings->es_pace_horizon    = LSQUIC_DF_PACE_HORIZON;
+    settings->es_ack_decimation  = LSQUIC_DF_ACK_DECIMATION;
+    settings->es_mm_max_cached   = LSQUIC_DF_MM_MAX_CACHED;
+    settings->es_conn_mem_budget = LSQUIC_DF_CONN_MEM_BUDGET;
+    settings->es_mm_huge_pages   = LSQUIC_DF_MM_HUGE_PAGES;
 }
 
 
@@ -251,6 +302,20 @@ lsquic_engine_check_settings (const struct lsquic_engine_settings *settings,
                         "one or more unsupported QUIC version is specified");
         return -1;
     }
+    if (settings->es_max_train_len > LSQUIC_MAX_TRAIN_LEN)
+    {
+        if (err_buf)
+            snprintf(err_buf, err_buf_sz, "max_train_len cannot exceed %d",
+                                                    LSQUIC_MAX_TRAIN_LEN);
+        return -1;
+    }
+    if (settings->es_cc_algo > 2)
+    {
+        if (err_buf)
+            snprintf(err_buf, err_buf_sz, "invalid congestion control "
+                "algorithm value %u", settings->es_cc_algo);
+        return -1;
+    }
     return 0;
 }
 
@@ -258,17 +323,18 @@ lsquic_engine_check_settings (const struct lsquic_engine_settings *settings,
 static void
 free_packet (void *ctx, void *conn_ctx, void *packet_data, char is_ipv6)
 {
-    free(packet_data);
+    lsquic_pkt_ring_release(ctx, packet_data);
 }
 
 
 static void *
 malloc_buf (void *ctx, void *conn_ctx, unsigned short size, char is_ipv6)
 {
-    return malloc(size);
+    return lsquic_pkt_ring_alloc(ctx, size);
 }
 
 
+/* The stock packet out memory interface uses the engine's ring buffer */
 static const struct lsquic_packout_mem_if stock_pmi =
 {
     malloc_buf, free_packet, free_packet,
@@ -327,6 +393,9 @@ lsquic_engine_new (unsigned flags,
     engine->stream_if_ctx   = api->ea_stream_if_ctx;
     engine->packets_out     = api->ea_packets_out;
     engine->packets_out_ctx = api->ea_packets_out_ctx;
+    engine->cmd_notify      = api->ea_cmd_notify;
+    engine->cmd_notify_ctx  = api->ea_cmd_notify_ctx;
+    lsquic_cmdq_init(&engine->cmd_queue);
     if (api->ea_hsi_if)
     {
         engine->pub.enp_hsi_if  = api->ea_hsi_if;
@@ -345,16 +414,27 @@ lsquic_engine_new (unsigned flags,
     else
     {
         engine->pub.enp_pmi      = &stock_pmi;
-        engine->pub.enp_pmi_ctx  = NULL;
+        engine->pub.enp_pmi_ctx  = &engine->packout_ring;
     }
+    engine->pub.enp_mm.pimi      = api->ea_pimi;
+    engine->pub.enp_mm.pimi_ctx  = api->ea_pimi_ctx;
+    engine->pub.enp_mm.max_cached = engine->pub.enp_settings.es_mm_max_cached;
+    engine->pub.enp_mm.use_arena = engine->pub.enp_settings.es_mm_huge_pages;
     engine->pub.enp_verify_cert  = api->ea_verify_cert;
     engine->pub.enp_verify_ctx   = api->ea_verify_ctx;
     engine->pub.enp_engine = engine;
     conn_hash_init(&engine->conns_hash,
                         hash_conns_by_addr(engine) ?  CHF_USE_ADDR : 0);
-    engine->attq = attq_create();
+    if (engine->pub.enp_settings.es_timer_wheel)
+        engine->attq = attq_create_wheel(
+                                engine->pub.enp_settings.es_clock_granularity);
+    else
+        engine->attq = attq_create();
     eng_hist_init(&engine->history);
     engine->batch_size = INITIAL_OUT_BATCH_SIZE;
+    lsquic_pkt_ring_init(&engine->packout_ring, MAX_OUT_BATCH_SIZE);
+    engine->packout_ring.pr_huge_pages =
+                                engine->pub.enp_settings.es_mm_huge_pages;
 
 #if LSQUIC_CONN_STATS
     engine->stats_fh = api->ea_stats_fh;
@@ -380,24 +460,39 @@ shrink_batch_size (struct lsquic_engine *engine)
 
 
 #if LSQUIC_CONN_STATS
+static void
+add_conn_stats (struct conn_stats *dst_stats, const struct conn_stats *stats)
+{
+    unsigned long *const dst = (unsigned long *) dst_stats;
+    const unsigned long *const src = (unsigned long *) stats;
+    unsigned i;
+
+    for (i = 0; i < sizeof(*stats) / sizeof(unsigned long); ++i)
+        dst[i] += src[i];
+}
+
+
 void
 update_stats_sum (struct lsquic_engine *engine, struct lsquic_conn *conn)
 {
-    unsigned long *const dst = (unsigned long *) &engine->conn_stats_sum;
-    const unsigned long *src;
     const struct conn_stats *stats;
-    unsigned i;
 
     if (conn->cn_if->ci_get_stats && (stats = conn->cn_if->ci_get_stats(conn)))
     {
         ++engine->stats.conns;
-        src = (unsigned long *) stats;
-        for (i = 0; i < sizeof(*stats) / sizeof(unsigned long); ++i)
-            dst[i] += src[i];
+        add_conn_stats(&engine->conn_stats_sum, stats);
     }
 }
 
 
+void
+lsquic_engine_add_stats (lsquic_engine_t *engine, const lsquic_engine_t *src)
+{
+    engine->stats.conns += src->stats.conns;
+    add_conn_stats(&engine->conn_stats_sum, &src->conn_stats_sum);
+}
+
+
 #endif
 
 
@@ -471,13 +566,17 @@ new_full_conn_client (lsquic_engine_t *engine, const char *hostname,
 }
 
 
+/* If `conn' is not NULL, it is the connection the packet is already known
+ * to belong to and the hash lookup is skipped.
+ */
 static lsquic_conn_t *
 find_conn (lsquic_engine_t *engine, lsquic_packet_in_t *packet_in,
-         struct packin_parse_state *ppstate, const struct sockaddr *sa_local)
+         struct packin_parse_state *ppstate, const struct sockaddr *sa_local,
+         lsquic_conn_t *conn)
 {
-    lsquic_conn_t *conn;
-
-    if (conn_hash_using_addr(&engine->conns_hash))
+    if (conn)
+        /* Connection has been looked up by the caller */;
+    else if (conn_hash_using_addr(&engine->conns_hash))
         conn = conn_hash_find_by_addr(&engine->conns_hash, sa_local);
     else if (packet_in->pi_flags & PI_CONN_ID)
         conn = conn_hash_find_by_cid(&engine->conns_hash,
@@ -546,32 +645,42 @@ lsquic_engine_add_conn_to_attq (struct lsquic_engine_public *enpub,
 }
 
 
-/* Return 0 if packet is being processed by a connections, otherwise return 1 */
-static int
-process_packet_in (lsquic_engine_t *engine, lsquic_packet_in_t *packet_in,
+/* Return connection the packet should be passed to or NULL if the packet
+ * has been discarded.
+ */
+static lsquic_conn_t *
+packet_in_conn (lsquic_engine_t *engine, lsquic_packet_in_t *packet_in,
        struct packin_parse_state *ppstate, const struct sockaddr *sa_local,
-       const struct sockaddr *sa_peer, void *peer_ctx)
+       lsquic_conn_t *conn)
 {
-    lsquic_conn_t *conn;
-    const unsigned char *packet_in_data;
-    size_t packet_in_size;
-
     if (lsquic_packet_in_is_gquic_prst(packet_in)
                                 && !engine->pub.enp_settings.es_honor_prst)
     {
         lsquic_mm_put_packet_in(&engine->pub.enp_mm, packet_in);
         LSQ_DEBUG("public reset packet: discarding");
-        return 1;
+        return NULL;
     }
 
-    conn = find_conn(engine, packet_in, ppstate, sa_local);
+    conn = find_conn(engine, packet_in, ppstate, sa_local, conn);
 
     if (!conn)
     {
         lsquic_mm_put_packet_in(&engine->pub.enp_mm, packet_in);
-        return 1;
+        return NULL;
     }
 
+    return conn;
+}
+
+
+static void
+pass_packet_to_conn (lsquic_engine_t *engine, lsquic_conn_t *conn,
+            lsquic_packet_in_t *packet_in, const struct sockaddr *sa_local,
+            const struct sockaddr *sa_peer, void *peer_ctx)
+{
+    const unsigned char *packet_in_data;
+    size_t packet_in_size;
+
     if (0 == (conn->cn_flags & LSCONN_TICKABLE))
     {
         lsquic_mh_insert(&engine->conns_tickable, conn, conn->cn_last_ticked);
@@ -601,10 +710,106 @@ process_packet_in (lsquic_engine_t *engine, lsquic_packet_in_t *packet_in,
     conn->cn_if->ci_packet_in(conn, packet_in);
     QLOG_PACKET_RX(conn->cn_cid, packet_in, packet_in_data, packet_in_size);
     lsquic_packet_in_put(&engine->pub.enp_mm, packet_in);
+}
+
+
+/* Return 0 if packet is being processed by a connections, otherwise return 1 */
+static int
+process_packet_in (lsquic_engine_t *engine, lsquic_packet_in_t *packet_in,
+       struct packin_parse_state *ppstate, lsquic_conn_t *conn,
+       const struct sockaddr *sa_local, const struct sockaddr *sa_peer,
+       void *peer_ctx)
+{
+    conn = packet_in_conn(engine, packet_in, ppstate, sa_local, conn);
+    if (!conn)
+        return 1;
+
+    pass_packet_to_conn(engine, conn, packet_in, sa_local, sa_peer, peer_ctx);
     return 0;
 }
 
 
+void
+lsquic_engine_post_cmd (lsquic_engine_t *engine, struct lsquic_cmd *cmd)
+{
+    if (lsquic_cmdq_push(&engine->cmd_queue, cmd) && engine->cmd_notify)
+        engine->cmd_notify(engine->cmd_notify_ctx);
+}
+
+
+static ssize_t
+execute_cmd (struct lsquic_engine *engine, const struct lsquic_cmd *cmd)
+{
+    lsquic_conn_t *conn;
+    lsquic_stream_t *stream;
+    ssize_t nw;
+
+    conn = conn_hash_lookup_cid(&engine->conns_hash, cmd->cmd_cid);
+    if (!conn)
+    {
+        LSQ_DEBUG("command %d: connection %"PRIu64" not found",
+                                                cmd->cmd_type, cmd->cmd_cid);
+        return -1;
+    }
+
+    /* Commands are executed while the engine is processing connections,
+     * which is when stream and connection functions do not schedule the
+     * connection to be ticked.  Do it here, so that the effect of the
+     * command is seen in this call to lsquic_engine_process_conns().
+     */
+    if (!(conn->cn_flags & (LSCONN_TICKABLE|LSCONN_NEVER_TICKABLE)))
+    {
+        lsquic_mh_insert(&engine->conns_tickable, conn, conn->cn_last_ticked);
+        engine_incref_conn(conn, LSCONN_TICKABLE);
+    }
+
+    switch (cmd->cmd_type)
+    {
+    case LSQCMD_MAKE_STREAM:
+        lsquic_conn_make_stream(conn);
+        return 0;
+    case LSQCMD_CLOSE_CONN:
+        lsquic_conn_close(conn);
+        return 0;
+    case LSQCMD_WRITE:
+    case LSQCMD_CLOSE_STREAM:
+        stream = lsquic_conn_get_stream_by_id(conn, cmd->cmd_stream_id);
+        if (!stream)
+        {
+            LSQ_DEBUG("command %d: stream %u not found in connection "
+                "%"PRIu64, cmd->cmd_type, cmd->cmd_stream_id, cmd->cmd_cid);
+            return -1;
+        }
+        if (cmd->cmd_type == LSQCMD_CLOSE_STREAM)
+            return lsquic_stream_close(stream);
+        nw = lsquic_stream_write(stream, cmd->cmd_buf, cmd->cmd_sz);
+        if (nw > 0 && 0 != lsquic_stream_flush(stream))
+            return -1;
+        return nw;
+    default:
+        return -1;
+    }
+}
+
+
+/* If `execute' is false, the commands fail without being executed */
+static void
+execute_cmds (struct lsquic_engine *engine, int execute)
+{
+    struct lsquic_cmd *cmd, *next;
+    ssize_t result;
+
+    for (cmd = lsquic_cmdq_pop_all(&engine->cmd_queue); cmd; cmd = next)
+    {
+        /* Command may be freed or reposted by the callback */
+        next = cmd->cmd_next;
+        result = execute ? execute_cmd(engine, cmd) : -1;
+        if (cmd->cmd_done)
+            cmd->cmd_done(cmd, result);
+    }
+}
+
+
 void
 lsquic_engine_destroy (lsquic_engine_t *engine)
 {
@@ -615,6 +820,8 @@ lsquic_engine_destroy (lsquic_engine_t *engine)
     engine->flags |= ENG_DTOR;
 #endif
 
+    execute_cmds(engine, 0);
+
     while ((conn = lsquic_mh_pop(&engine->conns_out)))
     {
         assert(conn->cn_flags & LSCONN_HAS_OUTGOING);
@@ -638,6 +845,11 @@ lsquic_engine_destroy (lsquic_engine_t *engine)
     assert(0 == lsquic_mh_count(&engine->conns_out));
     assert(0 == lsquic_mh_count(&engine->conns_tickable));
     lsquic_mm_cleanup(&engine->pub.enp_mm);
+    if (engine->pub.enp_pmi == &stock_pmi)
+        LSQ_DEBUG("packet ring: %u out-of-order allocations, %u malloc "
+            "fallbacks", engine->packout_ring.pr_n_reused,
+            engine->packout_ring.pr_n_fallbacks);
+    lsquic_pkt_ring_cleanup(&engine->packout_ring);
     free(engine->conns_tickable.mh_elems);
 #if LSQUIC_CONN_STATS
     if (engine->stats_fh)
@@ -862,6 +1074,9 @@ lsquic_engine_process_conns (lsquic_engine_t *engine)
 
     ENGINE_IN(engine);
 
+    if (!lsquic_cmdq_empty(&engine->cmd_queue))
+        execute_cmds(engine, 1);
+
     now = lsquic_time_now();
     while ((conn = attq_pop(engine->attq, now)))
     {
@@ -874,6 +1089,7 @@ lsquic_engine_process_conns (lsquic_engine_t *engine)
     }
 
     process_connections(engine, conn_iter_next_tickable, now);
+    lsquic_mm_trim(&engine->pub.enp_mm, now);
     ENGINE_OUT(engine);
 }
 
@@ -886,17 +1102,19 @@ really_encrypt_packet (const lsquic_conn_t *conn,
     int header_sz, is_hello_packet;
     enum enc_level enc_level;
     size_t packet_sz;
-    unsigned char header_buf[QUIC_MAX_PUBHDR_SZ];
 
+    /* The header is generated directly in the output buffer: the packet is
+     * sealed after it.
+     */
     header_sz = conn->cn_pf->pf_gen_reg_pkt_header(conn, packet_out,
-                                            header_buf, sizeof(header_buf));
+                                                                buf, bufsz);
     if (header_sz < 0)
         return -1;
 
     is_hello_packet = !!(packet_out->po_flags & PO_HELLO);
     enc_level = conn->cn_esf->esf_encrypt(conn->cn_enc_session,
                 conn->cn_version, 0,
-                packet_out->po_packno, header_buf, header_sz,
+                packet_out->po_packno, buf, header_sz,
                 packet_out->po_data, packet_out->po_data_sz,
                 buf, bufsz, &packet_sz, is_hello_packet);
     if ((int) enc_level >= 0)
@@ -922,7 +1140,19 @@ conn_peer_ipv6 (const struct lsquic_conn *conn)
 }
 
 
-static enum { ENCPA_OK, ENCPA_NOMEM, ENCPA_BADCRYPT, }
+enum encpa { ENCPA_OK, ENCPA_NOMEM, ENCPA_BADCRYPT, };
+
+
+static size_t
+packet_out_enc_bufsz (const lsquic_conn_t *conn,
+                                    const lsquic_packet_out_t *packet_out)
+{
+    return conn->cn_pf->pf_packout_header_size(conn, packet_out->po_flags) +
+                                packet_out->po_data_sz + QUIC_PACKET_HASH_SZ;
+}
+
+
+static enum encpa
 encrypt_packet (lsquic_engine_t *engine, const lsquic_conn_t *conn,
                                             lsquic_packet_out_t *packet_out)
 {
@@ -932,8 +1162,7 @@ encrypt_packet (lsquic_engine_t *engine, const lsquic_conn_t *conn,
     unsigned char *buf;
     int ipv6;
 
-    bufsz = conn->cn_pf->pf_packout_header_size(conn, packet_out->po_flags) +
-                                packet_out->po_data_sz + QUIC_PACKET_HASH_SZ;
+    bufsz = packet_out_enc_bufsz(conn, packet_out);
     if (bufsz > USHRT_MAX)
         return ENCPA_BADCRYPT;  /* To cause connection to close */
     ipv6 = conn_peer_ipv6(conn);
@@ -968,11 +1197,75 @@ encrypt_packet (lsquic_engine_t *engine, const lsquic_conn_t *conn,
 }
 
 
+/* Encrypt packet into current packet train, starting a new train if
+ * necessary.  `idx' is the index the packet is going to have in the batch.
+ */
+static enum encpa
+encrypt_packet_train (lsquic_engine_t *engine, const lsquic_conn_t *conn,
+            lsquic_packet_out_t *packet_out, struct out_batch *batch,
+            unsigned idx)
+{
+    struct packet_train *train;
+    ssize_t enc_sz;
+    size_t bufsz, train_sz;
+    int ipv6;
+
+    bufsz = packet_out_enc_bufsz(conn, packet_out);
+    if (bufsz > USHRT_MAX)
+        return ENCPA_BADCRYPT;  /* To cause connection to close */
+    ipv6 = conn_peer_ipv6(conn);
+
+    train = batch->cur_train;
+    if (!train || (size_t) (train->bufsz - train->off) < bufsz)
+    {
+        assert(batch->n_trains < MAX_OUT_BATCH_SIZE);
+        train = &batch->trains[ batch->n_trains ];
+        train_sz = (size_t) conn->cn_pack_size
+                            * engine->pub.enp_settings.es_max_train_len;
+        if (train_sz > MAX_TRAIN_SZ)
+            train_sz = MAX_TRAIN_SZ;
+        if (train_sz < bufsz)
+            train_sz = bufsz;
+        train->buf = engine->pub.enp_pmi->pmi_allocate(
+                    engine->pub.enp_pmi_ctx, conn->cn_peer_ctx, train_sz, ipv6);
+        if (!train->buf)
+        {
+            LSQ_DEBUG("could not allocate memory for packet train of size %zd",
+                                                                    train_sz);
+            return ENCPA_NOMEM;
+        }
+        train->peer_ctx = conn->cn_peer_ctx;
+        train->first    = idx;
+        train->bufsz    = train_sz;
+        train->off      = 0;
+        train->ipv6     = ipv6;
+        ++batch->n_trains;
+        batch->cur_train = train;
+    }
+
+    enc_sz = really_encrypt_packet(conn, packet_out, train->buf + train->off,
+                                                    train->bufsz - train->off);
+    if (enc_sz < 0)
+        return ENCPA_BADCRYPT;
+
+    packet_out->po_enc_data    = train->buf + train->off;
+    packet_out->po_enc_data_sz = enc_sz;
+    packet_out->po_sent_sz     = enc_sz;
+    packet_out->po_flags &= ~PO_IPv6;
+    packet_out->po_flags |= PO_ENCRYPTED|PO_SENT_SZ|PO_TRAIN
+                                                |(ipv6 << POIPv6_SHIFT);
+    train->off += enc_sz;
+
+    return ENCPA_OK;
+}
+
+
 static void
 release_or_return_enc_data (struct lsquic_engine *engine,
                 void (*pmi_rel_or_ret) (void *, void *, void *, char),
                 struct lsquic_conn *conn, struct lsquic_packet_out *packet_out)
 {
+    assert(!(packet_out->po_flags & PO_TRAIN));
     pmi_rel_or_ret(engine->pub.enp_pmi_ctx, conn->cn_peer_ctx,
                 packet_out->po_enc_data, lsquic_packet_out_ipv6(packet_out));
     packet_out->po_flags &= ~PO_ENCRYPTED;
@@ -998,6 +1291,36 @@ return_enc_data (struct lsquic_engine *engine, struct lsquic_conn *conn,
 }
 
 
+/* Packets encrypted into a packet train never leave the engine in that
+ * state: packet train buffers are freed once the batch is sent.
+ */
+static void
+drop_train_enc_data (struct lsquic_packet_out *packet_out)
+{
+    packet_out->po_flags &= ~(PO_ENCRYPTED|PO_TRAIN);
+    packet_out->po_enc_data = NULL;
+}
+
+
+static void
+release_trains (struct lsquic_engine *engine, struct out_batch *batch,
+                                                        unsigned n_sent)
+{
+    struct packet_train *train;
+
+    for (train = batch->trains; train < batch->trains + batch->n_trains;
+                                                                    ++train)
+        if (train->first < n_sent)
+            engine->pub.enp_pmi->pmi_release(engine->pub.enp_pmi_ctx,
+                                    train->peer_ctx, train->buf, train->ipv6);
+        else
+            engine->pub.enp_pmi->pmi_return(engine->pub.enp_pmi_ctx,
+                                    train->peer_ctx, train->buf, train->ipv6);
+    batch->n_trains = 0;
+    batch->cur_train = NULL;
+}
+
+
 STAILQ_HEAD(conns_stailq, lsquic_conn);
 TAILQ_HEAD(conns_tailq, lsquic_conn);
 
@@ -1102,33 +1425,49 @@ coi_reheap (struct conns_out_iter *iter, lsquic_engine_t *engine)
 }
 
 
+/* Returns number of packets sent.  This may be larger than the number of
+ * specs passed to packets_out callback if packet trains are used.
+ */
 static unsigned
 send_batch (lsquic_engine_t *engine, struct conns_out_iter *conns_iter,
-                  struct out_batch *batch, unsigned n_to_send)
+                  struct out_batch *batch, unsigned n_outs, unsigned n_to_send)
 {
-    int n_sent, i;
+    int n_outs_sent, n_sent, i;
     lsquic_time_t now;
 
-    /* Set sent time before the write to avoid underestimating RTT */
+    /* Set sent time before the write to avoid underestimating RTT.  If
+     * the packets_out callback honors departure times, a packet is sent
+     * no earlier than its departure time.
+     */
     now = lsquic_time_now();
-    for (i = 0; i < (int) n_to_send; ++i)
-        batch->packets[i]->po_sent = now;
-    n_sent = engine->packets_out(engine->packets_out_ctx, batch->outs,
-                                                                n_to_send);
-    if (n_sent < (int) n_to_send)
+    if (engine->pub.enp_settings.es_pace_horizon)
+        for (i = 0; i < (int) n_to_send; ++i)
+            batch->packets[i]->po_sent =
+                                MAX(now, batch->packets[i]->po_txtime);
+    else
+        for (i = 0; i < (int) n_to_send; ++i)
+            batch->packets[i]->po_sent = now;
+    n_outs_sent = engine->packets_out(engine->packets_out_ctx, batch->outs,
+                                                                    n_outs);
+    if (n_outs_sent < (int) n_outs)
     {
         engine->pub.enp_flags &= ~ENPUB_CAN_SEND;
         engine->resume_sending_at = now + 1000000;
         LSQ_DEBUG("cannot send packets");
         EV_LOG_GENERIC_EVENT("cannot send packets");
     }
-    if (n_sent >= 0)
-        LSQ_DEBUG("packets out returned %d (out of %u)", n_sent, n_to_send);
+    if (n_outs_sent >= 0)
+        LSQ_DEBUG("packets out returned %d (out of %u)", n_outs_sent, n_outs);
     else
     {
         LSQ_DEBUG("packets out returned an error: %s", strerror(errno));
-        n_sent = 0;
+        n_outs_sent = 0;
     }
+    if (n_outs == n_to_send)
+        n_sent = n_outs_sent;
+    else
+        for (n_sent = 0, i = 0; i < n_outs_sent; ++i)
+            n_sent += batch->n_packets[i];
     if (n_sent > 0)
         engine->last_sent = now + n_sent;
     for (i = 0; i < n_sent; ++i)
@@ -1144,9 +1483,16 @@ send_batch (lsquic_engine_t *engine, struct conns_out_iter *conns_iter,
          * this buffer until the packet sending is attempted again
          * or until it times out and regenerated.
          */
-        if (batch->packets[i]->po_flags & PO_ENCRYPTED)
+        if (batch->packets[i]->po_flags & PO_TRAIN)
+            drop_train_enc_data(batch->packets[i]);
+        else if (batch->packets[i]->po_flags & PO_ENCRYPTED)
             release_enc_data(engine, batch->conns[i], batch->packets[i]);
     }
+    /* Slots of the stock allocator are released above and reclaimed here
+     * all at once.
+     */
+    if (engine->pub.enp_pmi == &stock_pmi)
+        lsquic_pkt_ring_reclaim(&engine->packout_ring);
     if (LSQ_LOG_ENABLED_EXT(LSQ_LOG_DEBUG, LSQLM_EVENT))
         for ( ; i < (int) n_to_send; ++i)
             EV_LOG_PACKET_NOT_SENT(batch->conns[i]->cn_cid, batch->packets[i]);
@@ -1155,11 +1501,18 @@ send_batch (lsquic_engine_t *engine, struct conns_out_iter *conns_iter,
      */
     for (i = (int) n_to_send - 1; i >= n_sent; --i)
     {
+        /* Packet train buffer is about to be freed: the packet will be
+         * encrypted again when it is scheduled.
+         */
+        if (batch->packets[i]->po_flags & PO_TRAIN)
+            drop_train_enc_data(batch->packets[i]);
         batch->conns[i]->cn_if->ci_packet_not_sent(batch->conns[i],
                                                     batch->packets[i]);
         if (!(batch->conns[i]->cn_flags & (LSCONN_COI_ACTIVE|LSCONN_EVANESCENT)))
             coi_reactivate(conns_iter, batch->conns[i]);
     }
+    if (batch->n_trains)
+        release_trains(engine, batch, n_sent);
     return n_sent;
 }
 
@@ -1181,31 +1534,71 @@ check_deadline (lsquic_engine_t *engine)
 }
 
 
+/* Return true if packet can be appended to the last spec in the batch as
+ * part of a packet train.
+ */
+static int
+extends_train (const struct out_batch *batch, unsigned n_outs,
+                            const lsquic_packet_out_t *packet_out,
+                            unsigned max_train_len, int honor_txtime)
+{
+    const struct lsquic_out_spec *out;
+    unsigned seg_sz;
+
+    /* A packet at the beginning of train buffer starts a new spec */
+    if (n_outs == 0 || !(packet_out->po_flags & PO_TRAIN)
+                        || packet_out->po_enc_data == batch->cur_train->buf)
+        return 0;
+    out = &batch->outs[ n_outs - 1 ];
+    if (out->buf + out->sz != packet_out->po_enc_data
+                        || batch->n_packets[ n_outs - 1 ] >= max_train_len)
+        return 0;
+    /* The whole train departs at once */
+    if (honor_txtime && packet_out->po_txtime > out->txtime)
+        return 0;
+    /* All segments but the last must be of the same size */
+    seg_sz = out->segment_sz ? out->segment_sz : out->sz;
+    return out->sz % seg_sz == 0 && packet_out->po_enc_data_sz <= seg_sz;
+}
+
+
 static void
 send_packets_out (struct lsquic_engine *engine,
                   struct conns_tailq *ticked_conns,
                   struct conns_stailq *closed_conns)
 {
-    unsigned n, w, n_sent, n_batches_sent;
+    unsigned n, n_outs, w, n_sent, n_batches_sent, max_train_len;
     lsquic_packet_out_t *packet_out;
     lsquic_conn_t *conn;
     struct out_batch *const batch = &engine->out_batch;
+    struct lsquic_out_spec *out;
     struct conns_out_iter conns_iter;
+    enum encpa encpa;
     int shrink, deadline_exceeded;
 
     coi_init(&conns_iter, engine);
     n_batches_sent = 0;
-    n_sent = 0, n = 0;
+    n_sent = 0, n = 0, n_outs = 0;
     shrink = 0;
     deadline_exceeded = 0;
+    max_train_len = engine->pub.enp_settings.es_max_train_len;
+    batch->n_trains = 0;
+    batch->cur_train = NULL;
 
-    while ((conn = coi_next(&conns_iter)))
+    /* In packet train mode, packets of one connection are batched until
+     * it has no more packets to send, so that specs are grouped by
+     * connection.
+     */
+    conn = NULL;
+    while (conn || (conn = coi_next(&conns_iter)))
     {
         packet_out = conn->cn_if->ci_next_packet_to_send(conn);
         if (!packet_out) {
             LSQ_DEBUG("batched all outgoing packets for conn %"PRIu64,
                                                             conn->cn_cid);
             coi_deactivate(&conns_iter, conn);
+            batch->cur_train = NULL;
+            conn = NULL;
             continue;
         }
         if ((packet_out->po_flags & PO_ENCRYPTED)
@@ -1218,7 +1611,12 @@ send_packets_out (struct lsquic_engine *engine,
         }
         if (!(packet_out->po_flags & (PO_ENCRYPTED|PO_NOENCRYPT)))
         {
-            switch (encrypt_packet(engine, conn, packet_out))
+            if (max_train_len)
+                encpa = encrypt_packet_train(engine, conn, packet_out, batch,
+                                                                        n);
+            else
+                encpa = encrypt_packet(engine, conn, packet_out);
+            switch (encpa)
             {
             case ENCPA_NOMEM:
                 /* Send what we have and wait for a more opportune moment */
@@ -1244,6 +1642,8 @@ send_packets_out (struct lsquic_engine *engine,
                         engine_decref_conn(engine, conn, LSCONN_TICKED);
                     }
                 }
+                batch->cur_train = NULL;
+                conn = NULL;
                 continue;
             case ENCPA_OK:
                 break;
@@ -1252,48 +1652,72 @@ send_packets_out (struct lsquic_engine *engine,
         LSQ_DEBUG("batched packet %"PRIu64" for connection %"PRIu64,
                                         packet_out->po_packno, conn->cn_cid);
         assert(conn->cn_flags & LSCONN_HAS_PEER_SA);
-        if (packet_out->po_flags & PO_ENCRYPTED)
+        batch->conns  [n]          = conn;
+        batch->packets[n]          = packet_out;
+        ++n;
+        if (max_train_len
+                && extends_train(batch, n_outs, packet_out, max_train_len,
+                            engine->pub.enp_settings.es_pace_horizon != 0))
         {
-            batch->outs[n].buf     = packet_out->po_enc_data;
-            batch->outs[n].sz      = packet_out->po_enc_data_sz;
+            out = &batch->outs[ n_outs - 1 ];
+            if (!out->segment_sz)
+                out->segment_sz = out->sz;
+            out->sz += packet_out->po_enc_data_sz;
+            ++batch->n_packets[ n_outs - 1 ];
         }
         else
         {
-            batch->outs[n].buf     = packet_out->po_data;
-            batch->outs[n].sz      = packet_out->po_data_sz;
+            out = &batch->outs[ n_outs ];
+            if (packet_out->po_flags & PO_ENCRYPTED)
+            {
+                out->buf     = packet_out->po_enc_data;
+                out->sz      = packet_out->po_enc_data_sz;
+            }
+            else
+            {
+                out->buf     = packet_out->po_data;
+                out->sz      = packet_out->po_data_sz;
+            }
+            out->peer_ctx   = conn->cn_peer_ctx;
+            out->local_sa   = (struct sockaddr *) conn->cn_local_addr;
+            out->dest_sa    = (struct sockaddr *) conn->cn_peer_addr;
+            out->segment_sz = 0;
+            out->txtime     = packet_out->po_txtime;
+            batch->n_packets[ n_outs ] = 1;
+            ++n_outs;
         }
-        batch->outs   [n].peer_ctx = conn->cn_peer_ctx;
-        batch->outs   [n].local_sa = (struct sockaddr *) conn->cn_local_addr;
-        batch->outs   [n].dest_sa  = (struct sockaddr *) conn->cn_peer_addr;
-        batch->conns  [n]          = conn;
-        batch->packets[n]          = packet_out;
-        ++n;
         if (n == engine->batch_size)
         {
-            n = 0;
-            w = send_batch(engine, &conns_iter, batch, engine->batch_size);
+            w = send_batch(engine, &conns_iter, batch, n_outs, n);
             ++n_batches_sent;
             n_sent += w;
-            if (w < engine->batch_size)
+            if (w < n)
             {
+                n = 0, n_outs = 0;
                 shrink = 1;
                 break;
             }
+            n = 0, n_outs = 0;
             deadline_exceeded = check_deadline(engine);
             if (deadline_exceeded)
                 break;
             grow_batch_size(engine);
         }
+        if (!max_train_len)
+            conn = NULL;
     }
   end_for:
 
     if (n > 0) {
-        w = send_batch(engine, &conns_iter, batch, n);
+        w = send_batch(engine, &conns_iter, batch, n_outs, n);
         n_sent += w;
         shrink = w < n;
         ++n_batches_sent;
         deadline_exceeded = check_deadline(engine);
     }
+    else if (batch->n_trains)
+        /* Encryption failed after a new train buffer was allocated */
+        release_trains(engine, batch, 0);
 
     if (shrink)
         shrink_batch_size(engine);
@@ -1441,16 +1865,30 @@ process_connections (lsquic_engine_t *engine, conn_iter_f next_conn,
 }
 
 
-/* Return 0 if packet is being processed by a real connection, 1 if the
- * packet was processed, but not by a connection, and -1 on error.
+/* If the application handed ownership of incoming packet buffers to the
+ * library, buffers of packets that are dropped before a packet_in object
+ * is allocated are released here.
  */
-int
-lsquic_engine_packet_in (lsquic_engine_t *engine,
+static void
+release_packet_in_data (lsquic_engine_t *engine,
+                                        const unsigned char *packet_in_data)
+{
+    if (engine->pub.enp_mm.pimi)
+        engine->pub.enp_mm.pimi->pimi_release(engine->pub.enp_mm.pimi_ctx,
+                                            (unsigned char *) packet_in_data);
+}
+
+
+/* Allocate incoming packet and parse the beginning of its header.  When
+ * connections are hashed by address, `conn' is the connection associated
+ * with the local address: its version determines which parser to use.
+ * On failure, NULL is returned and errno is set.
+ */
+static lsquic_packet_in_t *
+new_packet_in (lsquic_engine_t *engine,
     const unsigned char *packet_in_data, size_t packet_in_size,
-    const struct sockaddr *sa_local, const struct sockaddr *sa_peer,
-    void *peer_ctx)
+    const struct lsquic_conn *conn, struct packin_parse_state *ppstate)
 {
-    struct packin_parse_state ppstate;
     lsquic_packet_in_t *packet_in;
     int (*parse_packet_in_begin) (struct lsquic_packet_in *, size_t length,
                                 int is_server, struct packin_parse_state *);
@@ -1459,16 +1897,13 @@ lsquic_engine_packet_in (lsquic_engine_t *engine,
     {
         LSQ_DEBUG("Cannot handle packet_in_size(%zd) > %d packet incoming "
             "packet's header", packet_in_size, QUIC_MAX_PACKET_SZ);
+        release_packet_in_data(engine, packet_in_data);
         errno = E2BIG;
-        return -1;
+        return NULL;
     }
 
-    if (conn_hash_using_addr(&engine->conns_hash))
+    if (conn)
     {
-        const struct lsquic_conn *conn;
-        conn = conn_hash_find_by_addr(&engine->conns_hash, sa_local);
-        if (!conn)
-            return -1;
         if ((1 << conn->cn_version) & LSQUIC_GQUIC_HEADER_VERSIONS)
             parse_packet_in_begin = lsquic_gquic_parse_packet_in_begin;
         else
@@ -1479,26 +1914,189 @@ lsquic_engine_packet_in (lsquic_engine_t *engine,
 
     packet_in = lsquic_mm_get_packet_in(&engine->pub.enp_mm);
     if (!packet_in)
-        return -1;
+    {
+        release_packet_in_data(engine, packet_in_data);
+        return NULL;
+    }
 
-    /* Library does not modify packet_in_data, it is not referenced after
+    /* Unless the application handed the buffer over to the library, the
+     * library does not modify packet_in_data, it is not referenced after
      * this function returns and subsequent release of pi_data is guarded
      * by PI_OWN_DATA flag.
      */
     packet_in->pi_data = (unsigned char *) packet_in_data;
+    if (engine->pub.enp_mm.pimi)
+        packet_in->pi_flags |= PI_APP_DATA;
     if (0 != parse_packet_in_begin(packet_in, packet_in_size,
-                                        engine->flags & ENG_SERVER, &ppstate))
+                                        engine->flags & ENG_SERVER, ppstate))
     {
         LSQ_DEBUG("Cannot parse incoming packet's header");
         lsquic_mm_put_packet_in(&engine->pub.enp_mm, packet_in);
         errno = EINVAL;
+        return NULL;
+    }
+
+    return packet_in;
+}
+
+
+/* Use receive time provided by the user -- such as a kernel timestamp --
+ * unless it is not set or is in the future.
+ */
+static lsquic_time_t
+packet_in_received (uint64_t received, lsquic_time_t now)
+{
+    if (received && received <= now)
+        return received;
+    else
+        return now;
+}
+
+
+int
+lsquic_engine_packet_in (lsquic_engine_t *engine,
+    const unsigned char *packet_in_data, size_t packet_in_size,
+    const struct sockaddr *sa_local, const struct sockaddr *sa_peer,
+    void *peer_ctx)
+{
+    return lsquic_engine_packet_in_ts(engine, packet_in_data, packet_in_size,
+                                        sa_local, sa_peer, peer_ctx, 0);
+}
+
+
+/* Return 0 if packet is being processed by a real connection, 1 if the
+ * packet was processed, but not by a connection, and -1 on error.
+ */
+int
+lsquic_engine_packet_in_ts (lsquic_engine_t *engine,
+    const unsigned char *packet_in_data, size_t packet_in_size,
+    const struct sockaddr *sa_local, const struct sockaddr *sa_peer,
+    void *peer_ctx, uint64_t received)
+{
+    struct packin_parse_state ppstate;
+    lsquic_packet_in_t *packet_in;
+    lsquic_conn_t *conn;
+    lsquic_time_t now;
+
+    if (conn_hash_using_addr(&engine->conns_hash))
+    {
+        conn = conn_hash_find_by_addr(&engine->conns_hash, sa_local);
+        if (!conn)
+        {
+            release_packet_in_data(engine, packet_in_data);
+            return -1;
+        }
+    }
+    else
+        conn = NULL;
+
+    packet_in = new_packet_in(engine, packet_in_data, packet_in_size, conn,
+                                                                    &ppstate);
+    if (!packet_in)
         return -1;
+
+    now = lsquic_time_now();
+    packet_in->pi_received = packet_in_received(received, now);
+    eng_hist_inc(&engine->history, now, sl_packets_in);
+    return process_packet_in(engine, packet_in, &ppstate, conn, sa_local,
+                                                        sa_peer, peer_ctx);
+}
+
+
+unsigned
+lsquic_engine_packets_in (lsquic_engine_t *engine,
+        const struct lsquic_in_spec *in_specs, unsigned n_packets_in)
+{
+    const struct lsquic_in_spec *spec, *const end = in_specs + n_packets_in;
+    const struct sockaddr *last_sa_local;
+    struct packin_parse_state ppstate;
+    lsquic_packet_in_t *packet_in;
+    lsquic_conn_t *conn, *last_conn;
+    lsquic_time_t now;
+    unsigned i, j, n_batch, n_processed;
+    struct {
+        lsquic_conn_t               *conn;
+        lsquic_packet_in_t          *packet_in;
+        const struct lsquic_in_spec *spec;
+    } batch[MAX_IN_BATCH_SIZE];
+
+    now = lsquic_time_now();
+    n_processed = 0;
+    last_conn = NULL;
+    last_sa_local = NULL;
+    spec = in_specs;
+
+    while (spec < end)
+    {
+        /* First, parse packet headers and look up connections.  Packets
+         * in a batch tend to come from the same peer, so the connection
+         * the previous packet was found to belong to is checked first.
+         */
+        for (n_batch = 0; spec < end && n_batch < MAX_IN_BATCH_SIZE; ++spec)
+        {
+            if (conn_hash_using_addr(&engine->conns_hash))
+            {
+                if (!(last_conn && spec->local_sa == last_sa_local))
+                {
+                    last_conn = conn_hash_find_by_addr(&engine->conns_hash,
+                                                            spec->local_sa);
+                    last_sa_local = spec->local_sa;
+                }
+                conn = last_conn;
+                if (!conn)
+                {
+                    release_packet_in_data(engine, spec->buf);
+                    continue;
+                }
+            }
+            else
+                conn = NULL;
+
+            packet_in = new_packet_in(engine, spec->buf, spec->sz, conn,
+                                                                    &ppstate);
+            if (!packet_in)
+                continue;
+            packet_in->pi_received = packet_in_received(spec->received, now);
+            eng_hist_inc(&engine->history, now, sl_packets_in);
+
+            if (!conn && last_conn && (packet_in->pi_flags & PI_CONN_ID)
+                                && packet_in->pi_conn_id == last_conn->cn_cid)
+                conn = last_conn;
+            conn = packet_in_conn(engine, packet_in, &ppstate,
+                                                        spec->local_sa, conn);
+            if (!conn)
+                continue;
+            if (!conn_hash_using_addr(&engine->conns_hash))
+                last_conn = conn;
+
+            batch[n_batch].conn      = conn;
+            batch[n_batch].packet_in = packet_in;
+            batch[n_batch].spec      = spec;
+            ++n_batch;
+        }
+
+        /* Then, pass packets to connections.  All packets that belong to
+         * the same connection are passed to it in a row; their relative
+         * order is preserved.
+         */
+        for (i = 0; i < n_batch; ++i)
+        {
+            if (!batch[i].packet_in)
+                continue;
+            conn = batch[i].conn;
+            for (j = i; j < n_batch; ++j)
+                if (batch[j].conn == conn && batch[j].packet_in)
+                {
+                    pass_packet_to_conn(engine, conn, batch[j].packet_in,
+                        batch[j].spec->local_sa, batch[j].spec->peer_sa,
+                        batch[j].spec->peer_ctx);
+                    batch[j].packet_in = NULL;
+                    ++n_processed;
+                }
+        }
     }
 
-    packet_in->pi_received = lsquic_time_now();
-    eng_hist_inc(&engine->history, packet_in->pi_received, sl_packets_in);
-    return process_packet_in(engine, packet_in, &ppstate, sa_local, sa_peer,
-                                                                    peer_ctx);
+    return n_processed;
 }
 
 
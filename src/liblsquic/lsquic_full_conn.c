@@ -26,6 +26,7 @@
 #include "lsquic_packet_in.h"
 #include "lsquic_packet_out.h"
 #include "lsquic_rechist.h"
+#include "lsquic_ack_policy.h"
 #include "lsquic_util.h"
 #include "lsquic_conn_flow.h"
 #include "lsquic_sfcw.h"
@@ -33,6 +34,9 @@
 #include "lsquic_senhist.h"
 #include "lsquic_rtt.h"
 #include "lsquic_cubic.h"
+#include "lsquic_minmax.h"
+#include "lsquic_bw_sampler.h"
+#include "lsquic_bbr.h"
 #include "lsquic_pacer.h"
 #include "lsquic_send_ctl.h"
 #include "lsquic_set.h"
@@ -67,8 +71,6 @@
 enum { STREAM_IF_STD, STREAM_IF_HSK, STREAM_IF_HDR, N_STREAM_IFS };
 
 #define MAX_ANY_PACKETS_SINCE_LAST_ACK  20
-#define MAX_RETR_PACKETS_SINCE_LAST_ACK 2
-#define ACK_TIMEOUT                     25000
 #define TIME_BETWEEN_PINGS              15000000
 #define IDLE_TIMEOUT                    30000000
 
@@ -178,12 +180,11 @@ struct full_conn
         unsigned    max_stream_send;
     }                            fc_cfg;
     enum full_conn_flags         fc_flags;
-    /* Number of packets received since last ACK sent: */
-    unsigned                     fc_n_slack_all;
-    /* Number ackable packets received since last ACK was sent: */
-    unsigned                     fc_n_slack_akbl;
+    struct ack_policy            fc_ack_policy;
     unsigned                     fc_n_delayed_streams;
     unsigned                     fc_n_cons_unretx;
+    /* Headers stream memory counted in fc_pub.mem_used: */
+    unsigned                     fc_hs_mem_used;
     uint32_t                     fc_last_stream_id;
     uint32_t                     fc_max_peer_stream_id;
     uint32_t                     fc_goaway_stream_id;
@@ -543,11 +544,12 @@ new_conn_common (lsquic_cid_t cid, struct lsquic_engine_public *enpub,
     conn->fc_pub.mm = &enpub->enp_mm;
     conn->fc_pub.lconn = &conn->fc_conn;
     conn->fc_pub.send_ctl = &conn->fc_send_ctl;
+    conn->fc_pub.mem_budget = enpub->enp_settings.es_conn_mem_budget;
 #if LSQUIC_CONN_STATS
     conn->fc_pub.conn_stats = &conn->fc_stats;
 #endif
     conn->fc_pub.packet_out_malo =
-                        lsquic_malo_create(sizeof(struct lsquic_packet_out));
+                        lsquic_malo_create(PACKET_OUT_SLOT_SZ);
     conn->fc_stream_ifs[STREAM_IF_STD].stream_if     = stream_if;
     conn->fc_stream_ifs[STREAM_IF_STD].stream_if_ctx = stream_if_ctx;
     conn->fc_settings = &enpub->enp_settings;
@@ -589,6 +591,8 @@ new_conn_common (lsquic_cid_t cid, struct lsquic_engine_public *enpub,
     if (!conn->fc_pub.all_streams)
         goto cleanup_on_error;
     lsquic_rechist_init(&conn->fc_rechist, cid);
+    lsquic_ack_policy_init(&conn->fc_ack_policy,
+                                    conn->fc_settings->es_ack_decimation);
     if (conn->fc_flags & FC_HTTP)
     {
         conn->fc_pub.hs = lsquic_headers_stream_new(
@@ -826,6 +830,10 @@ full_conn_ci_destroy (lsquic_conn_t *lconn)
     LSQ_NOTICE("ACKs: in: %lu; processed: %lu; merged to: new %lu, old %lu",
         conn->fc_stats.in.n_acks, conn->fc_stats.in.n_acks_proc,
         conn->fc_stats.in.n_acks_merged[0], conn->fc_stats.in.n_acks_merged[1]);
+    LSQ_NOTICE("sent %lu ACKs, %lu per MB received",
+        conn->fc_stats.out.acks, conn->fc_stats.in.bytes
+            ? conn->fc_stats.out.acks * 1024 * 1024 / conn->fc_stats.in.bytes
+            : 0);
 #endif
     while ((sitr = STAILQ_FIRST(&conn->fc_stream_ids_to_reset)))
     {
@@ -861,10 +869,18 @@ conn_is_stream_closed (struct full_conn *conn, uint32_t stream_id)
 
 
 static void
-set_ack_timer (struct full_conn *conn, lsquic_time_t now)
+set_ack_timer (struct full_conn *conn, lsquic_time_t now,
+                                                    lsquic_time_t ack_delay)
 {
-    lsquic_alarmset_set(&conn->fc_alset, AL_ACK, now + ACK_TIMEOUT);
-    LSQ_DEBUG("ACK alarm set to %"PRIu64, now + ACK_TIMEOUT);
+    /* With ACK decimation, ACK delay is counted from the earliest
+     * unacknowledged packet.  Otherwise, each packet restarts the timer.
+     */
+    if (conn->fc_ack_policy.ap_decimation
+            && lsquic_alarmset_is_set(&conn->fc_alset, AL_ACK)
+            && conn->fc_alset.as_expiry[AL_ACK] <= now + ack_delay)
+        return;
+    lsquic_alarmset_set(&conn->fc_alset, AL_ACK, now + ack_delay);
+    LSQ_DEBUG("ACK alarm set to %"PRIu64, now + ack_delay);
 }
 
 
@@ -879,33 +895,42 @@ ack_alarm_expired (void *ctx, lsquic_time_t expiry, lsquic_time_t now)
 
 
 static void
-try_queueing_ack (struct full_conn *conn, int was_missing, lsquic_time_t now)
-{
-    if (conn->fc_n_slack_akbl >= MAX_RETR_PACKETS_SINCE_LAST_ACK ||
+try_queueing_ack (struct full_conn *conn, lsquic_packno_t packno, int ackable,
+                                                            lsquic_time_t now)
+{
+    enum ack_decision decision;
+    lsquic_time_t ack_delay;
+
+    decision = lsquic_ack_policy_packet_in(&conn->fc_ack_policy,
+                &conn->fc_rechist, packno, ackable,
+                !!(conn->fc_flags & FC_ACK_HAD_MISS),
+                lsquic_rtt_stats_get_min_rtt(&conn->fc_pub.rtt_stats),
+                &ack_delay);
+    if (decision == AD_NOW ||
         (conn->fc_conn.cn_version < LSQVER_039 /* Since Q039 do not ack ACKs */
-            && conn->fc_n_slack_all >= MAX_ANY_PACKETS_SINCE_LAST_ACK) ||
-        ((conn->fc_flags & FC_ACK_HAD_MISS) && was_missing)      ||
+            && conn->fc_ack_policy.ap_n_slack_all
+                                    >= MAX_ANY_PACKETS_SINCE_LAST_ACK) ||
         lsquic_send_ctl_n_stop_waiting(&conn->fc_send_ctl) > 1)
     {
         lsquic_alarmset_unset(&conn->fc_alset, AL_ACK);
         lsquic_send_ctl_sanity_check(&conn->fc_send_ctl);
         conn->fc_flags |= FC_ACK_QUEUED;
         LSQ_DEBUG("ACK queued: ackable: %u; all: %u; had_miss: %d; "
-            "was_missing: %d; n_stop_waiting: %u",
-            conn->fc_n_slack_akbl, conn->fc_n_slack_all,
-            !!(conn->fc_flags & FC_ACK_HAD_MISS), was_missing,
+            "decision: %d; n_stop_waiting: %u",
+            conn->fc_ack_policy.ap_n_slack_akbl,
+            conn->fc_ack_policy.ap_n_slack_all,
+            !!(conn->fc_flags & FC_ACK_HAD_MISS), decision,
             lsquic_send_ctl_n_stop_waiting(&conn->fc_send_ctl));
     }
-    else if (conn->fc_n_slack_akbl > 0)
-        set_ack_timer(conn, now);
+    else if (decision == AD_TIMER)
+        set_ack_timer(conn, now, ack_delay);
 }
 
 
 static void
 reset_ack_state (struct full_conn *conn)
 {
-    conn->fc_n_slack_all  = 0;
-    conn->fc_n_slack_akbl = 0;
+    lsquic_ack_policy_reset(&conn->fc_ack_policy);
     lsquic_send_ctl_n_stop_waiting_reset(&conn->fc_send_ctl);
     conn->fc_flags &= ~FC_ACK_QUEUED;
     lsquic_alarmset_unset(&conn->fc_alset, AL_ACK);
@@ -2011,7 +2036,6 @@ process_regular_packet (struct full_conn *conn, lsquic_packet_in_t *packet_in)
 {
     enum received_st st;
     enum quic_ft_bit frame_types;
-    int was_missing;
 
     reconstruct_packet_number(conn, packet_in);
     EV_LOG_PACKET_IN(LSQUIC_LOG_CONN_ID, packet_in);
@@ -2051,11 +2075,8 @@ process_regular_packet (struct full_conn *conn, lsquic_packet_in_t *packet_in)
         if (0 == (conn->fc_flags & FC_ACK_QUEUED))
         {
             frame_types = packet_in->pi_frame_types;
-            was_missing = packet_in->pi_packno !=
-                            lsquic_rechist_largest_packno(&conn->fc_rechist);
-            conn->fc_n_slack_all  += 1;
-            conn->fc_n_slack_akbl += !!(frame_types & QFRAME_ACKABLE_MASK);
-            try_queueing_ack(conn, was_missing, packet_in->pi_received);
+            try_queueing_ack(conn, packet_in->pi_packno,
+                !!(frame_types & QFRAME_ACKABLE_MASK), packet_in->pi_received);
         }
         return 0;
     case REC_ST_DUP:
@@ -2598,6 +2619,20 @@ service_streams (struct full_conn *conn)
 }
 
 
+/* Header blocks being read and header frames being written count against
+ * connection's memory budget.
+ */
+static void
+update_headers_mem_used (struct full_conn *conn)
+{
+    unsigned mem_used;
+
+    mem_used = (unsigned) lsquic_headers_stream_mem_used(conn->fc_pub.hs);
+    conn->fc_pub.mem_used += mem_used - conn->fc_hs_mem_used;
+    conn->fc_hs_mem_used = mem_used;
+}
+
+
 static void
 process_streams_read_events (struct full_conn *conn)
 {
@@ -2624,6 +2659,9 @@ process_streams_read_events (struct full_conn *conn)
                                 ^ (stream->stream_flags & STREAM_SERVICE_FLAGS);
     }
 
+    if (conn->fc_flags & FC_HTTP)
+        update_headers_mem_used(conn);
+
     if (needs_service)
         service_streams(conn);
 
@@ -3037,6 +3075,8 @@ full_conn_ci_tick (lsquic_conn_t *lconn, lsquic_time_t now)
         process_streams_write_events(conn, 0);
 
   end_write:
+    if (TAILQ_EMPTY(&conn->fc_pub.write_streams))
+        lsquic_send_ctl_maybe_app_limited(&conn->fc_send_ctl);
 
   skip_write:
     RETURN_IF_OUT_OF_PACKETS();
@@ -3136,7 +3176,6 @@ static void
 full_conn_ci_packet_sent (lsquic_conn_t *lconn, lsquic_packet_out_t *packet_out)
 {
     struct full_conn *conn = (struct full_conn *) lconn;
-    int s;
 
     recent_packet_hist_new(conn, 1, packet_out->po_sent);
     recent_packet_hist_frames(conn, 1, packet_out->po_frame_types);
@@ -3149,9 +3188,7 @@ full_conn_ci_packet_sent (lsquic_conn_t *lconn, lsquic_packet_out_t *packet_out)
     }
     else
         ++conn->fc_n_cons_unretx;
-    s = lsquic_send_ctl_sent_packet(&conn->fc_send_ctl, packet_out, 1);
-    if (s != 0)
-        ABORT_ERROR("sent packet failed: %s", strerror(errno));
+    lsquic_send_ctl_sent_packet(&conn->fc_send_ctl, packet_out, 1);
 #if LSQUIC_CONN_STATS
     ++conn->fc_stats.out.packets;
     conn->fc_stats.out.bytes += lsquic_packet_out_sent_sz(lconn, packet_out);
@@ -3490,6 +3527,19 @@ void lsquic_conn_set_ctx (lsquic_conn_t *lconn, lsquic_conn_ctx_t *ctx)
 }
 
 
+int
+lsquic_conn_get_info (lsquic_conn_t *lconn, struct lsquic_conn_info *info)
+{
+    struct full_conn *const conn = (struct full_conn *) lconn;
+
+    if (!info)
+        return -1;
+
+    lsquic_send_ctl_get_info(&conn->fc_send_ctl, info);
+    return 0;
+}
+
+
 enum LSQUIC_CONN_STATUS
 lsquic_conn_status (lsquic_conn_t *lconn, char *errbuf, size_t bufsz)
 {
@@ -3548,6 +3598,9 @@ full_conn_ci_is_tickable (lsquic_conn_t *lconn)
     struct full_conn *conn = (struct full_conn *) lconn;
     const struct lsquic_stream *stream;
 
+    if (conn->fc_flags & FC_ERROR)   /* Close the connection */
+        return 1;
+
     if (!TAILQ_EMPTY(&conn->fc_pub.service_streams))
         return 1;
 
@@ -189,6 +189,10 @@ static int
 lsquic_handshake_init(int flags)
 {
     crypto_init();
+    /* Build the hash now so that engines in different threads need not
+     * race to do it.
+     */
+    (void) get_common_certs_hash();
     return init_hs_hash_tables(flags);
 }
 
@@ -1542,7 +1546,8 @@ verify_packet_hash (const lsquic_enc_session_t *enc_session,
         if (max_out_len < *header_len + *out_len)
             return -1;
 
-        memcpy(buf_out, buf, *header_len + *out_len);
+        if (buf_out != buf)
+            memcpy(buf_out, buf, *header_len + *out_len);
         return 0;
     }
     else
@@ -1563,9 +1568,25 @@ decrypt_packet (lsquic_enc_session_t *enc_session, uint8_t path_id,
     EVP_AEAD_CTX *key = NULL;
     int try_times = 0;
     enum enc_level enc_level;
+    unsigned char *out;
+    unsigned char scratch[QUIC_MAX_PACKET_SZ];
 
     path_id_packet_number = combine_path_id_pack_num(path_id, pack_num);
-    memcpy(buf_out, buf, *header_len);
+    if (buf_out != buf)
+    {
+        memcpy(buf_out, buf, *header_len);
+        out = buf_out + *header_len;
+    }
+    /* When decrypting in place, failed attempt destroys the ciphertext.  If
+     * the second key may have to be tried, decrypt into scratch buffer.
+     * This is so even after the peer has been seen to use the final key:
+     * a delayed or reordered packet may still be sealed using the initial
+     * key.
+     */
+    else if (enc_session->have_key == 3 && data_len <= sizeof(scratch))
+        out = scratch;
+    else
+        out = buf_out + *header_len;
     do
     {
         if (enc_session->have_key == 3 && try_times == 0)
@@ -1590,7 +1611,7 @@ decrypt_packet (lsquic_enc_session_t *enc_session, uint8_t path_id,
                            buf, *header_len,
                            nonce, 12,
                            buf + *header_len, data_len,
-                           buf_out + *header_len, out_len);
+                           out, out_len);
 
         if (ret != 0)
             ++try_times;
@@ -1612,6 +1633,9 @@ decrypt_packet (lsquic_enc_session_t *enc_session, uint8_t path_id,
     }
     while (try_times < 2);
 
+    if (ret == 0 && out == scratch)
+        memcpy(buf_out + *header_len, scratch, *out_len);
+
     LSQ_DEBUG("***decrypt_packet %s.", (ret == 0 ? "succeed" : "failed"));
     return ret == 0 ? enc_level : (enum enc_level) -1;
 }
@@ -1696,7 +1720,8 @@ lsquic_enc_session_encrypt (lsquic_enc_session_t *enc_session,
         }
 
         serialize_fnv128_short(hash, md);
-        memcpy(buf_out, header, header_len);
+        if (buf_out != header)
+            memcpy(buf_out, header, header_len);
         memcpy(buf_out + header_len, md, HS_PKT_HASH_LENGTH);
         memcpy(buf_out + header_len + HS_PKT_HASH_LENGTH, data, data_len);
         return ENC_LEV_CLEAR;
@@ -1727,7 +1752,8 @@ lsquic_enc_session_encrypt (lsquic_enc_session_t *enc_session,
         memcpy(nonce + 4, &path_id_packet_number,
                sizeof(path_id_packet_number));
 
-        memcpy(buf_out, header, header_len);
+        if (buf_out != header)
+            memcpy(buf_out, header, header_len);
         *out_len = max_out_len - header_len;
 
         ret = aes_aead_enc(key, header, header_len, nonce, 12, data,
@@ -1987,6 +2013,31 @@ lsquic_enc_session_get_zero_rtt (lsquic_enc_session_t *enc_session,
 }
 
 
+#ifndef NDEBUG
+void
+lsquic_enc_session_set_test_keys (lsquic_enc_session_t *enc_session,
+                    uint8_t have_key, uint8_t peer_have_final_key,
+                    unsigned char *key_i, const unsigned char *iv_i,
+                    unsigned char *key_f, const unsigned char *iv_f)
+{
+    setup_aead_ctx(&enc_session->enc_ctx_i, key_i, aes128_key_len,
+                                                    enc_session->enc_key_i);
+    setup_aead_ctx(&enc_session->dec_ctx_i, key_i, aes128_key_len,
+                                                    enc_session->dec_key_i);
+    memcpy(enc_session->enc_key_nonce_i, iv_i, aes128_iv_len);
+    memcpy(enc_session->dec_key_nonce_i, iv_i, aes128_iv_len);
+    setup_aead_ctx(&enc_session->enc_ctx_f, key_f, aes128_key_len, NULL);
+    setup_aead_ctx(&enc_session->dec_ctx_f, key_f, aes128_key_len, NULL);
+    memcpy(enc_session->enc_key_nonce_f, iv_f, aes128_iv_len);
+    memcpy(enc_session->dec_key_nonce_f, iv_f, aes128_iv_len);
+    enc_session->have_key = have_key;
+    enc_session->peer_have_final_key = peer_have_final_key;
+}
+
+
+#endif
+
+
 #ifdef NDEBUG
 const
 #endif
@@ -123,7 +123,9 @@ struct enc_session_funcs
     /* Return true if handshake has been completed */
     int (*esf_is_hsk_done)(lsquic_enc_session_t *enc_session);
 
-    /* Encrypt buffer */
+    /* Encrypt buffer.  The header may be located at the beginning of
+     * `buf_out'.
+     */
     enum enc_level (*esf_encrypt)(lsquic_enc_session_t *enc_session,
                enum lsquic_version, uint8_t path_id, uint64_t pack_num,
                const unsigned char *header, size_t header_len,
@@ -205,4 +207,15 @@ struct enc_session_funcs lsquic_enc_session_gquic_1;
 enum lsquic_version
 lsquic_zero_rtt_version (const unsigned char *, size_t);
 
+#ifndef NDEBUG
+/* Used by unit tests: the same key and IV are used for sending and for
+ * receiving at each encryption level.
+ */
+void
+lsquic_enc_session_set_test_keys (lsquic_enc_session_t *,
+                    uint8_t have_key, uint8_t peer_have_final_key,
+                    unsigned char *key_i, const unsigned char *iv_i,
+                    unsigned char *key_f, const unsigned char *iv_f);
+#endif
+
 #endif
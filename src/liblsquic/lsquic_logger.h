@@ -73,6 +73,8 @@ enum lsquic_logger_module {
     LSQLM_MIN_HEAP,
     LSQLM_HTTP1X,
     LSQLM_QLOG,
+    LSQLM_BBR,
+    LSQLM_BW_SAMPLER,
     N_LSQUIC_LOGGER_MODULES
 };
 
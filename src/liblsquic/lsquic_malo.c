@@ -7,7 +7,8 @@
  * does the following:
  *
  *  1. Allocations occur 4 KB at a time.
- *  2. No division or multiplication operations are performed.
+ *  2. No division operations are performed: slot index is calculated
+ *     using multiplication by precomputed reciprocal of the slot size.
  *
  * (In recent testing, malo was about 2.7 times faster than malloc for
  * 64-byte objects.)
@@ -24,19 +25,23 @@
  * To gain all these advantages, there are trade-offs:
  *
  *  1. There are two memory penalties:
- *      a. Per object overhead.  To avoid division and multiplication,
- *         the object sizes is rounded up to the nearest power or two,
- *         starting with 64 bytes (minumum) and up to 2 KB (maximum).
- *         Thus, a 104-byte object will have a 24-byte overhead; a
- *         130-byte object will have 126-byte overhead.  This is
- *         something to keep in mind.
- *      b. Per page overhead.  Page links occupy some bytes in the
- *         page.  To keep things fast, at least one slot per page is
- *         always occupied, independent of object size.  Thus, for a
- *         1 KB object size, 25% of the page is used for the page
- *         header.
- *  2. 4 KB pages are not freed until the malo allocator is destroyed.
- *     This is something to keep in mind.
+ *      a. Per object overhead.  Object size is rounded up to a multiple
+ *         of 8 bytes.  Because slot usage is tracked by a 64-bit bitmap,
+ *         a page holds at most 64 objects; objects smaller than about
+ *         60 bytes waste the remainder of the page.  The largest object
+ *         is 2 KB.
+ *      b. Per page overhead.  The page header occupies the beginning of
+ *         each page.  The first page also contains the malo object.
+ *         Slots sized in multiples of 64 bytes start on a cache line
+ *         boundary, which may leave a gap after the header.
+ *         Whatever is left over after the last slot is not used.
+ *  2. Empty 4 KB pages are not freed until lsquic_malo_trim() is called
+ *     or the malo allocator is destroyed.  This is something to keep in
+ *     mind.
+ *
+ * Before exact slot sizes were introduced, object size was rounded up to
+ * the nearest power of two.  Run `test_malo -s 2' to see how the two
+ * compare for objects allocated by the memory manager.
  *
  * P.S. In Russian, "malo" (мало) means "little" or "few".  Thus, the
  *      malo allocator aims to perform its job in as few CPU cycles as
@@ -56,76 +61,115 @@
 #include "fiu-local.h"
 #include "lsquic_malo.h"
 
-/* 64 slots in a 4KB page means that the smallest object is 64 bytes.
- * The largest object is 2KB.
- */
-#define MALO_MIN_NBITS 6
-#define MALO_MAX_NBITS 11
+#define MALO_PAGE_SIZE  0x1000
+#define MALO_MAX_SLOTS  64
+#define MALO_ALIGN      8
+#define MALO_MAX_OBJ_SZ 2048
+#define MALO_LINE_SZ    64
 
 /* A "free page" is a page with free slots available.
  */
 
 static unsigned find_free_slot (uint64_t slots);
-static unsigned size_in_bits (size_t sz);
 
 struct malo_page {
-    SLIST_ENTRY(malo_page)  next_page;
+    LIST_ENTRY(malo_page)   next_page;
     LIST_ENTRY(malo_page)   next_free_page;
     struct malo            *malo;
     uint64_t                slots,
                             full_slot_mask;
-    unsigned                nbits;
-    unsigned                initial_slot;
+    uint32_t                slot_size;
+    /* Slot index is (offset * recip) >> 32: see slot_index() */
+    uint32_t                recip;
+    /* Offset of the first slot from the beginning of the page */
+    unsigned                first_off;
+    unsigned                n_slots;
 };
 
-typedef char malo_header_fits_in_one_slot
-    [(sizeof(struct malo_page) > (1 << MALO_MAX_NBITS)) ? -1 : 1];
-
 struct malo {
     struct malo_page        page_header;
-    SLIST_HEAD(, malo_page) all_pages;
+    LIST_HEAD(, malo_page)  all_pages;
     LIST_HEAD(, malo_page)  free_pages;
+    unsigned                n_pages;
     struct {
         struct malo_page   *cur_page;
         unsigned            next_slot;
     }                       iter;
 };
 
+/* Offsets within a page are smaller than 2^12 and slot sizes are smaller
+ * than 2^12, which makes multiplication by the rounded-up reciprocal exact.
+ */
+static unsigned
+slot_index (const struct malo_page *page, const void *obj)
+{
+    uint32_t off;
+
+    off = (uint32_t) ((uintptr_t) obj - (uintptr_t) page) - page->first_off;
+    return (unsigned) (((uint64_t) off * page->recip) >> 32);
+}
+
+
+/* If slot size is a multiple of cache line size, slots are aligned on cache
+ * line boundary, so that an object does not straddle more lines than
+ * necessary.  Otherwise, slots are aligned on the largest power of two
+ * that divides slot size.
+ */
+static void
+init_page (struct malo_page *page, struct malo *malo, unsigned header_sz,
+                                                            unsigned slot_size)
+{
+    unsigned align, first_off;
+
+    align = slot_size & -slot_size;
+    if (align > MALO_LINE_SZ)
+        align = MALO_LINE_SZ;
+    first_off = (header_sz + align - 1) & ~(align - 1);
+
+    page->malo = malo;
+    page->slots = 0;
+    page->slot_size = slot_size;
+    page->recip = (uint32_t) ((1ULL << 32) / slot_size + 1);
+    page->first_off = first_off;
+    page->n_slots = (MALO_PAGE_SIZE - first_off) / slot_size;
+    if (page->n_slots > MALO_MAX_SLOTS)
+        page->n_slots = MALO_MAX_SLOTS;
+    if (page->n_slots == MALO_MAX_SLOTS)
+        page->full_slot_mask = ~0ULL;
+    else
+        page->full_slot_mask = (1ULL << page->n_slots) - 1;
+}
+
+
+#define ALIGN(sz) (((sz) + MALO_ALIGN - 1) & ~(MALO_ALIGN - 1))
+
+
 struct malo *
 lsquic_malo_create (size_t obj_size)
 {
-    unsigned nbits = size_in_bits(obj_size);
-    if (nbits < MALO_MIN_NBITS)
-        nbits = MALO_MIN_NBITS;
-    else if (nbits > MALO_MAX_NBITS)
+    struct malo *malo;
+    unsigned slot_size;
+
+    if (obj_size > MALO_MAX_OBJ_SZ)
     {
         errno = EOVERFLOW;
         return NULL;
     }
+    slot_size = ALIGN(obj_size ? obj_size : 1);
 
-    struct malo *malo;
-    if (0 != posix_memalign((void **) &malo, 0x1000, 0x1000))
+    if (0 != posix_memalign((void **) &malo, MALO_PAGE_SIZE, MALO_PAGE_SIZE))
         return NULL;
 
-    SLIST_INIT(&malo->all_pages);
+    LIST_INIT(&malo->all_pages);
     LIST_INIT(&malo->free_pages);
+    malo->n_pages = 1;
     malo->iter.cur_page = &malo->page_header;
     malo->iter.next_slot = 0;
 
-    int n_slots =   sizeof(*malo) / (1 << nbits)
-                + ((sizeof(*malo) % (1 << nbits)) > 0);
-
     struct malo_page *const page = &malo->page_header;
-    SLIST_INSERT_HEAD(&malo->all_pages, page, next_page);
+    LIST_INSERT_HEAD(&malo->all_pages, page, next_page);
     LIST_INSERT_HEAD(&malo->free_pages, page, next_free_page);
-    page->malo = malo;
-    if (nbits == MALO_MIN_NBITS)
-        page->full_slot_mask = ~0ULL;
-    else
-        page->full_slot_mask = (1ULL << (1 << (12 - nbits))) - 1;
-    page->slots = (1ULL << n_slots) - 1;
-    page->nbits = nbits;
-    page->initial_slot = n_slots;
+    init_page(page, malo, sizeof(*malo), slot_size);
 
     return malo;
 }
@@ -135,15 +179,13 @@ static struct malo_page *
 allocate_page (struct malo *malo)
 {
     struct malo_page *page;
-    if (0 != posix_memalign((void **) &page, 0x1000, 0x1000))
+    if (0 != posix_memalign((void **) &page, MALO_PAGE_SIZE, MALO_PAGE_SIZE))
         return NULL;
-    SLIST_INSERT_HEAD(&malo->all_pages, page, next_page);
+    LIST_INSERT_HEAD(&malo->all_pages, page, next_page);
     LIST_INSERT_HEAD(&malo->free_pages, page, next_free_page);
-    page->slots = 1;
-    page->full_slot_mask = malo->page_header.full_slot_mask;
-    page->nbits = malo->page_header.nbits;
-    page->malo = malo;
-    page->initial_slot = 1;
+    ++malo->n_pages;
+    init_page(page, malo, sizeof(*page),
+                                            malo->page_header.slot_size);
     return page;
 }
 
@@ -166,7 +208,7 @@ lsquic_malo_get (struct malo *malo)
     page->slots |= (1ULL << slot);
     if (page->full_slot_mask == page->slots)
         LIST_REMOVE(page, next_free_page);
-    return (char *) page + (slot << page->nbits);
+    return (char *) page + page->first_off + slot * page->slot_size;
 }
 
 
@@ -174,35 +216,68 @@ lsquic_malo_get (struct malo *malo)
 void
 lsquic_malo_put (void *obj)
 {
-    uintptr_t page_addr = (uintptr_t) obj & ~((1 << 12) - 1);
+    uintptr_t page_addr = (uintptr_t) obj & ~(MALO_PAGE_SIZE - 1);
     struct malo_page *page = (void *) page_addr;
-    unsigned slot = ((uintptr_t) obj - page_addr) >> page->nbits;
+    unsigned slot = slot_index(page, obj);
+    assert(page->slots & (1ULL << slot));
     if (page->full_slot_mask == page->slots)
         LIST_INSERT_HEAD(&page->malo->free_pages, page, next_free_page);
     page->slots &= ~(1ULL << slot);
 }
 
 
+static void
+free_page (struct malo_page *page)
+{
+#ifndef WIN32
+    free(page);
+#else
+    _aligned_free(page);
+#endif
+}
+
+
 void
 lsquic_malo_destroy (struct malo *malo)
 {
     struct malo_page *page, *next;
-    page = SLIST_FIRST(&malo->all_pages);
+    page = LIST_FIRST(&malo->all_pages);
     while (page != &malo->page_header)
     {
-        next = SLIST_NEXT(page, next_page);
-#ifndef WIN32
-        free(page);
-#else
-        _aligned_free(page);
-#endif
+        next = LIST_NEXT(page, next_page);
+        free_page(page);
         page = next;
     }
-#ifndef WIN32
-    free(page);
-#else
-        _aligned_free(page);
-#endif
+    free_page(page);
+}
+
+
+/* Free pages that have no objects on them.  The first page is never
+ * freed, as it contains the malo header; neither is the page the
+ * iterator is on.
+ */
+size_t
+lsquic_malo_trim (struct malo *malo)
+{
+    struct malo_page *page, *next;
+    size_t released;
+
+    released = 0;
+    for (page = LIST_FIRST(&malo->free_pages); page; page = next)
+    {
+        next = LIST_NEXT(page, next_free_page);
+        if (page->slots == 0 && page != &malo->page_header
+                                        && page != malo->iter.cur_page)
+        {
+            LIST_REMOVE(page, next_free_page);
+            LIST_REMOVE(page, next_page);
+            free_page(page);
+            --malo->n_pages;
+            released += MALO_PAGE_SIZE;
+        }
+    }
+
+    return released;
 }
 
 
@@ -214,8 +289,8 @@ lsquic_malo_destroy (struct malo *malo)
 void *
 lsquic_malo_first (struct malo *malo)
 {
-    malo->iter.cur_page = SLIST_FIRST(&malo->all_pages);
-    malo->iter.next_slot = malo->iter.cur_page->initial_slot;
+    malo->iter.cur_page = LIST_FIRST(&malo->all_pages);
+    malo->iter.next_slot = 0;
     return lsquic_malo_next(malo);
 }
 
@@ -229,22 +304,23 @@ lsquic_malo_next (struct malo *malo)
     page = malo->iter.cur_page;
     if (page)
     {
-        max_slot = 1 << (12 - page->nbits);     /* Same for all pages */
         slot = malo->iter.next_slot;
         while (1)
         {
+            max_slot = page->n_slots;
             for (; slot < max_slot; ++slot)
             {
                 if (page->slots & (1ULL << slot))
                 {
                     malo->iter.cur_page  = page;
                     malo->iter.next_slot = slot + 1;
-                    return (char *) page + (slot << page->nbits);
+                    return (char *) page + page->first_off
+                                                    + slot * page->slot_size;
                 }
             }
-            page = SLIST_NEXT(page, next_page);
+            page = LIST_NEXT(page, next_page);
             if (page)
-                slot = page->initial_slot;
+                slot = 0;
             else
             {
                 malo->iter.cur_page = NULL;     /* Stop iterator */
@@ -257,35 +333,6 @@ lsquic_malo_next (struct malo *malo)
 }
 
 
-static unsigned
-size_in_bits (size_t sz)
-{
-#if __GNUC__
-    unsigned clz = __builtin_clz(sz - 1);
-    return 32 - clz;
-#elif defined(WIN32)
-    unsigned char s;
-    unsigned long idx;
-    s = _BitScanReverse(&idx, sz);
-    assert(s);
-    return (unsigned) idx + 1;
-#else
-#error This function contains a bug!
-    unsigned clz;
-    size_t y;
-
-    --sz;
-    clz = 32;
-    y = sz >> 16;   if (y) { clz -= 16; sz = y; }
-    y = sz >>  8;   if (y) { clz -=  8; sz = y; }
-    y = sz >>  4;   if (y) { clz -=  4; sz = y; }
-    y = sz >>  2;   if (y) { clz -=  2; sz = y; }
-    y = sz >>  1;   if (y) return 32 - clz + 1;
-    return 32 - clz + sz;
-#endif
-}
-
-
 static unsigned
 find_free_slot (uint64_t slots)
 {
@@ -311,12 +358,5 @@ find_free_slot (uint64_t slots)
 size_t
 lsquic_malo_mem_used (const struct malo *malo)
 {
-    const struct malo_page *page;
-    size_t size;
-
-    size = 0;
-    SLIST_FOREACH(page, &malo->all_pages, next_page)
-        size += sizeof(*page);
-
-    return size;
+    return (size_t) malo->n_pages * MALO_PAGE_SIZE;
 }
@@ -24,6 +24,10 @@ lsquic_malo_put (void *obj);
 void
 lsquic_malo_destroy (struct malo *);
 
+/* Free empty pages.  Returns number of bytes released. */
+size_t
+lsquic_malo_trim (struct malo *);
+
 /* The iterator is built-in.  Usage:
  * void *obj;
  * for (obj = lsquic_malo_first(obj); obj; lsquic_malo_next(obj))
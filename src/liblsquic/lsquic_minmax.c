@@ -0,0 +1,107 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_minmax.c -- Windowed min/max filter
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "lsquic_minmax.h"
+
+
+void
+minmax_reset (struct minmax *minmax, uint64_t time, uint64_t value)
+{
+    minmax->samples[0].time  = time;
+    minmax->samples[0].value = value;
+    minmax->samples[2] = minmax->samples[1] = minmax->samples[0];
+}
+
+
+/* As time goes by, shift samples so that the best sample is never older
+ * than the window and the second and third best samples come from the
+ * later parts of the window.
+ */
+static void
+minmax_subwin_update (struct minmax *minmax, const struct minmax_sample *sample)
+{
+    uint64_t dt;
+
+    dt = sample->time - minmax->samples[0].time;
+    if (dt > minmax->window)
+    {
+        /* The best sample has expired: promote the second best and the
+         * third best samples.  Do it again if the new best has expired,
+         * too.
+         */
+        minmax->samples[0] = minmax->samples[1];
+        minmax->samples[1] = minmax->samples[2];
+        minmax->samples[2] = *sample;
+        if (sample->time - minmax->samples[0].time > minmax->window)
+        {
+            minmax->samples[0] = minmax->samples[1];
+            minmax->samples[1] = minmax->samples[2];
+            minmax->samples[2] = *sample;
+        }
+    }
+    else if (minmax->samples[1].time == minmax->samples[0].time
+                                                && dt > minmax->window / 4)
+        /* A quarter of the window has passed without a better second
+         * sample: take this one as second and third best.
+         */
+        minmax->samples[2] = minmax->samples[1] = *sample;
+    else if (minmax->samples[2].time == minmax->samples[1].time
+                                                && dt > minmax->window / 2)
+        /* Half of the window has passed without a better third sample */
+        minmax->samples[2] = *sample;
+}
+
+
+void
+minmax_upmax (struct minmax *minmax, uint64_t now, uint64_t value)
+{
+    struct minmax_sample sample;
+
+    if (minmax->samples[0].value == 0
+        || value >= minmax->samples[0].value
+        || now - minmax->samples[2].time > minmax->window)
+    {
+        minmax_reset(minmax, now, value);
+        return;
+    }
+
+    sample.time = now;
+    sample.value = value;
+
+    if (value >= minmax->samples[1].value)
+        minmax->samples[2] = minmax->samples[1] = sample;
+    else if (value >= minmax->samples[2].value)
+        minmax->samples[2] = sample;
+
+    minmax_subwin_update(minmax, &sample);
+}
+
+
+void
+minmax_upmin (struct minmax *minmax, uint64_t now, uint64_t value)
+{
+    struct minmax_sample sample;
+
+    if (minmax->samples[0].value == 0
+        || value <= minmax->samples[0].value
+        || now - minmax->samples[2].time > minmax->window)
+    {
+        minmax_reset(minmax, now, value);
+        return;
+    }
+
+    sample.time = now;
+    sample.value = value;
+
+    if (value <= minmax->samples[1].value)
+        minmax->samples[2] = minmax->samples[1] = sample;
+    else if (value <= minmax->samples[2].value)
+        minmax->samples[2] = sample;
+
+    minmax_subwin_update(minmax, &sample);
+}
@@ -0,0 +1,48 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_minmax.h -- Windowed min/max filter
+ *
+ * This is Kathleen Nichols' algorithm for tracking the minimum (or the
+ * maximum) value of a data stream over some fixed time interval.  Only
+ * three samples are kept: the best, second best, and third best values
+ * in successive subwindows.  The time unit is up to the user: BBR uses
+ * round trip counts for bandwidth and microseconds for RTT.
+ */
+
+#ifndef LSQUIC_MINMAX_H
+#define LSQUIC_MINMAX_H 1
+
+struct minmax_sample
+{
+    uint64_t    time;
+    uint64_t    value;
+};
+
+
+/* This struct is initialized using minmax_init().  Value of zero means
+ * that there are no samples.
+ */
+struct minmax
+{
+    uint64_t                window;
+    struct minmax_sample    samples[3];
+};
+
+
+#define minmax_init(minmax_, window_) do {                              \
+    memset((minmax_), 0, sizeof(*(minmax_)));                           \
+    (minmax_)->window = (window_);                                      \
+} while (0)
+
+#define minmax_get(minmax_) (+(minmax_)->samples[0].value)
+
+void
+minmax_reset (struct minmax *, uint64_t time, uint64_t value);
+
+void
+minmax_upmax (struct minmax *, uint64_t now, uint64_t value);
+
+void
+minmax_upmin (struct minmax *, uint64_t now, uint64_t value);
+
+#endif
@@ -20,31 +20,55 @@
 #include "lsquic_packet_common.h"
 #include "lsquic_packet_in.h"
 #include "lsquic_packet_out.h"
+#include "lsquic_minmax.h"
+#include "lsquic_bw_sampler.h"
 #include "lsquic_parse.h"
 #include "lsquic_mm.h"
 #include "lsquic_engine_public.h"
+#include "lsquic_util.h"
 
 #define FAIL_NOMEM do { errno = ENOMEM; return NULL; } while (0)
 
+/* Objects that stay on a free list for this long are released: */
+#define MM_TRIM_PERIOD 1000000
 
-struct payload_buf
+#define MM_ARENA_SZ LSQUIC_HUGE_PAGE_SZ
+
+/* Buffers in arenas are aligned on cache line boundary */
+#define MM_ARENA_ALIGN 64
+
+
+struct mm_buf
 {
-    SLIST_ENTRY(payload_buf)  next_pb;
+    SLIST_ENTRY(mm_buf)     next_buf;
 };
 
-struct packet_out_buf
+
+struct mm_arena
 {
-    SLIST_ENTRY(packet_out_buf) next_pob;
+    struct mm_arena        *next;
+    unsigned char          *mem;
+    size_t                  off;        /* Offset of unused memory */
+    int                     mmapped;    /* Otherwise, posix_memalign'ed */
 };
 
-struct four_k_page
-{
-    SLIST_ENTRY(four_k_page)  next_fkp;
+
+/* Based on commonly used MTUs, ordered from small to large: */
+enum {
+    PACKET_OUT_PAYLOAD_0 = 1280                    - QUIC_MIN_PACKET_OVERHEAD,
+    PACKET_OUT_PAYLOAD_1 = QUIC_MAX_IPv6_PACKET_SZ - QUIC_MIN_PACKET_OVERHEAD,
+    PACKET_OUT_PAYLOAD_2 = QUIC_MAX_IPv4_PACKET_SZ - QUIC_MIN_PACKET_OVERHEAD,
 };
 
-struct sixteen_k_page
-{
-    SLIST_ENTRY(sixteen_k_page)  next_skp;
+
+static const unsigned pool_sizes[N_MM_POOLS] = {
+    [MM_POOL_PACKET_IN]         = sizeof(struct lsquic_packet_in),
+    [MM_POOL_PACKET_OUT + 0]    = PACKET_OUT_PAYLOAD_0,
+    [MM_POOL_PACKET_OUT + 1]    = PACKET_OUT_PAYLOAD_1,
+    [MM_POOL_PACKET_OUT + 2]    = PACKET_OUT_PAYLOAD_2,
+    [MM_POOL_1370]              = 1370,
+    [MM_POOL_4K]                = 0x1000,
+    [MM_POOL_16K]               = 0x4000,
 };
 
 
@@ -57,15 +81,26 @@ lsquic_mm_init (struct lsquic_mm *mm)
     mm->malo.stream_frame = lsquic_malo_create(sizeof(struct stream_frame));
     mm->malo.stream_rec_arr = lsquic_malo_create(sizeof(struct stream_rec_arr));
     mm->malo.packet_in = lsquic_malo_create(sizeof(struct lsquic_packet_in));
-    mm->malo.packet_out = lsquic_malo_create(sizeof(struct lsquic_packet_out));
+    mm->malo.packet_out = lsquic_malo_create(PACKET_OUT_SLOT_SZ);
+    mm->malo.bwp_state = lsquic_malo_create(sizeof(struct bwp_state));
     TAILQ_INIT(&mm->free_packets_in);
-    for (i = 0; i < MM_N_OUT_BUCKETS; ++i)
-        SLIST_INIT(&mm->packet_out_bufs[i]);
-    SLIST_INIT(&mm->payload_bufs);
-    SLIST_INIT(&mm->four_k_pages);
-    SLIST_INIT(&mm->sixteen_k_pages);
+    for (i = 0; i < N_MM_POOLS; ++i)
+    {
+        SLIST_INIT(&mm->pools[i].bufs);
+        mm->pools[i].n_cached = 0;
+        mm->pools[i].low_water = 0;
+    }
+    mm->pimi = NULL;
+    mm->pimi_ctx = NULL;
+    mm->max_cached = 0;
+    mm->cached = 0;
+    mm->live = 0;
+    mm->next_trim = 0;
+    mm->use_arena = 0;
+    mm->arena = NULL;
+    mm->arena_sz = 0;
     if (mm->acki && mm->malo.stream_frame && mm->malo.stream_rec_arr &&
-                              mm->malo.packet_in)
+                              mm->malo.packet_in && mm->malo.bwp_state)
     {
         return 0;
     }
@@ -78,41 +113,142 @@ void
 lsquic_mm_cleanup (struct lsquic_mm *mm)
 {
     int i;
-    struct packet_out_buf *pob;
-    struct payload_buf *pb;
-    struct four_k_page *fkp;
-    struct sixteen_k_page *skp;
+    struct mm_buf *buf;
+    struct mm_arena *arena;
 
     free(mm->acki);
     lsquic_malo_destroy(mm->malo.packet_in);
     lsquic_malo_destroy(mm->malo.packet_out);
+    lsquic_malo_destroy(mm->malo.bwp_state);
     lsquic_malo_destroy(mm->malo.stream_frame);
     lsquic_malo_destroy(mm->malo.stream_rec_arr);
 
-    for (i = 0; i < MM_N_OUT_BUCKETS; ++i)
-        while ((pob = SLIST_FIRST(&mm->packet_out_bufs[i])))
+    for (i = 0; i < N_MM_POOLS; ++i)
+        while ((buf = SLIST_FIRST(&mm->pools[i].bufs)))
         {
-            SLIST_REMOVE_HEAD(&mm->packet_out_bufs[i], next_pob);
-            free(pob);
+            SLIST_REMOVE_HEAD(&mm->pools[i].bufs, next_buf);
+            if (!mm->use_arena)
+                free(buf);
         }
 
-    while ((pb = SLIST_FIRST(&mm->payload_bufs)))
+    while ((arena = mm->arena))
+    {
+        mm->arena = arena->next;
+        lsquic_huge_free(arena->mem, MM_ARENA_SZ, arena->mmapped);
+        free(arena);
+    }
+}
+
+
+static struct mm_arena *
+new_arena (void)
+{
+    struct mm_arena *arena;
+
+    arena = malloc(sizeof(*arena));
+    if (!arena)
+        return NULL;
+
+    arena->mem = lsquic_huge_alloc(MM_ARENA_SZ, &arena->mmapped);
+    if (!arena->mem)
     {
-        SLIST_REMOVE_HEAD(&mm->payload_bufs, next_pb);
-        free(pb);
+        free(arena);
+        return NULL;
     }
+    arena->off = 0;
+    return arena;
+}
+
 
-    while ((fkp = SLIST_FIRST(&mm->four_k_pages)))
+/* Memory at the end of an arena too small for the requested buffer
+ * is wasted.
+ */
+static void *
+arena_get (struct lsquic_mm *mm, unsigned size)
+{
+    struct mm_arena *arena;
+    void *buf;
+
+    size = (size + MM_ARENA_ALIGN - 1) & ~(MM_ARENA_ALIGN - 1);
+    arena = mm->arena;
+    if (!arena || arena->off + size > MM_ARENA_SZ)
     {
-        SLIST_REMOVE_HEAD(&mm->four_k_pages, next_fkp);
-        free(fkp);
+        arena = new_arena();
+        if (!arena)
+            return NULL;
+        arena->next = mm->arena;
+        mm->arena = arena;
+        mm->arena_sz += MM_ARENA_SZ;
     }
 
-    while ((skp = SLIST_FIRST(&mm->sixteen_k_pages)))
+    buf = arena->mem + arena->off;
+    arena->off += size;
+    return buf;
+}
+
+
+static int
+may_cache (const struct lsquic_mm *mm, enum mm_pool pool)
+{
+    return mm->max_cached == 0
+        || (mm->use_arena && pool != MM_POOL_PACKET_IN)
+        || mm->cached + pool_sizes[pool] <= mm->max_cached;
+}
+
+
+static void
+cached_added (struct lsquic_mm *mm, enum mm_pool pool)
+{
+    ++mm->pools[pool].n_cached;
+    mm->cached += pool_sizes[pool];
+}
+
+
+static void
+cached_removed (struct lsquic_mm *mm, enum mm_pool pool)
+{
+    --mm->pools[pool].n_cached;
+    if (mm->pools[pool].n_cached < mm->pools[pool].low_water)
+        mm->pools[pool].low_water = mm->pools[pool].n_cached;
+    mm->cached -= pool_sizes[pool];
+}
+
+
+static void *
+get_buf (struct lsquic_mm *mm, enum mm_pool pool)
+{
+    struct mm_buf *buf;
+
+    buf = SLIST_FIRST(&mm->pools[pool].bufs);
+    if (buf)
     {
-        SLIST_REMOVE_HEAD(&mm->sixteen_k_pages, next_skp);
-        free(skp);
+        SLIST_REMOVE_HEAD(&mm->pools[pool].bufs, next_buf);
+        cached_removed(mm, pool);
     }
+    else if (mm->use_arena)
+        buf = arena_get(mm, pool_sizes[pool]);
+    else
+        buf = malloc(pool_sizes[pool]);
+
+    if (buf)
+        mm->live += pool_sizes[pool];
+    return buf;
+}
+
+
+static void
+put_buf (struct lsquic_mm *mm, enum mm_pool pool, void *mem)
+{
+    struct mm_buf *buf = mem;
+
+    mm->live -= pool_sizes[pool];
+    if (may_cache(mm, pool))
+    {
+        SLIST_INSERT_HEAD(&mm->pools[pool].bufs, buf, next_buf);
+        cached_added(mm, pool);
+    }
+    else
+        free(buf);
 }
 
 
@@ -128,6 +264,7 @@ lsquic_mm_get_packet_in (struct lsquic_mm *mm)
     {
         assert(0 == packet_in->pi_refcnt);
         TAILQ_REMOVE(&mm->free_packets_in, packet_in, pi_next);
+        cached_removed(mm, MM_POOL_PACKET_IN);
     }
     else
         packet_in = lsquic_malo_get(mm->malo.packet_in);
@@ -139,21 +276,6 @@ lsquic_mm_get_packet_in (struct lsquic_mm *mm)
 }
 
 
-/* Based on commonly used MTUs, ordered from small to large: */
-enum {
-    PACKET_OUT_PAYLOAD_0 = 1280                    - QUIC_MIN_PACKET_OVERHEAD,
-    PACKET_OUT_PAYLOAD_1 = QUIC_MAX_IPv6_PACKET_SZ - QUIC_MIN_PACKET_OVERHEAD,
-    PACKET_OUT_PAYLOAD_2 = QUIC_MAX_IPv4_PACKET_SZ - QUIC_MIN_PACKET_OVERHEAD,
-};
-
-
-static const unsigned packet_out_sizes[] = {
-    PACKET_OUT_PAYLOAD_0,
-    PACKET_OUT_PAYLOAD_1,
-    PACKET_OUT_PAYLOAD_2,
-};
-
-
 static unsigned
 packet_out_index (unsigned size)
 {
@@ -167,13 +289,11 @@ void
 lsquic_mm_put_packet_out (struct lsquic_mm *mm,
                           struct lsquic_packet_out *packet_out)
 {
-    struct packet_out_buf *pob;
     unsigned idx;
 
     assert(packet_out->po_data);
-    pob = (struct packet_out_buf *) packet_out->po_data;
     idx = packet_out_index(packet_out->po_n_alloc);
-    SLIST_INSERT_HEAD(&mm->packet_out_bufs[idx], pob, next_pob);
+    put_buf(mm, MM_POOL_PACKET_OUT + idx, packet_out->po_data);
     lsquic_malo_put(packet_out);
 }
 
@@ -183,7 +303,7 @@ lsquic_mm_get_packet_out (struct lsquic_mm *mm, struct malo *malo,
                           unsigned short size)
 {
     struct lsquic_packet_out *packet_out;
-    struct packet_out_buf *pob;
+    void *buf;
     unsigned idx;
 
     assert(size <= QUIC_MAX_PAYLOAD_SZ);
@@ -195,22 +315,16 @@ lsquic_mm_get_packet_out (struct lsquic_mm *mm, struct malo *malo,
         return NULL;
 
     idx = packet_out_index(size);
-    pob = SLIST_FIRST(&mm->packet_out_bufs[idx]);
-    if (pob)
-        SLIST_REMOVE_HEAD(&mm->packet_out_bufs[idx], next_pob);
-    else
+    buf = get_buf(mm, MM_POOL_PACKET_OUT + idx);
+    if (!buf)
     {
-        pob = malloc(packet_out_sizes[idx]);
-        if (!pob)
-        {
-            lsquic_malo_put(packet_out);
-            return NULL;
-        }
+        lsquic_malo_put(packet_out);
+        return NULL;
     }
 
     memset(packet_out, 0, sizeof(*packet_out));
     packet_out->po_n_alloc = size;
-    packet_out->po_data = (unsigned char *) pob;
+    packet_out->po_data = buf;
 
     return packet_out;
 }
@@ -219,63 +333,45 @@ lsquic_mm_get_packet_out (struct lsquic_mm *mm, struct malo *malo,
 void *
 lsquic_mm_get_1370 (struct lsquic_mm *mm)
 {
-    struct payload_buf *pb = SLIST_FIRST(&mm->payload_bufs);
     fiu_do_on("mm/1370", FAIL_NOMEM);
-    if (pb)
-        SLIST_REMOVE_HEAD(&mm->payload_bufs, next_pb);
-    else
-        pb = malloc(1370);
-    return pb;
+    return get_buf(mm, MM_POOL_1370);
 }
 
 
 void
 lsquic_mm_put_1370 (struct lsquic_mm *mm, void *mem)
 {
-    struct payload_buf *pb = mem;
-    SLIST_INSERT_HEAD(&mm->payload_bufs, pb, next_pb);
+    put_buf(mm, MM_POOL_1370, mem);
 }
 
 
 void *
 lsquic_mm_get_4k (struct lsquic_mm *mm)
 {
-    struct four_k_page *fkp = SLIST_FIRST(&mm->four_k_pages);
     fiu_do_on("mm/4k", FAIL_NOMEM);
-    if (fkp)
-        SLIST_REMOVE_HEAD(&mm->four_k_pages, next_fkp);
-    else
-        fkp = malloc(0x1000);
-    return fkp;
+    return get_buf(mm, MM_POOL_4K);
 }
 
 
 void
 lsquic_mm_put_4k (struct lsquic_mm *mm, void *mem)
 {
-    struct four_k_page *fkp = mem;
-    SLIST_INSERT_HEAD(&mm->four_k_pages, fkp, next_fkp);
+    put_buf(mm, MM_POOL_4K, mem);
 }
 
 
 void *
 lsquic_mm_get_16k (struct lsquic_mm *mm)
 {
-    struct sixteen_k_page *skp = SLIST_FIRST(&mm->sixteen_k_pages);
     fiu_do_on("mm/16k", FAIL_NOMEM);
-    if (skp)
-        SLIST_REMOVE_HEAD(&mm->sixteen_k_pages, next_skp);
-    else
-        skp = malloc(16 * 1024);
-    return skp;
+    return get_buf(mm, MM_POOL_16K);
 }
 
 
 void
 lsquic_mm_put_16k (struct lsquic_mm *mm, void *mem)
 {
-    struct sixteen_k_page *skp = mem;
-    SLIST_INSERT_HEAD(&mm->sixteen_k_pages, skp, next_skp);
+    put_buf(mm, MM_POOL_16K, mem);
 }
 
 
@@ -286,18 +382,66 @@ lsquic_mm_put_packet_in (struct lsquic_mm *mm,
     assert(0 == packet_in->pi_refcnt);
     if (packet_in->pi_flags & PI_OWN_DATA)
         lsquic_mm_put_1370(mm, packet_in->pi_data);
-    TAILQ_INSERT_HEAD(&mm->free_packets_in, packet_in, pi_next);
+    else if (packet_in->pi_flags & PI_APP_DATA)
+        mm->pimi->pimi_release(mm->pimi_ctx, packet_in->pi_data);
+    if (may_cache(mm, MM_POOL_PACKET_IN))
+    {
+        TAILQ_INSERT_HEAD(&mm->free_packets_in, packet_in, pi_next);
+        cached_added(mm, MM_POOL_PACKET_IN);
+    }
+    else
+        lsquic_malo_put(packet_in);
+}
+
+
+/* Objects that stayed on a free list for the whole trim period -- that is,
+ * the list's low-water mark -- are not needed and are released.  Then
+ * empty malo pages are freed.
+ */
+void
+lsquic_mm_trim (struct lsquic_mm *mm, lsquic_time_t now)
+{
+    struct lsquic_packet_in *packet_in;
+    struct mm_buf *buf;
+    unsigned i, n;
+
+    if (now < mm->next_trim)
+        return;
+    mm->next_trim = now + MM_TRIM_PERIOD;
+
+    for (n = mm->pools[MM_POOL_PACKET_IN].low_water; n > 0; --n)
+    {
+        packet_in = TAILQ_FIRST(&mm->free_packets_in);
+        TAILQ_REMOVE(&mm->free_packets_in, packet_in, pi_next);
+        cached_removed(mm, MM_POOL_PACKET_IN);
+        lsquic_malo_put(packet_in);
+    }
+
+    /* Buffers allocated from arenas cannot be freed */
+    if (!mm->use_arena)
+        for (i = MM_POOL_PACKET_OUT; i < N_MM_POOLS; ++i)
+            for (n = mm->pools[i].low_water; n > 0; --n)
+            {
+                buf = SLIST_FIRST(&mm->pools[i].bufs);
+                SLIST_REMOVE_HEAD(&mm->pools[i].bufs, next_buf);
+                cached_removed(mm, i);
+                free(buf);
+            }
+
+    for (i = 0; i < N_MM_POOLS; ++i)
+        mm->pools[i].low_water = mm->pools[i].n_cached;
+
+    (void) lsquic_malo_trim(mm->malo.packet_in);
+    (void) lsquic_malo_trim(mm->malo.packet_out);
+    (void) lsquic_malo_trim(mm->malo.bwp_state);
+    (void) lsquic_malo_trim(mm->malo.stream_frame);
+    (void) lsquic_malo_trim(mm->malo.stream_rec_arr);
 }
 
 
-size_t
-lsquic_mm_mem_used (const struct lsquic_mm *mm)
+void
+lsquic_mm_mem_used (const struct lsquic_mm *mm, struct mm_mem_stats *stats)
 {
-    const struct packet_out_buf *pob;
-    const struct payload_buf *pb;
-    const struct four_k_page *fkp;
-    const struct sixteen_k_page *skp;
-    unsigned i;
     size_t size;
 
     size = sizeof(*mm);
@@ -306,19 +450,18 @@ lsquic_mm_mem_used (const struct lsquic_mm *mm)
     size += lsquic_malo_mem_used(mm->malo.stream_rec_arr);
     size += lsquic_malo_mem_used(mm->malo.packet_in);
     size += lsquic_malo_mem_used(mm->malo.packet_out);
+    size += lsquic_malo_mem_used(mm->malo.bwp_state);
+    /* Cached incoming packets reside in malo pages: */
+    size -= mm->pools[MM_POOL_PACKET_IN].n_cached
+                                        * pool_sizes[MM_POOL_PACKET_IN];
+    if (mm->use_arena)
+        /* Buffers on free lists reside in arenas */
+        size += mm->arena_sz - (mm->cached
+                    - mm->pools[MM_POOL_PACKET_IN].n_cached
+                                        * pool_sizes[MM_POOL_PACKET_IN]);
+    else
+        size += mm->live;
 
-    for (i = 0; i < MM_N_OUT_BUCKETS; ++i)
-        SLIST_FOREACH(pob, &mm->packet_out_bufs[i], next_pob)
-            size += packet_out_sizes[i];
-
-    SLIST_FOREACH(pb, &mm->payload_bufs, next_pb)
-        size += 1370;
-
-    SLIST_FOREACH(fkp, &mm->four_k_pages, next_fkp)
-        size += 0x1000;
-
-    SLIST_FOREACH(skp, &mm->sixteen_k_pages, next_skp)
-        size += 0x4000;
-
-    return size;
+    stats->cached = mm->cached;
+    stats->live   = size;
 }
@@ -4,19 +4,49 @@
  *
  * Allocators and in this class are meant to be used for the lifetime of
  * QUIC engine.
+ *
+ * Released objects are kept on free lists for reuse.  The number of bytes
+ * on free lists can be capped.  lsquic_mm_trim() should be called
+ * periodically: it releases objects that have not been reused since the
+ * previous trim.
+ *
+ * Optionally, buffers can be carved out of 2 MB arenas backed by huge
+ * pages to reduce TLB misses.  Buffers allocated from an arena are never
+ * freed individually: they stay on free lists until the memory manager
+ * is cleaned up.
  */
 
 #ifndef LSQUIC_MM_H
 #define LSQUIC_MM_H 1
 
+#include "lsquic_int_types.h"
+
 struct lsquic_engine_public;
+struct lsquic_packin_mem_if;
 struct lsquic_packet_in;
 struct lsquic_packet_out;
 struct ack_info;
 struct malo;
+struct mm_arena;
+struct mm_buf;
 
 #define MM_N_OUT_BUCKETS 3
 
+/* Free lists, each of which contains objects of the same size: */
+enum mm_pool {
+    MM_POOL_PACKET_IN,
+    MM_POOL_PACKET_OUT,
+    MM_POOL_1370 = MM_POOL_PACKET_OUT + MM_N_OUT_BUCKETS,
+    MM_POOL_4K,
+    MM_POOL_16K,
+    N_MM_POOLS
+};
+
+struct mm_mem_stats {
+    size_t      cached;     /* Bytes on free lists */
+    size_t      live;       /* Everything else */
+};
+
 struct lsquic_mm {
     struct ack_info     *acki;
     struct {
@@ -24,12 +54,31 @@ struct lsquic_mm {
         struct malo     *stream_rec_arr;/* For struct stream_rec_arr */
         struct malo     *packet_in;     /* For struct lsquic_packet_in */
         struct malo     *packet_out;    /* For struct lsquic_packet_out */
+        struct malo     *bwp_state;     /* For struct bwp_state */
     }                    malo;
     TAILQ_HEAD(, lsquic_packet_in)  free_packets_in;
-    SLIST_HEAD(, packet_out_buf)    packet_out_bufs[MM_N_OUT_BUCKETS];
-    SLIST_HEAD(, payload_buf)       payload_bufs;
-    SLIST_HEAD(, four_k_page)       four_k_pages;
-    SLIST_HEAD(, sixteen_k_page)    sixteen_k_pages;
+    /* Used to release packet data owned by the application */
+    const struct lsquic_packin_mem_if
+                                   *pimi;
+    void                           *pimi_ctx;
+    /* Bytes on free lists are capped at this value; zero means no cap */
+    size_t                          max_cached;
+    size_t                          cached;
+    /* Buffers that have been handed out, in bytes: */
+    size_t                          live;
+    lsquic_time_t                   next_trim;
+    /* If set, buffers are allocated from huge-page arenas.  This must be
+     * set before any buffers are allocated.
+     */
+    int                             use_arena;
+    struct mm_arena                *arena;      /* Current arena is first */
+    size_t                          arena_sz;   /* Total size of arenas */
+    struct {
+        SLIST_HEAD(, mm_buf)    bufs;   /* Not used for packet_in */
+        unsigned                n_cached;
+        /* Smallest number of objects on the free list since last trim */
+        unsigned                low_water;
+    }                               pools[N_MM_POOLS];
 };
 
 int
@@ -75,7 +124,10 @@ lsquic_mm_get_16k (struct lsquic_mm *);
 void
 lsquic_mm_put_16k (struct lsquic_mm *, void *);
 
-size_t
-lsquic_mm_mem_used (const struct lsquic_mm *mm);
+void
+lsquic_mm_trim (struct lsquic_mm *, lsquic_time_t now);
+
+void
+lsquic_mm_mem_used (const struct lsquic_mm *, struct mm_mem_stats *);
 
 #endif
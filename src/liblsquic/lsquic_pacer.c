@@ -24,12 +24,14 @@
 
 
 void
-pacer_init (struct pacer *pacer, lsquic_cid_t cid, unsigned clock_granularity)
+pacer_init (struct pacer *pacer, lsquic_cid_t cid, unsigned clock_granularity,
+            unsigned horizon)
 {
     memset(pacer, 0, sizeof(*pacer));
     pacer->pa_burst_tokens = 10;
     pacer->pa_cid = cid;
     pacer->pa_clock_granularity = clock_granularity;
+    pacer->pa_horizon = MAX(horizon, clock_granularity);
 }
 
 
@@ -42,12 +44,12 @@ pacer_cleanup (struct pacer *pacer)
 }
 
 
-void
+lsquic_time_t
 pacer_packet_scheduled (struct pacer *pacer, unsigned n_in_flight,
-                            int in_recovery, tx_time_f tx_time, void *tx_ctx)
+            int in_recovery, unsigned packet_sz, uint64_t pacing_rate)
 {
-    lsquic_time_t delay, sched_time;
-    int app_limited, making_up;
+    lsquic_time_t departure;
+    uint64_t interval_ns;
 
 #ifndef NDEBUG
     ++pacer->pa_stats.n_scheduled;
@@ -59,38 +61,43 @@ pacer_packet_scheduled (struct pacer *pacer, unsigned n_in_flight,
         LSQ_DEBUG("%s: replenish tokens: %u", __func__, pacer->pa_burst_tokens);
     }
 
-    if (pacer->pa_burst_tokens > 0)
+    /* Time not used because the connection was woken up late is made up
+     * for, but by no more than one clock tick.  Time not used because the
+     * sender was application-limited is not carried over.
+     */
+    if (pacer->pa_next_sched + pacer->pa_clock_granularity < pacer->pa_now)
     {
-        --pacer->pa_burst_tokens;
-        pacer->pa_flags &= ~PA_LAST_SCHED_DELAYED;
-        pacer->pa_next_sched = 0;
-        pacer->pa_last_delayed = 0;
-        LSQ_DEBUG("%s: tokens: %u", __func__, pacer->pa_burst_tokens);
-        return;
+        if (pacer->pa_flags & PA_LAST_SCHED_DELAYED)
+            pacer->pa_next_sched = pacer->pa_now - pacer->pa_clock_granularity;
+        else
+            pacer->pa_next_sched = pacer->pa_now;
+        pacer->pa_next_sched_ns = 0;
     }
+    pacer->pa_flags &= ~PA_LAST_SCHED_DELAYED;
 
-    sched_time = pacer->pa_now;
-    delay = tx_time(tx_ctx);
-    if (pacer->pa_flags & PA_LAST_SCHED_DELAYED)
+    if (pacer->pa_burst_tokens > 0)
     {
-        pacer->pa_next_sched += delay;
-        app_limited = pacer->pa_last_delayed != 0
-            && pacer->pa_last_delayed + delay <= sched_time;
-        making_up = pacer->pa_next_sched <= sched_time;
-        LSQ_DEBUG("making up: %d; app limited; %d", making_up, app_limited);
-        if (making_up && !app_limited)
-            pacer->pa_last_delayed = sched_time;
-        else
+        --pacer->pa_burst_tokens;
+        if (pacer->pa_next_sched < pacer->pa_now)
         {
-            pacer->pa_flags &= ~PA_LAST_SCHED_DELAYED;
-            pacer->pa_last_delayed = 0;
+            pacer->pa_next_sched = pacer->pa_now;
+            pacer->pa_next_sched_ns = 0;
         }
+        LSQ_DEBUG("%s: tokens: %u", __func__, pacer->pa_burst_tokens);
+        return pacer->pa_now;
     }
-    else
-        pacer->pa_next_sched = MAX(pacer->pa_next_sched + delay,
-                                                    sched_time + delay);
-    LSQ_DEBUG("next_sched is set to %"PRIu64" usec from now",
-                                pacer->pa_next_sched - lsquic_time_now());
+
+    if (pacing_rate == 0)
+        pacing_rate = 1;
+    departure = MAX(pacer->pa_next_sched, pacer->pa_now);
+    interval_ns = (uint64_t) packet_sz * 1000000000 / pacing_rate
+                                                + pacer->pa_next_sched_ns;
+    pacer->pa_next_sched += interval_ns / 1000;
+    pacer->pa_next_sched_ns = interval_ns % 1000;
+    LSQ_DEBUG("rate: %"PRIu64"; departure: +%"PRIu64" usec; next_sched: "
+        "%+"PRId64" usec", pacing_rate, departure - pacer->pa_now,
+        (int64_t) (pacer->pa_next_sched - pacer->pa_now));
+    return departure;
 }
 
 
@@ -109,7 +116,7 @@ pacer_can_schedule (struct pacer *pacer, unsigned n_in_flight)
 
     if (pacer->pa_burst_tokens > 0 || n_in_flight == 0)
         can = 1;
-    else if (pacer->pa_next_sched > pacer->pa_now + pacer->pa_clock_granularity)
+    else if (pacer->pa_next_sched > pacer->pa_now + pacer->pa_horizon)
     {
         pacer->pa_flags |= PA_LAST_SCHED_DELAYED;
         can = 0;
@@ -1,18 +1,38 @@
 /* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_pacer.h -- Rate-based pacer.
+ *
+ * The pacer assigns each scheduled packet an earliest departure time
+ * computed from the congestion controller's pacing rate.  Departure times
+ * have sub-microsecond precision internally, so that the intended rate is
+ * kept even when inter-packet gaps are shorter than a clock tick.  The
+ * departure time is passed to the packets_out callback, which may hand it
+ * to the kernel (e.g. SO_TXTIME) to pace packets exactly.
+ */
 #ifndef LSQUIC_PACER_H
 #define LSQUIC_PACER_H 1
 
 struct pacer
 {
     lsquic_cid_t    pa_cid;             /* Used for logging */
+    /* Earliest departure time of the next paced packet */
     lsquic_time_t   pa_next_sched;
-    lsquic_time_t   pa_last_delayed;
     lsquic_time_t   pa_now;
 
     /* All tick times are in microseconds */
 
     unsigned        pa_clock_granularity;
 
+    /* Packets whose departure times are up to this far in the future can
+     * be scheduled.  At least one clock tick.
+     */
+    unsigned        pa_horizon;
+
+    /* Fraction of microsecond, in nanoseconds, not yet added to
+     * pa_next_sched.
+     */
+    unsigned        pa_next_sched_ns;
+
     unsigned        pa_burst_tokens;
     enum {
         PA_LAST_SCHED_DELAYED   = (1 << 0),
@@ -25,10 +45,9 @@ struct pacer
 };
 
 
-typedef lsquic_time_t (*tx_time_f)(void *ctx);
-
 void
-pacer_init (struct pacer *, lsquic_cid_t, unsigned clock_granularity);
+pacer_init (struct pacer *, lsquic_cid_t, unsigned clock_granularity,
+            unsigned horizon);
 
 void
 pacer_cleanup (struct pacer *);
@@ -39,15 +58,20 @@ pacer_tick (struct pacer *, lsquic_time_t);
 int
 pacer_can_schedule (struct pacer *, unsigned n_in_flight);
 
-void
+/* Returns earliest departure time of the scheduled packet.  `pacing_rate'
+ * is in bytes per second.
+ */
+lsquic_time_t
 pacer_packet_scheduled (struct pacer *pacer, unsigned n_in_flight,
-                        int in_recovery, tx_time_f tx_time, void *tx_ctx);
+            int in_recovery, unsigned packet_sz, uint64_t pacing_rate);
 
 void
 pacer_loss_event (struct pacer *);
 
 #define pacer_delayed(pacer) ((pacer)->pa_flags & PA_LAST_SCHED_DELAYED)
 
-#define pacer_next_sched(pacer) (+(pacer)->pa_next_sched)
+/* Time at which the next packet can be scheduled */
+#define pacer_next_sched(pacer) (+(pacer)->pa_next_sched                   \
+                - ((pacer)->pa_horizon - (pacer)->pa_clock_granularity))
 
 #endif
@@ -57,6 +57,11 @@ typedef struct lsquic_packet_in
         PI_DECRYPTED    = (1 << 0),
         PI_OWN_DATA     = (1 << 1),                /* We own pi_data */
         PI_CONN_ID      = (1 << 2),                /* pi_conn_id is set */
+        PI_APP_DATA     = (1 << 3),                /* pi_data was handed over
+                                                    * by the application: it
+                                                    * may be modified and is
+                                                    * released using pimi.
+                                                    */
 #define PIBIT_ENC_LEV_SHIFT 5
         PI_ENC_LEV_BIT_0= (1 << 5),                /* Encodes encryption level */
         PI_ENC_LEV_BIT_1= (1 << 6),                /*  (see enum enc_level). */
@@ -66,8 +71,8 @@ typedef struct lsquic_packet_in
         PI_BITS_BIT_1   = (1 << 9),
     }                               pi_flags:16;
     enum header_type                pi_header_type:8;
-    /* If PI_OWN_DATA flag is not set, `pi_data' points to user-supplied
-     * packet data, which is NOT TO BE MODIFIED.
+    /* If neither PI_OWN_DATA nor PI_APP_DATA flag is set, `pi_data' points
+     * to user-supplied packet data, which is NOT TO BE MODIFIED.
      */
     unsigned char                  *pi_data;
 } lsquic_packet_in_t;
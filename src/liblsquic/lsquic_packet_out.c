@@ -5,6 +5,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/queue.h>
@@ -27,6 +28,11 @@
 typedef char _stream_rec_arr_is_at_most_64bytes[
                                 (sizeof(struct stream_rec_arr) <= 64)? 1: - 1];
 
+/* Fields used when packets are acknowledged should fit into one cache line */
+typedef char _packet_out_hot_fields_fit_in_64bytes[
+    (offsetof(struct lsquic_packet_out, po_bwp_state)
+                            + sizeof(struct bwp_state *) <= 64)? 1: - 1];
+
 static struct stream_rec *
 srec_one_posi_first (struct packet_out_srec_iter *posi,
                      struct lsquic_packet_out *packet_out)
@@ -264,8 +270,10 @@ lsquic_packet_out_destroy (lsquic_packet_out_t *packet_out,
     if (packet_out->po_flags & PO_ENCRYPTED)
         enpub->enp_pmi->pmi_release(enpub->enp_pmi_ctx, peer_ctx,
                 packet_out->po_enc_data, lsquic_packet_out_ipv6(packet_out));
-    if (packet_out->po_nonce)
+    if (packet_out->po_flags & PO_NONCE)
         free(packet_out->po_nonce);
+    if (packet_out->po_bwp_state)
+        lsquic_malo_put(packet_out->po_bwp_state);
     lsquic_mm_put_packet_out(&enpub->enp_mm, packet_out);
 }
 
@@ -356,6 +364,12 @@ lsquic_packet_out_ack_streams (lsquic_packet_out_t *packet_out)
 {
     struct packet_out_srec_iter posi;
     struct stream_rec *srec;
+
+    /* Do not touch stream records unless there are any */
+    if (!(packet_out->po_frame_types
+                            & (QUIC_FTBIT_STREAM|QUIC_FTBIT_RST_STREAM)))
+        return;
+
     for (srec = posi_first(&posi, packet_out); srec; srec = posi_next(&posi))
         lsquic_stream_acked(srec->sr_stream);
 }
@@ -9,6 +9,7 @@
 #include <sys/queue.h>
 
 struct malo;
+struct bwp_state;
 struct lsquic_conn;
 struct lsquic_engine_public;
 struct lsquic_mm;
@@ -56,13 +57,19 @@ TAILQ_HEAD(stream_rec_arr_tailq, stream_rec_arr);
 
 typedef struct lsquic_packet_out
 {
+    /* Fields that are used when a packet is sent, acknowledged, or lost
+     * come first: on 64-bit platforms, they fit into a single cache line.
+     * Fields used only to generate, encrypt, or retransmit the packet come
+     * after.
+     */
+
     /* `po_next' is used for packets_out, unacked_packets and expired_packets
      * lists.
      */
     TAILQ_ENTRY(lsquic_packet_out)
                        po_next;
-    lsquic_time_t      po_sent;       /* Time sent */
     lsquic_packno_t    po_packno;
+    lsquic_time_t      po_sent;       /* Time sent */
 
     enum packet_out_flags {
         PO_HELLO    = (1 << 1),         /* Packet contains SHLO or CHLO data */
@@ -93,6 +100,9 @@ typedef struct lsquic_packet_out
                                          *   otherwise unset.
                                          */
         PO_LIMITED  = (1 <<21),         /* Used to credit sc_next_limit if needed. */
+        PO_TRAIN    = (1 <<22),         /* po_enc_data points into packet train
+                                         *   buffer owned by the engine.
+                                         */
     }                  po_flags;
     enum quic_ft_bit   po_frame_types:16; /* Bitmask of QUIC_FRAME_* */
     unsigned short     po_data_sz;      /* Number of usable bytes in data */
@@ -104,8 +114,15 @@ typedef struct lsquic_packet_out
                                          * frames.
                                          */
     unsigned short     po_n_alloc;      /* Total number of bytes allocated in po_data */
-    enum header_type   po_header_type:8;
     unsigned char     *po_data;
+    /* Delivery rate sampler state, set while the packet is in flight */
+    struct bwp_state  *po_bwp_state;
+
+    /* End of hot fields */
+
+    lsquic_time_t      po_txtime;     /* Earliest departure time set by
+                                       * the pacer; zero if not paced.
+                                       */
     lsquic_packno_t    po_ack2ed;       /* If packet has ACK frame, value of
                                          * largest acked in it.
                                          */
@@ -113,7 +130,8 @@ typedef struct lsquic_packet_out
     /* A lot of packets contain data belonging to only one stream.  Thus,
      * `one' is used first.  If this is not enough, any number of
      * stream_rec_arr structures can be allocated to handle more stream
-     * records.
+     * records.  Stream records are only present if the packet contains
+     * STREAM or RST_STREAM frames.
      */
     union {
         struct stream_rec               one;
@@ -125,8 +143,9 @@ typedef struct lsquic_packet_out
      */
     unsigned char     *po_enc_data;
 
-    lsquic_ver_tag_t   po_ver_tag;      /* Set if PO_VERSION is set */
     unsigned char     *po_nonce;        /* Use to generate header if PO_NONCE is set */
+    lsquic_ver_tag_t   po_ver_tag;      /* Set if PO_VERSION is set */
+    enum header_type   po_header_type:8;
 } lsquic_packet_out_t;
 
 /* The size of lsquic_packet_out_t could be further reduced:
@@ -135,6 +154,12 @@ typedef struct lsquic_packet_out
  * in po_flags.  The cost is a bit of complexity.  This will save us four bytes.
  */
 
+/* Packets are allocated in slots that are a multiple of cache line size.
+ * This way, the malo allocator aligns them on cache line boundary and the
+ * hot fields do not straddle two cache lines.
+ */
+#define PACKET_OUT_SLOT_SZ ((sizeof(struct lsquic_packet_out) + 63) & ~63)
+
 #define lsquic_packet_out_avail(p) ((unsigned short) \
                                         ((p)->po_n_alloc - (p)->po_data_sz))
 
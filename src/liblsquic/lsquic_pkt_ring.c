@@ -0,0 +1,190 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_pkt_ring.c -- Ring buffer allocator for outgoing packets.
+ *
+ * Each slot has a state byte.  Zero means that the slot is free.  The first
+ * slot of an allocation records the number of slots in it; the rest of the
+ * slots are marked as continuation slots.  Head and tail are free-running
+ * counters: the slots in [tail, head) are the ones that may be in use.
+ *
+ * An allocation never wraps around: if it does not fit before the end of
+ * the ring, the slots at the end are skipped.
+ *
+ * A slot that stays in use blocks the tail.  When the ring is full, free
+ * slots between tail and head are reused out of order.  This does not
+ * move head or tail: such slots are reclaimed with the rest once released.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fiu-local.h"
+#include "lsquic_int_types.h"
+#include "lsquic_util.h"
+#include "lsquic_pkt_ring.h"
+
+#define PRS_FREE 0
+#define PRS_CONT 0xFF
+
+/* State of the first slot records allocation size, thus allocations are
+ * limited to fewer than PRS_CONT slots.
+ */
+#define MAX_ALLOC_SLOTS(ring) ((ring)->pr_n_slots / 2 < PRS_CONT - 1 ? \
+                                (ring)->pr_n_slots / 2 : PRS_CONT - 1)
+
+
+void
+lsquic_pkt_ring_init (struct pkt_ring *ring, unsigned n_slots)
+{
+    memset(ring, 0, sizeof(*ring));
+    ring->pr_n_slots = 1;
+    while (ring->pr_n_slots < n_slots)
+        ring->pr_n_slots <<= 1;
+}
+
+
+void
+lsquic_pkt_ring_cleanup (struct pkt_ring *ring)
+{
+    if (ring->pr_buf && ring->pr_huge_pages)
+        lsquic_huge_free(ring->pr_buf,
+            (size_t) ring->pr_n_slots * PKT_RING_SLOT_SZ, ring->pr_mmapped);
+    else
+        free(ring->pr_buf);
+    free(ring->pr_state);
+    ring->pr_buf = NULL;
+    ring->pr_state = NULL;
+}
+
+
+static int
+allocate_ring (struct pkt_ring *ring)
+{
+    fiu_return_on("pkt_ring/allocate_ring", -1);
+
+    if (ring->pr_huge_pages)
+        ring->pr_buf = lsquic_huge_alloc(
+            (size_t) ring->pr_n_slots * PKT_RING_SLOT_SZ, &ring->pr_mmapped);
+    else
+        ring->pr_buf = malloc((size_t) ring->pr_n_slots * PKT_RING_SLOT_SZ);
+    ring->pr_state = calloc(ring->pr_n_slots, 1);
+    if (ring->pr_buf && ring->pr_state)
+        return 0;
+    lsquic_pkt_ring_cleanup(ring);
+    return -1;
+}
+
+
+void
+lsquic_pkt_ring_reclaim (struct pkt_ring *ring)
+{
+    while (ring->pr_tail != ring->pr_head
+            && PRS_FREE == ring->pr_state[
+                                ring->pr_tail & (ring->pr_n_slots - 1) ])
+        ++ring->pr_tail;
+}
+
+
+/* Find `n' contiguous free slots in [tail, head) and mark them used.
+ * Returns slot index or -1 if there is no such run.
+ */
+static int
+alloc_behind_tail (struct pkt_ring *ring, unsigned n)
+{
+    unsigned pos, idx, count;
+
+    count = 0;
+    for (pos = ring->pr_tail; pos != ring->pr_head; ++pos)
+    {
+        idx = pos & (ring->pr_n_slots - 1);
+        if (idx == 0)
+            count = 0;  /* Allocations do not wrap */
+        if (PRS_FREE == ring->pr_state[idx])
+        {
+            if (++count == n)
+            {
+                idx -= n - 1;
+                ring->pr_state[idx] = n;
+                memset(&ring->pr_state[idx + 1], PRS_CONT, n - 1);
+                return idx;
+            }
+        }
+        else
+        {
+            /* Skip over the rest of the allocation */
+            assert(PRS_CONT != ring->pr_state[idx]);
+            pos += ring->pr_state[idx] - 1;
+            count = 0;
+        }
+    }
+
+    return -1;
+}
+
+
+void *
+lsquic_pkt_ring_alloc (struct pkt_ring *ring, size_t size)
+{
+    unsigned n, idx, pad;
+    int hole;
+
+    n = (size + PKT_RING_SLOT_SZ - 1) / PKT_RING_SLOT_SZ;
+    if (n == 0)
+        n = 1;
+    if (n > MAX_ALLOC_SLOTS(ring))
+        goto fallback;
+    if (!ring->pr_buf && 0 != allocate_ring(ring))
+        goto fallback;
+
+    idx = ring->pr_head & (ring->pr_n_slots - 1);
+    if (idx + n > ring->pr_n_slots)
+        pad = ring->pr_n_slots - idx;
+    else
+        pad = 0;
+    if (lsquic_pkt_ring_n_used(ring) + pad + n > ring->pr_n_slots)
+    {
+        lsquic_pkt_ring_reclaim(ring);
+        if (lsquic_pkt_ring_n_used(ring) + pad + n > ring->pr_n_slots)
+        {
+            hole = alloc_behind_tail(ring, n);
+            if (hole < 0)
+                goto fallback;
+            ++ring->pr_n_reused;
+            return ring->pr_buf + (size_t) hole * PKT_RING_SLOT_SZ;
+        }
+    }
+
+    /* Skipped slots are free: they are reclaimed along with the rest */
+    ring->pr_head += pad;
+    idx = ring->pr_head & (ring->pr_n_slots - 1);
+    ring->pr_state[idx] = n;
+    memset(&ring->pr_state[idx + 1], PRS_CONT, n - 1);
+    ring->pr_head += n;
+    return ring->pr_buf + (size_t) idx * PKT_RING_SLOT_SZ;
+
+  fallback:
+    ++ring->pr_n_fallbacks;
+    return malloc(size);
+}
+
+
+void
+lsquic_pkt_ring_release (struct pkt_ring *ring, void *buf)
+{
+    uintptr_t off;
+    unsigned idx;
+
+    off = (uintptr_t) buf - (uintptr_t) ring->pr_buf;
+    if (ring->pr_buf && off < (uintptr_t) ring->pr_n_slots * PKT_RING_SLOT_SZ)
+    {
+        idx = off / PKT_RING_SLOT_SZ;
+        assert(off % PKT_RING_SLOT_SZ == 0);
+        assert(ring->pr_state[idx] != PRS_FREE
+                                    && ring->pr_state[idx] != PRS_CONT);
+        memset(&ring->pr_state[idx], PRS_FREE, ring->pr_state[idx]);
+    }
+    else
+        free(buf);
+}
@@ -0,0 +1,68 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_pkt_ring.h -- Ring buffer allocator for outgoing packets.
+ *
+ * This is the default packet out memory interface used by the engine.
+ * Buffers are carved out of a ring of fixed-size slots in the order they
+ * are allocated, so that consecutive packets are laid out contiguously.
+ * Buffers may be released in any order; slots are reclaimed once all
+ * older slots are free.  If the ring is full, the allocator looks for a run
+ * of free slots behind the oldest slot still in use -- for example, behind
+ * a packet that is held for a long time.  If there is none or the
+ * allocation is too large, the allocator falls back to malloc(3).
+ *
+ * The ring may be backed by huge pages, see lsquic_huge_alloc().
+ */
+
+#ifndef LSQUIC_PKT_RING_H
+#define LSQUIC_PKT_RING_H 1
+
+/* The slot fits the largest gQUIC packet.  Larger allocations -- packet
+ * trains -- span several contiguous slots.
+ */
+#define PKT_RING_SLOT_SZ 1376
+
+struct pkt_ring
+{
+    unsigned char      *pr_buf;     /* Allocated on first use */
+    unsigned char      *pr_state;   /* Per-slot state, see lsquic_pkt_ring.c */
+    unsigned            pr_n_slots; /* Power of two */
+    unsigned            pr_head;    /* Next slot to allocate */
+    unsigned            pr_tail;    /* Oldest slot that may be in use */
+    unsigned            pr_n_fallbacks; /* Number of malloc'ed buffers */
+    unsigned            pr_n_reused;    /* Allocated behind the tail */
+    /* If set, the ring is allocated using huge pages.  This must be set
+     * before the first allocation.
+     */
+    int                 pr_huge_pages;
+    int                 pr_mmapped;
+};
+
+/* `n_slots' is rounded up to the nearest power of two.  No memory is
+ * allocated until the first call to lsquic_pkt_ring_alloc().
+ */
+void
+lsquic_pkt_ring_init (struct pkt_ring *, unsigned n_slots);
+
+void
+lsquic_pkt_ring_cleanup (struct pkt_ring *);
+
+void *
+lsquic_pkt_ring_alloc (struct pkt_ring *, size_t size);
+
+/* Mark buffer as free.  The slots are not reused until
+ * lsquic_pkt_ring_reclaim() is called, which allocation does as needed.
+ */
+void
+lsquic_pkt_ring_release (struct pkt_ring *, void *buf);
+
+/* Advance tail over released slots.  Releasing many buffers and then
+ * reclaiming them at once is cheaper than doing it one by one.
+ */
+void
+lsquic_pkt_ring_reclaim (struct pkt_ring *);
+
+/* Number of slots in use, including released slots not yet reclaimed */
+#define lsquic_pkt_ring_n_used(ring) ((ring)->pr_head - (ring)->pr_tail)
+
+#endif
@@ -17,12 +17,23 @@
 #define ALPHA_SHIFT 3   /* Alpha is 1/8 */
 #define BETA_SHIFT  2   /* Beta is 1/4 */
 
+#define MIN_RTT_WINDOW  (10 * 1000000)  /* Ten seconds */
+
 
 void
-lsquic_rtt_stats_update (struct lsquic_rtt_stats *stats,
+lsquic_rtt_stats_update (struct lsquic_rtt_stats *stats, lsquic_time_t now,
                          lsquic_time_t send_delta, lsquic_time_t lack_delta)
 {
-    if (send_delta > lack_delta)
+    if (stats->min_rtt.window == 0)
+        minmax_init(&stats->min_rtt, MIN_RTT_WINDOW);
+    minmax_upmin(&stats->min_rtt, now, send_delta);
+    stats->latest_rtt = send_delta;
+
+    /* Peer's ACK delay is only subtracted if the result is not smaller
+     * than the minimum RTT: an inflated ACK delay value would otherwise
+     * make RTT appear too small and retransmission timers fire early.
+     */
+    if (send_delta >= lack_delta + lsquic_rtt_stats_get_min_rtt(stats))
         send_delta -= lack_delta;
     if (stats->srtt) {
         stats->rttvar -= stats->rttvar >> BETA_SHIFT;
@@ -6,21 +6,38 @@
 #ifndef LSQUIC_RTT_H
 #define LSQUIC_RTT_H 1
 
+#include "lsquic_minmax.h"
 
 /* This struct is initialized by setting it to zero */
 struct lsquic_rtt_stats {
     lsquic_time_t   srtt;
     lsquic_time_t   rttvar;
+    /* Latest RTT sample, not adjusted for ACK delay */
+    lsquic_time_t   latest_rtt;
+    /* Minimum RTT over a window of time.  ACK delay is not subtracted from
+     * samples fed to this filter: this way, the value is a lower bound.
+     */
+    struct minmax   min_rtt;
 };
 
 
 void
-lsquic_rtt_stats_update (struct lsquic_rtt_stats *, lsquic_time_t send_delta,
-                                                    lsquic_time_t lack_delta);
+lsquic_rtt_stats_update (struct lsquic_rtt_stats *, lsquic_time_t now,
+                         lsquic_time_t send_delta, lsquic_time_t lack_delta);
 
 
 #define lsquic_rtt_stats_get_srtt(stats) ((stats)->srtt)
 
 #define lsquic_rtt_stats_get_rttvar(stats) ((stats)->rttvar)
 
+#define lsquic_rtt_stats_get_latest_rtt(stats) ((stats)->latest_rtt)
+
+#define lsquic_rtt_stats_get_min_rtt(stats) minmax_get(&(stats)->min_rtt)
+
+/* The larger of smoothed and latest RTT.  When RTT goes up, srtt lags
+ * behind the latest sample; timers based on this value do not fire early.
+ */
+#define lsquic_rtt_stats_get_max_rtt(stats) \
+    ((stats)->srtt > (stats)->latest_rtt ? (stats)->srtt : (stats)->latest_rtt)
+
 #endif
@@ -21,7 +21,11 @@
 #include "lsquic_packet_out.h"
 #include "lsquic_senhist.h"
 #include "lsquic_rtt.h"
+#include "lsquic_cong_ctl.h"
 #include "lsquic_cubic.h"
+#include "lsquic_minmax.h"
+#include "lsquic_bw_sampler.h"
+#include "lsquic_bbr.h"
 #include "lsquic_pacer.h"
 #include "lsquic_send_ctl.h"
 #include "lsquic_util.h"
@@ -43,6 +47,8 @@
 #define DEFAULT_RETX_DELAY      500000      /* Microseconds */
 #define MAX_RTO_DELAY           60000000    /* Microseconds */
 #define MIN_RTO_DELAY           1000000      /* Microseconds */
+#define UNACKED_RING_MIN_SIZE   64
+#define UNACKED_RING_MAX_SIZE   (1U << 16)
 #define N_NACKS_BEFORE_RETX     3
 
 #define packet_out_total_sz(p) \
@@ -50,6 +56,27 @@
 #define packet_out_sent_sz(p) \
                 lsquic_packet_out_sent_sz(ctl->sc_conn_pub->lconn, p)
 
+/* Argument passed to congestion controller functions */
+#define CGP(ctl) ((void *) &(ctl)->sc_cong_u)
+
+/* In RACK mode, the reordering window grows up to this many quarters of
+ * min RTT.  It shrinks back after this many loss events without spurious
+ * losses.
+ */
+#define REO_WND_MAX_MULT    4
+#define REO_WND_PERSIST     16
+
+/* Buffered packets count against connection's memory budget */
+#define bpq_incr(ctl, q) do {                                               \
+    ++(q)->bpq_count;                                                       \
+    (ctl)->sc_conn_pub->mem_used += (ctl)->sc_pack_size;                    \
+} while (0)
+
+#define bpq_decr(ctl, q) do {                                               \
+    --(q)->bpq_count;                                                       \
+    (ctl)->sc_conn_pub->mem_used -= (ctl)->sc_pack_size;                    \
+} while (0)
+
 enum retx_mode {
     RETX_MODE_HANDSHAKE,
     RETX_MODE_LOSS,
@@ -79,6 +106,9 @@ send_ctl_expire (lsquic_send_ctl_t *, enum expire_filter);
 static void
 set_retx_alarm (lsquic_send_ctl_t *ctl);
 
+static void
+send_ctl_destroy_packet (struct lsquic_send_ctl *, struct lsquic_packet_out *);
+
 static void
 send_ctl_detect_losses (lsquic_send_ctl_t *ctl, lsquic_time_t time);
 
@@ -173,12 +203,12 @@ get_retx_mode (lsquic_send_ctl_t *ctl)
 static lsquic_time_t
 get_retx_delay (const struct lsquic_rtt_stats *rtt_stats)
 {
-    lsquic_time_t srtt, delay;
+    lsquic_time_t rtt, delay;
 
-    srtt = lsquic_rtt_stats_get_srtt(rtt_stats);
-    if (srtt)
+    rtt = lsquic_rtt_stats_get_max_rtt(rtt_stats);
+    if (rtt)
     {
-        delay = srtt + 4 * lsquic_rtt_stats_get_rttvar(rtt_stats);
+        delay = rtt + 4 * lsquic_rtt_stats_get_rttvar(rtt_stats);
         if (delay < MIN_RTO_DELAY)
             delay = MIN_RTO_DELAY;
     }
@@ -220,7 +250,7 @@ retx_alarm_rings (void *ctx, lsquic_time_t expiry, lsquic_time_t now)
         ctl->sc_next_limit = 2;
         LSQ_DEBUG("packet RTO is %"PRIu64" usec", expiry);
         send_ctl_expire(ctl, EXFI_ALL);
-        lsquic_cubic_timeout(&ctl->sc_cubic);
+        ctl->sc_ci->cci_timeout(CGP(ctl));
         break;
     }
 
@@ -248,12 +278,29 @@ lsquic_send_ctl_init (lsquic_send_ctl_t *ctl, struct lsquic_alarmset *alset,
     ctl->sc_conn_pub = conn_pub;
     if (enpub->enp_settings.es_pace_packets)
         ctl->sc_flags |= SC_PACE;
+    if (enpub->enp_settings.es_rack)
+        ctl->sc_flags |= SC_RACK;
+    ctl->sc_reo_wnd_mult = 1;
     lsquic_alarmset_init_alarm(alset, AL_RETX, retx_alarm_rings, ctl);
     lsquic_senhist_init(&ctl->sc_senhist);
-    lsquic_cubic_init(&ctl->sc_cubic, LSQUIC_LOG_CONN_ID);
+    switch (enpub->enp_settings.es_cc_algo)
+    {
+    case 2:
+        ctl->sc_ci = &lsquic_cong_bbr_if;
+        break;
+    case 1:
+    default:
+        ctl->sc_ci = &lsquic_cong_cubic_if;
+        break;
+    }
+    if (0 != lsquic_bw_sampler_init(&ctl->sc_bw_sampler,
+                    enpub->enp_mm.malo.bwp_state, conn_pub->lconn->cn_cid))
+        LSQ_WARN("bandwidth sampler is not available");
+    ctl->sc_ci->cci_init(CGP(ctl), conn_pub, &ctl->sc_bw_sampler);
     if (ctl->sc_flags & SC_PACE)
         pacer_init(&ctl->sc_pacer, LSQUIC_LOG_CONN_ID,
-                                    enpub->enp_settings.es_clock_granularity);
+                                    enpub->enp_settings.es_clock_granularity,
+                                    enpub->enp_settings.es_pace_horizon);
     for (i = 0; i < sizeof(ctl->sc_buffered_packets) /
                                 sizeof(ctl->sc_buffered_packets[0]); ++i)
         TAILQ_INIT(&ctl->sc_buffered_packets[i].bpq_packets);
@@ -281,20 +328,20 @@ calculate_packet_rto (lsquic_send_ctl_t *ctl)
 static lsquic_time_t
 calculate_tlp_delay (lsquic_send_ctl_t *ctl)
 {
-    lsquic_time_t srtt, delay;
+    lsquic_time_t rtt, delay;
 
-    srtt = lsquic_rtt_stats_get_srtt(&ctl->sc_conn_pub->rtt_stats);
+    rtt = lsquic_rtt_stats_get_max_rtt(&ctl->sc_conn_pub->rtt_stats);
     if (ctl->sc_n_in_flight_all > 1)
     {
         delay = 10000;  /* 10 ms is the minimum tail loss probe delay */
-        if (delay < 2 * srtt)
-            delay = 2 * srtt;
+        if (delay < 2 * rtt)
+            delay = 2 * rtt;
     }
     else
     {
-        delay = srtt + srtt / 2 + MIN_RTO_DELAY;
-        if (delay < 2 * srtt)
-            delay = 2 * srtt;
+        delay = rtt + rtt / 2 + MIN_RTO_DELAY;
+        if (delay < 2 * rtt)
+            delay = 2 * rtt;
     }
 
     return delay;
@@ -368,38 +415,90 @@ send_ctl_in_recovery (lsquic_send_ctl_t *ctl)
 }
 
 
+#define unacked_ring_size(ctl) \
+    ((ctl)->sc_unacked_ring ? (ctl)->sc_unacked_ring_mask + 1 : 0)
+
+
 static int
-send_ctl_in_slow_start (lsquic_send_ctl_t *ctl)
+send_ctl_grow_unacked_ring (struct lsquic_send_ctl *ctl, lsquic_packno_t span)
 {
-    return lsquic_cubic_in_slow_start(&ctl->sc_cubic);
+    struct lsquic_packet_out **ring, *packet_out;
+    unsigned size;
+
+    if (span > UNACKED_RING_MAX_SIZE)
+    {
+        LSQ_INFO("range of unacked packet numbers is too large to index: "
+                                                            "%"PRIu64, span);
+        return -1;
+    }
+
+    size = ctl->sc_unacked_ring ? unacked_ring_size(ctl) * 2
+                                                    : UNACKED_RING_MIN_SIZE;
+    while (size < span)
+        size *= 2;
+
+    ring = calloc(size, sizeof(ring[0]));
+    if (!ring)
+    {
+        LSQ_WARN("cannot allocate unacked ring of %u elements", size);
+        return -1;
+    }
+
+    TAILQ_FOREACH(packet_out, &ctl->sc_unacked_packets, po_next)
+        ring[ packet_out->po_packno & (size - 1) ] = packet_out;
+    free(ctl->sc_unacked_ring);
+    ctl->sc_unacked_ring = ring;
+    ctl->sc_unacked_ring_mask = size - 1;
+    LSQ_DEBUG("unacked ring size is now %u", size);
+    return 0;
 }
 
 
-static lsquic_time_t
-send_ctl_transfer_time (void *ctx)
-{
-    lsquic_send_ctl_t *const ctl = ctx;
-    uint64_t bandwidth, pacing_rate;
-    lsquic_time_t srtt, tx_time;
-    unsigned long cwnd;
-
-    srtt = lsquic_rtt_stats_get_srtt(&ctl->sc_conn_pub->rtt_stats);
-    if (srtt == 0)
-        srtt = 50000;
-    cwnd = lsquic_cubic_get_cwnd(&ctl->sc_cubic);
-    bandwidth = cwnd * 1000000 / srtt;
-    if (send_ctl_in_slow_start(ctl))
-        pacing_rate = bandwidth * 2;
-    else if (send_ctl_in_recovery(ctl))
-        pacing_rate = bandwidth;
-    else
-        pacing_rate = bandwidth + bandwidth / 4;
+/* Make sure that the unacked ring can hold packet `packno' once it is sent.
+ * This is done before the packet is handed out for sending, so that
+ * recording it as sent cannot fail.
+ *
+ * Packets are sent in the order of their packet numbers.  Thus, packets
+ * handed out but not yet sent have numbers larger than the largest sent
+ * packet number, and the smallest number the ring has to cover can only
+ * grow by the time the packet is sent.
+ *
+ * If the ring cannot cover the range -- it would be too large or it cannot
+ * be allocated -- the ring is dropped and ACK processing walks the unacked
+ * queue instead.  The ring is rebuilt once the range has shrunk to half of
+ * the maximum ring size.
+ */
+static void
+send_ctl_reserve_unacked (struct lsquic_send_ctl *ctl, lsquic_packno_t packno)
+{
+    lsquic_packno_t low, span;
 
-    tx_time = (uint64_t) ctl->sc_pack_size * 1000000 / pacing_rate;
-    LSQ_DEBUG("srtt: %"PRIu64"; ss: %d; rec: %d; cwnd: %lu; bandwidth: "
-        "%"PRIu64"; tx_time: %"PRIu64, srtt, send_ctl_in_slow_start(ctl),
-        send_ctl_in_recovery(ctl), cwnd, bandwidth, tx_time);
-    return tx_time;
+    if (TAILQ_EMPTY(&ctl->sc_unacked_packets))
+        low = lsquic_senhist_largest(&ctl->sc_senhist) + 1;
+    else
+        low = TAILQ_FIRST(&ctl->sc_unacked_packets)->po_packno;
+    if (low > packno)
+        low = packno;
+    span = packno - low + 1;
+    if (span <= unacked_ring_size(ctl))
+        return;
+    if ((ctl->sc_flags & SC_UNACKED_LIST) && span > UNACKED_RING_MAX_SIZE / 2)
+        return;
+    if (0 == send_ctl_grow_unacked_ring(ctl, span))
+    {
+        if (ctl->sc_flags & SC_UNACKED_LIST)
+        {
+            LSQ_DEBUG("index unacked packets again");
+            ctl->sc_flags &= ~SC_UNACKED_LIST;
+        }
+    }
+    else if (!(ctl->sc_flags & SC_UNACKED_LIST))
+    {
+        LSQ_INFO("stop indexing unacked packets");
+        free(ctl->sc_unacked_ring);
+        ctl->sc_unacked_ring = NULL;
+        ctl->sc_flags |= SC_UNACKED_LIST;
+    }
 }
 
 
@@ -407,6 +506,23 @@ static void
 send_ctl_unacked_append (struct lsquic_send_ctl *ctl,
                          struct lsquic_packet_out *packet_out)
 {
+    /* Packets are sent in the order of their packet numbers, which keeps
+     * the unacked queue sorted.
+     */
+    assert(TAILQ_EMPTY(&ctl->sc_unacked_packets) || packet_out->po_packno >
+        TAILQ_LAST(&ctl->sc_unacked_packets, lsquic_packets_tailq)->po_packno);
+    if (ctl->sc_unacked_ring)
+    {
+        assert(packet_out->po_packno - (TAILQ_EMPTY(&ctl->sc_unacked_packets)
+            ? packet_out->po_packno
+            : TAILQ_FIRST(&ctl->sc_unacked_packets)->po_packno)
+                                                < unacked_ring_size(ctl));
+        assert(!ctl->sc_unacked_ring[
+                        packet_out->po_packno & ctl->sc_unacked_ring_mask]);
+        ctl->sc_unacked_ring[
+                packet_out->po_packno & ctl->sc_unacked_ring_mask ] = packet_out;
+    }
+
     TAILQ_INSERT_TAIL(&ctl->sc_unacked_packets, packet_out, po_next);
     ctl->sc_bytes_unacked_all += packet_out_total_sz(packet_out);
     ctl->sc_n_in_flight_all  += 1;
@@ -422,6 +538,13 @@ static void
 send_ctl_unacked_remove (struct lsquic_send_ctl *ctl,
                      struct lsquic_packet_out *packet_out, unsigned packet_sz)
 {
+    if (ctl->sc_unacked_ring)
+    {
+        assert(ctl->sc_unacked_ring[ packet_out->po_packno
+                                & ctl->sc_unacked_ring_mask] == packet_out);
+        ctl->sc_unacked_ring[
+                    packet_out->po_packno & ctl->sc_unacked_ring_mask ] = NULL;
+    }
     TAILQ_REMOVE(&ctl->sc_unacked_packets, packet_out, po_next);
     assert(ctl->sc_bytes_unacked_all >= packet_sz);
     ctl->sc_bytes_unacked_all -= packet_sz;
@@ -481,13 +604,25 @@ lsquic_send_ctl_sent_packet (lsquic_send_ctl_t *ctl,
                              struct lsquic_packet_out *packet_out, int account)
 {
     char frames[lsquic_frame_types_str_sz];
+    uint64_t in_flight;
+
     LSQ_DEBUG("packet %"PRIu64" has been sent (frame types: %s)",
         packet_out->po_packno, lsquic_frame_types_to_str(frames,
             sizeof(frames), packet_out->po_frame_types));
     if (account)
         ctl->sc_bytes_out -= packet_out_total_sz(packet_out);
     lsquic_senhist_add(&ctl->sc_senhist, packet_out->po_packno);
+    in_flight = ctl->sc_bytes_unacked_all;
     send_ctl_unacked_append(ctl, packet_out);
+    ctl->sc_ci->cci_sent(CGP(ctl), packet_out, packet_out_total_sz(packet_out),
+                                                                in_flight);
+    if (ctl->sc_flags & SC_APP_LIMITED)
+    {
+        ctl->sc_flags &= ~SC_APP_LIMITED;
+        lsquic_bw_sampler_app_limited(&ctl->sc_bw_sampler);
+    }
+    lsquic_bw_sampler_packet_sent(&ctl->sc_bw_sampler, packet_out,
+                                packet_out_total_sz(packet_out), in_flight);
     if (packet_out->po_frame_types & QFRAME_RETRANSMITTABLE_MASK)
     {
         if (!lsquic_alarmset_is_set(ctl->sc_alset, AL_RETX))
@@ -514,13 +649,20 @@ take_rtt_sample (lsquic_send_ctl_t *ctl,
     const lsquic_packno_t packno = ctl->sc_largest_acked_packno;
     const lsquic_time_t sent = ctl->sc_largest_acked_sent_time;
     const lsquic_time_t measured_rtt = now - sent;
-    if (packno > ctl->sc_max_rtt_packno && lack_delta < measured_rtt)
+    /* Receive time may come from a different clock, such as a kernel
+     * timestamp: guard against it preceding the send time.
+     */
+    if (packno > ctl->sc_max_rtt_packno && now > sent
+                                            && lack_delta < measured_rtt)
     {
         ctl->sc_max_rtt_packno = packno;
-        lsquic_rtt_stats_update(&ctl->sc_conn_pub->rtt_stats, measured_rtt, lack_delta);
+        lsquic_rtt_stats_update(&ctl->sc_conn_pub->rtt_stats, now,
+                                                    measured_rtt, lack_delta);
         LSQ_DEBUG("packno %"PRIu64"; rtt: %"PRIu64"; delta: %"PRIu64"; "
-            "new srtt: %"PRIu64, packno, measured_rtt, lack_delta,
-            lsquic_rtt_stats_get_srtt(&ctl->sc_conn_pub->rtt_stats));
+            "new srtt: %"PRIu64"; min rtt: %"PRIu64, packno, measured_rtt,
+            lack_delta,
+            lsquic_rtt_stats_get_srtt(&ctl->sc_conn_pub->rtt_stats),
+            lsquic_rtt_stats_get_min_rtt(&ctl->sc_conn_pub->rtt_stats));
     }
 }
 
@@ -546,6 +688,61 @@ send_ctl_destroy_packet (struct lsquic_send_ctl *ctl,
 }
 
 
+static void
+send_ctl_record_lost (struct lsquic_send_ctl *ctl, lsquic_packno_t packno)
+{
+    struct lost_rec *rec;
+
+    rec = &ctl->sc_lost_recs[ ctl->sc_lost_recs_idx++ % SC_N_LOST_RECS ];
+    rec->lr_packno = packno;
+    rec->lr_resched_packno = 0;
+    rec->lr_data_sz = 0;
+    /* Packets lost by loss detection are tagged with the loss event after
+     * it is determined.  Packets retransmitted on timeout are not.
+     */
+    rec->lr_event  = 0;
+}
+
+
+/* Remember which scheduled packet carries the contents of lost packet
+ * `packno', so that it can be dropped if the loss turns out to be spurious.
+ */
+static void
+send_ctl_record_resched (struct lsquic_send_ctl *ctl, lsquic_packno_t packno,
+                                const struct lsquic_packet_out *packet_out)
+{
+    struct lost_rec *rec;
+    unsigned n;
+
+    /* Most recently lost packets are the likeliest to be rescheduled */
+    for (n = 1; n <= SC_N_LOST_RECS; ++n)
+    {
+        rec = &ctl->sc_lost_recs[ (ctl->sc_lost_recs_idx - n)
+                                                        % SC_N_LOST_RECS ];
+        if (rec->lr_packno == packno)
+        {
+            rec->lr_resched_packno = packet_out->po_packno;
+            rec->lr_data_sz = packet_out->po_data_sz;
+            return;
+        }
+    }
+}
+
+
+/* Once scheduled packets are renumbered or dropped, the recorded packet
+ * numbers no longer identify them.
+ */
+static void
+send_ctl_forget_resched (struct lsquic_send_ctl *ctl)
+{
+    struct lost_rec *rec;
+
+    for (rec = ctl->sc_lost_recs;
+                        rec < ctl->sc_lost_recs + SC_N_LOST_RECS; ++rec)
+        rec->lr_resched_packno = 0;
+}
+
+
 /* Returns true if packet was rescheduled, false otherwise.  In the latter
  * case, you should not dereference packet_out after the function returns.
  */
@@ -558,6 +755,8 @@ send_ctl_handle_lost_packet (lsquic_send_ctl_t *ctl,
     assert(ctl->sc_n_in_flight_all);
     packet_sz = packet_out_sent_sz(packet_out);
     send_ctl_unacked_remove(ctl, packet_out, packet_sz);
+    lsquic_bw_sampler_packet_lost(&ctl->sc_bw_sampler, packet_out);
+    ctl->sc_ci->cci_lost(CGP(ctl), packet_out, packet_sz);
     if (packet_out->po_flags & PO_ENCRYPTED)
         send_ctl_release_enc_data(ctl, packet_out);
     if (packet_out->po_frame_types & (1 << QUIC_FRAME_ACK))
@@ -569,6 +768,7 @@ send_ctl_handle_lost_packet (lsquic_send_ctl_t *ctl,
     {
         LSQ_DEBUG("lost retransmittable packet %"PRIu64,
                                                     packet_out->po_packno);
+        send_ctl_record_lost(ctl, packet_out->po_packno);
         TAILQ_INSERT_TAIL(&ctl->sc_lost_packets, packet_out, po_next);
         return 1;
     }
@@ -596,15 +796,53 @@ largest_retx_packet_number (const lsquic_send_ctl_t *ctl)
 }
 
 
+static lsquic_time_t
+send_ctl_reo_wnd (const struct lsquic_send_ctl *ctl)
+{
+    const struct lsquic_rtt_stats *const rtt_stats =
+                                            &ctl->sc_conn_pub->rtt_stats;
+    lsquic_time_t reo_wnd;
+
+    reo_wnd = ctl->sc_reo_wnd_mult
+                            * lsquic_rtt_stats_get_min_rtt(rtt_stats) / 4;
+    if (reo_wnd > lsquic_rtt_stats_get_srtt(rtt_stats))
+        reo_wnd = lsquic_rtt_stats_get_srtt(rtt_stats);
+    return reo_wnd;
+}
+
+
+/* Tag the last `count' lost packet records with the current loss event */
+static void
+send_ctl_tag_lost (struct lsquic_send_ctl *ctl, unsigned count)
+{
+    unsigned n;
+
+    ctl->sc_n_event_lost += count;
+    if (count > SC_N_LOST_RECS)
+        count = SC_N_LOST_RECS;
+    for (n = 1; n <= count; ++n)
+        ctl->sc_lost_recs[ (ctl->sc_lost_recs_idx - n) % SC_N_LOST_RECS ]
+                                            .lr_event = ctl->sc_loss_event;
+}
+
+
 static void
 send_ctl_detect_losses (lsquic_send_ctl_t *ctl, lsquic_time_t time)
 {
     lsquic_packet_out_t *packet_out, *next;
     lsquic_packno_t largest_retx_packno, largest_lost_packno;
+    lsquic_time_t loss_delay;
+    unsigned lost_recs_idx;
 
     largest_retx_packno = largest_retx_packet_number(ctl);
     largest_lost_packno = 0;
     ctl->sc_loss_to = 0;
+    lost_recs_idx = ctl->sc_lost_recs_idx;
+    if (ctl->sc_flags & SC_RACK)
+        loss_delay = send_ctl_reo_wnd(ctl)
+                + lsquic_rtt_stats_get_max_rtt(&ctl->sc_conn_pub->rtt_stats);
+    else
+        loss_delay = 0;
 
     for (packet_out = TAILQ_FIRST(&ctl->sc_unacked_packets);
             packet_out && packet_out->po_packno <= ctl->sc_largest_acked_packno;
@@ -612,6 +850,29 @@ send_ctl_detect_losses (lsquic_send_ctl_t *ctl, lsquic_time_t time)
     {
         next = TAILQ_NEXT(packet_out, po_next);
 
+        if (ctl->sc_flags & SC_RACK)
+        {
+            /* A packet is lost if a packet sent after it has been acked
+             * and enough time has passed to rule out reordering.
+             */
+            if (packet_out->po_sent + loss_delay > time)
+            {
+                /* Packets are in the order they were sent: the rest of them
+                 * cannot be declared lost yet either.
+                 */
+                ctl->sc_loss_to = packet_out->po_sent + loss_delay - time;
+                LSQ_DEBUG("set sc_loss_to to %"PRIu64", packet %"PRIu64,
+                                    ctl->sc_loss_to, packet_out->po_packno);
+                break;
+            }
+            LSQ_DEBUG("loss by RACK detected, packet %"PRIu64,
+                                                    packet_out->po_packno);
+            if (packet_out->po_frame_types & QFRAME_RETRANSMITTABLE_MASK)
+                largest_lost_packno = packet_out->po_packno;
+            (void) send_ctl_handle_lost_packet(ctl, packet_out);
+            continue;
+        }
+
         if (packet_out->po_packno + N_NACKS_BEFORE_RETX <
                                                 ctl->sc_largest_acked_packno)
         {
@@ -630,7 +891,7 @@ send_ctl_detect_losses (lsquic_send_ctl_t *ctl, lsquic_time_t time)
                                                     packet_out->po_packno);
             largest_lost_packno = packet_out->po_packno;
             ctl->sc_loss_to =
-                lsquic_rtt_stats_get_srtt(&ctl->sc_conn_pub->rtt_stats) / 4;
+                lsquic_rtt_stats_get_max_rtt(&ctl->sc_conn_pub->rtt_stats) / 4;
             LSQ_DEBUG("set sc_loss_to to %"PRIu64", packet %"PRIu64,
                                     ctl->sc_loss_to, packet_out->po_packno);
             (void) send_ctl_handle_lost_packet(ctl, packet_out);
@@ -638,7 +899,7 @@ send_ctl_detect_losses (lsquic_send_ctl_t *ctl, lsquic_time_t time)
         }
 
         if (ctl->sc_largest_acked_sent_time > packet_out->po_sent +
-                    lsquic_rtt_stats_get_srtt(&ctl->sc_conn_pub->rtt_stats))
+                    lsquic_rtt_stats_get_max_rtt(&ctl->sc_conn_pub->rtt_stats))
         {
             LSQ_DEBUG("loss by sent time detected: packet %"PRIu64,
                                                     packet_out->po_packno);
@@ -654,11 +915,20 @@ send_ctl_detect_losses (lsquic_send_ctl_t *ctl, lsquic_time_t time)
     {
         LSQ_DEBUG("detected new loss: packet %"PRIu64"; new lsac: "
             "%"PRIu64, largest_lost_packno, ctl->sc_largest_sent_at_cutback);
-        lsquic_cubic_loss(&ctl->sc_cubic);
+        ctl->sc_ci->cci_loss(CGP(ctl));
         if (ctl->sc_flags & SC_PACE)
             pacer_loss_event(&ctl->sc_pacer);
+        ctl->sc_lsac_before_event = ctl->sc_largest_sent_at_cutback;
         ctl->sc_largest_sent_at_cutback =
                                 lsquic_senhist_largest(&ctl->sc_senhist);
+        ++ctl->sc_loss_event;
+        ctl->sc_n_event_lost = 0;
+        ctl->sc_n_event_spurious = 0;
+        if (ctl->sc_reo_wnd_persist && 0 == --ctl->sc_reo_wnd_persist)
+        {
+            ctl->sc_reo_wnd_mult = 1;
+            LSQ_DEBUG("no spurious losses lately: reset reordering window");
+        }
     }
     else if (largest_lost_packno)
         /* Lost packets whose numbers are smaller than the largest packet
@@ -667,6 +937,149 @@ send_ctl_detect_losses (lsquic_send_ctl_t *ctl, lsquic_time_t time)
          */
         LSQ_DEBUG("ignore loss of packet %"PRIu64" smaller than lsac "
             "%"PRIu64, largest_lost_packno, ctl->sc_largest_sent_at_cutback);
+
+    if (ctl->sc_lost_recs_idx != lost_recs_idx)
+        send_ctl_tag_lost(ctl, ctl->sc_lost_recs_idx - lost_recs_idx);
+}
+
+
+static int
+in_acked_range (const struct ack_info *acki, lsquic_packno_t packno)
+{
+    unsigned n;
+
+    for (n = 0; n < acki->n_ranges; ++n)
+        if (packno >= acki->ranges[n].low)
+            return packno <= acki->ranges[n].high;
+    return 0;
+}
+
+
+/* An acked packet that has not been retransmitted yet is dropped from the
+ * lost queue or, if it has already been rescheduled, from the scheduled
+ * queue.  A rescheduled copy is left alone if it has been renumbered,
+ * modified, or taken off the scheduled queue to be sent: then it is too
+ * late and the packet is retransmitted anyway.
+ *
+ * Returns true if a packet was dropped from the scheduled queue: the caller
+ * must then renumber scheduled packets to close the gap.
+ */
+static int
+send_ctl_drop_lost (struct lsquic_send_ctl *ctl, struct lost_rec *rec)
+{
+    struct lsquic_packet_out *packet_out;
+
+    TAILQ_FOREACH(packet_out, &ctl->sc_lost_packets, po_next)
+        if (packet_out->po_packno == rec->lr_packno)
+        {
+            LSQ_DEBUG("drop acked packet %"PRIu64" from lost queue",
+                                                            rec->lr_packno);
+            TAILQ_REMOVE(&ctl->sc_lost_packets, packet_out, po_next);
+            lsquic_packet_out_ack_streams(packet_out);
+            send_ctl_destroy_packet(ctl, packet_out);
+            return 0;
+        }
+
+    if (!rec->lr_resched_packno)
+        return 0;
+
+    TAILQ_FOREACH(packet_out, &ctl->sc_scheduled_packets, po_next)
+        if (packet_out->po_packno == rec->lr_resched_packno)
+        {
+            if ((packet_out->po_flags & PO_REPACKNO)
+                                || packet_out->po_data_sz != rec->lr_data_sz)
+                break;
+            LSQ_DEBUG("drop acked packet %"PRIu64" rescheduled as packet "
+                "%"PRIu64" from scheduled queue", rec->lr_packno,
+                rec->lr_resched_packno);
+            send_ctl_sched_remove(ctl, packet_out);
+            lsquic_packet_out_ack_streams(packet_out);
+            send_ctl_destroy_packet(ctl, packet_out);
+            rec->lr_resched_packno = 0;
+            return 1;
+        }
+
+    rec->lr_resched_packno = 0;
+    return 0;
+}
+
+
+/* Look for packets that were declared lost but which peer acked anyway.
+ * Each such spurious loss widens the reordering window.  If all packets
+ * lost in the current loss event were spurious, the loss event is undone.
+ */
+static void
+send_ctl_detect_spurious_losses (struct lsquic_send_ctl *ctl,
+                                                const struct ack_info *acki)
+{
+    struct lost_rec *rec;
+    unsigned dropped = 0;
+
+    for (rec = ctl->sc_lost_recs;
+                        rec < ctl->sc_lost_recs + SC_N_LOST_RECS; ++rec)
+    {
+        if (!(rec->lr_packno && in_acked_range(acki, rec->lr_packno)))
+            continue;
+        LSQ_DEBUG("packet %"PRIu64" was declared lost but has been acked",
+                                                            rec->lr_packno);
+        ++ctl->sc_n_spurious_losses;
+        dropped += send_ctl_drop_lost(ctl, rec);
+        if (ctl->sc_reo_wnd_mult < REO_WND_MAX_MULT)
+        {
+            ++ctl->sc_reo_wnd_mult;
+            LSQ_DEBUG("reordering window is now %u/4 of min RTT",
+                                                    ctl->sc_reo_wnd_mult);
+        }
+        ctl->sc_reo_wnd_persist = REO_WND_PERSIST;
+        if (rec->lr_event && rec->lr_event == ctl->sc_loss_event
+                    && ++ctl->sc_n_event_spurious == ctl->sc_n_event_lost)
+        {
+            LSQ_INFO("all %u packets lost in the last loss event have been "
+                "acked: undo", ctl->sc_n_event_lost);
+            ctl->sc_ci->cci_undo(CGP(ctl));
+            ctl->sc_largest_sent_at_cutback = ctl->sc_lsac_before_event;
+            /* Make sure the loss event is not undone again */
+            ++ctl->sc_loss_event;
+        }
+        rec->lr_packno = 0;
+    }
+
+    if (dropped)
+        lsquic_send_ctl_reset_packnos(ctl);
+}
+
+
+/* Remove acked packet from the unacked queue, report it to the congestion
+ * controller, and destroy it.
+ */
+static void
+send_ctl_packet_acked (struct lsquic_send_ctl *ctl,
+                struct lsquic_packet_out *packet_out,
+                lsquic_time_t ack_recv_time, lsquic_time_t *now,
+                int *app_limited)
+{
+    struct bw_sample bw_sample;
+    const struct bw_sample *sample;
+    unsigned packet_sz;
+
+    if (*app_limited < 0)
+    {
+        *app_limited = send_ctl_retx_bytes_out(ctl) + 3 * ctl->sc_pack_size /* This
+            is the "maximum burst" parameter */
+            < ctl->sc_ci->cci_get_cwnd(CGP(ctl));
+        if (!*now)
+            *now = lsquic_time_now();
+    }
+    packet_sz = packet_out_sent_sz(packet_out);
+    ctl->sc_largest_acked_packno    = packet_out->po_packno;
+    ctl->sc_largest_acked_sent_time = packet_out->po_sent;
+    send_ctl_unacked_remove(ctl, packet_out, packet_sz);
+    sample = 0 == lsquic_bw_sampler_packet_acked(&ctl->sc_bw_sampler,
+                    packet_out, ack_recv_time, &bw_sample) ? &bw_sample : NULL;
+    ctl->sc_ci->cci_ack(CGP(ctl), packet_out, packet_sz, *now, *app_limited,
+                                                                    sample);
+    lsquic_packet_out_ack_streams(packet_out);
+    send_ctl_destroy_packet(ctl, packet_out);
 }
 
 
@@ -679,16 +1092,12 @@ lsquic_send_ctl_got_ack (lsquic_send_ctl_t *ctl,
                                     &acki->ranges[ acki->n_ranges - 1 ];
     lsquic_packet_out_t *packet_out, *next;
     lsquic_time_t now = 0;
-    lsquic_packno_t smallest_unacked;
-    lsquic_packno_t ack2ed[2];
-    unsigned packet_sz;
+    lsquic_packno_t smallest_unacked, largest_unacked, packno, high;
+    lsquic_packno_t ack2ed;
     int app_limited;
-    signed char do_rtt, skip_checks;
+    signed char do_rtt;
 
     packet_out = TAILQ_FIRST(&ctl->sc_unacked_packets);
-#if __GNUC__
-    __builtin_prefetch(packet_out);
-#endif
 
 #if __GNUC__
 #   define UNLIKELY(cond) __builtin_expect(cond, 0)
@@ -717,58 +1126,87 @@ lsquic_send_ctl_got_ack (lsquic_send_ctl_t *ctl,
         LSQ_DEBUG("ACK comes after a period of quiescence");
         if (!now)
             now = lsquic_time_now();
-        lsquic_cubic_was_quiet(&ctl->sc_cubic, now);
+        ctl->sc_ci->cci_was_quiet(CGP(ctl), now);
     }
 
+    /* Packets declared lost are no longer on the unacked list, so this
+     * check is done whether or not there are unacked packets.
+     */
+    if (ctl->sc_lost_recs_idx)
+        send_ctl_detect_spurious_losses(ctl, acki);
+
     if (UNLIKELY(!packet_out))
         goto no_unacked_packets;
 
     smallest_unacked = packet_out->po_packno;
-    ack2ed[1] = 0;
+    largest_unacked = TAILQ_LAST(&ctl->sc_unacked_packets,
+                                            lsquic_packets_tailq)->po_packno;
+    ack2ed = 0;
+
+    ctl->sc_ci->cci_begin_ack(CGP(ctl), ack_recv_time,
+                                                    ctl->sc_bytes_unacked_all);
 
-    if (packet_out->po_packno > largest_acked(acki))
+    if (smallest_unacked > largest_acked(acki))
         goto detect_losses;
 
-    do_rtt = 0, skip_checks = 0;
+    do_rtt = 0;
     app_limited = -1;
-    do
+    if (ctl->sc_unacked_ring)
     {
-        next = TAILQ_NEXT(packet_out, po_next);
+        /* Go over ACK ranges from the smallest packet number up, looking up
+         * each acked packet in the unacked ring.  Only the part of each
+         * range that overlaps the range of unacked packet numbers is
+         * examined.
+         */
+        for (range = &acki->ranges[ acki->n_ranges - 1 ];
+                        range >= acki->ranges && range->low <= largest_unacked;
+                                                                    --range)
+        {
+            if (range->high < smallest_unacked)
+                continue;
+            packno = range->low > smallest_unacked
+                                            ? range->low : smallest_unacked;
+            high = range->high < largest_unacked
+                                            ? range->high : largest_unacked;
+            for ( ; packno <= high; ++packno)
+            {
+                packet_out = ctl->sc_unacked_ring[
+                                        packno & ctl->sc_unacked_ring_mask];
+                if (!packet_out || packet_out->po_packno != packno)
+                    continue;
 #if __GNUC__
-        __builtin_prefetch(next);
+                __builtin_prefetch(ctl->sc_unacked_ring[
+                                (packno + 1) & ctl->sc_unacked_ring_mask]);
 #endif
-        if (skip_checks)
-            goto after_checks;
-        /* This is faster than binary search in the normal case when the number
-         * of ranges is not much larger than the number of unacked packets.
+                if (packet_out->po_frame_types & (1 << QUIC_FRAME_ACK))
+                    ack2ed = packet_out->po_ack2ed;
+                do_rtt |= packet_out->po_packno == largest_acked(acki);
+                send_ctl_packet_acked(ctl, packet_out, ack_recv_time, &now,
+                                                                &app_limited);
+            }
+        }
+    }
+    else
+    {
+        /* The range of unacked packet numbers is too large to index: walk
+         * the unacked queue, which is sorted by packet number.
          */
-        while (UNLIKELY(range->high < packet_out->po_packno))
-            --range;
-        if (range->low <= packet_out->po_packno)
+        next = packet_out;
+        while ((packet_out = next)
+                            && packet_out->po_packno <= largest_acked(acki))
         {
-            skip_checks = range == acki->ranges;
-            if (app_limited < 0)
-                app_limited = send_ctl_retx_bytes_out(ctl) + 3 * ctl->sc_pack_size /* This
-                    is the "maximum burst" parameter */
-                    < lsquic_cubic_get_cwnd(&ctl->sc_cubic);
-            if (!now)
-                now = lsquic_time_now();
-  after_checks:
-            packet_sz = packet_out_sent_sz(packet_out);
-            ctl->sc_largest_acked_packno    = packet_out->po_packno;
-            ctl->sc_largest_acked_sent_time = packet_out->po_sent;
-            send_ctl_unacked_remove(ctl, packet_out, packet_sz);
-            ack2ed[!!(packet_out->po_frame_types & (1 << QUIC_FRAME_ACK))]
-                = packet_out->po_ack2ed;
+            next = TAILQ_NEXT(packet_out, po_next);
+            while (range->high < packet_out->po_packno)
+                --range;
+            if (range->low > packet_out->po_packno)
+                continue;
+            if (packet_out->po_frame_types & (1 << QUIC_FRAME_ACK))
+                ack2ed = packet_out->po_ack2ed;
             do_rtt |= packet_out->po_packno == largest_acked(acki);
-            lsquic_cubic_ack(&ctl->sc_cubic, now, now - packet_out->po_sent,
-                             app_limited, packet_sz);
-            lsquic_packet_out_ack_streams(packet_out);
-            send_ctl_destroy_packet(ctl, packet_out);
+            send_ctl_packet_acked(ctl, packet_out, ack_recv_time, &now,
+                                                                &app_limited);
         }
-        packet_out = next;
     }
-    while (packet_out && packet_out->po_packno <= largest_acked(acki));
 
     if (do_rtt)
     {
@@ -780,6 +1218,7 @@ lsquic_send_ctl_got_ack (lsquic_send_ctl_t *ctl,
 
   detect_losses:
     send_ctl_detect_losses(ctl, ack_recv_time);
+    ctl->sc_ci->cci_end_ack(CGP(ctl), ctl->sc_bytes_unacked_all);
     if (send_ctl_first_unacked_retx_packet(ctl))
         set_retx_alarm(ctl);
     else
@@ -789,8 +1228,8 @@ lsquic_send_ctl_got_ack (lsquic_send_ctl_t *ctl,
     }
     lsquic_send_ctl_sanity_check(ctl);
 
-    if ((ctl->sc_flags & SC_NSTP) && ack2ed[1] > ctl->sc_largest_ack2ed)
-        ctl->sc_largest_ack2ed = ack2ed[1];
+    if ((ctl->sc_flags & SC_NSTP) && ack2ed > ctl->sc_largest_ack2ed)
+        ctl->sc_largest_ack2ed = ack2ed;
 
     if (ctl->sc_n_in_flight_retx == 0)
         ctl->sc_flags |= SC_WAS_QUIET;
@@ -891,6 +1330,8 @@ lsquic_send_ctl_cleanup (lsquic_send_ctl_t *ctl)
     }
     assert(0 == ctl->sc_n_in_flight_all);
     assert(0 == ctl->sc_bytes_unacked_all);
+    free(ctl->sc_unacked_ring);
+    ctl->sc_unacked_ring = NULL;
     while ((packet_out = TAILQ_FIRST(&ctl->sc_lost_packets)))
     {
         TAILQ_REMOVE(&ctl->sc_lost_packets, packet_out, po_next);
@@ -908,10 +1349,13 @@ lsquic_send_ctl_cleanup (lsquic_send_ctl_t *ctl)
     }
     if (ctl->sc_flags & SC_PACE)
         pacer_cleanup(&ctl->sc_pacer);
+    ctl->sc_ci->cci_cleanup(CGP(ctl));
+    lsquic_bw_sampler_cleanup(&ctl->sc_bw_sampler);
 #if LSQUIC_SEND_STATS
-    LSQ_NOTICE("stats: n_total_sent: %u; n_resent: %u; n_delayed: %u",
-        ctl->sc_stats.n_total_sent, ctl->sc_stats.n_resent,
-        ctl->sc_stats.n_delayed);
+    LSQ_NOTICE("stats: n_total_sent: %u; n_resent: %u; n_delayed: %u; "
+        "n_spurious_losses: %u", ctl->sc_stats.n_total_sent,
+        ctl->sc_stats.n_resent, ctl->sc_stats.n_delayed,
+        ctl->sc_n_spurious_losses);
 #endif
 }
 
@@ -952,12 +1396,12 @@ int
 lsquic_send_ctl_can_send (lsquic_send_ctl_t *ctl)
 {
     const unsigned n_out = send_ctl_all_bytes_out(ctl);
-    LSQ_DEBUG("%s: n_out: %u (unacked_all: %u, out: %u); cwnd: %lu", __func__,
-        n_out, ctl->sc_bytes_unacked_all, ctl->sc_bytes_out,
-        lsquic_cubic_get_cwnd(&ctl->sc_cubic));
+    const uint64_t cwnd = ctl->sc_ci->cci_get_cwnd(CGP(ctl));
+    LSQ_DEBUG("%s: n_out: %u (unacked_all: %u, out: %u); cwnd: %"PRIu64,
+        __func__, n_out, ctl->sc_bytes_unacked_all, ctl->sc_bytes_out, cwnd);
     if (ctl->sc_flags & SC_PACE)
     {
-        if (n_out >= lsquic_cubic_get_cwnd(&ctl->sc_cubic))
+        if (n_out >= cwnd)
             return 0;
         if (pacer_can_schedule(&ctl->sc_pacer,
                                ctl->sc_n_scheduled + ctl->sc_n_in_flight_all))
@@ -971,7 +1415,7 @@ lsquic_send_ctl_can_send (lsquic_send_ctl_t *ctl)
         return 0;
     }
     else
-        return n_out < lsquic_cubic_get_cwnd(&ctl->sc_cubic);
+        return n_out < cwnd;
 }
 
 
@@ -1054,6 +1498,11 @@ lsquic_send_ctl_sanity_check (const lsquic_send_ctl_t *ctl)
     assert(count == ctl->sc_n_in_flight_all);
     assert(bytes == ctl->sc_bytes_unacked_all);
 
+    if (ctl->sc_unacked_ring)
+        TAILQ_FOREACH(packet_out, &ctl->sc_unacked_packets, po_next)
+            assert(ctl->sc_unacked_ring[ packet_out->po_packno
+                                & ctl->sc_unacked_ring_mask] == packet_out);
+
     count = 0, bytes = 0;
     TAILQ_FOREACH(packet_out, &ctl->sc_scheduled_packets, po_next)
     {
@@ -1083,9 +1532,14 @@ lsquic_send_ctl_scheduled_one (lsquic_send_ctl_t *ctl,
     if (ctl->sc_flags & SC_PACE)
     {
         unsigned n_out = ctl->sc_n_in_flight_retx + ctl->sc_n_scheduled;
-        pacer_packet_scheduled(&ctl->sc_pacer, n_out,
-            send_ctl_in_recovery(ctl), send_ctl_transfer_time, ctl);
+        int in_recovery = send_ctl_in_recovery(ctl);
+        uint64_t pacing_rate = ctl->sc_ci->cci_pacing_rate(CGP(ctl),
+                                                                in_recovery);
+        packet_out->po_txtime = pacer_packet_scheduled(&ctl->sc_pacer, n_out,
+                            in_recovery, ctl->sc_pack_size, pacing_rate);
     }
+    else
+        packet_out->po_txtime = 0;
     send_ctl_sched_append(ctl, packet_out);
 }
 
@@ -1144,6 +1598,8 @@ lsquic_send_ctl_next_packet_to_send (lsquic_send_ctl_t *ctl)
         }
     }
 
+    send_ctl_reserve_unacked(ctl, packet_out->po_packno);
+
     ctl->sc_bytes_out += packet_out_total_sz(packet_out);
     if (dec_limit)
     {
@@ -1314,6 +1770,7 @@ unsigned
 lsquic_send_ctl_reschedule_packets (lsquic_send_ctl_t *ctl)
 {
     lsquic_packet_out_t *packet_out;
+    lsquic_packno_t packno;
     unsigned n = 0;
 
     while ((packet_out = send_ctl_next_lost(ctl)))
@@ -1323,8 +1780,10 @@ lsquic_send_ctl_reschedule_packets (lsquic_send_ctl_t *ctl)
 #if LSQUIC_CONN_STATS
         ++ctl->sc_conn_pub->conn_stats->out.retx_packets;
 #endif
+        packno = packet_out->po_packno;
         update_for_resending(ctl, packet_out);
         lsquic_send_ctl_scheduled_one(ctl, packet_out);
+        send_ctl_record_resched(ctl, packno, packet_out);
     }
 
     if (n)
@@ -1410,7 +1869,7 @@ lsquic_send_ctl_elide_stream_frames (lsquic_send_ctl_t *ctl, uint32_t stream_id)
                         "frames for stream %"PRIu32, n, stream_id);
                     TAILQ_REMOVE(&ctl->sc_buffered_packets[n].bpq_packets,
                                  packet_out, po_next);
-                    --ctl->sc_buffered_packets[n].bpq_count;
+                    bpq_decr(ctl, &ctl->sc_buffered_packets[n]);
                     send_ctl_destroy_packet(ctl, packet_out);
                     LSQ_DEBUG("Elide packet from buffered queue #%u; count: %u",
                               n, ctl->sc_buffered_packets[n].bpq_count);
@@ -1550,6 +2009,7 @@ lsquic_send_ctl_reset_packnos (lsquic_send_ctl_t *ctl)
     ctl->sc_cur_packno = lsquic_senhist_largest(&ctl->sc_senhist);
     TAILQ_FOREACH(packet_out, &ctl->sc_scheduled_packets, po_next)
         packet_out->po_flags |= PO_REPACKNO;
+    send_ctl_forget_resched(ctl);
 }
 
 
@@ -1578,6 +2038,7 @@ lsquic_send_ctl_drop_scheduled (lsquic_send_ctl_t *ctl)
     }
     assert(0 == ctl->sc_n_scheduled);
     ctl->sc_cur_packno = lsquic_senhist_largest(&ctl->sc_senhist);
+    send_ctl_forget_resched(ctl);
     LSQ_DEBUG("dropped %u scheduled packet%s", n, n != 0 ? "s" : "");
 }
 
@@ -1637,9 +2098,9 @@ send_ctl_max_bpq_count (const lsquic_send_ctl_t *ctl,
     case BPT_HIGHEST_PRIO:
     default: /* clang does not complain about absence of `default'... */
         count = ctl->sc_n_scheduled + ctl->sc_n_in_flight_retx;
-        if (count < lsquic_cubic_get_cwnd(&ctl->sc_cubic) / ctl->sc_pack_size)
+        if (count < ctl->sc_ci->cci_get_cwnd(CGP(ctl)) / ctl->sc_pack_size)
         {
-            count -= lsquic_cubic_get_cwnd(&ctl->sc_cubic) / ctl->sc_pack_size;
+            count -= ctl->sc_ci->cci_get_cwnd(CGP(ctl)) / ctl->sc_pack_size;
             if (count > MAX_BPQ_COUNT)
                 return count;
         }
@@ -1689,6 +2150,14 @@ send_ctl_get_buffered_packet (lsquic_send_ctl_t *ctl,
     if (packet_q->bpq_count >= send_ctl_max_bpq_count(ctl, packet_type))
         return NULL;
 
+    if (packet_q->bpq_count > 0
+                        && lsquic_conn_pub_over_budget(ctl->sc_conn_pub))
+    {
+        LSQ_DEBUG("over memory budget: do not buffer more packets in "
+                                                "queue #%u", packet_type);
+        return NULL;
+    }
+
     if (packet_q->bpq_count == 0)
     {
         /* If ACK was written to the low-priority queue first, steal it */
@@ -1740,7 +2209,7 @@ send_ctl_get_buffered_packet (lsquic_send_ctl_t *ctl,
     }
 
     TAILQ_INSERT_TAIL(&packet_q->bpq_packets, packet_out, po_next);
-    ++packet_q->bpq_count;
+    bpq_incr(ctl, packet_q);
     LSQ_DEBUG("Add new packet to buffered queue #%u; count: %u",
               packet_type, packet_q->bpq_count);
     return packet_out;
@@ -1786,7 +2255,7 @@ lsquic_send_ctl_calc_packno_bits (lsquic_send_ctl_t *ctl)
     unsigned n_in_flight;
 
     smallest_unacked = lsquic_send_ctl_smallest_unacked(ctl);
-    n_in_flight = lsquic_cubic_get_cwnd(&ctl->sc_cubic) / ctl->sc_pack_size;
+    n_in_flight = ctl->sc_ci->cci_get_cwnd(CGP(ctl)) / ctl->sc_pack_size;
     bits = calc_packno_bits(ctl->sc_cur_packno + 1, smallest_unacked,
                                                             n_in_flight);
     if (bits <= ctl->sc_max_packno_bits)
@@ -1828,7 +2297,7 @@ split_buffered_packet (lsquic_send_ctl_t *ctl,
         lsquic_packet_out_set_packno_bits(packet_out, bits);
         TAILQ_INSERT_AFTER(&packet_q->bpq_packets, packet_out, new_packet_out,
                            po_next);
-        ++packet_q->bpq_count;
+        bpq_incr(ctl, packet_q);
         LSQ_DEBUG("Add split packet to buffered queue #%u; count: %u",
                   packet_type, packet_q->bpq_count);
         return 0;
@@ -1867,7 +2336,7 @@ lsquic_send_ctl_schedule_buffered (lsquic_send_ctl_t *ctl,
             {
                 LSQ_DEBUG("Dropping now-empty buffered packet");
                 TAILQ_REMOVE(&packet_q->bpq_packets, packet_out, po_next);
-                --packet_q->bpq_count;
+                bpq_decr(ctl, packet_q);
                 send_ctl_destroy_packet(ctl, packet_out);
                 continue;
             }
@@ -1888,7 +2357,7 @@ lsquic_send_ctl_schedule_buffered (lsquic_send_ctl_t *ctl,
             }
         }
         TAILQ_REMOVE(&packet_q->bpq_packets, packet_out, po_next);
-        --packet_q->bpq_count;
+        bpq_decr(ctl, packet_q);
         packet_out->po_packno = send_ctl_next_packno(ctl);
         LSQ_DEBUG("Remove packet from buffered queue #%u; count: %u.  "
             "It becomes packet %"PRIu64, packet_type, packet_q->bpq_count,
@@ -1964,3 +2433,40 @@ lsquic_send_ctl_verneg_done (struct lsquic_send_ctl *ctl)
         lsquic_ver2str[ ctl->sc_conn_pub->lconn->cn_version ],
         ctl->sc_max_packno_bits);
 }
+
+
+void
+lsquic_send_ctl_maybe_app_limited (struct lsquic_send_ctl *ctl)
+{
+    uint64_t cwnd;
+
+    cwnd = ctl->sc_ci->cci_get_cwnd(CGP(ctl));
+    if (send_ctl_all_bytes_out(ctl) + ctl->sc_pack_size < cwnd)
+    {
+        LSQ_DEBUG("app-limited");
+        ctl->sc_flags |= SC_APP_LIMITED;
+    }
+}
+
+
+void
+lsquic_send_ctl_get_info (struct lsquic_send_ctl *ctl,
+                                                struct lsquic_conn_info *info)
+{
+    const struct lsquic_rtt_stats *const rtt_stats =
+                                            &ctl->sc_conn_pub->rtt_stats;
+
+    info->lci_bw_estimate = lsquic_bw_sampler_estimate(&ctl->sc_bw_sampler);
+    info->lci_bw_sample = lsquic_bw_sampler_last_sample(&ctl->sc_bw_sampler);
+    info->lci_bytes_delivered =
+                    lsquic_bw_sampler_total_acked(&ctl->sc_bw_sampler);
+    info->lci_bytes_in_flight = ctl->sc_bytes_unacked_all;
+    info->lci_cwnd = ctl->sc_ci->cci_get_cwnd(CGP(ctl));
+    info->lci_pacing_rate = ctl->sc_ci->cci_pacing_rate(CGP(ctl),
+                                                send_ctl_in_recovery(ctl));
+    info->lci_srtt = lsquic_rtt_stats_get_srtt(rtt_stats);
+    info->lci_rttvar = lsquic_rtt_stats_get_rttvar(rtt_stats);
+    info->lci_min_rtt = lsquic_rtt_stats_get_min_rtt(rtt_stats);
+    info->lci_latest_rtt = lsquic_rtt_stats_get_latest_rtt(rtt_stats);
+    info->lci_n_spurious_losses = ctl->sc_n_spurious_losses;
+}
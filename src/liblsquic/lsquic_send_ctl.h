@@ -14,6 +14,7 @@ TAILQ_HEAD(lsquic_packets_tailq, lsquic_packet_out);
 
 struct lsquic_packet_out;
 struct ack_info;
+struct cong_ctl_if;
 struct lsquic_alarmset;
 struct lsquic_engine_public;
 struct lsquic_conn_public;
@@ -36,6 +37,26 @@ enum send_ctl_flags {
     SC_SCHED_TICK   = (1 << 4),
     SC_BUFFER_STREAM= (1 << 5),
     SC_WAS_QUIET    = (1 << 6),
+    SC_APP_LIMITED  = (1 << 7),
+    SC_RACK         = (1 << 8),
+    SC_UNACKED_LIST = (1 << 9),     /* Unacked ring dropped: walk queue */
+};
+
+/* Packet numbers of recently lost packets are kept to detect spurious
+ * losses: an ACK for one of these means the packet was not lost after all.
+ */
+#define SC_N_LOST_RECS 32
+
+struct lost_rec
+{
+    lsquic_packno_t     lr_packno;      /* Zero means unused */
+    /* Packet number of the copy on the scheduled queue, zero if the lost
+     * packet has not been rescheduled.  The size is recorded to tell
+     * whether the copy has been modified since.
+     */
+    lsquic_packno_t     lr_resched_packno;
+    unsigned short      lr_data_sz;
+    unsigned            lr_event;       /* See sc_loss_event */
 };
 
 typedef struct lsquic_send_ctl {
@@ -47,13 +68,25 @@ typedef struct lsquic_send_ctl {
     enum send_ctl_flags             sc_flags;
     unsigned                        sc_n_stop_waiting;
     struct lsquic_packets_tailq     sc_unacked_packets;
+    /* Unacked packets are also indexed by packet number, modulo the size
+     * of this ring.  The ring covers the whole range of unacked packet
+     * numbers and is grown as necessary.  It is NULL if the range is too
+     * large to index: see SC_UNACKED_LIST.
+     */
+    struct lsquic_packet_out      **sc_unacked_ring;
+    unsigned                        sc_unacked_ring_mask;
     lsquic_packno_t                 sc_largest_acked_packno;
     lsquic_time_t                   sc_largest_acked_sent_time;
     unsigned                        sc_bytes_out;
     unsigned                        sc_bytes_unacked_retx;
     unsigned                        sc_bytes_scheduled;
     unsigned                        sc_pack_size;
-    struct lsquic_cubic             sc_cubic;
+    const struct cong_ctl_if       *sc_ci;
+    union {
+        struct lsquic_cubic         cubic;
+        struct lsquic_bbr           bbr;
+    }                               sc_cong_u;
+    struct bw_sampler               sc_bw_sampler;
     struct lsquic_engine_public    *sc_enpub;
     unsigned                        sc_bytes_unacked_all;
     unsigned                        sc_n_in_flight_all;
@@ -88,6 +121,22 @@ typedef struct lsquic_send_ctl {
      */
     lsquic_packno_t                 sc_largest_acked;
     lsquic_time_t                   sc_loss_to;
+    /* Packets lost in the same loss event are tagged with the same
+     * sc_loss_event value.  When all of them turn out to have been
+     * delivered, the loss event is undone.
+     */
+    struct lost_rec                 sc_lost_recs[SC_N_LOST_RECS];
+    unsigned                        sc_lost_recs_idx;
+    unsigned                        sc_loss_event;
+    unsigned                        sc_n_event_lost;
+    unsigned                        sc_n_event_spurious;
+    lsquic_packno_t                 sc_lsac_before_event;
+    unsigned                        sc_n_spurious_losses;
+    /* Reordering window (RACK mode) is a multiple of a quarter of min RTT.
+     * It grows with each spurious loss.
+     */
+    unsigned                        sc_reo_wnd_mult;
+    unsigned                        sc_reo_wnd_persist;
     struct
     {
         uint32_t                stream_id;
@@ -294,4 +343,15 @@ lsquic_send_ctl_buffered_and_same_prio_as_headers (struct lsquic_send_ctl *,
 void
 lsquic_send_ctl_verneg_done (struct lsquic_send_ctl *);
 
+/* Called when the connection has nothing more to send.  If the congestion
+ * window is not full, packets sent next are marked as app-limited.
+ */
+void
+lsquic_send_ctl_maybe_app_limited (struct lsquic_send_ctl *);
+
+struct lsquic_conn_info;
+
+void
+lsquic_send_ctl_get_info (struct lsquic_send_ctl *, struct lsquic_conn_info *);
+
 #endif
@@ -90,8 +90,10 @@ int
 lsquic_sfcw_fc_offsets_changed (struct lsquic_sfcw *fc)
 {
     lsquic_time_t since_last_update, srtt, now;
+    unsigned window;
 
-    if (fc->sf_recv_off - fc->sf_read_off >= fc->sf_max_recv_win / 2)
+    window = lsquic_conn_budget_window(fc->sf_conn_pub, fc->sf_max_recv_win);
+    if (fc->sf_recv_off - fc->sf_read_off >= window / 2)
     {
         LSQ_DEBUG("recv_off has not changed, still at %"PRIu64,
                                                             fc->sf_recv_off);
@@ -104,9 +106,18 @@ lsquic_sfcw_fc_offsets_changed (struct lsquic_sfcw *fc)
 
     srtt = lsquic_rtt_stats_get_srtt(&fc->sf_conn_pub->rtt_stats);
     if (since_last_update < srtt * 2)
-        sfcw_maybe_increase_max_window(fc);
+    {
+        if (window < fc->sf_max_recv_win)
+            LSQ_DEBUG("over memory budget, do not increase max window");
+        else
+        {
+            sfcw_maybe_increase_max_window(fc);
+            window = lsquic_conn_budget_window(fc->sf_conn_pub,
+                                                        fc->sf_max_recv_win);
+        }
+    }
 
-    fc->sf_recv_off = fc->sf_read_off + fc->sf_max_recv_win;
+    fc->sf_recv_off = fc->sf_read_off + window;
     LSQ_DEBUG("recv_off changed: read_off: %"PRIu64"; "
         "recv_off: %"PRIu64, fc->sf_read_off, fc->sf_recv_off);
     return 1;
@@ -6,9 +6,11 @@
 #include <ctype.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #ifndef WIN32
+#include <sys/mman.h>
 #include <sys/time.h>
 #include <unistd.h>
 #else
@@ -97,6 +99,52 @@ lsquic_is_zero (const void *pbuf, size_t bufsz)
 }
 
 
+void *
+lsquic_huge_alloc (size_t size, int *mmapped)
+{
+    void *mem;
+
+    size = (size + LSQUIC_HUGE_PAGE_SZ - 1)
+                                    & ~(size_t) (LSQUIC_HUGE_PAGE_SZ - 1);
+
+#if !defined(WIN32) && defined(MAP_HUGETLB)
+    mem = mmap(NULL, size, PROT_READ|PROT_WRITE,
+                            MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+    if (mem != MAP_FAILED)
+    {
+        *mmapped = 1;
+        return mem;
+    }
+#endif
+
+    if (0 != posix_memalign(&mem, LSQUIC_HUGE_PAGE_SZ, size))
+        return NULL;
+#if !defined(WIN32) && defined(MADV_HUGEPAGE)
+    (void) madvise(mem, size, MADV_HUGEPAGE);
+#endif
+    *mmapped = 0;
+    return mem;
+}
+
+
+void
+lsquic_huge_free (void *mem, size_t size, int mmapped)
+{
+#ifndef WIN32
+    if (mmapped)
+    {
+        size = (size + LSQUIC_HUGE_PAGE_SZ - 1)
+                                    & ~(size_t) (LSQUIC_HUGE_PAGE_SZ - 1);
+        munmap(mem, size);
+    }
+    else
+        free(mem);
+#else
+    _aligned_free(mem);
+#endif
+}
+
+
 /* XXX this function uses static buffer.  Replace it with hexdump() if possible */
 char *get_bin_str(const void *s, size_t len, size_t max_display_len)
 {
@@ -21,6 +21,20 @@ lsquic_init_timers (void);
 int
 lsquic_is_zero (const void *buf, size_t bufsz);
 
+#define LSQUIC_HUGE_PAGE_SZ (2 * 1024 * 1024)
+
+/* Allocate memory backed by huge pages.  `size' is rounded up to a multiple
+ * of LSQUIC_HUGE_PAGE_SZ.  Explicit huge pages are tried first.  If none
+ * are available, the memory is aligned on huge page boundary and the kernel
+ * is asked to back it with transparent huge pages.  `mmapped' records which
+ * it is; pass it along with the same `size' to lsquic_huge_free().
+ */
+void *
+lsquic_huge_alloc (size_t size, int *mmapped);
+
+void
+lsquic_huge_free (void *mem, size_t size, int mmapped);
+
 
 
 char * get_bin_str(const void *s, size_t len, size_t max_display_len);
@@ -3,6 +3,10 @@
  * http_client.c -- A simple HTTP/QUIC client
  */
 
+#if __GNUC__
+#define _GNU_SOURCE     /* For pthread_setaffinity_np */
+#endif
+
 #ifndef WIN32
 #include <arpa/inet.h>
 #include <netinet/in.h>
@@ -27,6 +31,10 @@
 #include <sys/types.h>
 #include <dirent.h>
 #include <limits.h>
+#include <pthread.h>
+#endif
+#if __linux__
+#include <sched.h>
 #endif
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -73,11 +81,17 @@ struct sample_stats
     unsigned long   sum_X2;     /* To calculate stddev */
 };
 
-static struct sample_stats  s_stat_to_conn,     /* Time to connect */
-                            s_stat_ttfb,
-                            s_stat_req;     /* From TTFB to EOS */
-static unsigned s_stat_conns_ok, s_stat_conns_failed;
-static unsigned long s_stat_downloaded_bytes;
+/* Statistics are kept per client context, as each engine runs in its own
+ * thread.  They are added up at the end.
+ */
+struct client_stats
+{
+    struct sample_stats     to_conn,    /* Time to connect */
+                            ttfb,
+                            req;        /* From TTFB to EOS */
+    unsigned                conns_ok, conns_failed;
+    unsigned long           downloaded_bytes;
+};
 
 static void
 update_sample_stats (struct sample_stats *stats, unsigned long val)
@@ -101,6 +115,41 @@ update_sample_stats (struct sample_stats *stats, unsigned long val)
 }
 
 
+static void
+add_sample_stats (struct sample_stats *stats, const struct sample_stats *src)
+{
+    if (src->n == 0)
+        return;
+    if (stats->n)
+    {
+        if (src->min < stats->min)
+            stats->min = src->min;
+        if (src->max > stats->max)
+            stats->max = src->max;
+    }
+    else
+    {
+        stats->min = src->min;
+        stats->max = src->max;
+    }
+    stats->sum += src->sum;
+    stats->sum_X2 += src->sum_X2;
+    stats->n += src->n;
+}
+
+
+static void
+add_client_stats (struct client_stats *stats, const struct client_stats *src)
+{
+    add_sample_stats(&stats->to_conn, &src->to_conn);
+    add_sample_stats(&stats->ttfb, &src->ttfb);
+    add_sample_stats(&stats->req, &src->req);
+    stats->conns_ok += src->conns_ok;
+    stats->conns_failed += src->conns_failed;
+    stats->downloaded_bytes += src->downloaded_bytes;
+}
+
+
 static void
 calc_sample_stats (const struct sample_stats *stats,
         long double *mean_p, long double *stddev_p)
@@ -186,6 +235,7 @@ struct http_client_ctx {
         HCC_RTT_INFO            = (1 << 3),
     }                            hcc_flags;
     struct prog                 *prog;
+    struct client_stats          hcc_stats;
 };
 
 struct lsquic_conn_ctx {
@@ -212,7 +262,11 @@ struct hset_elem
 };
 
 
-STAILQ_HEAD(hset, hset_elem);
+struct hset
+{
+    STAILQ_HEAD(, hset_elem)    hs_elems;
+    struct client_stats        *hs_stats;
+};
 
 static void
 hset_dump (const struct hset *, FILE *);
@@ -416,8 +470,8 @@ http_client_on_hsk_done (lsquic_conn_t *conn, enum lsquic_hsk_status status)
     if (status != LSQ_HSK_FAIL)
     {
         conn_h = lsquic_conn_get_ctx(conn);
-        ++s_stat_conns_ok;
-        update_sample_stats(&s_stat_to_conn,
+        ++client_ctx->hcc_stats.conns_ok;
+        update_sample_stats(&client_ctx->hcc_stats.to_conn,
                                     lsquic_time_now() - conn_h->ch_created);
         if (TAILQ_EMPTY(&client_ctx->hcc_path_elems))
         {
@@ -426,7 +480,7 @@ http_client_on_hsk_done (lsquic_conn_t *conn, enum lsquic_hsk_status status)
         }
     }
     else
-        ++s_stat_conns_failed;
+        ++client_ctx->hcc_stats.conns_failed;
 }
 
 
@@ -649,7 +703,8 @@ http_client_on_read (lsquic_stream_t *stream, lsquic_stream_ctx_t *st_h)
                 exit(2);
             }
             st_h->sh_ttfb = lsquic_time_now();
-            update_sample_stats(&s_stat_ttfb, st_h->sh_ttfb - st_h->sh_created);
+            update_sample_stats(&client_ctx->hcc_stats.ttfb,
+                                        st_h->sh_ttfb - st_h->sh_created);
             if (s_discard_response)
                 LSQ_DEBUG("discard response: do not dump headers");
             else
@@ -659,12 +714,12 @@ http_client_on_read (lsquic_stream_t *stream, lsquic_stream_ctx_t *st_h)
         }
         else if (nread = lsquic_stream_read(stream, buf, sizeof(buf)), nread > 0)
         {
-            s_stat_downloaded_bytes += nread;
+            client_ctx->hcc_stats.downloaded_bytes += nread;
             if (!g_header_bypass && !(st_h->sh_flags & PROCESSED_HEADERS))
             {
                 /* First read is assumed to be the first byte */
                 st_h->sh_ttfb = lsquic_time_now();
-                update_sample_stats(&s_stat_ttfb,
+                update_sample_stats(&client_ctx->hcc_stats.ttfb,
                                     st_h->sh_ttfb - st_h->sh_created);
                 st_h->sh_flags |= PROCESSED_HEADERS;
             }
@@ -685,7 +740,8 @@ http_client_on_read (lsquic_stream_t *stream, lsquic_stream_ctx_t *st_h)
         }
         else if (0 == nread)
         {
-            update_sample_stats(&s_stat_req, lsquic_time_now() - st_h->sh_ttfb);
+            update_sample_stats(&client_ctx->hcc_stats.req,
+                                        lsquic_time_now() - st_h->sh_ttfb);
             client_ctx->hcc_flags |= HCC_SEEN_FIN;
             lsquic_stream_shutdown(stream, 0);
             break;
@@ -793,10 +849,103 @@ usage (const char *prog)
 "   -a          Display server certificate chain after successful handshake.\n"
 "   -t          Print stats to stdout.\n"
 "   -T FILE     Print stats to FILE.  If FILE is -, print stats to stdout.\n"
+#ifndef WIN32
+"   -j ENGINES  Number of engines to run in parallel.  Each engine runs in\n"
+"                 its own thread, pinned to its own CPU, and uses its own\n"
+"                 socket.  Connections (-n) and requests (-r) are divided\n"
+"                 among engines.  Defaults to 1.\n"
+#endif
             , prog);
 }
 
 
+#ifndef WIN32
+/* An engine run in addition to the main one when -j option is used */
+struct shard
+{
+    struct prog             prog;
+    struct http_client_ctx  client_ctx;
+    struct sport_head       sports;
+    unsigned char           zero_rtt[8192];
+    pthread_t               thread;
+    unsigned                cpu;
+    int                     status;
+};
+
+
+static void
+pin_to_cpu (unsigned cpu)
+{
+#if __linux__
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (0 != pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+        LSQ_WARN("cannot pin thread to CPU %u", cpu);
+#endif
+}
+
+
+/* Divide `total' among `n_shards' as evenly as possible */
+static unsigned
+shard_share (unsigned total, unsigned n_shards, unsigned idx)
+{
+    return total / n_shards + (idx < total % n_shards);
+}
+
+
+static int
+init_shard (struct shard *shard, unsigned idx, unsigned n_shards,
+            const struct prog *prog, const struct http_client_ctx *client_ctx)
+{
+    long n_cpus;
+
+    TAILQ_INIT(&shard->sports);
+    shard->client_ctx = *client_ctx;
+    /* The list of paths is shared, as it is not modified after the options
+     * are parsed.
+     */
+    TAILQ_INIT(&shard->client_ctx.conn_ctxs);
+    shard->client_ctx.hcc_total_n_reqs = shard_share(
+                            client_ctx->hcc_total_n_reqs, n_shards, idx);
+    shard->client_ctx.hcc_concurrency = shard_share(
+                            client_ctx->hcc_concurrency, n_shards, idx);
+    /* Zero-RTT info is written to file by the main engine only */
+    memcpy(shard->zero_rtt, client_ctx->hcc_zero_rtt,
+                                            client_ctx->hcc_zero_rtt_len);
+    shard->client_ctx.hcc_zero_rtt = shard->zero_rtt;
+    shard->client_ctx.hcc_zero_rtt_max_len = sizeof(shard->zero_rtt);
+    shard->client_ctx.hcc_zero_rtt_file = NULL;
+    shard->client_ctx.hcc_zero_rtt_file_name = NULL;
+    shard->client_ctx.prog = &shard->prog;
+
+    if (0 != prog_copy(&shard->prog, prog, &shard->sports, &shard->client_ctx))
+        return -1;
+    if (g_header_bypass)
+        shard->prog.prog_api.ea_hsi_ctx = &shard->client_ctx;
+
+    n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    shard->cpu = n_cpus > 0 ? idx % n_cpus : 0;
+    return 0;
+}
+
+
+static void *
+run_shard (void *arg)
+{
+    struct shard *const shard = arg;
+
+    pin_to_cpu(shard->cpu);
+    create_connections(&shard->client_ctx);
+    shard->status = prog_run(&shard->prog);
+    return NULL;
+}
+
+
+#endif
+
+
 #ifndef WIN32
 static X509_STORE *store;
 
@@ -914,13 +1063,13 @@ verify_server_cert (void *ctx, STACK_OF(X509) *chain)
 static void *
 hset_create (void *hsi_ctx, int is_push_promise)
 {
+    struct http_client_ctx *const client_ctx = hsi_ctx;
     struct hset *hset;
 
-    if (s_discard_response)
-        return (void *) 1;
-    else if ((hset = malloc(sizeof(*hset))))
+    if ((hset = malloc(sizeof(*hset))))
     {
-        STAILQ_INIT(hset);
+        STAILQ_INIT(&hset->hs_elems);
+        hset->hs_stats = &client_ctx->hcc_stats;
         return hset;
     }
     else
@@ -937,9 +1086,9 @@ hset_add_header (void *hset_p, unsigned name_idx,
     struct hset_elem *el;
 
     if (name)
-        s_stat_downloaded_bytes += name_len + value_len + 4;    /* ": \r\n" */
+        hset->hs_stats->downloaded_bytes += name_len + value_len + 4; /* ": \r\n" */
     else
-        s_stat_downloaded_bytes += 2;   /* \r\n "*/
+        hset->hs_stats->downloaded_bytes += 2;   /* \r\n "*/
 
     if (s_discard_response)
         return LSQUIC_HDR_OK;
@@ -962,7 +1111,7 @@ hset_add_header (void *hset_p, unsigned name_idx,
     }
 
     el->name_idx = name_idx;
-    STAILQ_INSERT_TAIL(hset, el, next);
+    STAILQ_INSERT_TAIL(&hset->hs_elems, el, next);
     return LSQUIC_HDR_OK;
 }
 
@@ -973,17 +1122,14 @@ hset_destroy (void *hset_p)
     struct hset *hset = hset_p;
     struct hset_elem *el, *next;
 
-    if (!s_discard_response)
+    for (el = STAILQ_FIRST(&hset->hs_elems); el; el = next)
     {
-        for (el = STAILQ_FIRST(hset); el; el = next)
-        {
-            next = STAILQ_NEXT(el, next);
-            free(el->name);
-            free(el->value);
-            free(el);
-        }
-        free(hset);
+        next = STAILQ_NEXT(el, next);
+        free(el->name);
+        free(el->value);
+        free(el);
     }
+    free(hset);
 }
 
 
@@ -992,7 +1138,7 @@ hset_dump (const struct hset *hset, FILE *out)
 {
     const struct hset_elem *el;
 
-    STAILQ_FOREACH(el, hset, next)
+    STAILQ_FOREACH(el, &hset->hs_elems, next)
         if (el->name_idx)
             fprintf(out, "%s (static table idx %u): %s\n", el->name,
                                                     el->name_idx, el->value);
@@ -1041,6 +1187,10 @@ main (int argc, char **argv)
     struct sport_head sports;
     struct prog prog;
     unsigned char zero_rtt[8192];
+#ifndef WIN32
+    struct shard *shards = NULL;
+    unsigned n, n_shards = 1;
+#endif
 
     TAILQ_INIT(&sports);
     memset(&client_ctx, 0, sizeof(client_ctx));
@@ -1064,7 +1214,7 @@ main (int argc, char **argv)
 
     while (-1 != (opt = getopt(argc, argv, PROG_OPTS "46Br:R:IKu:EP:M:n:w:H:p:0:h"
 #ifndef WIN32
-                                                                      "C:atT:"
+                                                                      "C:atT:j:"
 #endif
                                                                             )))
     {
@@ -1079,7 +1229,7 @@ main (int argc, char **argv)
         case 'B':
             g_header_bypass = 1;
             prog.prog_api.ea_hsi_if = &header_bypass_api;
-            prog.prog_api.ea_hsi_ctx = NULL;
+            prog.prog_api.ea_hsi_ctx = &client_ctx;
             break;
         case 'I':
             client_ctx.hcc_flags |= HCC_ABORT_ON_INCOMPLETE;
@@ -1160,6 +1310,11 @@ main (int argc, char **argv)
                 }
             }
             break;
+#ifndef WIN32
+        case 'j':
+            n_shards = atoi(optarg);
+            break;
+#endif
         case '0':
             client_ctx.hcc_zero_rtt_file_name = optarg;
             client_ctx.hcc_zero_rtt_file = fopen(optarg, "rb+");
@@ -1174,6 +1329,16 @@ main (int argc, char **argv)
         }
     }
 
+#ifndef WIN32
+    if (n_shards < 1 || n_shards > client_ctx.hcc_concurrency
+                                    || n_shards > client_ctx.hcc_total_n_reqs)
+    {
+        fprintf(stderr, "number of engines must be between 1 and the number "
+            "of connections and requests\n");
+        exit(1);
+    }
+#endif
+
 #if LSQUIC_CONN_STATS
     prog.prog_api.ea_stats_fh = stats_fh;
 #endif
@@ -1200,12 +1365,56 @@ main (int argc, char **argv)
         exit(EXIT_FAILURE);
     }
 
+#ifndef WIN32
+    if (n_shards > 1)
+    {
+        shards = calloc(n_shards - 1, sizeof(*shards));
+        if (!shards)
+        {
+            perror("calloc");
+            exit(EXIT_FAILURE);
+        }
+        for (n = 1; n < n_shards; ++n)
+            if (0 != init_shard(&shards[n - 1], n, n_shards, &prog,
+                                                                &client_ctx)
+                    || 0 != prog_prep(&shards[n - 1].prog))
+            {
+                LSQ_ERROR("could not prep engine #%u", n);
+                exit(EXIT_FAILURE);
+            }
+        client_ctx.hcc_total_n_reqs = shard_share(
+                            client_ctx.hcc_total_n_reqs, n_shards, 0);
+        client_ctx.hcc_concurrency = shard_share(
+                            client_ctx.hcc_concurrency, n_shards, 0);
+        pin_to_cpu(0);
+        for (n = 1; n < n_shards; ++n)
+            if (0 != pthread_create(&shards[n - 1].thread, NULL, run_shard,
+                                                            &shards[n - 1]))
+            {
+                LSQ_ERROR("could not create thread for engine #%u", n);
+                exit(EXIT_FAILURE);
+            }
+    }
+#endif
+
     create_connections(&client_ctx);
 
     LSQ_DEBUG("entering event loop");
 
     s = prog_run(&prog);
 
+#ifndef WIN32
+    for (n = 1; n < n_shards; ++n)
+    {
+        pthread_join(shards[n - 1].thread, NULL);
+        if (shards[n - 1].status != 0)
+            s = shards[n - 1].status;
+        add_client_stats(&client_ctx.hcc_stats,
+                                        &shards[n - 1].client_ctx.hcc_stats);
+        prog.prog_read_count += shards[n - 1].prog.prog_read_count;
+    }
+#endif
+
     if (client_ctx.hcc_zero_rtt_file)
     {
         fclose(client_ctx.hcc_zero_rtt_file);
@@ -1217,17 +1426,29 @@ main (int argc, char **argv)
     {
         elapsed = (long double) (lsquic_time_now() - start_time) / 1000000;
         fprintf(stats_fh, "overall statistics as calculated by %s:\n", argv[0]);
-        display_stat(stats_fh, &s_stat_to_conn, "time for connect");
-        display_stat(stats_fh, &s_stat_req, "time for request");
-        display_stat(stats_fh, &s_stat_ttfb, "time to 1st byte");
+        display_stat(stats_fh, &client_ctx.hcc_stats.to_conn,
+                                                        "time for connect");
+        display_stat(stats_fh, &client_ctx.hcc_stats.req, "time for request");
+        display_stat(stats_fh, &client_ctx.hcc_stats.ttfb, "time to 1st byte");
         fprintf(stats_fh, "downloaded %lu application bytes in %.3Lf seconds\n",
-            s_stat_downloaded_bytes, elapsed);
+            client_ctx.hcc_stats.downloaded_bytes, elapsed);
         fprintf(stats_fh, "%.2Lf reqs/sec; %.0Lf bytes/sec\n",
-            (long double) s_stat_req.n / elapsed,
-            (long double) s_stat_downloaded_bytes / elapsed);
+            (long double) client_ctx.hcc_stats.req.n / elapsed,
+            (long double) client_ctx.hcc_stats.downloaded_bytes / elapsed);
         fprintf(stats_fh, "read handler count %lu\n", prog.prog_read_count);
     }
 
+#ifndef WIN32
+    /* Engine statistics are printed by the main engine when it is destroyed */
+    for (n = 1; n < n_shards; ++n)
+    {
+#if LSQUIC_CONN_STATS
+        lsquic_engine_add_stats(prog.prog_engine, shards[n - 1].prog.prog_engine);
+#endif
+        prog_cleanup(&shards[n - 1].prog);
+    }
+    free(shards);
+#endif
     prog_cleanup(&prog);
     if (promise_fd >= 0)
         (void) close(promise_fd);
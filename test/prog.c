@@ -27,8 +27,6 @@
 #include "test_common.h"
 #include "prog.h"
 
-static int prog_stopped;
-
 static const struct lsquic_packout_mem_if pmi = {
     .pmi_allocate = pba_allocate,
     .pmi_release  = pba_release,
@@ -80,6 +78,58 @@ prog_add_sport (struct prog *prog, const char *arg)
 }
 
 
+int
+prog_copy (struct prog *prog, const struct prog *src,
+                            struct sport_head *sports, void *stream_if_ctx)
+{
+    const struct service_port *src_sport;
+    struct service_port *sport;
+
+    memset(prog, 0, sizeof(*prog));
+    prog->prog_sports           = sports;
+    prog->prog_settings         = src->prog_settings;
+    prog->prog_api              = src->prog_api;
+    prog->prog_api.ea_settings  = &prog->prog_settings;
+    prog->prog_api.ea_stream_if_ctx
+                                = stream_if_ctx;
+    prog->prog_api.ea_packets_out_ctx
+                                = prog;
+    if (src->prog_api.ea_pmi_ctx == &src->prog_pba)
+        prog->prog_api.ea_pmi_ctx = &prog->prog_pba;
+#if LSQUIC_CONN_STATS
+    /* Statistics are printed by `src' */
+    prog->prog_api.ea_stats_fh  = NULL;
+#endif
+    prog->prog_engine_flags     = src->prog_engine_flags;
+    prog->prog_dummy_sport      = src->prog_dummy_sport;
+    prog->prog_packout_max      = src->prog_packout_max;
+    prog->prog_max_packet_size  = src->prog_max_packet_size;
+    prog->prog_version_cleared  = src->prog_version_cleared;
+    prog->prog_hostname         = src->prog_hostname;
+    prog->prog_ipver            = src->prog_ipver;
+    prog->prog_no_signals       = 1;
+
+    TAILQ_FOREACH(src_sport, src->prog_sports, next_sport)
+    {
+        sport = malloc(sizeof(*sport));
+        if (!sport)
+            return -1;
+        *sport = *src_sport;
+        sport->fd       = -1;
+        sport->ev       = NULL;
+        sport->engine   = NULL;
+        sport->packs_in = NULL;
+        sport->sp_prog  = prog;
+        /* Hostname may have been taken from the service port */
+        if (src->prog_hostname == src_sport->host)
+            prog->prog_hostname = sport->host;
+        TAILQ_INSERT_TAIL(prog->prog_sports, sport, next_sport);
+    }
+
+    return 0;
+}
+
+
 void
 prog_print_common_options (const struct prog *prog, FILE *out)
 {
@@ -134,6 +184,26 @@ prog_print_common_options (const struct prog *prog, FILE *out)
 "   -S opt=val  Socket options.  Supported options:\n"
 "                   sndbuf=12345    # Sets SO_SNDBUF\n"
 "                   rcvbuf=12345    # Sets SO_RCVBUF\n"
+#if LSQUIC_MMSG_SUPPORTED
+"                   mmsg=1          # Use recvmmsg() and sendmmsg()\n"
+#endif
+#if LSQUIC_GSO_SUPPORTED
+"                   gso=1           # Send packet trains using UDP_SEGMENT.\n"
+"                                   #   Implies mmsg=1\n"
+#endif
+#if LSQUIC_GRO_SUPPORTED
+"                   gro=1           # Receive packets using UDP_GRO.\n"
+"                                   #   Implies mmsg=1\n"
+#endif
+#if LSQUIC_TXTIME_SUPPORTED
+"                   txtime=1        # Pass departure times to the kernel\n"
+"                                   #   using SO_TXTIME.  Use with fq qdisc\n"
+"                                   #   and -o pace_horizon=USECS\n"
+#endif
+#if __linux__
+"                   timestamps=1    # Use kernel receive timestamps\n"
+"                                   #   (SO_TIMESTAMPNS)\n"
+#endif
     );
 
 
@@ -235,6 +305,61 @@ prog_set_opt (struct prog *prog, int opt, const char *arg)
                 free(name);
                 return 0;
             }
+#if LSQUIC_MMSG_SUPPORTED
+            else if (0 == strcasecmp(name, "mmsg"))
+            {
+                if (atoi(val))
+                    sport->sp_flags |= SPORT_MMSG;
+                else
+                    sport->sp_flags &= ~SPORT_MMSG;
+                free(name);
+                return 0;
+            }
+#endif
+#if LSQUIC_GSO_SUPPORTED
+            else if (0 == strcasecmp(name, "gso"))
+            {
+                if (atoi(val))
+                    sport->sp_flags |= SPORT_GSO|SPORT_MMSG;
+                else
+                    sport->sp_flags &= ~SPORT_GSO;
+                free(name);
+                return 0;
+            }
+#endif
+#if LSQUIC_GRO_SUPPORTED
+            else if (0 == strcasecmp(name, "gro"))
+            {
+                if (atoi(val))
+                    sport->sp_flags |= SPORT_GRO|SPORT_MMSG;
+                else
+                    sport->sp_flags &= ~SPORT_GRO;
+                free(name);
+                return 0;
+            }
+#endif
+#if LSQUIC_TXTIME_SUPPORTED
+            else if (0 == strcasecmp(name, "txtime"))
+            {
+                if (atoi(val))
+                    sport->sp_flags |= SPORT_TXTIME;
+                else
+                    sport->sp_flags &= ~SPORT_TXTIME;
+                free(name);
+                return 0;
+            }
+#endif
+#if __linux__
+            else if (0 == strcasecmp(name, "timestamps"))
+            {
+                if (atoi(val))
+                    sport->sp_flags |= SPORT_TIMESTAMPS;
+                else
+                    sport->sp_flags &= ~SPORT_TIMESTAMPS;
+                free(name);
+                return 0;
+            }
+#endif
             else
             {
                 free(name);
@@ -315,7 +440,7 @@ prog_process_conns (struct prog *prog)
             timeout.tv_usec = (unsigned) diff % 1000000;
         }
 
-        if (!prog_is_stopped())
+        if (!prog_is_stopped(prog))
             event_add(prog->prog_timer, &timeout);
     }
 }
@@ -325,7 +450,7 @@ static void
 prog_timer_handler (int fd, short what, void *arg)
 {
     struct prog *const prog = arg;
-    if (!prog_is_stopped())
+    if (!prog_is_stopped(prog))
         prog_process_conns(prog);
 }
 
@@ -342,9 +467,12 @@ int
 prog_run (struct prog *prog)
 {
 #ifndef WIN32
-    prog->prog_usr1 = evsignal_new(prog->prog_eb, SIGUSR1,
+    if (!prog->prog_no_signals)
+    {
+        prog->prog_usr1 = evsignal_new(prog->prog_eb, SIGUSR1,
                                                     prog_usr1_handler, prog);
-    evsignal_add(prog->prog_usr1, NULL);
+        evsignal_add(prog->prog_usr1, NULL);
+    }
 #endif
 
     event_base_loop(prog->prog_eb, 0);
@@ -368,7 +496,7 @@ prog_stop (struct prog *prog)
 {
     struct service_port *sport;
 
-    prog_stopped = 1;
+    prog->prog_stopped = 1;
 
     while ((sport = TAILQ_FIRST(prog->prog_sports)))
     {
@@ -404,7 +532,9 @@ prog_prep (struct prog *prog)
         return -1;
     }
 
-    pba_init(&prog->prog_pba, prog->prog_packout_max);
+    /* Packet trains are allocated as single buffers of up to 64 KB */
+    pba_init(&prog->prog_pba, prog->prog_packout_max,
+                        prog->prog_settings.es_max_train_len ? 0xFFFF : 0);
 
     if (TAILQ_EMPTY(prog->prog_sports))
     {
@@ -435,9 +565,9 @@ prog_prep (struct prog *prog)
 
 
 int
-prog_is_stopped (void)
+prog_is_stopped (const struct prog *prog)
 {
-    return prog_stopped != 0;
+    return prog->prog_stopped != 0;
 }
 
 
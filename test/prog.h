@@ -30,12 +30,23 @@ struct prog
     struct lsquic_engine           *prog_engine;
     const char                     *prog_hostname;
     int                             prog_ipver;     /* 0, 4, or 6 */
+    int                             prog_stopped;
+    int                             prog_no_signals;
 };
 
 void
 prog_init (struct prog *, unsigned lsquic_engine_flags, struct sport_head *,
                     const struct lsquic_stream_if *, void *stream_if_ctx);
 
+/* Initialize `prog' using settings and options of `src', including service
+ * ports.  This is used to run several engines in parallel, each in its own
+ * thread.  Unlike prog_init(), global initialization is not performed.
+ * Signals are left to `src' to handle.
+ */
+int
+prog_copy (struct prog *, const struct prog *src, struct sport_head *,
+                                                        void *stream_if_ctx);
+
 #if LSQUIC_DONTFRAG_SUPPORTED
 #   define IP_DONTFRAG_FLAG "D"
 #else
@@ -74,7 +85,7 @@ void
 prog_print_common_options (const struct prog *, FILE *);
 
 int
-prog_is_stopped (void);
+prog_is_stopped (const struct prog *);
 
 void
 prog_process_conns (struct prog *);
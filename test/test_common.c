@@ -16,6 +16,9 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
+#if __linux__
+#include <netinet/udp.h>
+#endif
 #else
 #include <Windows.h>
 #include <WinSock2.h>
@@ -33,6 +36,12 @@
 #if HAVE_REGEX
 #include <regex.h>
 #endif
+#if __linux__
+#include <time.h>
+#endif
+#if LSQUIC_TXTIME_SUPPORTED
+#include <linux/net_tstamp.h>
+#endif
 
 #include <event2/event.h>
 
@@ -57,8 +66,10 @@
 
 #if __linux__
 #   define NDROPPED_SZ CMSG_SPACE(sizeof(uint32_t))  /* SO_RXQ_OVFL */
+#   define TSTAMP_SZ CMSG_SPACE(sizeof(struct timespec))  /* SO_TIMESTAMPNS */
 #else
 #   define NDROPPED_SZ 0
+#   define TSTAMP_SZ 0
 #endif
 
 #if __linux__ && defined(IP_RECVORIGDSTADDR)
@@ -74,7 +85,38 @@
 #define MAX_PACKET_SZ 1370
 
 #define CTL_SZ (CMSG_SPACE(MAX(DST_MSG_SZ, \
-                                sizeof(struct in6_pktinfo))) + NDROPPED_SZ)
+                    sizeof(struct in6_pktinfo))) + NDROPPED_SZ + TSTAMP_SZ)
+
+#if LSQUIC_MMSG_SUPPORTED
+/* Maximum number of datagrams received by one recvmmsg() call */
+#define MAX_MMSG_IN 64
+/* Maximum number of messages sent by one sendmmsg() call */
+#define MAX_MMSG_OUT 64
+#endif
+
+#if LSQUIC_GSO_SUPPORTED
+#ifndef UDP_MAX_SEGMENTS
+#define UDP_MAX_SEGMENTS 64
+#endif
+/* Limit on the payload of a single GSO datagram, leaving room for headers */
+#define MAX_GSO_SZ (0xFFFF - 48)
+#endif
+
+#if LSQUIC_TXTIME_SUPPORTED
+/* Departure time in nanoseconds (SCM_TXTIME) */
+#define TXTIME_CTL_SZ CMSG_SPACE(sizeof(uint64_t))
+#else
+#define TXTIME_CTL_SZ 0
+#endif
+
+#if LSQUIC_GRO_SUPPORTED
+/* A GRO datagram carries up to 64 coalesced packets (UDP_GRO_CNT_MAX) */
+#define MAX_GRO_SEGS 64
+#define GRO_BUF_SZ 0x10000
+#define GRO_CTL_SZ CMSG_SPACE(sizeof(int))
+#else
+#define GRO_CTL_SZ 0
+#endif
 
 /* There are `n_alloc' elements in `vecs', `local_addresses', and
  * `peer_addresses' arrays.  `ctlmsg_data' is n_alloc * CTL_SZ.  Each packets
@@ -94,6 +136,10 @@ struct packets_in
 #endif
     struct sockaddr_storage *local_addresses,
                             *peer_addresses;
+    uint64_t                *received;      /* Zero if not timestamped */
+#if LSQUIC_MMSG_SUPPORTED
+    struct lsquic_in_spec   *specs;
+#endif
     unsigned                 n_alloc;
     unsigned                 data_sz;
 };
@@ -150,7 +196,7 @@ static void getExtensionPtrs()
 
 
 static struct packets_in *
-allocate_packets_in (SOCKET_TYPE fd)
+allocate_packets_in (const struct service_port *sport, SOCKET_TYPE fd)
 {
     struct packets_in *packs_in;
     unsigned n_alloc;
@@ -164,6 +210,12 @@ allocate_packets_in (SOCKET_TYPE fd)
         return NULL;
     }
 
+#if LSQUIC_GRO_SUPPORTED
+    /* Make sure that there is room for at least one GRO datagram */
+    if ((sport->sp_flags & SPORT_GRO) && recvsz < GRO_BUF_SZ)
+        recvsz = GRO_BUF_SZ;
+#endif
+
     n_alloc = (unsigned) recvsz / MAX_PACKET_SZ * 2;
     LSQ_INFO("socket buffer size: %d bytes; max # packets is set to %u",
         recvsz, n_alloc);
@@ -176,6 +228,10 @@ allocate_packets_in (SOCKET_TYPE fd)
     packs_in->vecs = malloc(n_alloc * sizeof(packs_in->vecs[0]));
     packs_in->local_addresses = malloc(n_alloc * sizeof(packs_in->local_addresses[0]));
     packs_in->peer_addresses = malloc(n_alloc * sizeof(packs_in->peer_addresses[0]));
+    packs_in->received = malloc(n_alloc * sizeof(packs_in->received[0]));
+#if LSQUIC_MMSG_SUPPORTED
+    packs_in->specs = malloc(n_alloc * sizeof(packs_in->specs[0]));
+#endif
 
     return packs_in;
 }
@@ -184,6 +240,10 @@ allocate_packets_in (SOCKET_TYPE fd)
 static void
 free_packets_in (struct packets_in *packs_in)
 {
+#if LSQUIC_MMSG_SUPPORTED
+    free(packs_in->specs);
+#endif
+    free(packs_in->received);
     free(packs_in->peer_addresses);
     free(packs_in->local_addresses);
     free(packs_in->ctlmsg_data);
@@ -367,8 +427,30 @@ sport_new (const char *optarg, struct prog *prog)
 }
 
 
+#if __linux__
+/* Convert kernel receive timestamp, which uses CLOCK_REALTIME, to the
+ * monotonic clock used by the library.
+ */
+static uint64_t
+timestamp_to_received (const struct timespec *ts)
+{
+    struct timespec real, mono;
+    int64_t age;
+
+    (void) clock_gettime(CLOCK_REALTIME, &real);
+    (void) clock_gettime(CLOCK_MONOTONIC, &mono);
+    age = (int64_t) (real.tv_sec - ts->tv_sec) * 1000000
+                                    + (real.tv_nsec - ts->tv_nsec) / 1000;
+    if (age < 0)
+        age = 0;
+    return (uint64_t) mono.tv_sec * 1000000 + mono.tv_nsec / 1000 - age;
+}
+
+
+#endif
 /* Replace IP address part of `sa' with that provided in ancillary messages
- * in `msg'.
+ * in `msg'.  On Linux, also get the number of dropped packets and receive
+ * timestamp, if present.
  */
 static void
 proc_ancillary (
@@ -379,7 +461,7 @@ proc_ancillary (
 #endif
                               *msg, struct sockaddr_storage *storage
 #if __linux__
-                , uint32_t *n_dropped
+                , uint32_t *n_dropped, uint64_t *received
 #endif
                 )
 {
@@ -429,6 +511,13 @@ proc_ancillary (
         else if (cmsg->cmsg_level == SOL_SOCKET &&
                  cmsg->cmsg_type  == SO_RXQ_OVFL)
             memcpy(n_dropped, CMSG_DATA(cmsg), sizeof(*n_dropped));
+        else if (cmsg->cmsg_level == SOL_SOCKET &&
+                 cmsg->cmsg_type  == SCM_TIMESTAMPNS)
+        {
+            struct timespec ts;
+            memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+            *received = timestamp_to_received(&ts);
+        }
 #endif
     }
 }
@@ -444,6 +533,22 @@ struct read_iter
 
 enum rop { ROP_OK, ROP_NOROOM, ROP_ERROR, };
 
+
+#if __linux__
+static void
+update_n_dropped (struct service_port *sport, uint32_t n_dropped)
+{
+    if (sport->drop_init)
+    {
+        if (sport->n_dropped < n_dropped)
+            LSQ_INFO("dropped %u packets", n_dropped - sport->n_dropped);
+    }
+    else
+        sport->drop_init = 1;
+    sport->n_dropped = n_dropped;
+}
+#endif
+
 static enum rop
 read_one_packet (struct read_iter *iter)
 {
@@ -514,23 +619,17 @@ read_one_packet (struct read_iter *iter)
 
     local_addr = &packs_in->local_addresses[iter->ri_idx];
     memcpy(local_addr, &sport->sp_local_addr, sizeof(*local_addr));
+    packs_in->received[iter->ri_idx] = 0;
 #if __linux__
     n_dropped = 0;
 #endif
     proc_ancillary(&msg, local_addr
 #if __linux__
-        , &n_dropped
+        , &n_dropped, &packs_in->received[iter->ri_idx]
 #endif
     );
 #if __linux__
-    if (sport->drop_init)
-    {
-        if (sport->n_dropped < n_dropped)
-            LSQ_INFO("dropped %u packets", n_dropped - sport->n_dropped);
-    }
-    else
-        sport->drop_init = 1;
-    sport->n_dropped = n_dropped;
+    update_n_dropped(sport, n_dropped);
 #endif
 
 #ifndef WIN32
@@ -545,6 +644,137 @@ read_one_packet (struct read_iter *iter)
 }
 
 
+#if LSQUIC_GRO_SUPPORTED
+/* Return segment size of a GRO datagram or zero if the datagram was not
+ * coalesced.
+ */
+static int
+get_gro_size (struct msghdr *msg)
+{
+    struct cmsghdr *cmsg;
+    int gso_size;
+
+    for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg))
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+        {
+            memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+            return gso_size;
+        }
+
+    return 0;
+}
+#endif
+
+
+#if LSQUIC_MMSG_SUPPORTED
+/* Read as many datagrams as there is room for using a single recvmmsg()
+ * call.  When GRO is on, a datagram may contain several packets: these
+ * are split up into separate `vecs' elements.
+ */
+static enum rop
+read_packets_mmsg (struct read_iter *iter)
+{
+    struct service_port *const sport = iter->ri_sport;
+    struct packets_in *const packs_in = sport->packs_in;
+    struct mmsghdr mmsgs[MAX_MMSG_IN];
+    struct iovec iovs[MAX_MMSG_IN];
+    struct sockaddr_storage peer_addrs[MAX_MMSG_IN];
+    unsigned char ctl_bufs[MAX_MMSG_IN][CTL_SZ + GRO_CTL_SZ];
+    struct sockaddr_storage local_addr;
+    unsigned n, n_msgs, max_segs;
+    size_t buf_sz, off, seg_off, seg_sz, gso_size;
+    uint32_t n_dropped;
+    uint64_t received;
+    int nread;
+
+#if LSQUIC_GRO_SUPPORTED
+    if (sport->sp_flags & SPORT_GRO)
+    {
+        buf_sz = GRO_BUF_SZ;
+        max_segs = MAX_GRO_SEGS;
+    }
+    else
+#endif
+    {
+        buf_sz = MAX_PACKET_SZ;
+        max_segs = 1;
+    }
+
+    for (n_msgs = 0, off = iter->ri_off;
+            n_msgs < MAX_MMSG_IN
+            && off + buf_sz <= packs_in->data_sz
+            && iter->ri_idx + (n_msgs + 1) * max_segs <= packs_in->n_alloc;
+                                                ++n_msgs, off += buf_sz)
+    {
+        iovs[n_msgs].iov_base = packs_in->packet_data + off;
+        iovs[n_msgs].iov_len  = buf_sz;
+        mmsgs[n_msgs].msg_hdr = (struct msghdr) {
+            .msg_name       = &peer_addrs[n_msgs],
+            .msg_namelen    = sizeof(peer_addrs[n_msgs]),
+            .msg_iov        = &iovs[n_msgs],
+            .msg_iovlen     = 1,
+            .msg_control    = ctl_bufs[n_msgs],
+            .msg_controllen = sizeof(ctl_bufs[n_msgs]),
+        };
+    }
+
+    if (0 == n_msgs)
+    {
+        LSQ_DEBUG("out of room in packets_in");
+        return ROP_NOROOM;
+    }
+
+    nread = recvmmsg(sport->fd, mmsgs, n_msgs, 0, NULL);
+    if (-1 == nread) {
+        if (!(EAGAIN == errno || EWOULDBLOCK == errno))
+            LSQ_ERROR("recvmmsg: %s", strerror(errno));
+        return ROP_ERROR;
+    }
+
+    for (n = 0; n < (unsigned) nread; ++n)
+    {
+        memcpy(&local_addr, &sport->sp_local_addr, sizeof(local_addr));
+        n_dropped = 0;
+        received = 0;
+        proc_ancillary(&mmsgs[n].msg_hdr, &local_addr, &n_dropped,
+                                                                &received);
+        update_n_dropped(sport, n_dropped);
+#if LSQUIC_GRO_SUPPORTED
+        if (sport->sp_flags & SPORT_GRO)
+            gso_size = get_gro_size(&mmsgs[n].msg_hdr);
+        else
+#endif
+            gso_size = 0;
+        if (0 == gso_size)
+            gso_size = mmsgs[n].msg_len;
+        for (seg_off = 0; seg_off < mmsgs[n].msg_len; seg_off += seg_sz)
+        {
+            seg_sz = MIN(gso_size, mmsgs[n].msg_len - seg_off);
+            packs_in->vecs[iter->ri_idx].iov_base =
+                                (unsigned char *) iovs[n].iov_base + seg_off;
+            packs_in->vecs[iter->ri_idx].iov_len  = seg_sz;
+            memcpy(&packs_in->local_addresses[iter->ri_idx], &local_addr,
+                                                        sizeof(local_addr));
+            memcpy(&packs_in->peer_addresses[iter->ri_idx], &peer_addrs[n],
+                                                        sizeof(peer_addrs[n]));
+            packs_in->received[iter->ri_idx] = received;
+            iter->ri_idx += 1;
+        }
+        iter->ri_off += buf_sz;
+    }
+
+    if ((unsigned) nread < n_msgs)
+    {
+        /* Socket has been drained: save a system call */
+        errno = EAGAIN;
+        return ROP_ERROR;
+    }
+
+    return ROP_OK;
+}
+#endif
+
+
 #if __GNUC__
 #   define UNLIKELY(cond) __builtin_expect(cond, 0)
 #else
@@ -562,8 +792,16 @@ read_handler (evutil_socket_t fd, short flags, void *ctx)
     unsigned n, n_batches;
     /* Save the value in case program is stopped packs_in is freed: */
     const unsigned n_alloc = packs_in->n_alloc;
+    enum rop (*read_packets) (struct read_iter *);
     enum rop rop;
 
+#if LSQUIC_MMSG_SUPPORTED
+    if (sport->sp_flags & SPORT_MMSG)
+        read_packets = read_packets_mmsg;
+    else
+#endif
+        read_packets = read_one_packet;
+
     n_batches = 0;
     iter.ri_sport = sport;
 
@@ -574,7 +812,7 @@ read_handler (evutil_socket_t fd, short flags, void *ctx)
         iter.ri_idx = 0;
 
         do
-            rop = read_one_packet(&iter);
+            rop = read_packets(&iter);
         while (ROP_OK == rop);
 
         if (UNLIKELY(ROP_ERROR == rop && (sport->sp_flags & SPORT_CONNECT)
@@ -587,8 +825,26 @@ read_handler (evutil_socket_t fd, short flags, void *ctx)
 
         n_batches += iter.ri_idx > 0;
 
+#if LSQUIC_MMSG_SUPPORTED
+        if (sport->sp_flags & SPORT_MMSG)
+        {
+            for (n = 0; n < iter.ri_idx; ++n)
+            {
+                packs_in->specs[n].buf      = packs_in->vecs[n].iov_base;
+                packs_in->specs[n].sz       = packs_in->vecs[n].iov_len;
+                packs_in->specs[n].local_sa =
+                        (struct sockaddr *) &packs_in->local_addresses[n];
+                packs_in->specs[n].peer_sa  =
+                        (struct sockaddr *) &packs_in->peer_addresses[n];
+                packs_in->specs[n].peer_ctx = sport;
+                packs_in->specs[n].received = packs_in->received[n];
+            }
+            (void) lsquic_engine_packets_in(engine, packs_in->specs, n);
+        }
+        else
+#endif
         for (n = 0; n < iter.ri_idx; ++n)
-            if (0 > lsquic_engine_packet_in(engine,
+            if (0 > lsquic_engine_packet_in_ts(engine,
 #ifndef WIN32
                         packs_in->vecs[n].iov_base,
                         packs_in->vecs[n].iov_len,
@@ -598,13 +854,13 @@ read_handler (evutil_socket_t fd, short flags, void *ctx)
 #endif
                         (struct sockaddr *) &packs_in->local_addresses[n],
                         (struct sockaddr *) &packs_in->peer_addresses[n],
-                        sport))
+                        sport, packs_in->received[n]))
                 break;
 
         if (n > 0)
             prog_process_conns(sport->sp_prog);
     }
-    while (ROP_NOROOM == rop && !prog_is_stopped());
+    while (ROP_NOROOM == rop && !prog_is_stopped(sport->sp_prog));
 
     if (n_batches)
         n += n_alloc * (n_batches - 1);
@@ -768,6 +1024,53 @@ sport_init_client (struct service_port *sport, struct lsquic_engine *engine,
         }
     }
 
+#if LSQUIC_GRO_SUPPORTED
+    if (sport->sp_flags & SPORT_GRO)
+    {
+        int on = 1;
+        s = setsockopt(sockfd, SOL_UDP, UDP_GRO, &on, sizeof(on));
+        if (0 != s)
+        {
+            saved_errno = errno;
+            CLOSE_SOCKET(sockfd);
+            errno = saved_errno;
+            return -1;
+        }
+    }
+#endif
+
+#if __linux__
+    if (sport->sp_flags & SPORT_TIMESTAMPS)
+    {
+        int on = 1;
+        s = setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+        if (0 != s)
+        {
+            saved_errno = errno;
+            CLOSE_SOCKET(sockfd);
+            errno = saved_errno;
+            return -1;
+        }
+    }
+#endif
+
+#if LSQUIC_TXTIME_SUPPORTED
+    if (sport->sp_flags & SPORT_TXTIME)
+    {
+        /* Departure times passed by the library are on CLOCK_MONOTONIC */
+        struct sock_txtime txtime_opt = { .clockid = CLOCK_MONOTONIC, };
+        s = setsockopt(sockfd, SOL_SOCKET, SO_TXTIME, &txtime_opt,
+                                                    sizeof(txtime_opt));
+        if (0 != s)
+        {
+            saved_errno = errno;
+            CLOSE_SOCKET(sockfd);
+            errno = saved_errno;
+            return -1;
+        }
+    }
+#endif
+
     if (0 != getsockname(sockfd, sa_local, &socklen))
     {
         saved_errno = errno;
@@ -776,7 +1079,7 @@ sport_init_client (struct service_port *sport, struct lsquic_engine *engine,
         return -1;
     }
 
-    sport->packs_in = allocate_packets_in(sockfd);
+    sport->packs_in = allocate_packets_in(sport, sockfd);
     if (!sport->packs_in)
     {
         saved_errno = errno;
@@ -878,11 +1181,49 @@ setup_control_msg (
 }
 
 
+#if LSQUIC_TXTIME_SUPPORTED
+/* Append SCM_TXTIME message to control data in `buf', which may already
+ * contain other messages.
+ */
+static void
+add_txtime_msg (struct msghdr *msg, unsigned char *buf, size_t bufsz,
+                                                            uint64_t txtime)
+{
+    struct cmsghdr *cmsg;
+    uint64_t txtime_ns;
+    size_t off;
+
+    off = CMSG_ALIGN(msg->msg_controllen);
+    assert(off + CMSG_SPACE(sizeof(txtime_ns)) <= bufsz);
+    cmsg = (struct cmsghdr *) (buf + off);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type  = SCM_TXTIME;
+    cmsg->cmsg_len   = CMSG_LEN(sizeof(txtime_ns));
+    txtime_ns = txtime * 1000;
+    memcpy(CMSG_DATA(cmsg), &txtime_ns, sizeof(txtime_ns));
+    msg->msg_control    = buf;
+    msg->msg_controllen = off + CMSG_SPACE(sizeof(txtime_ns));
+}
+
+
+#endif
+/* Return size of the packet at offset `off' in the spec buffer */
+static size_t
+spec_seg_sz (const struct lsquic_out_spec *spec, size_t off)
+{
+    if (spec->segment_sz)
+        return MIN(spec->segment_sz, spec->sz - off);
+    else
+        return spec->sz;
+}
+
+
 static int
 send_packets_one_by_one (const struct lsquic_out_spec *specs, unsigned count)
 {
     const struct service_port *sport;
     unsigned n;
+    size_t off, seg_sz;
     int s = 0;
 #ifndef WIN32
     struct msghdr msg;
@@ -898,7 +1239,8 @@ send_packets_one_by_one (const struct lsquic_out_spec *specs, unsigned count)
 #	define SIZE1 sizeof(struct in_addr)
 #endif
         unsigned char buf[
-            CMSG_SPACE(MAX(SIZE1, sizeof(struct in6_pktinfo)))];
+            CMSG_SPACE(MAX(SIZE1, sizeof(struct in6_pktinfo)))
+                                                        + TXTIME_CTL_SZ];
         struct cmsghdr cmsg;
     } ancil;
 #ifndef WIN32
@@ -930,12 +1272,15 @@ send_packets_one_by_one (const struct lsquic_out_spec *specs, unsigned count)
 #endif
 
     n = 0;
+    off = 0;
     do
     {
         sport = specs[n].peer_ctx;
+        /* Packet train is sent one packet at a time */
+        seg_sz = spec_seg_sz(&specs[n], off);
 #ifndef WIN32
-        iov.iov_base = (void *) specs[n].buf;
-        iov.iov_len = specs[n].sz;
+        iov.iov_base = (void *) (specs[n].buf + off);
+        iov.iov_len = seg_sz;
         msg.msg_name       = (void *) specs[n].dest_sa;
         msg.msg_namelen    = (AF_INET == specs[n].dest_sa->sa_family ?
                                             sizeof(struct sockaddr_in) :
@@ -944,8 +1289,8 @@ send_packets_one_by_one (const struct lsquic_out_spec *specs, unsigned count)
         msg.msg_iovlen     = 1;
         msg.msg_flags      = 0;
 #else
-        iov.buf = (void *) specs[n].buf;
-        iov.len = specs[n].sz;
+        iov.buf = (void *) (specs[n].buf + off);
+        iov.len = seg_sz;
         msg.name           = (void *) specs[n].dest_sa;
         msg.namelen        = (AF_INET == specs[n].dest_sa->sa_family ?
                                             sizeof(struct sockaddr_in) :
@@ -966,6 +1311,11 @@ send_packets_one_by_one (const struct lsquic_out_spec *specs, unsigned count)
             msg.Control.len = 0;
 #endif
         }
+#if LSQUIC_TXTIME_SUPPORTED
+        if ((sport->sp_flags & SPORT_TXTIME) && specs[n].txtime)
+            add_txtime_msg(&msg, ancil.buf, sizeof(ancil.buf),
+                                                        specs[n].txtime);
+#endif
 #ifndef WIN32
         s = sendmsg(sport->fd, &msg, 0);
 #else
@@ -980,7 +1330,12 @@ send_packets_one_by_one (const struct lsquic_out_spec *specs, unsigned count)
 #endif
             break;
         }
-        ++n;
+        off += seg_sz;
+        if (off == specs[n].sz)
+        {
+            ++n;
+            off = 0;
+        }
     }
     while (n < count);
 
@@ -1001,10 +1356,234 @@ send_packets_one_by_one (const struct lsquic_out_spec *specs, unsigned count)
 }
 
 
+#if LSQUIC_MMSG_SUPPORTED
+static socklen_t
+sockaddr_len (const struct sockaddr *sa)
+{
+    return AF_INET == sa->sa_family ? sizeof(struct sockaddr_in)
+                                    : sizeof(struct sockaddr_in6);
+}
+
+
+static int
+sockaddr_eq (const struct sockaddr *a, const struct sockaddr *b)
+{
+    const struct sockaddr_in *a4, *b4;
+    const struct sockaddr_in6 *a6, *b6;
+
+    if (a == b)
+        return 1;
+    if (a->sa_family != b->sa_family)
+        return 0;
+    if (AF_INET == a->sa_family)
+    {
+        a4 = (const struct sockaddr_in *) a;
+        b4 = (const struct sockaddr_in *) b;
+        return a4->sin_port == b4->sin_port
+            && a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+    }
+    else
+    {
+        a6 = (const struct sockaddr_in6 *) a;
+        b6 = (const struct sockaddr_in6 *) b;
+        return a6->sin6_port == b6->sin6_port
+            && 0 == memcmp(&a6->sin6_addr, &b6->sin6_addr,
+                                                    sizeof(a6->sin6_addr));
+    }
+}
+
+
+/* Send packets using sendmmsg(), one system call per up to MAX_MMSG_OUT
+ * messages.  If GSO is on, consecutive packets to the same destination
+ * are sent as one datagram which the kernel splits into segments.  All
+ * packets in such a train must have the same size, except for the last
+ * packet, which may be shorter.
+ *
+ * Packet trains prepared by the engine (see es_max_train_len) are sent
+ * the same way.  Without GSO, each packet in the train is sent as its
+ * own message.  A spec counts as sent only once all of its packets are
+ * sent: if a train is cut short, its packets will be sent again.
+ */
+static int
+send_packets_mmsg (const struct lsquic_out_spec *specs, unsigned count)
+{
+    struct service_port *sport;
+    struct mmsghdr mmsgs[MAX_MMSG_OUT];
+    struct iovec iovs[MAX_MMSG_OUT];
+    unsigned n_specs[MAX_MMSG_OUT];     /* Number of specs completed by
+                                         * message
+                                         */
+    union {
+        /* cmsg(3) recommends union for proper alignment */
+        unsigned char buf[
+            CMSG_SPACE(MAX(sizeof(struct in_pktinfo),
+                                            sizeof(struct in6_pktinfo)))
+                                                        + TXTIME_CTL_SZ];
+        struct cmsghdr cmsg;
+    } ancil[MAX_MMSG_OUT];
+#if LSQUIC_GSO_SUPPORTED
+    struct cmsghdr *cmsg;
+#endif
+    const unsigned char *seg;
+    unsigned i, n, n_sent, n_msgs, n_iovs, first, first_iov, n_segs;
+    size_t off, seg_sz, sz, total_sz;
+    int s, gso;
+
+    if (0 == count)
+        return 0;
+
+    n = 0;
+    off = 0;
+    n_sent = 0;
+    s = 0;
+    sport = specs[0].peer_ctx;
+    while (n < count)
+    {
+        sport = specs[n].peer_ctx;
+        n_msgs = 0;
+        n_iovs = 0;
+        while (n < count && n_msgs < MAX_MMSG_OUT && n_iovs < MAX_MMSG_OUT
+                                            && specs[n].peer_ctx == sport)
+        {
+            first = n;
+            first_iov = n_iovs;
+            seg_sz = spec_seg_sz(&specs[n], off);
+            total_sz = 0;
+            n_segs = 0;
+            n_specs[n_msgs] = 0;
+            gso = 0;
+#if LSQUIC_GSO_SUPPORTED
+            /* Servers need source address in ancillary data: only bother
+             * with GSO for clients.
+             */
+            gso = (sport->sp_flags & SPORT_GSO)
+                && !((sport->sp_flags & SPORT_SERVER)
+                                        && specs[n].local_sa->sa_family);
+#endif
+            do
+            {
+                /* Packets adjacent in memory -- such as those in a packet
+                 * train -- share an iovec.
+                 */
+                seg = specs[n].buf + off;
+                sz = spec_seg_sz(&specs[n], off);
+                if (n_iovs > first_iov
+                        && (unsigned char *) iovs[n_iovs - 1].iov_base
+                                    + iovs[n_iovs - 1].iov_len == seg)
+                    iovs[n_iovs - 1].iov_len += sz;
+                else
+                {
+                    iovs[n_iovs].iov_base = (void *) seg;
+                    iovs[n_iovs].iov_len  = sz;
+                    ++n_iovs;
+                }
+                total_sz += sz;
+                ++n_segs;
+                off += sz;
+                if (off == specs[n].sz)
+                {
+                    ++n_specs[n_msgs];
+                    ++n;
+                    off = 0;
+                }
+            }
+            while (gso && n < count && n_iovs < MAX_MMSG_OUT
+#if LSQUIC_GSO_SUPPORTED
+                && n_segs < UDP_MAX_SEGMENTS
+                && total_sz + spec_seg_sz(&specs[n], off) <= MAX_GSO_SZ
+#endif
+#if LSQUIC_TXTIME_SUPPORTED
+                /* The whole datagram departs at once */
+                && !((sport->sp_flags & SPORT_TXTIME)
+                                && specs[n].txtime > specs[first].txtime)
+#endif
+                && specs[n].peer_ctx == sport
+                && sz == seg_sz && spec_seg_sz(&specs[n], off) <= seg_sz
+                && sockaddr_eq(specs[n].dest_sa, specs[first].dest_sa));
+
+            mmsgs[n_msgs].msg_hdr = (struct msghdr) {
+                .msg_name       = (void *) specs[first].dest_sa,
+                .msg_namelen    = sockaddr_len(specs[first].dest_sa),
+                .msg_iov        = &iovs[first_iov],
+                .msg_iovlen     = n_iovs - first_iov,
+            };
+            if ((sport->sp_flags & SPORT_SERVER)
+                                        && specs[first].local_sa->sa_family)
+                setup_control_msg(&mmsgs[n_msgs].msg_hdr, &specs[first],
+                            ancil[n_msgs].buf, sizeof(ancil[n_msgs].buf));
+#if LSQUIC_GSO_SUPPORTED
+            else if (n_segs > 1)
+            {
+                mmsgs[n_msgs].msg_hdr.msg_control = ancil[n_msgs].buf;
+                mmsgs[n_msgs].msg_hdr.msg_controllen =
+                                                    sizeof(ancil[n_msgs].buf);
+                cmsg = CMSG_FIRSTHDR(&mmsgs[n_msgs].msg_hdr);
+                cmsg->cmsg_level = SOL_UDP;
+                cmsg->cmsg_type  = UDP_SEGMENT;
+                cmsg->cmsg_len   = CMSG_LEN(sizeof(uint16_t));
+                *(uint16_t *) CMSG_DATA(cmsg) = seg_sz;
+                mmsgs[n_msgs].msg_hdr.msg_controllen = CMSG_SPACE(
+                                                            sizeof(uint16_t));
+            }
+#endif
+#if LSQUIC_TXTIME_SUPPORTED
+            if ((sport->sp_flags & SPORT_TXTIME) && specs[first].txtime)
+                add_txtime_msg(&mmsgs[n_msgs].msg_hdr, ancil[n_msgs].buf,
+                            sizeof(ancil[n_msgs].buf), specs[first].txtime);
+#endif
+            ++n_msgs;
+        }
+
+        s = sendmmsg(sport->fd, mmsgs, n_msgs, 0);
+        if (s < 0)
+        {
+#if LSQUIC_GSO_SUPPORTED
+            if (EIO == errno && (sport->sp_flags & SPORT_GSO))
+            {
+                /* Likely no checksum offload: fall back to plain sendmmsg */
+                LSQ_WARN("sendmmsg failed with EIO, turn off GSO");
+                sport->sp_flags &= ~SPORT_GSO;
+                n = n_sent;
+                off = 0;
+                continue;
+            }
+#endif
+            LSQ_INFO("sendmmsg failed: %s", strerror(errno));
+            break;
+        }
+        for (i = 0; i < (unsigned) s; ++i)
+            n_sent += n_specs[i];
+        if ((unsigned) s < n_msgs)
+            break;
+    }
+
+    if (n_sent < count)
+        prog_sport_cant_send(sport->sp_prog, sport->fd);
+
+    if (n_sent > 0)
+        return n_sent;
+    else if (s < 0)
+        return -1;
+    else
+        return 0;
+}
+#endif
+
+
 int
 sport_packets_out (void *ctx, const struct lsquic_out_spec *specs,
                    unsigned count)
 {
+#if LSQUIC_MMSG_SUPPORTED
+    const struct service_port *sport;
+
+    if (count > 0)
+    {
+        sport = specs[0].peer_ctx;
+        if (sport->sp_flags & SPORT_MMSG)
+            return send_packets_mmsg(specs, count);
+    }
+#endif
         return send_packets_one_by_one(specs, count);
 }
 
@@ -1045,6 +1624,11 @@ set_engine_option (struct lsquic_engine_settings *settings,
             settings->es_support_srej = atoi(val);
             return 0;
         }
+        if (0 == strncmp(name, "rack", 4))
+        {
+            settings->es_rack = atoi(val);
+            return 0;
+        }
         break;
     case 7:
         if (0 == strncmp(name, "version", 7))
@@ -1066,6 +1650,11 @@ set_engine_option (struct lsquic_engine_settings *settings,
             settings->es_rw_once = atoi(val);
             return 0;
         }
+        else if (0 == strncmp(name, "cc_algo", 7))
+        {
+            settings->es_cc_algo = atoi(val);
+            return 0;
+        }
         break;
     case 8:
         if (0 == strncmp(name, "max_cfcw", 8))
@@ -1086,6 +1675,13 @@ set_engine_option (struct lsquic_engine_settings *settings,
             return 0;
         }
         break;
+    case 11:
+        if (0 == strncmp(name, "timer_wheel", 11))
+        {
+            settings->es_timer_wheel = atoi(val);
+            return 0;
+        }
+        break;
     case 12:
         if (0 == strncmp(name, "idle_conn_to", 12))
         {
@@ -1112,6 +1708,11 @@ set_engine_option (struct lsquic_engine_settings *settings,
             settings->es_handshake_to = atoi(val);
             return 0;
         }
+        if (0 == strncmp(name, "pace_horizon", 12))
+        {
+            settings->es_pace_horizon = atoi(val);
+            return 0;
+        }
         break;
     case 13:
         if (0 == strncmp(name, "support_tcid0", 13))
@@ -1119,6 +1720,21 @@ set_engine_option (struct lsquic_engine_settings *settings,
             settings->es_support_tcid0 = atoi(val);
             return 0;
         }
+        if (0 == strncmp(name, "max_train_len", 13))
+        {
+            settings->es_max_train_len = atoi(val);
+            return 0;
+        }
+        if (0 == strncmp(name, "mm_max_cached", 13))
+        {
+            settings->es_mm_max_cached = atoi(val);
+            return 0;
+        }
+        if (0 == strncmp(name, "mm_huge_pages", 13))
+        {
+            settings->es_mm_huge_pages = atoi(val);
+            return 0;
+        }
         break;
     case 14:
         if (0 == strncmp(name, "max_streams_in", 14))
@@ -1131,6 +1747,18 @@ set_engine_option (struct lsquic_engine_settings *settings,
             settings->es_progress_check = atoi(val);
             return 0;
         }
+        if (0 == strncmp(name, "ack_decimation", 14))
+        {
+            settings->es_ack_decimation = atoi(val);
+            return 0;
+        }
+        break;
+    case 15:
+        if (0 == strncmp(name, "conn_mem_budget", 15))
+        {
+            settings->es_conn_mem_budget = atoi(val);
+            return 0;
+        }
         break;
     case 16:
         if (0 == strncmp(name, "proc_time_thresh", 16))
@@ -1161,11 +1789,12 @@ struct packout_buf
 
 
 void
-pba_init (struct packout_buf_allocator *pba, unsigned max)
+pba_init (struct packout_buf_allocator *pba, unsigned max, unsigned bufsz)
 {
     SLIST_INIT(&pba->free_packout_bufs);
     pba->max   = max;
     pba->n_out = 0;
+    pba->bufsz = MAX(bufsz, MAX_PACKOUT_BUF_SZ);
 }
 
 
@@ -1176,7 +1805,7 @@ pba_allocate (void *packout_buf_allocator, void *peer_ctx, unsigned short size,
     struct packout_buf_allocator *const pba = packout_buf_allocator;
     struct packout_buf *pb;
 
-    if (size > MAX_PACKOUT_BUF_SZ)
+    if (size > pba->bufsz)
     {
         fprintf(stderr, "packout buf size too large: %hu", size);
         abort();
@@ -1193,7 +1822,7 @@ pba_allocate (void *packout_buf_allocator, void *peer_ctx, unsigned short size,
     if (pb)
         SLIST_REMOVE_HEAD(&pba->free_packout_bufs, next_free_pb);
     else
-        pb = malloc(MAX_PACKOUT_BUF_SZ);
+        pb = malloc(pba->bufsz);
 
     if (pb)
         ++pba->n_out;
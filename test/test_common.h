@@ -29,6 +29,21 @@ enum sport_flags
     SPORT_SET_RCVBUF        = (1 << 2), /* SO_RCVBUF */
     SPORT_SERVER            = (1 << 3),
     SPORT_CONNECT           = (1 << 4),
+#if LSQUIC_MMSG_SUPPORTED
+    SPORT_MMSG              = (1 << 5), /* recvmmsg() and sendmmsg() */
+#endif
+#if LSQUIC_GSO_SUPPORTED
+    SPORT_GSO               = (1 << 6), /* UDP_SEGMENT */
+#endif
+#if LSQUIC_GRO_SUPPORTED
+    SPORT_GRO               = (1 << 7), /* UDP_GRO */
+#endif
+#if LSQUIC_TXTIME_SUPPORTED
+    SPORT_TXTIME            = (1 << 8), /* SO_TXTIME */
+#endif
+#if __linux__
+    SPORT_TIMESTAMPS        = (1 << 9), /* SO_TIMESTAMPNS */
+#endif
 };
 
 struct service_port {
@@ -80,12 +95,14 @@ struct packout_buf;
 struct packout_buf_allocator
 {
     unsigned                    n_out,      /* Number of buffers outstanding */
-                                max;        /* Maximum outstanding.  Zero mean no limit */
+                                max,        /* Maximum outstanding.  Zero mean no limit */
+                                bufsz;      /* Size of each buffer */
     SLIST_HEAD(, packout_buf)   free_packout_bufs;
 };
 
+/* If `bufsz' is smaller than the maximum packet size, the latter is used */
 void
-pba_init (struct packout_buf_allocator *, unsigned max);
+pba_init (struct packout_buf_allocator *, unsigned max, unsigned bufsz);
 
 void *
 pba_allocate (void *packout_buf_allocator, void*, unsigned short, char);
@@ -0,0 +1,279 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * Test ACK policy.
+ *
+ * Without arguments, functional tests are run.  To benchmark, specify
+ * ACK decimation using -d (0 turns it off): the number of ACK packets
+ * sent per megabyte received is printed.
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#ifndef WIN32
+#include <unistd.h>
+#else
+#include <getopt.h>
+#endif
+
+#include "lsquic_types.h"
+#include "lsquic_int_types.h"
+#include "lsquic_rechist.h"
+#include "lsquic_ack_policy.h"
+
+#define MIN_RTT 20000
+
+
+static enum ack_decision
+packet_in (struct ack_policy *ap, struct lsquic_rechist *rechist,
+           lsquic_packno_t packno, int ackable, int had_miss,
+           lsquic_time_t *ack_delay)
+{
+    (void) lsquic_rechist_received(rechist, packno, 0);
+    return lsquic_ack_policy_packet_in(ap, rechist, packno, ackable,
+                                            had_miss, MIN_RTT, ack_delay);
+}
+
+
+/* Without decimation, every other ackable packet is acknowledged */
+static void
+test_default (void)
+{
+    struct ack_policy ap;
+    struct lsquic_rechist rechist;
+    lsquic_time_t ack_delay;
+    lsquic_packno_t packno;
+    enum ack_decision decision;
+
+    lsquic_rechist_init(&rechist, 0);
+    lsquic_ack_policy_init(&ap, 0);
+
+    decision = packet_in(&ap, &rechist, 1, 0, 0, &ack_delay);
+    assert(AD_NONE == decision);
+    decision = packet_in(&ap, &rechist, 2, 1, 0, &ack_delay);
+    assert(AD_TIMER == decision);
+    assert(ACK_TIMEOUT == ack_delay);
+    decision = packet_in(&ap, &rechist, 3, 1, 0, &ack_delay);
+    assert(AD_NOW == decision);
+    lsquic_ack_policy_reset(&ap);
+
+    for (packno = 4; packno < 1000; packno += 2)
+    {
+        decision = packet_in(&ap, &rechist, packno, 1, 0, &ack_delay);
+        assert(AD_TIMER == decision);
+        decision = packet_in(&ap, &rechist, packno + 1, 1, 0, &ack_delay);
+        assert(AD_NOW == decision);
+        lsquic_ack_policy_reset(&ap);
+    }
+
+    lsquic_rechist_cleanup(&rechist);
+}
+
+
+static void
+test_decimation (void)
+{
+    struct ack_policy ap;
+    struct lsquic_rechist rechist;
+    lsquic_time_t ack_delay;
+    lsquic_packno_t packno;
+    enum ack_decision decision;
+    unsigned n_acks;
+
+    lsquic_rechist_init(&rechist, 0);
+    lsquic_ack_policy_init(&ap, 10);
+
+    /* Peer may be in slow start: ACK every other packet */
+    n_acks = 0;
+    for (packno = 1; packno < 100; ++packno)
+    {
+        decision = packet_in(&ap, &rechist, packno, 1, 0, &ack_delay);
+        if (AD_NOW == decision)
+        {
+            ++n_acks;
+            lsquic_ack_policy_reset(&ap);
+        }
+        else
+        {
+            assert(AD_TIMER == decision);
+            assert(ACK_TIMEOUT == ack_delay);
+        }
+    }
+    assert(49 == n_acks);
+
+    /* Now ACK every ten packets with a shorter delay */
+    for ( ; packno < 1000; ++packno)
+    {
+        decision = packet_in(&ap, &rechist, packno, 1, 0, &ack_delay);
+        if (packno % 10 == 8)
+        {
+            assert(AD_NOW == decision);
+            lsquic_ack_policy_reset(&ap);
+        }
+        else
+        {
+            assert(AD_TIMER == decision);
+            assert(MIN_RTT / 4 == ack_delay);
+        }
+    }
+
+    lsquic_ack_policy_reset(&ap);   /* ACK timer fired */
+
+    /* Packet 1000 is lost.  Packet 1001 opens a gap: it gets a short
+     * delay and the ACK is not decimated.
+     */
+    decision = packet_in(&ap, &rechist, 1001, 1, 0, &ack_delay);
+    assert(AD_TIMER == decision);
+    assert(MIN_RTT / 8 == ack_delay);
+    decision = packet_in(&ap, &rechist, 1002, 1, 0, &ack_delay);
+    assert(AD_NOW == decision);
+    lsquic_ack_policy_reset(&ap);
+
+    /* Until the gap is gone, ACK every other packet */
+    decision = packet_in(&ap, &rechist, 1003, 1, 1, &ack_delay);
+    assert(AD_TIMER == decision);
+    assert(ACK_TIMEOUT == ack_delay);
+
+    /* Reordered packet arrives after ACK with missing packets was sent */
+    decision = packet_in(&ap, &rechist, 1000, 1, 1, &ack_delay);
+    assert(AD_NOW == decision);
+    lsquic_ack_policy_reset(&ap);
+
+    /* No more gaps: decimate again */
+    decision = packet_in(&ap, &rechist, 1004, 1, 0, &ack_delay);
+    assert(AD_TIMER == decision);
+    assert(MIN_RTT / 4 == ack_delay);
+
+    lsquic_rechist_cleanup(&rechist);
+}
+
+
+/* Receive `n_bytes' of data in full-sized packets at `rate' bytes per
+ * second, losing every `loss'th packet, and return number of ACKs sent.
+ * The peer stops waiting for packets one min RTT after they are sent.
+ */
+static unsigned
+simulate (unsigned decimation, uint64_t n_bytes, uint64_t rate, unsigned loss)
+{
+    const unsigned packet_sz = 1350;
+    struct ack_policy ap;
+    struct lsquic_rechist rechist;
+    lsquic_time_t now, interval, ack_delay, ack_time;
+    lsquic_packno_t packno, n_packets, lag;
+    enum ack_decision decision;
+    unsigned n_acks;
+    int had_miss, send_ack;
+
+    lsquic_rechist_init(&rechist, 0);
+    lsquic_ack_policy_init(&ap, decimation);
+
+    interval = packet_sz * 1000000 / rate;
+    n_packets = n_bytes / packet_sz;
+    lag = MIN_RTT / interval;
+    ack_time = 0;
+    had_miss = 0;
+    n_acks = 0;
+
+    for (packno = 1, now = 0; packno <= n_packets; ++packno, now += interval)
+    {
+        if (ack_time && ack_time <= now)
+            send_ack = 1;
+        else
+            send_ack = 0;
+        if (!(loss && packno % loss == 0))
+        {
+            (void) lsquic_rechist_received(&rechist, packno, now);
+            decision = lsquic_ack_policy_packet_in(&ap, &rechist, packno, 1,
+                                            had_miss, MIN_RTT, &ack_delay);
+            send_ack |= AD_NOW == decision;
+            /* Timer handling mirrors set_ack_timer() in full_conn */
+            if (AD_TIMER == decision && (!ack_time || !decimation
+                                            || now + ack_delay < ack_time))
+                ack_time = now + ack_delay;
+        }
+        if (send_ack)
+        {
+            ++n_acks;
+            lsquic_ack_policy_reset(&ap);
+            ack_time = 0;
+            (void) lsquic_rechist_first(&rechist);
+            had_miss = NULL != lsquic_rechist_next(&rechist);
+            if (packno > lag)
+                lsquic_rechist_stop_wait(&rechist, packno - lag);
+        }
+    }
+
+    lsquic_rechist_cleanup(&rechist);
+    return n_acks;
+}
+
+
+static void
+test_sim (void)
+{
+    const uint64_t n_bytes = 10 * 1024 * 1024, rate = 10 * 1024 * 1024;
+    unsigned n_acks_off, n_acks_on, n_acks_loss;
+
+    n_acks_off = simulate(0, n_bytes, rate, 0);
+    n_acks_on = simulate(10, n_bytes, rate, 0);
+    n_acks_loss = simulate(10, n_bytes, rate, 100);
+    assert(n_acks_on * 4 < n_acks_off);
+    /* Losses suspend decimation for a while */
+    assert(n_acks_loss > n_acks_on);
+    assert(n_acks_loss * 2 < n_acks_off);
+}
+
+
+int
+main (int argc, char **argv)
+{
+    int opt, decimation = -1;
+    unsigned n_mbytes = 100, mbps = 100, loss = 0, n_acks;
+
+    while (-1 != (opt = getopt(argc, argv, "d:n:r:l:")))
+    {
+        switch (opt)
+        {
+        case 'd':
+            decimation = atoi(optarg);
+            break;
+        case 'n':
+            n_mbytes = atoi(optarg);
+            break;
+        case 'r':
+            mbps = atoi(optarg);
+            break;
+        case 'l':
+            loss = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-d decimation] [-n megabytes] "
+                "[-r rate in Mbps] [-l lose every Nth packet]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    if (decimation < 0)
+    {
+        test_default();
+        test_decimation();
+        test_sim();
+        return 0;
+    }
+
+    if (n_mbytes < 1 || mbps < 1)
+    {
+        fprintf(stderr, "error: invalid parameters\n");
+        exit(2);
+    }
+
+    n_acks = simulate(decimation, (uint64_t) n_mbytes * 1024 * 1024,
+                                        (uint64_t) mbps * 1000000 / 8, loss);
+    printf("decimation: %d; received %u MB at %u Mbps; sent %u ACKs, "
+        "%.1f per MB\n", decimation, n_mbytes, mbps, n_acks,
+        (double) n_acks / n_mbytes);
+    return 0;
+}
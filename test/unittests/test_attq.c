@@ -1,6 +1,21 @@
 /* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * Test advisory tick time queue backed by binary heap and by timer wheel.
+ *
+ * Without arguments, functional tests are run.  To benchmark, specify
+ * mode using -s: 0 uses binary heap, 1 uses timer wheel.
+ */
+
 #include <assert.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#ifndef WIN32
+#include <unistd.h>
+#else
+#include <getopt.h>
+#endif
 
 #include "lsquic.h"
 #include "lsquic_types.h"
@@ -49,10 +64,22 @@ cmp_chars_desc (const void *ap, const void *bp)
 }
 
 
+/* Granularity of zero means binary heap */
+static struct attq *
+create_attq (unsigned granularity)
+{
+    if (granularity)
+        return attq_create_wheel(granularity);
+    else
+        return attq_create();
+}
+
+
 enum sort_action { SORT_NONE, SORT_ASC, SORT_DESC, };
 
+/* When timer wheel is used, ordering is exact only if granularity is 1 */
 static void
-test_attq_ordering (enum sort_action sa)
+test_attq_ordering (enum sort_action sa, unsigned granularity)
 {
     struct attq *q;
     struct lsquic_conn *conns, *conn;
@@ -75,7 +102,7 @@ test_attq_ordering (enum sort_action sa)
         break;
     }
 
-    q = attq_create();
+    q = create_attq(granularity);
 
     conns = calloc(sizeof(curiosity), sizeof(conns[0]));
     for (i = 0; i < sizeof(curiosity); ++i)
@@ -129,12 +156,12 @@ test_attq_ordering (enum sort_action sa)
 
 /* Filter up */
 static void
-test_attq_removal_1 (void)
+test_attq_removal_1 (unsigned granularity)
 {
     struct attq *q;
     struct lsquic_conn *conns;
 
-    q = attq_create();
+    q = create_attq(granularity);
     conns = calloc(6, sizeof(conns[0]));
 
     attq_add(q, &conns[0], 1);
@@ -153,12 +180,12 @@ test_attq_removal_1 (void)
 
 /* Filter down */
 static void
-test_attq_removal_2 (void)
+test_attq_removal_2 (unsigned granularity)
 {
     struct attq *q;
     struct lsquic_conn *conns;
 
-    q = attq_create();
+    q = create_attq(granularity);
     conns = calloc(9, sizeof(conns[0]));
 
     attq_add(q, &conns[0], 1);
@@ -180,12 +207,12 @@ test_attq_removal_2 (void)
 
 /* Filter up */
 static void
-test_attq_removal_3 (void)
+test_attq_removal_3 (unsigned granularity)
 {
     struct attq *q;
     struct lsquic_conn *conns;
 
-    q = attq_create();
+    q = create_attq(granularity);
     conns = calloc(9, sizeof(conns[0]));
 
     attq_add(q, &conns[0], 1);
@@ -205,14 +232,237 @@ test_attq_removal_3 (void)
 }
 
 
+/* Elements that straddle the cutoff within the same tick are handled
+ * correctly: only those whose advisory time is before cutoff are popped.
+ */
+static void
+test_wheel_cutoff (void)
+{
+    struct attq *q;
+    struct lsquic_conn *conns;
+    const lsquic_time_t *t;
+
+    q = attq_create_wheel(1000);
+    conns = calloc(4, sizeof(conns[0]));
+
+    attq_add(q, &conns[0], 1500);
+    attq_add(q, &conns[1], 1200);
+    attq_add(q, &conns[2], 1900);
+    attq_add(q, &conns[3], 2500);
+
+    t = attq_next_time(q);
+    assert(t && *t == 1200);
+    assert(2 == attq_count_before(q, 1600));
+
+    assert(&conns[0] == attq_pop(q, 1600));
+    assert(&conns[1] == attq_pop(q, 1600));
+    assert(NULL == attq_pop(q, 1600));
+    t = attq_next_time(q);
+    assert(t && *t == 1900);
+
+    /* Time going backwards is not a problem */
+    assert(NULL == attq_pop(q, 100));
+    attq_add(q, &conns[0], 300);
+    t = attq_next_time(q);
+    assert(t && *t == 300);
+    assert(&conns[0] == attq_pop(q, 301));
+
+    assert(&conns[2] == attq_pop(q, 3000));
+    assert(&conns[3] == attq_pop(q, 3000));
+    assert(NULL == attq_pop(q, 3000));
+    assert(NULL == attq_next_time(q));
+
+    free(conns);
+    attq_destroy(q);
+}
+
+
+/* Timer wheel and binary heap must agree on which connections are due.
+ * Advisory times are spread over all levels of the wheel, including the
+ * overflow list.
+ */
+static void
+test_wheel_vs_heap (unsigned n_conns, unsigned granularity)
+{
+    struct attq *heap, *wheel;
+    struct lsquic_conn *hconns, *wconns, *conn;
+    unsigned char *hdone, *wdone;
+    lsquic_time_t now, t;
+    const lsquic_time_t *ht, *wt;
+    unsigned i, n_left, count;
+
+    heap = attq_create();
+    wheel = attq_create_wheel(granularity);
+    hconns = calloc(n_conns, sizeof(hconns[0]));
+    wconns = calloc(n_conns, sizeof(wconns[0]));
+    hdone = calloc(n_conns, 1);
+    wdone = calloc(n_conns, 1);
+
+    srand(n_conns);
+    for (i = 0; i < n_conns; ++i)
+    {
+        t = (lsquic_time_t) rand() << (rand() % 36);
+        assert(0 == attq_add(heap, &hconns[i], t));
+        assert(0 == attq_add(wheel, &wconns[i], t));
+    }
+    n_left = n_conns;
+
+    /* Remove some connections and reschedule others */
+    for (i = 0; i < n_conns; i += 7)
+    {
+        attq_remove(heap, &hconns[i]);
+        attq_remove(wheel, &wconns[i]);
+        if (i % 2)
+        {
+            t = (lsquic_time_t) rand() << (rand() % 24);
+            assert(0 == attq_add(heap, &hconns[i], t));
+            assert(0 == attq_add(wheel, &wconns[i], t));
+        }
+        else
+        {
+            hdone[i] = wdone[i] = 1;
+            --n_left;
+        }
+    }
+
+    while (n_left > 0)
+    {
+        ht = attq_next_time(heap);
+        wt = attq_next_time(wheel);
+        assert(ht && wt && *ht == *wt);
+        now = *ht + 1 + rand() % (3 * granularity);
+        assert(attq_count_before(heap, now) ==
+                                        attq_count_before(wheel, now));
+        /* Cutoff further out covers whole slots at higher levels.  Count
+         * from heap is not exact in this case: count directly.
+         */
+        t = now + ((lsquic_time_t) rand() << (rand() % 36));
+        for (count = 0, i = 0; i < n_conns; ++i)
+            count += !wdone[i] && wconns[i].cn_attq_elem->ae_adv_time < t;
+        assert(count == attq_count_before(wheel, t));
+        while ((conn = attq_pop(heap, now)))
+        {
+            assert(!hdone[conn - hconns]);
+            hdone[conn - hconns] = 1;
+            --n_left;
+        }
+        while ((conn = attq_pop(wheel, now)))
+        {
+            assert(!wdone[conn - wconns]);
+            wdone[conn - wconns] = 1;
+        }
+        assert(0 == memcmp(hdone, wdone, n_conns));
+    }
+
+    assert(NULL == attq_next_time(heap));
+    assert(NULL == attq_next_time(wheel));
+    free(wdone);
+    free(hdone);
+    free(wconns);
+    free(hconns);
+    attq_destroy(wheel);
+    attq_destroy(heap);
+}
+
+
+/* Simulate engine with many mostly idle connections: most are waiting
+ * for idle timeout, some are active and get rescheduled often.  Every
+ * iteration is one millisecond.
+ */
+static void
+run_bench (int mode, unsigned n_iters, unsigned n_conns)
+{
+    struct attq *q;
+    struct lsquic_conn *conns, *conn;
+    lsquic_time_t now;
+    unsigned i, n;
+
+    q = create_attq(mode ? 1000 : 0);
+    conns = calloc(n_conns, sizeof(conns[0]));
+
+    srand(n_conns);
+    now = 1000000;
+    for (i = 0; i < n_conns; ++i)
+        (void) attq_add(q, &conns[i], now + 30000000 - rand() % 1000000);
+
+    for (n = 0; n < n_iters; ++n)
+    {
+        now += 1000;
+        /* A few active connections change their next tick time */
+        for (i = 0; i < 64; ++i)
+        {
+            conn = &conns[ rand() % n_conns ];
+            if (conn->cn_attq_elem)
+                attq_remove(q, conn);
+            (void) attq_add(q, conn, now + 1000 + rand() % 50000);
+        }
+        (void) attq_next_time(q);
+        while ((conn = attq_pop(q, now)))
+            (void) attq_add(q, conn, now + (rand() % 10 ? 30000000
+                                                    : 1000 + rand() % 50000));
+    }
+
+    free(conns);
+    attq_destroy(q);
+}
+
+
 int
-main (void)
+main (int argc, char **argv)
 {
-    test_attq_ordering(SORT_NONE);
-    test_attq_ordering(SORT_ASC);
-    test_attq_ordering(SORT_DESC);
-    test_attq_removal_1();
-    test_attq_removal_2();
-    test_attq_removal_3();
+    static const unsigned granularities[] = { 0, 1, };
+    int opt, mode = -1;
+    unsigned n_iters = 10000, n_conns = 50000, i;
+
+    while (-1 != (opt = getopt(argc, argv, "s:n:c:")))
+    {
+        switch (opt)
+        {
+        case 's':
+            mode = atoi(optarg);
+            break;
+        case 'n':
+            n_iters = atoi(optarg);
+            break;
+        case 'c':
+            n_conns = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-s mode] [-n iterations] "
+                                            "[-c connections]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    switch (mode)
+    {
+    case -1:
+        for (i = 0; i < sizeof(granularities) / sizeof(granularities[0]); ++i)
+        {
+            test_attq_ordering(SORT_NONE, granularities[i]);
+            test_attq_ordering(SORT_ASC, granularities[i]);
+            test_attq_ordering(SORT_DESC, granularities[i]);
+            test_attq_removal_1(granularities[i]);
+            test_attq_removal_2(granularities[i]);
+            test_attq_removal_3(granularities[i]);
+        }
+        test_wheel_cutoff();
+        test_wheel_vs_heap(1000, 1);
+        test_wheel_vs_heap(3000, 1000);
+        break;
+    case 0:
+    case 1:
+        if (n_conns < 1)
+        {
+            fprintf(stderr, "error: invalid number of connections\n");
+            exit(2);
+        }
+        run_bench(mode, n_iters, n_conns);
+        break;
+    default:
+        fprintf(stderr, "error: invalid mode %d\n", mode);
+        exit(2);
+    }
+
     return 0;
 }
@@ -0,0 +1,252 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * Test BBR congestion controller by running it over a simulated path
+ * with a bottleneck link.
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+
+#include "lsquic.h"
+
+#include "lsquic_types.h"
+#include "lsquic_int_types.h"
+#include "lsquic_malo.h"
+#include "lsquic_packet_common.h"
+#include "lsquic_packet_out.h"
+#include "lsquic_rtt.h"
+#include "lsquic_conn_flow.h"
+#include "lsquic_sfcw.h"
+#include "lsquic_stream.h"
+#include "lsquic_conn_public.h"
+#include "lsquic_conn.h"
+#include "lsquic_cong_ctl.h"
+#include "lsquic_minmax.h"
+#include "lsquic_bw_sampler.h"
+#include "lsquic_bbr.h"
+
+#define PACK_SIZE 1370
+#define MAX_QUEUE (1 << 16)
+
+
+struct sim_packet
+{
+    struct lsquic_packet_out    packet_out;
+    lsquic_time_t               arrival;    /* Time ACK arrives at sender */
+    int                         lost;
+};
+
+
+struct path
+{
+    uint64_t        bandwidth;      /* Bytes per second */
+    lsquic_time_t   rtt;            /* Propagation delay, round trip */
+    unsigned        loss;           /* Per 1000 packets */
+};
+
+
+struct sim_stats
+{
+    uint64_t        delivered;      /* After warm-up */
+    uint64_t        max_in_flight;  /* After warm-up */
+    uint64_t        sampler_bw;     /* Sampler's estimate at the end */
+    int             seen_probe_bw;
+    int             seen_high_gain, seen_low_gain;
+};
+
+
+static void
+run_sim (const struct path *path, lsquic_time_t duration,
+         lsquic_time_t warm_up, struct lsquic_bbr *bbr,
+         struct sim_stats *stats)
+{
+    struct lsquic_conn lconn;
+    struct lsquic_conn_public conn_pub;
+    struct bw_sampler sampler;
+    struct malo *malo;
+    struct bw_sample bw_sample;
+    const struct bw_sample *sample;
+    struct sim_packet **queue, *sp;
+    unsigned head, tail, n_lost;
+    lsquic_time_t now, link_free, next_send, t_ack, t_send, departure;
+    lsquic_packno_t packno;
+    uint64_t in_flight, pacing_rate, bw;
+
+    memset(&lconn, 0, sizeof(lconn));
+    lconn.cn_cid = 0x12345678;
+    lconn.cn_pack_size = PACK_SIZE;
+    memset(&conn_pub, 0, sizeof(conn_pub));
+    conn_pub.lconn = &lconn;
+    memset(stats, 0, sizeof(*stats));
+    srand(path->loss + 1);
+
+    queue = malloc(sizeof(queue[0]) * MAX_QUEUE);
+    head = tail = 0;
+    now = link_free = next_send = 0;
+    packno = 0;
+    in_flight = 0;
+
+    malo = lsquic_malo_create(sizeof(struct bwp_state));
+    if (0 != lsquic_bw_sampler_init(&sampler, malo, lconn.cn_cid))
+        assert(0);
+    lsquic_cong_bbr_if.cci_init(bbr, &conn_pub, &sampler);
+
+    while (1)
+    {
+        t_ack = head != tail ? queue[head]->arrival : ~0ull;
+        if (in_flight + PACK_SIZE <= lsquic_cong_bbr_if.cci_get_cwnd(bbr))
+            t_send = next_send > now ? next_send : now;
+        else
+            t_send = ~0ull;
+        now = t_ack < t_send ? t_ack : t_send;
+        if (now > duration)
+            break;
+
+        if (t_ack <= t_send)
+        {
+            /* Packets that arrived by now are acked by a single ACK */
+            lsquic_cong_bbr_if.cci_begin_ack(bbr, now, in_flight);
+            n_lost = 0;
+            while (head != tail && queue[head]->arrival <= now)
+            {
+                sp = queue[head];
+                head = (head + 1) % MAX_QUEUE;
+                in_flight -= PACK_SIZE;
+                if (sp->lost)
+                {
+                    lsquic_bw_sampler_packet_lost(&sampler, &sp->packet_out);
+                    lsquic_cong_bbr_if.cci_lost(bbr, &sp->packet_out,
+                                                                PACK_SIZE);
+                    ++n_lost;
+                }
+                else
+                {
+                    lsquic_rtt_stats_update(&conn_pub.rtt_stats, now,
+                                            now - sp->packet_out.po_sent, 0);
+                    sample = 0 == lsquic_bw_sampler_packet_acked(&sampler,
+                                    &sp->packet_out, now, &bw_sample)
+                                    ? &bw_sample : NULL;
+                    lsquic_cong_bbr_if.cci_ack(bbr, &sp->packet_out,
+                                                PACK_SIZE, now, 0, sample);
+                    if (now >= warm_up)
+                        stats->delivered += PACK_SIZE;
+                }
+                assert(!sp->packet_out.po_bwp_state);
+                free(sp);
+            }
+            if (n_lost)
+                lsquic_cong_bbr_if.cci_loss(bbr);
+            lsquic_cong_bbr_if.cci_end_ack(bbr, in_flight);
+
+            if (now >= warm_up)
+            {
+                bw = lsquic_bbr_bandwidth(bbr);
+                if (bbr->bbr_mode == BBR_MODE_PROBE_BW)
+                {
+                    stats->seen_probe_bw = 1;
+                    pacing_rate = lsquic_cong_bbr_if.cci_pacing_rate(bbr, 0);
+                    stats->seen_high_gain |= pacing_rate > bw;
+                    stats->seen_low_gain  |= pacing_rate < bw;
+                }
+            }
+        }
+        else
+        {
+            sp = calloc(1, sizeof(*sp));
+            sp->packet_out.po_packno = ++packno;
+            sp->packet_out.po_sent = now;
+            lsquic_cong_bbr_if.cci_sent(bbr, &sp->packet_out, PACK_SIZE,
+                                                                in_flight);
+            lsquic_bw_sampler_packet_sent(&sampler, &sp->packet_out,
+                                                    PACK_SIZE, in_flight);
+            in_flight += PACK_SIZE;
+            if (now >= warm_up && in_flight > stats->max_in_flight)
+                stats->max_in_flight = in_flight;
+            /* The bottleneck link serializes packets */
+            departure = (link_free > now ? link_free : now)
+                                    + PACK_SIZE * 1000000 / path->bandwidth;
+            link_free = departure;
+            sp->arrival = departure + path->rtt;
+            sp->lost = (unsigned) rand() % 1000 < path->loss;
+            queue[tail] = sp;
+            tail = (tail + 1) % MAX_QUEUE;
+            assert(tail != head);
+            pacing_rate = lsquic_cong_bbr_if.cci_pacing_rate(bbr, 0);
+            next_send = now + PACK_SIZE * 1000000 / pacing_rate;
+        }
+    }
+
+    while (head != tail)
+    {
+        lsquic_bw_sampler_packet_lost(&sampler, &queue[head]->packet_out);
+        lsquic_cong_bbr_if.cci_lost(bbr, &queue[head]->packet_out, PACK_SIZE);
+        free(queue[head]);
+        head = (head + 1) % MAX_QUEUE;
+    }
+    free(queue);
+
+    /* The sampler's estimate should match BBR's */
+    stats->sampler_bw = lsquic_bw_sampler_estimate(&sampler);
+    lsquic_bw_sampler_cleanup(&sampler);
+    lsquic_malo_destroy(malo);
+}
+
+
+/* BBR should find the bottleneck bandwidth and the propagation delay,
+ * utilize the link fully, and keep the queue short.
+ */
+static void
+test_bottleneck (unsigned loss)
+{
+    const struct path path = {
+        .bandwidth  = 1250000,  /* 10 Mbps */
+        .rtt        = 100000,
+        .loss       = loss,
+    };
+    const lsquic_time_t duration = 20000000, warm_up = 5000000;
+    const uint64_t bdp = path.bandwidth * path.rtt / 1000000;
+    struct lsquic_bbr bbr;
+    struct sim_stats stats;
+    uint64_t throughput;
+
+    run_sim(&path, duration, warm_up, &bbr, &stats);
+
+    throughput = stats.delivered * 1000000 / (duration - warm_up);
+    printf("loss: %u/1000; bandwidth estimate: %"PRIu64" B/s; min rtt: "
+        "%"PRIu64" usec; throughput: %"PRIu64" B/s; max in flight: %"PRIu64
+        " bytes; BDP: %"PRIu64" bytes\n", loss, lsquic_bbr_bandwidth(&bbr),
+        bbr.bbr_min_rtt, throughput, stats.max_in_flight, bdp);
+
+    assert(stats.sampler_bw >= path.bandwidth * 95 / 100);
+    assert(stats.sampler_bw <= path.bandwidth * 105 / 100);
+    assert(stats.seen_probe_bw);
+    assert(stats.seen_high_gain);
+    assert(stats.seen_low_gain);
+    assert(bbr.bbr_min_rtt >= path.rtt);
+    assert(bbr.bbr_min_rtt < path.rtt + path.rtt / 10);
+    if (loss == 0)
+    {
+        assert(lsquic_bbr_bandwidth(&bbr) >= path.bandwidth * 95 / 100);
+        assert(lsquic_bbr_bandwidth(&bbr) <= path.bandwidth * 105 / 100);
+        assert(throughput >= path.bandwidth * 90 / 100);
+        assert(stats.max_in_flight <= bdp * 3);
+    }
+    else
+        /* Random loss does not make BBR back off much */
+        assert(throughput >= path.bandwidth * 75 / 100);
+
+    lsquic_cong_bbr_if.cci_cleanup(&bbr);
+}
+
+
+int
+main (void)
+{
+    test_bottleneck(0);
+    test_bottleneck(10);
+    return 0;
+}
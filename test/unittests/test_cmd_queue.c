@@ -0,0 +1,343 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * Test the engine command queue: the lock-free queue itself and commands
+ * posted to the engine.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#ifndef WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#endif
+
+#include "lsquic.h"
+#include "lsquic_int_types.h"
+#include "lsquic_conn.h"
+#include "lsquic_cmd_queue.h"
+
+#define N_CMDS 100
+
+
+static void
+test_order (void)
+{
+    struct cmd_queue cmdq;
+    struct lsquic_cmd cmds[N_CMDS], *cmd;
+    unsigned n, count;
+
+    lsquic_cmdq_init(&cmdq);
+    assert(lsquic_cmdq_empty(&cmdq));
+    assert(NULL == lsquic_cmdq_pop_all(&cmdq));
+
+    for (n = 0; n < N_CMDS; ++n)
+    {
+        /* Only the first push finds the queue empty */
+        assert(!!lsquic_cmdq_push(&cmdq, &cmds[n]) == (n == 0));
+        assert(!lsquic_cmdq_empty(&cmdq));
+    }
+
+    count = 0;
+    for (cmd = lsquic_cmdq_pop_all(&cmdq); cmd; cmd = cmd->cmd_next)
+        assert(cmd == &cmds[count++]);
+    assert(count == N_CMDS);
+    assert(lsquic_cmdq_empty(&cmdq));
+
+    assert(lsquic_cmdq_push(&cmdq, &cmds[0]));
+    cmd = lsquic_cmdq_pop_all(&cmdq);
+    assert(cmd == &cmds[0] && cmd->cmd_next == NULL);
+}
+
+
+#ifndef WIN32
+#define N_PRODUCERS 4
+#define N_PER_PRODUCER 100000
+
+struct producer
+{
+    struct cmd_queue       *cmdq;
+    unsigned                id;
+    struct lsquic_cmd      *cmds;
+};
+
+
+static void *
+produce (void *arg)
+{
+    struct producer *const producer = arg;
+    unsigned n;
+
+    for (n = 0; n < N_PER_PRODUCER; ++n)
+    {
+        producer->cmds[n].cmd_stream_id = producer->id;
+        producer->cmds[n].cmd_sz = n;
+        (void) lsquic_cmdq_push(producer->cmdq, &producer->cmds[n]);
+    }
+
+    return NULL;
+}
+
+
+/* Commands from each producer are consumed in order they were pushed */
+static void
+test_threads (void)
+{
+    struct cmd_queue cmdq;
+    struct producer producers[N_PRODUCERS];
+    pthread_t threads[N_PRODUCERS];
+    size_t next[N_PRODUCERS];
+    struct lsquic_cmd *cmd;
+    unsigned n, count;
+
+    lsquic_cmdq_init(&cmdq);
+    for (n = 0; n < N_PRODUCERS; ++n)
+    {
+        producers[n].cmdq = &cmdq;
+        producers[n].id = n;
+        producers[n].cmds = calloc(N_PER_PRODUCER, sizeof(struct lsquic_cmd));
+        assert(producers[n].cmds);
+        next[n] = 0;
+    }
+    for (n = 0; n < N_PRODUCERS; ++n)
+    {
+        int s = pthread_create(&threads[n], NULL, produce, &producers[n]);
+        assert(0 == s);
+    }
+
+    count = 0;
+    while (count < N_PRODUCERS * N_PER_PRODUCER)
+    {
+        if (lsquic_cmdq_empty(&cmdq))
+            continue;
+        for (cmd = lsquic_cmdq_pop_all(&cmdq); cmd; cmd = cmd->cmd_next)
+        {
+            assert(cmd->cmd_stream_id < N_PRODUCERS);
+            assert(cmd->cmd_sz == next[cmd->cmd_stream_id]);
+            ++next[cmd->cmd_stream_id];
+            ++count;
+        }
+    }
+
+    for (n = 0; n < N_PRODUCERS; ++n)
+    {
+        pthread_join(threads[n], NULL);
+        assert(next[n] == N_PER_PRODUCER);
+        free(producers[n].cmds);
+    }
+    assert(lsquic_cmdq_empty(&cmdq));
+}
+#endif
+
+
+struct engine_test
+{
+    lsquic_engine_t        *engine;
+    lsquic_conn_t          *conn;
+    lsquic_stream_t        *stream;
+    unsigned                n_notified;
+    unsigned                n_done;
+    unsigned                n_packets;
+    ssize_t                 results[10];
+};
+
+
+static lsquic_conn_ctx_t *
+on_new_conn (void *stream_if_ctx, lsquic_conn_t *conn)
+{
+    return (void *) stream_if_ctx;
+}
+
+
+static void
+on_conn_closed (lsquic_conn_t *conn)
+{
+    struct engine_test *const test = (void *) lsquic_conn_get_ctx(conn);
+    test->conn = NULL;
+}
+
+
+static lsquic_stream_ctx_t *
+on_new_stream (void *stream_if_ctx, lsquic_stream_t *stream)
+{
+    struct engine_test *const test = stream_if_ctx;
+    test->stream = stream;
+    return (void *) test;
+}
+
+
+static void
+on_close (lsquic_stream_t *stream, lsquic_stream_ctx_t *st_h)
+{
+    struct engine_test *const test = (void *) st_h;
+    if (test->stream == stream)
+        test->stream = NULL;
+}
+
+
+static const struct lsquic_stream_if stream_if = {
+    .on_new_conn            = on_new_conn,
+    .on_conn_closed         = on_conn_closed,
+    .on_new_stream          = on_new_stream,
+    .on_close               = on_close,
+};
+
+
+static int
+packets_out (void *ctx, const struct lsquic_out_spec *specs, unsigned count)
+{
+    struct engine_test *const test = ctx;
+    test->n_packets += count;
+    return (int) count;
+}
+
+
+static void
+cmd_notify (void *ctx)
+{
+    struct engine_test *const test = ctx;
+    ++test->n_notified;
+}
+
+
+static void
+cmd_done (struct lsquic_cmd *cmd, ssize_t result)
+{
+    struct engine_test *const test = cmd->cmd_ctx;
+    assert(test->n_done < sizeof(test->results) / sizeof(test->results[0]));
+    test->results[ test->n_done++ ] = result;
+}
+
+
+static void
+test_engine (void)
+{
+    struct engine_test test;
+    struct lsquic_engine_settings settings;
+    struct lsquic_engine_api api;
+    struct sockaddr_in local_sa, peer_sa;
+    struct lsquic_cmd cmds[5];
+    unsigned char buf[100];
+    lsquic_cid_t cid;
+    unsigned n, n_packets;
+
+    memset(&test, 0, sizeof(test));
+    lsquic_engine_init_settings(&settings, 0);
+    settings.es_versions = 1 << LSQVER_043;
+    memset(&api, 0, sizeof(api));
+    api.ea_settings = &settings;
+    api.ea_packets_out = packets_out;
+    api.ea_packets_out_ctx = &test;
+    api.ea_stream_if = &stream_if;
+    api.ea_stream_if_ctx = &test;
+    api.ea_cmd_notify = cmd_notify;
+    api.ea_cmd_notify_ctx = &test;
+    test.engine = lsquic_engine_new(0, &api);
+    assert(test.engine);
+
+    memset(&local_sa, 0, sizeof(local_sa));
+    local_sa.sin_family = AF_INET;
+    local_sa.sin_port = htons(10000);
+    local_sa.sin_addr.s_addr = htonl(0x7F000001);
+    peer_sa = local_sa;
+    peer_sa.sin_port = htons(443);
+    test.conn = lsquic_engine_connect(test.engine,
+                (struct sockaddr *) &local_sa, (struct sockaddr *) &peer_sa,
+                &test, NULL, "localhost", 0, NULL, 0);
+    assert(test.conn);
+    cid = lsquic_conn_id(test.conn);
+
+    memset(cmds, 0, sizeof(cmds));
+    for (n = 0; n < sizeof(cmds) / sizeof(cmds[0]); ++n)
+    {
+        cmds[n].cmd_cid = cid;
+        cmds[n].cmd_done = cmd_done;
+        cmds[n].cmd_ctx = &test;
+    }
+
+    /* Unknown connection, unknown stream, and new stream */
+    cmds[0].cmd_type = LSQCMD_MAKE_STREAM;
+    cmds[0].cmd_cid = ~cid;
+    cmds[1].cmd_type = LSQCMD_WRITE;
+    cmds[1].cmd_stream_id = 1001;
+    cmds[1].cmd_buf = buf;
+    cmds[1].cmd_sz = sizeof(buf);
+    cmds[2].cmd_type = LSQCMD_MAKE_STREAM;
+    for (n = 0; n < 3; ++n)
+        lsquic_engine_post_cmd(test.engine, &cmds[n]);
+    assert(1 == test.n_notified);
+    assert(0 == test.n_done);
+    lsquic_engine_process_conns(test.engine);
+    assert(3 == test.n_done);
+    assert(-1 == test.results[0]);
+    assert(-1 == test.results[1]);
+    assert(0 == test.results[2]);
+    assert(test.stream);
+
+    /* There is no server to complete the handshake: pretend it is done so
+     * that stream data can be sent.
+     */
+    test.conn->cn_flags |= LSCONN_HANDSHAKE_DONE;
+
+    /* Written data is sent in the same call that executes the command */
+    memset(buf, 'A', sizeof(buf));
+    cmds[3].cmd_type = LSQCMD_WRITE;
+    cmds[3].cmd_stream_id = lsquic_stream_id(test.stream);
+    cmds[3].cmd_buf = buf;
+    cmds[3].cmd_sz = sizeof(buf);
+    lsquic_engine_post_cmd(test.engine, &cmds[3]);
+    n_packets = test.n_packets;
+    lsquic_engine_process_conns(test.engine);
+    assert(4 == test.n_done);
+    assert(sizeof(buf) == test.results[3]);
+    assert(test.n_packets > n_packets);
+
+    /* Write to the stream and close it */
+    cmds[3].cmd_type = LSQCMD_WRITE;
+    cmds[3].cmd_stream_id = lsquic_stream_id(test.stream);
+    cmds[3].cmd_buf = buf;
+    cmds[3].cmd_sz = sizeof(buf);
+    cmds[4].cmd_type = LSQCMD_CLOSE_STREAM;
+    cmds[4].cmd_stream_id = lsquic_stream_id(test.stream);
+    lsquic_engine_post_cmd(test.engine, &cmds[3]);
+    lsquic_engine_post_cmd(test.engine, &cmds[4]);
+    assert(3 == test.n_notified);
+    lsquic_engine_process_conns(test.engine);
+    assert(6 == test.n_done);
+    assert(sizeof(buf) == test.results[4]);
+    assert(0 == test.results[5]);
+
+    /* Close connection */
+    cmds[0].cmd_type = LSQCMD_CLOSE_CONN;
+    cmds[0].cmd_cid = cid;
+    lsquic_engine_post_cmd(test.engine, &cmds[0]);
+    lsquic_engine_process_conns(test.engine);
+    assert(7 == test.n_done);
+    assert(0 == test.results[6]);
+    assert(NULL == test.conn);      /* Closed in the same call */
+
+    /* Commands pending at destruction fail */
+    lsquic_engine_post_cmd(test.engine, &cmds[1]);
+    lsquic_engine_destroy(test.engine);
+    assert(8 == test.n_done);
+    assert(-1 == test.results[7]);
+}
+
+
+int
+main (void)
+{
+    if (0 != lsquic_global_init(LSQUIC_GLOBAL_CLIENT))
+        exit(EXIT_FAILURE);
+    test_order();
+#ifndef WIN32
+    test_threads();
+#endif
+    test_engine();
+    lsquic_global_cleanup();
+    return 0;
+}
@@ -1,12 +1,26 @@
 /* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * Test connection hash.
+ *
+ * Without -s, functional tests are run.  To benchmark lookups, specify
+ * mode using -s: 0 looks up connections that are in the hash, 1 looks up
+ * connections that are not.  Use -n to set the number of connections in
+ * the hash and -l to set the number of lookups.
+ */
+
 #include <assert.h>
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/queue.h>
 #ifndef WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
 #include <unistd.h>
+#else
+#include <getopt.h>
 #endif
 
 #include "lsquic.h"
@@ -17,6 +31,7 @@
 #include "lsquic_mm.h"
 #include "lsquic_malo.h"
 #include "lsquic_logger.h"
+#include "lsquic_util.h"
 #include "lsquic.h"
 
 
@@ -30,23 +45,15 @@ get_new_lsquic_conn (struct malo *malo)
 }
 
 
-int
-main (int argc, char **argv)
+static void
+test_cid (unsigned nelems)
 {
     struct malo *malo;
     struct conn_hash conn_hash;
-    unsigned n, nelems;
+    unsigned n;
     struct lsquic_conn *lconn, *find_lsconn;
     int s;
 
-    if (argc > 1)
-        nelems = atoi(argv[1]);
-    else
-        nelems = 1000000;
-
-    lsquic_log_to_fstream(stderr, LLTS_HHMMSSMS);
-    lsquic_set_log_level("info");
-
     malo = lsquic_malo_create(sizeof(*lconn));
     s = conn_hash_init(&conn_hash, 0);
     assert(0 == s);
@@ -80,6 +87,287 @@ main (int argc, char **argv)
 
     conn_hash_cleanup(&conn_hash);
     lsquic_malo_destroy(malo);
+}
+
+
+/* Each connection is visited exactly once, even if connections are
+ * removed as they are visited.
+ */
+static void
+test_iter (unsigned nelems, int remove)
+{
+    struct malo *malo;
+    struct conn_hash conn_hash;
+    struct lsquic_conn *lconn;
+    unsigned n, count;
+    int s;
+
+    malo = lsquic_malo_create(sizeof(*lconn));
+    s = conn_hash_init(&conn_hash, 0);
+    assert(0 == s);
+
+    for (n = 0; n < nelems; ++n)
+    {
+        lconn = get_new_lsquic_conn(malo);
+        s = conn_hash_add(&conn_hash, lconn);
+        assert(0 == s);
+    }
+
+    count = 0;
+    for (lconn = conn_hash_first(&conn_hash); lconn;
+                                    lconn = conn_hash_next(&conn_hash))
+    {
+        assert(lconn->cn_flags == 0);
+        lconn->cn_flags = 1;
+        ++count;
+        if (remove)
+            conn_hash_remove(&conn_hash, lconn);
+    }
+    assert(count == nelems);
+    assert(conn_hash_count(&conn_hash) == (remove ? 0 : nelems));
+
+    conn_hash_cleanup(&conn_hash);
+    lsquic_malo_destroy(malo);
+}
+
+
+static void
+test_addr (unsigned nelems)
+{
+    struct malo *malo;
+    struct conn_hash conn_hash;
+    struct lsquic_conn *lconn;
+    struct sockaddr_in sa;
+    unsigned n;
+    int s;
+
+    malo = lsquic_malo_create(sizeof(*lconn));
+    s = conn_hash_init(&conn_hash, CHF_USE_ADDR);
+    assert(0 == s);
+    assert(conn_hash_using_addr(&conn_hash));
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(0x7F000001);
+    for (n = 0; n < nelems; ++n)
+    {
+        lconn = get_new_lsquic_conn(malo);
+        sa.sin_port = htons(1000 + n);
+        memcpy(lconn->cn_local_addr, &sa, sizeof(sa));
+        s = conn_hash_add(&conn_hash, lconn);
+        assert(0 == s);
+    }
+
+    for (n = 0; n < nelems; ++n)
+    {
+        sa.sin_port = htons(1000 + n);
+        lconn = conn_hash_find_by_addr(&conn_hash, (struct sockaddr *) &sa);
+        assert(lconn);
+        assert(0 == memcmp(lconn->cn_local_addr, &sa, sizeof(sa)));
+        if (n % 2)
+        {
+            conn_hash_remove(&conn_hash, lconn);
+            assert(!conn_hash_find_by_addr(&conn_hash,
+                                                (struct sockaddr *) &sa));
+            assert(!conn_hash_lookup_cid(&conn_hash, lconn->cn_cid));
+        }
+    }
+    sa.sin_port = htons(1000 + nelems);
+    assert(!conn_hash_find_by_addr(&conn_hash, (struct sockaddr *) &sa));
+    assert(conn_hash_count(&conn_hash) == (nelems + 1) / 2);
+
+    /* Lookup by CID does not disturb the iterator */
+    n = 0;
+    for (lconn = conn_hash_first(&conn_hash); lconn;
+                                    lconn = conn_hash_next(&conn_hash))
+    {
+        assert(lconn == conn_hash_lookup_cid(&conn_hash, lconn->cn_cid));
+        assert(!conn_hash_lookup_cid(&conn_hash, ~lconn->cn_cid));
+        ++n;
+    }
+    assert(n == conn_hash_count(&conn_hash));
+
+    conn_hash_cleanup(&conn_hash);
+    lsquic_malo_destroy(malo);
+}
+
+
+/* Connections are found while the hash is migrating to the larger table,
+ * including those removed and those added during migration.
+ */
+static void
+test_migration (unsigned nelems)
+{
+    struct malo *malo;
+    struct conn_hash conn_hash;
+    struct lsquic_conn **conns, *lconn;
+    unsigned n, i, count;
+    int s;
+
+    malo = lsquic_malo_create(sizeof(*lconn));
+    s = conn_hash_init(&conn_hash, 0);
+    assert(0 == s);
+    conns = calloc(nelems, sizeof(conns[0]));
+
+    srand(nelems);
+    for (n = 0; n < nelems; ++n)
+    {
+        conns[n] = get_new_lsquic_conn(malo);
+        s = conn_hash_add(&conn_hash, conns[n]);
+        assert(0 == s);
+        conns[n]->cn_flags = 1;
+        /* Remove some connections, possibly from the old table */
+        if (n % 3 == 0)
+        {
+            i = rand() % (n + 1);
+            if (conns[i]->cn_flags)
+            {
+                conn_hash_remove(&conn_hash, conns[i]);
+                conns[i]->cn_flags = 0;
+            }
+        }
+        for (i = 0; i < 8; ++i)
+        {
+            lconn = conns[ rand() % (n + 1) ];
+            assert(conn_hash_find_by_cid(&conn_hash, lconn->cn_cid)
+                                        == (lconn->cn_flags ? lconn : NULL));
+        }
+        /* Iterate in the middle of migration once in a while */
+        if (n % 1000 == 999)
+        {
+            count = 0;
+            for (lconn = conn_hash_first(&conn_hash); lconn;
+                                        lconn = conn_hash_next(&conn_hash))
+            {
+                assert(lconn->cn_flags);
+                ++count;
+            }
+            assert(count == conn_hash_count(&conn_hash));
+        }
+    }
+
+    for (n = 0; n < nelems; ++n)
+    {
+        assert(conn_hash_find_by_cid(&conn_hash, conns[n]->cn_cid)
+                                    == (conns[n]->cn_flags ? conns[n] : NULL));
+        if (conns[n]->cn_flags)
+            conn_hash_remove(&conn_hash, conns[n]);
+    }
+    assert(0 == conn_hash_count(&conn_hash));
+
+    free(conns);
+    conn_hash_cleanup(&conn_hash);
+    lsquic_malo_destroy(malo);
+}
+
+
+static void
+run_bench (int mode, unsigned nelems, unsigned n_lookups)
+{
+    struct malo *malo;
+    struct conn_hash conn_hash;
+    struct lsquic_conn *lconn;
+    lsquic_cid_t *cids, *lookups;
+    lsquic_time_t start, end, max_add;
+    unsigned n, found;
+
+    malo = lsquic_malo_create(sizeof(*lconn));
+    (void) conn_hash_init(&conn_hash, 0);
+    cids = malloc(nelems * sizeof(cids[0]));
+    lookups = malloc(nelems * sizeof(lookups[0]));
+
+    max_add = 0;
+    for (n = 0; n < nelems; ++n)
+    {
+        lconn = get_new_lsquic_conn(malo);
+        start = lsquic_time_now();
+        (void) conn_hash_add(&conn_hash, lconn);
+        end = lsquic_time_now();
+        if (end - start > max_add)
+            max_add = end - start;
+        cids[n] = lconn->cn_cid;
+    }
+    printf("added %u connections; slowest addition took %"PRIu64" usec\n",
+                                                            nelems, max_add);
+
+    /* Look up in pseudo-random order to defeat the cache.  CIDs are taken
+     * from the original array, so that a miss CID is never derived from
+     * another miss CID.
+     */
+    srand(nelems);
+    for (n = 0; n < nelems; ++n)
+        lookups[n] = cids[ rand() % nelems ] + (mode ? 1 : 0);
+
+    found = 0;
+    start = lsquic_time_now();
+    for (n = 0; n < n_lookups; ++n)
+        found += NULL != conn_hash_find_by_cid(&conn_hash,
+                                                    lookups[n % nelems]);
+    end = lsquic_time_now();
+    assert(found == (mode ? 0 : n_lookups));
+    printf("%u lookups in %"PRIu64" usec: %.1f nsec per lookup\n", n_lookups,
+                end - start, (double) (end - start) * 1000 / n_lookups);
+
+    free(lookups);
+    free(cids);
+    conn_hash_cleanup(&conn_hash);
+    lsquic_malo_destroy(malo);
+}
+
+
+int
+main (int argc, char **argv)
+{
+    int opt, mode = -1;
+    unsigned nelems = 1000000, n_lookups = 10000000;
+
+    while (-1 != (opt = getopt(argc, argv, "s:n:l:")))
+    {
+        switch (opt)
+        {
+        case 's':
+            mode = atoi(optarg);
+            break;
+        case 'n':
+            nelems = atoi(optarg);
+            break;
+        case 'l':
+            n_lookups = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-s mode] [-n connections] "
+                                                "[-l lookups]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    lsquic_log_to_fstream(stderr, LLTS_HHMMSSMS);
+    lsquic_set_log_level("info");
+
+    switch (mode)
+    {
+    case -1:
+        test_cid(nelems);
+        test_iter(0, 0);
+        test_iter(1000, 0);
+        test_iter(1000, 1);
+        test_iter(12345, 1);
+        test_addr(1000);
+        test_migration(100000);
+        break;
+    case 0:
+    case 1:
+        if (nelems < 1 || n_lookups < 1)
+        {
+            fprintf(stderr, "error: invalid parameters\n");
+            exit(2);
+        }
+        run_bench(mode, nelems, n_lookups);
+        break;
+    default:
+        fprintf(stderr, "error: invalid mode %d\n", mode);
+        exit(2);
+    }
 
     exit(0);
 }
@@ -0,0 +1,109 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * Test that packets are decrypted correctly in place -- that is, when
+ * the output buffer is the same as the input buffer.  Once both keys
+ * are available, a failed attempt to use the forward-secure key must not
+ * prevent decryption using the initial key.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lsquic.h"
+#include "lsquic_types.h"
+#include "lsquic_str.h"
+#include "lsquic_handshake.h"
+
+#define HEADER_SZ 10
+
+
+static unsigned char key_i[aes128_key_len] = {
+    0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+    0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x10,
+};
+static unsigned char key_f[aes128_key_len] = {
+    0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+    0xF9, 0xFA, 0xFB, 0xFC, 0xFD, 0xFE, 0xFF, 0xF0,
+};
+static const unsigned char iv_i[aes128_iv_len] = { 0x11, 0x12, 0x13, 0x14, };
+static const unsigned char iv_f[aes128_iv_len] = { 0x21, 0x22, 0x23, 0x24, };
+
+static const unsigned char header[HEADER_SZ] = {
+    0x0C, 0x34, 0x12, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x64,
+};
+static const unsigned char payload[] =
+    "Small packet payload that is to be encrypted and then decrypted";
+
+
+/* Seal packet using the key selected by `have_key' and return its size */
+static size_t
+seal_packet (const struct enc_session_funcs *esf,
+             lsquic_enc_session_t *enc_session, uint8_t have_key,
+             uint64_t packno, unsigned char *buf, size_t bufsz)
+{
+    enum enc_level enc_level;
+    size_t out_len;
+
+    lsquic_enc_session_set_test_keys(enc_session, have_key, 0,
+                                            key_i, iv_i, key_f, iv_f);
+    enc_level = esf->esf_encrypt(enc_session, LSQVER_043, 0, packno,
+                        header, sizeof(header), payload, sizeof(payload),
+                        buf, bufsz, &out_len, 0);
+    assert(enc_level == (have_key == 3 ? ENC_LEV_FORW : ENC_LEV_INIT));
+    assert(out_len > sizeof(header) + sizeof(payload));
+    return out_len;
+}
+
+
+static void
+test_decrypt_in_place (uint8_t peer_have_final_key, uint8_t sealed_with)
+{
+    const struct enc_session_funcs *const esf = select_esf_by_ver(LSQVER_043);
+    lsquic_enc_session_t *enc_session;
+    enum enc_level enc_level;
+    size_t packet_sz, header_len, out_len;
+    unsigned char buf[0x200];
+
+    enc_session = esf->esf_create_client("example.com", 0x1234, NULL,
+                                                                NULL, 0);
+    assert(enc_session);
+
+    packet_sz = seal_packet(esf, enc_session, sealed_with, 100, buf,
+                                                                sizeof(buf));
+
+    lsquic_enc_session_set_test_keys(enc_session, 3, peer_have_final_key,
+                                            key_i, iv_i, key_f, iv_f);
+    header_len = sizeof(header);
+    enc_level = esf->esf_decrypt(enc_session, LSQVER_043, 0, 100, buf,
+                    &header_len, packet_sz - sizeof(header), NULL,
+                    buf, sizeof(buf), &out_len);
+    assert(enc_level == (sealed_with == 3 ? ENC_LEV_FORW : ENC_LEV_INIT));
+    assert(header_len == sizeof(header));
+    assert(out_len == sizeof(payload));
+    assert(0 == memcmp(buf, header, sizeof(header)));
+    assert(0 == memcmp(buf + header_len, payload, sizeof(payload)));
+
+    esf->esf_destroy(enc_session);
+}
+
+
+int
+main (void)
+{
+    if (0 != lsquic_global_init(LSQUIC_GLOBAL_CLIENT))
+        return 1;
+
+    /* Before peer is known to use the forward-secure key: */
+    test_decrypt_in_place(0, 2);
+    test_decrypt_in_place(0, 3);
+    /* Delayed or reordered initial-key packet after forward-secure key
+     * has been seen:
+     */
+    test_decrypt_in_place(1, 2);
+    test_decrypt_in_place(1, 3);
+
+    lsquic_global_cleanup();
+    return 0;
+}
@@ -1,15 +1,27 @@
 /* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * Without arguments, functional tests are run.  Benchmarks: -s 0 and -s 1
+ * compare malloc and malo speed; -s 2 prints memory density for objects
+ * allocated by the memory manager.  Use -n to specify number of iterations
+ * (or, for -s 2, number of objects).
+ */
 #include <assert.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/queue.h>
 #ifndef WIN32
 #include <unistd.h>
 #else
 #include <getopt.h>
 #endif
 
+#include "lsquic.h"
+#include "lsquic_int_types.h"
 #include "lsquic_malo.h"
+#include "lsquic_packet_common.h"
+#include "lsquic_packet_in.h"
+#include "lsquic_packet_out.h"
 
 struct elem {
     unsigned        id;
@@ -60,6 +72,40 @@ run_tests (size_t el_size)
     el = lsquic_malo_first(malo);
     assert(!el);
 
+    /* All pages but the first one are empty now */
+    assert(lsquic_malo_mem_used(malo) > 0x1000);
+    assert(lsquic_malo_trim(malo) > 0);
+    assert(lsquic_malo_mem_used(malo) == 0x1000);
+
+    for (i = 1; i <= N_ELEMS; ++i)
+    {
+        el = lsquic_malo_get(malo);
+        el->id = i;
+    }
+    sum = 0;
+    for (el = lsquic_malo_first(malo); el; el = lsquic_malo_next(malo))
+        sum += el->id;
+    assert(sum == ((uint64_t) N_ELEMS + 1) * ((uint64_t) N_ELEMS / 2));
+
+    lsquic_malo_destroy(malo);
+}
+
+
+/* Slots whose size is a multiple of 64 are aligned on cache line boundary */
+static void
+test_alignment (void)
+{
+    struct malo *malo;
+    unsigned i;
+    void *obj;
+
+    malo = lsquic_malo_create(128);
+    assert(malo);
+    for (i = 0; i < 100; ++i)
+    {
+        obj = lsquic_malo_get(malo);
+        assert(0 == ((uintptr_t) obj & 63));
+    }
     lsquic_malo_destroy(malo);
 }
 
@@ -108,6 +154,63 @@ alloc_using_malo (int n)
 }
 
 
+/* Size of slot before exact slot sizes were introduced */
+static size_t
+pow2_slot_size (size_t sz)
+{
+    size_t slot_sz;
+
+    for (slot_sz = 64; slot_sz < sz; slot_sz <<= 1)
+        ;
+    return slot_sz;
+}
+
+
+/* Print memory density for objects allocated by the memory manager */
+static void
+measure_density (int n)
+{
+    static const struct {
+        const char *name;
+        size_t      size;
+    } objs[] = {
+        { "stream_frame",       sizeof(struct stream_frame), },
+        { "stream_rec_arr",     sizeof(struct stream_rec_arr), },
+        { "lsquic_packet_in",   sizeof(struct lsquic_packet_in), },
+        { "lsquic_packet_out",  sizeof(struct lsquic_packet_out), },
+        /* Sizes that are not a power of two, for comparison */
+        { "odd-sized",          72, },
+        { "odd-sized",          200, },
+        { "odd-sized",          700, },
+    };
+    struct malo *malo;
+    size_t mem_used, pow2_sz;
+    unsigned i;
+    int j;
+
+    if (n < 1000)
+        n = 1000;
+
+    printf("%-20s %6s %10s %10s %12s\n", "object", "size", "bytes/obj",
+                                                    "objs/page", "pow2 b/obj");
+    for (i = 0; i < sizeof(objs) / sizeof(objs[0]); ++i)
+    {
+        malo = lsquic_malo_create(objs[i].size);
+        assert(malo);
+        for (j = 0; j < n; ++j)
+            (void) lsquic_malo_get(malo);
+        mem_used = lsquic_malo_mem_used(malo);
+        pow2_sz = pow2_slot_size(objs[i].size);
+        printf("%-20s %6zu %10.1f %10.1f %12.1f\n", objs[i].name,
+            objs[i].size, (double) mem_used / n,
+            (double) n * 0x1000 / mem_used,
+            /* One slot per page used to be taken by the page header */
+            (double) 0x1000 / (0x1000 / pow2_sz - 1));
+        lsquic_malo_destroy(malo);
+    }
+}
+
+
 int
 main (int argc, char **argv)
 {
@@ -140,6 +243,7 @@ main (int argc, char **argv)
             run_tests(sz + 1);
             run_tests(sz + 3);
         }
+        test_alignment();
         break;
     }
     case 0:
@@ -148,6 +252,9 @@ main (int argc, char **argv)
     case 1:
         alloc_using_malo(n);
         break;
+    case 2:
+        measure_density(n);
+        break;
     default:
         fprintf(stderr, "error: invalid mode %d\n", mode);
         exit(2);
@@ -0,0 +1,321 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * Test that memory manager caps and trims its free lists.
+ *
+ * Without arguments, functional tests are run.  To benchmark the packet
+ * build and encrypt loop, use -b; add -H to allocate buffers from huge
+ * pages.  -n sets the number of packets and -w the number of packets in
+ * flight.
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#ifndef WIN32
+#include <unistd.h>
+#else
+#include <getopt.h>
+#endif
+
+#include "lsquic.h"
+#include "lsquic_int_types.h"
+#include "lsquic_packet_common.h"
+#include "lsquic_packet_in.h"
+#include "lsquic_packet_out.h"
+#include "lsquic_mm.h"
+#include "lsquic_pkt_ring.h"
+#include "lsquic_util.h"
+
+#define N_BUFS 100
+
+
+/* Objects not reused during a trim period are released by the next trim */
+static void
+test_trim (void)
+{
+    struct lsquic_mm mm;
+    struct mm_mem_stats before, spike, after;
+    struct lsquic_packet_in *packets_in[N_BUFS];
+    void *bufs[N_BUFS];
+    lsquic_time_t now;
+    unsigned i;
+
+    lsquic_mm_init(&mm);
+    lsquic_mm_mem_used(&mm, &before);
+    assert(0 == before.cached);
+
+    for (i = 0; i < N_BUFS; ++i)
+    {
+        bufs[i] = lsquic_mm_get_16k(&mm);
+        packets_in[i] = lsquic_mm_get_packet_in(&mm);
+        packets_in[i]->pi_data = lsquic_mm_get_1370(&mm);
+        packets_in[i]->pi_flags |= PI_OWN_DATA;
+    }
+    lsquic_mm_mem_used(&mm, &spike);
+    assert(0 == spike.cached);
+    assert(spike.live >= before.live + N_BUFS * (0x4000 + 1370));
+
+    for (i = 0; i < N_BUFS; ++i)
+    {
+        lsquic_mm_put_16k(&mm, bufs[i]);
+        lsquic_mm_put_packet_in(&mm, packets_in[i]);
+    }
+    lsquic_mm_mem_used(&mm, &after);
+    assert(after.cached >= N_BUFS * (0x4000 + 1370));
+    assert(after.live < spike.live - N_BUFS * (0x4000 + 1370));
+
+    now = 1;
+    lsquic_mm_trim(&mm, now);      /* Starts trim period */
+    lsquic_mm_mem_used(&mm, &after);
+    assert(after.cached >= N_BUFS * (0x4000 + 1370));
+
+    /* Some objects are reused during the trim period: they are kept */
+    for (i = 0; i < 10; ++i)
+        bufs[i] = lsquic_mm_get_16k(&mm);
+    for (i = 0; i < 10; ++i)
+        lsquic_mm_put_16k(&mm, bufs[i]);
+
+    lsquic_mm_trim(&mm, now + 1);  /* Too early: nothing happens */
+    lsquic_mm_mem_used(&mm, &after);
+    assert(after.cached >= N_BUFS * (0x4000 + 1370));
+
+    now += 2000000;
+    lsquic_mm_trim(&mm, now);
+    lsquic_mm_mem_used(&mm, &after);
+    assert(after.cached == 10 * 0x4000);
+    /* Empty malo pages are released, too */
+    assert(after.live == before.live);
+
+    now += 2000000;
+    lsquic_mm_trim(&mm, now);
+    lsquic_mm_mem_used(&mm, &after);
+    assert(0 == after.cached);
+
+    lsquic_mm_cleanup(&mm);
+}
+
+
+static void
+test_cap (void)
+{
+    struct lsquic_mm mm;
+    struct mm_mem_stats stats;
+    void *bufs[N_BUFS];
+    unsigned i;
+
+    lsquic_mm_init(&mm);
+    mm.max_cached = 10 * 0x1000;
+
+    for (i = 0; i < N_BUFS; ++i)
+        bufs[i] = lsquic_mm_get_4k(&mm);
+    for (i = 0; i < N_BUFS; ++i)
+        lsquic_mm_put_4k(&mm, bufs[i]);
+
+    lsquic_mm_mem_used(&mm, &stats);
+    assert(stats.cached == 10 * 0x1000);
+
+    /* Cached buffers are reused */
+    for (i = 0; i < 10; ++i)
+        bufs[i] = lsquic_mm_get_4k(&mm);
+    lsquic_mm_mem_used(&mm, &stats);
+    assert(0 == stats.cached);
+    for (i = 0; i < 10; ++i)
+        lsquic_mm_put_4k(&mm, bufs[i]);
+
+    lsquic_mm_cleanup(&mm);
+}
+
+
+static void
+test_arena (void)
+{
+    struct lsquic_mm mm;
+    struct mm_mem_stats stats;
+    struct lsquic_packet_out *packets_out[N_BUFS];
+    void *bufs[N_BUFS];
+    size_t arena_sz;
+    unsigned i;
+
+    lsquic_mm_init(&mm);
+    mm.use_arena = 1;
+    mm.max_cached = 0x1000;
+
+    for (i = 0; i < N_BUFS; ++i)
+    {
+        bufs[i] = lsquic_mm_get_16k(&mm);
+        memset(bufs[i], 'a', 0x4000);
+        packets_out[i] = lsquic_mm_get_packet_out(&mm, NULL,
+                                                        QUIC_MAX_PAYLOAD_SZ);
+        assert(packets_out[i]);
+        memset(packets_out[i]->po_data, 'b', QUIC_MAX_PAYLOAD_SZ);
+    }
+    assert(mm.arena_sz >= N_BUFS * (0x4000 + QUIC_MAX_PAYLOAD_SZ));
+    lsquic_mm_mem_used(&mm, &stats);
+    assert(stats.live >= mm.arena_sz);
+
+    /* Arena buffers are always cached, the cap notwithstanding */
+    for (i = 0; i < N_BUFS; ++i)
+    {
+        lsquic_mm_put_16k(&mm, bufs[i]);
+        lsquic_mm_put_packet_out(&mm, packets_out[i]);
+    }
+    lsquic_mm_mem_used(&mm, &stats);
+    assert(stats.cached >= N_BUFS * 0x4000);
+
+    lsquic_mm_trim(&mm, 1);
+    lsquic_mm_trim(&mm, 3000000);
+    lsquic_mm_mem_used(&mm, &stats);
+    assert(stats.cached >= N_BUFS * 0x4000);
+
+    /* Cached buffers are reused: arenas do not grow */
+    arena_sz = mm.arena_sz;
+    for (i = 0; i < N_BUFS; ++i)
+        bufs[i] = lsquic_mm_get_16k(&mm);
+    assert(mm.arena_sz == arena_sz);
+    for (i = 0; i < N_BUFS; ++i)
+        lsquic_mm_put_16k(&mm, bufs[i]);
+
+    lsquic_mm_cleanup(&mm);
+}
+
+
+/* Stand-in for AEAD: reads the payload and writes the same number of
+ * bytes into the encryption buffer.
+ */
+static void
+encrypt (unsigned char *dst, const unsigned char *src, unsigned sz,
+                                                            uint64_t nonce)
+{
+    unsigned i;
+
+    for (i = 0; i < sz; ++i)
+        dst[i] = src[i] ^ (unsigned char) (nonce + i);
+}
+
+
+/* The engine uses the same ring size and initial batch size */
+#define BENCH_RING_SLOTS 1024
+#define BENCH_BATCH_SIZE 32
+
+
+/* Build and encrypt `n_packets' packets, keeping `window' of them in
+ * flight.  Return number of microseconds taken.
+ *
+ * As in the engine, encryption buffers come from the packet ring and are
+ * released once a batch has been sent, while packets stay in flight until
+ * they are acknowledged.
+ */
+static lsquic_time_t
+run_bench (int use_arena, unsigned n_packets, unsigned window)
+{
+    struct lsquic_mm mm;
+    struct pkt_ring ring;
+    struct lsquic_packet_out **in_flight, *packet_out;
+    struct lsquic_packet_out *batch[BENCH_BATCH_SIZE];
+    unsigned char data[QUIC_MAX_PAYLOAD_SZ];
+    lsquic_time_t start;
+    unsigned n, idx, n_batch, i;
+
+    lsquic_mm_init(&mm);
+    mm.use_arena = use_arena;
+    lsquic_pkt_ring_init(&ring, BENCH_RING_SLOTS);
+    ring.pr_huge_pages = use_arena;
+    in_flight = calloc(window, sizeof(in_flight[0]));
+    assert(in_flight);
+    memset(data, 'd', sizeof(data));
+    n_batch = 0;
+
+    start = lsquic_time_now();
+    for (n = 0; n < n_packets; ++n)
+    {
+        idx = n % window;
+        if (in_flight[idx])     /* Oldest packet has been acknowledged */
+            lsquic_mm_put_packet_out(&mm, in_flight[idx]);
+        packet_out = lsquic_mm_get_packet_out(&mm, NULL, QUIC_MAX_PAYLOAD_SZ);
+        assert(packet_out);
+        memcpy(packet_out->po_data, data, sizeof(data));
+        packet_out->po_data_sz = sizeof(data);
+        packet_out->po_enc_data = lsquic_pkt_ring_alloc(&ring,
+                                                        QUIC_MAX_PACKET_SZ);
+        assert(packet_out->po_enc_data);
+        encrypt(packet_out->po_enc_data, packet_out->po_data,
+                                                packet_out->po_data_sz, n);
+        in_flight[idx] = packet_out;
+        batch[n_batch++] = packet_out;
+        if (n_batch == BENCH_BATCH_SIZE || n + 1 == n_packets)
+        {
+            for (i = 0; i < n_batch; ++i)
+            {
+                lsquic_pkt_ring_release(&ring, batch[i]->po_enc_data);
+                batch[i]->po_enc_data = NULL;
+            }
+            lsquic_pkt_ring_reclaim(&ring);
+            n_batch = 0;
+        }
+    }
+    start = lsquic_time_now() - start;
+    assert(0 == ring.pr_n_fallbacks);
+
+    for (idx = 0; idx < window; ++idx)
+        if (in_flight[idx])
+            lsquic_mm_put_packet_out(&mm, in_flight[idx]);
+    free(in_flight);
+    lsquic_pkt_ring_cleanup(&ring);
+    lsquic_mm_cleanup(&mm);
+    return start;
+}
+
+
+int
+main (int argc, char **argv)
+{
+    int opt, bench = 0, use_arena = 0;
+    unsigned n_packets = 1000000, window = 10000;
+    lsquic_time_t elapsed;
+
+    while (-1 != (opt = getopt(argc, argv, "bHn:w:")))
+    {
+        switch (opt)
+        {
+        case 'b':
+            bench = 1;
+            break;
+        case 'H':
+            use_arena = 1;
+            break;
+        case 'n':
+            n_packets = atoi(optarg);
+            break;
+        case 'w':
+            window = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-b] [-H] [-n packets] "
+                                        "[-w packets in flight]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    if (!bench)
+    {
+        test_trim();
+        test_cap();
+        test_arena();
+        return 0;
+    }
+
+    if (window < 1)
+    {
+        fprintf(stderr, "error: invalid parameters\n");
+        exit(2);
+    }
+
+    elapsed = run_bench(use_arena, n_packets, window);
+    printf("huge pages: %s; built and encrypted %u packets (%u in flight) "
+        "in %"PRIu64" usec, %.1f ns per packet\n", use_arena ? "on" : "off",
+        n_packets, window, elapsed, (double) elapsed * 1000 / n_packets);
+    return 0;
+}
@@ -0,0 +1,145 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lsquic_types.h"
+#include "lsquic_int_types.h"
+#include "lsquic_pacer.h"
+
+#define PACK_SIZE 1000
+#define GRANULARITY 1000
+
+
+/* Departure times are spaced according to the pacing rate, with
+ * sub-microsecond precision.
+ */
+static void
+test_rate (void)
+{
+    struct pacer pacer;
+    lsquic_time_t departure, prev;
+    unsigned n;
+
+    pacer_init(&pacer, 0, GRANULARITY, 0);
+    pacer_tick(&pacer, 1000000);
+    /* Spend burst tokens */
+    for (n = 0; n < 10; ++n)
+    {
+        assert(pacer_can_schedule(&pacer, n));
+        departure = pacer_packet_scheduled(&pacer, n, 0, PACK_SIZE,
+                                                            400000000);
+        assert(departure == 1000000);
+    }
+
+    /* 1000 bytes at 400 MB/s: 2.5 usec per packet */
+    prev = 0;
+    for (n = 0; n < 400; ++n)
+    {
+        assert(pacer_can_schedule(&pacer, 10 + n));
+        departure = pacer_packet_scheduled(&pacer, 10 + n, 0, PACK_SIZE,
+                                                            400000000);
+        assert(departure >= 1000000 + n * 5 / 2);
+        assert(departure <= 1000000 + n * 5 / 2 + 1);
+        assert(departure >= prev);
+        prev = departure;
+    }
+    /* Packets up to one clock tick ahead can be scheduled */
+    assert(pacer_next_sched(&pacer) == 1000000 + GRANULARITY);
+    assert(pacer_can_schedule(&pacer, 410));
+    (void) pacer_packet_scheduled(&pacer, 410, 0, PACK_SIZE, 400000000);
+    assert(!pacer_can_schedule(&pacer, 411));
+    assert(pacer_delayed(&pacer));
+
+    pacer_cleanup(&pacer);
+}
+
+
+/* Time lost to a late wakeup is made up for, but by no more than one
+ * clock tick.  Time not used while application-limited is not.
+ */
+static void
+test_credit (void)
+{
+    struct pacer pacer;
+    lsquic_time_t departure;
+
+    pacer_init(&pacer, 0, GRANULARITY, 0);
+    pacer_loss_event(&pacer);
+    pacer_tick(&pacer, 1000000);
+
+    /* 1000 bytes at 1 MB/s: 1 ms per packet */
+    departure = pacer_packet_scheduled(&pacer, 1, 0, PACK_SIZE, 1000000);
+    assert(departure == 1000000);
+    departure = pacer_packet_scheduled(&pacer, 2, 0, PACK_SIZE, 1000000);
+    assert(departure == 1001000);
+    assert(!pacer_can_schedule(&pacer, 3));
+    assert(pacer_delayed(&pacer));
+
+    /* Woken up half a tick late: keep the schedule */
+    pacer_tick(&pacer, 1002500);
+    assert(pacer_can_schedule(&pacer, 3));
+    departure = pacer_packet_scheduled(&pacer, 3, 0, PACK_SIZE, 1000000);
+    assert(departure == 1002500);
+    assert(!pacer_delayed(&pacer));
+    assert(pacer_next_sched(&pacer) == 1003000);
+
+    /* Application-limited for a long time: start from now */
+    pacer_tick(&pacer, 2000000);
+    departure = pacer_packet_scheduled(&pacer, 4, 0, PACK_SIZE, 1000000);
+    assert(departure == 2000000);
+    departure = pacer_packet_scheduled(&pacer, 5, 0, PACK_SIZE, 1000000);
+    assert(departure == 2001000);
+    assert(!pacer_can_schedule(&pacer, 6));
+
+    /* Woken up three ticks late: make up for one tick only */
+    pacer_tick(&pacer, 2005000);
+    assert(pacer_can_schedule(&pacer, 6));
+    departure = pacer_packet_scheduled(&pacer, 6, 0, PACK_SIZE, 1000000);
+    assert(departure == 2005000);
+    departure = pacer_packet_scheduled(&pacer, 7, 0, PACK_SIZE, 1000000);
+    assert(departure == 2005000);
+    assert(pacer_next_sched(&pacer) == 2006000);
+
+    pacer_cleanup(&pacer);
+}
+
+
+/* With a horizon, packets are released ahead of their departure times,
+ * so a single tick can schedule a whole burst.
+ */
+static void
+test_horizon (void)
+{
+    struct pacer pacer;
+    lsquic_time_t departure;
+    unsigned n;
+
+    pacer_init(&pacer, 0, GRANULARITY, 10 * GRANULARITY);
+    pacer_loss_event(&pacer);
+    pacer_tick(&pacer, 1000000);
+
+    /* 1000 bytes at 1 MB/s: 1 ms per packet */
+    for (n = 0; n <= 10; ++n)
+    {
+        assert(pacer_can_schedule(&pacer, 1 + n));
+        departure = pacer_packet_scheduled(&pacer, 1 + n, 0, PACK_SIZE,
+                                                                1000000);
+        assert(departure == 1000000 + n * 1000);
+    }
+    assert(!pacer_can_schedule(&pacer, 12));
+    /* Wake up when the next packet falls within the horizon */
+    assert(pacer_next_sched(&pacer) == 1002000);
+
+    pacer_cleanup(&pacer);
+}
+
+
+int
+main (void)
+{
+    test_rate();
+    test_credit();
+    test_horizon();
+    return 0;
+}
@@ -0,0 +1,416 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * Test lsquic_engine_packets_in() and compare its performance with that
+ * of lsquic_engine_packet_in().  Also test that incoming packet buffers
+ * handed over to the library are released, and that receive time passed
+ * by the user is recorded in the packet.
+ *
+ * Without arguments, functional tests are run.  To benchmark, specify
+ * mode using -s: 0 passes packets one by one, 1 passes them in batches.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#else
+#include <getopt.h>
+#endif
+
+#include "lsquic.h"
+#include "lsquic_int_types.h"
+#include "lsquic_conn.h"
+#include "lsquic_packet_common.h"
+#include "lsquic_packet_in.h"
+#include "lsquic_util.h"
+
+#define MAX_CONNS 64
+#define MAX_BATCH 1024
+#define PACKET_SZ 1200
+
+
+static lsquic_conn_ctx_t *
+on_new_conn (void *stream_if_ctx, lsquic_conn_t *conn)
+{
+    return NULL;
+}
+
+
+static void
+on_conn_closed (lsquic_conn_t *conn)
+{
+}
+
+
+static const struct lsquic_stream_if stream_if = {
+    .on_new_conn            = on_new_conn,
+    .on_conn_closed         = on_conn_closed,
+};
+
+
+static int
+packets_out (void *ctx, const struct lsquic_out_spec *specs, unsigned count)
+{
+    return (int) count;
+}
+
+
+struct test_ctx
+{
+    lsquic_engine_t        *engine;
+    unsigned                n_released[MAX_BATCH];
+    unsigned                n_conns;
+    lsquic_conn_t          *conns[MAX_CONNS];
+    lsquic_cid_t            cids[MAX_CONNS];
+    struct sockaddr_in      local_sa[MAX_CONNS];
+    struct sockaddr_in      peer_sa;
+    unsigned char           bufs[MAX_BATCH][PACKET_SZ];
+    struct lsquic_in_spec   specs[MAX_BATCH];
+};
+
+
+static void
+release_packet_in (void *pimi_ctx, void *buf)
+{
+    struct test_ctx *const ctx = pimi_ctx;
+    unsigned n;
+
+    n = ((unsigned char *) buf - &ctx->bufs[0][0]) / PACKET_SZ;
+    assert(n < MAX_BATCH);
+    assert(buf == ctx->bufs[n]);
+    ++ctx->n_released[n];
+}
+
+
+static const struct lsquic_packin_mem_if pimi = {
+    .pimi_release = release_packet_in,
+};
+
+
+static void
+init_test_ctx (struct test_ctx *ctx, unsigned n_conns, int use_tcid0,
+                                                            int own_buffers)
+{
+    struct lsquic_engine_settings settings;
+    struct lsquic_engine_api api;
+    lsquic_conn_t *conn;
+    unsigned n;
+
+    lsquic_engine_init_settings(&settings, 0);
+    settings.es_versions = 1 << LSQVER_043;
+    settings.es_support_tcid0 = use_tcid0;
+    memset(&api, 0, sizeof(api));
+    api.ea_settings = &settings;
+    api.ea_packets_out = packets_out;
+    api.ea_stream_if = &stream_if;
+    if (own_buffers)
+    {
+        api.ea_pimi = &pimi;
+        api.ea_pimi_ctx = ctx;
+    }
+
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->engine = lsquic_engine_new(0, &api);
+    assert(ctx->engine);
+
+    ctx->peer_sa.sin_family = AF_INET;
+    ctx->peer_sa.sin_port = htons(443);
+    ctx->peer_sa.sin_addr.s_addr = htonl(0x7F000001);
+
+    assert(n_conns <= MAX_CONNS);
+    for (n = 0; n < n_conns; ++n)
+    {
+        ctx->local_sa[n].sin_family = AF_INET;
+        ctx->local_sa[n].sin_port = htons(10000 + n);
+        ctx->local_sa[n].sin_addr.s_addr = htonl(0x7F000001);
+        conn = lsquic_engine_connect(ctx->engine,
+                    (struct sockaddr *) &ctx->local_sa[n],
+                    (struct sockaddr *) &ctx->peer_sa, ctx, NULL,
+                    "localhost", 0, NULL, 0);
+        assert(conn);
+        ctx->conns[n] = conn;
+        ctx->cids[n] = lsquic_conn_id(conn);
+    }
+    ctx->n_conns = n_conns;
+}
+
+
+/* Generate `count' short-header gQUIC packets.  Consecutive packets are
+ * spread among connections in runs of `run_len' packets.  Packet with
+ * index `unknown_idx' (if valid) is destined to a nonexistent connection.
+ */
+static void
+gen_packets (struct test_ctx *ctx, unsigned count, unsigned run_len,
+                                                    unsigned unknown_idx)
+{
+    unsigned char *p;
+    lsquic_cid_t cid;
+    unsigned n, conn_idx;
+
+    assert(count <= MAX_BATCH);
+    for (n = 0; n < count; ++n)
+    {
+        conn_idx = n / run_len % ctx->n_conns;
+        if (n == unknown_idx)
+            cid = ~ctx->cids[conn_idx];
+        else
+            cid = ctx->cids[conn_idx];
+        p = ctx->bufs[n];
+        *p++ = 0x08;                    /* Eight-byte CID, one-byte packno */
+        memcpy(p, &cid, sizeof(cid));
+        p += sizeof(cid);
+        *p++ = (unsigned char) (n + 1);
+        memset(p, 0xA5, PACKET_SZ - (p - ctx->bufs[n]));
+        ctx->specs[n].buf      = ctx->bufs[n];
+        ctx->specs[n].sz       = PACKET_SZ;
+        ctx->specs[n].local_sa = (struct sockaddr *) &ctx->local_sa[conn_idx];
+        ctx->specs[n].peer_sa  = (struct sockaddr *) &ctx->peer_sa;
+        ctx->specs[n].peer_ctx = ctx;
+        ctx->specs[n].received = 0;
+    }
+}
+
+
+static unsigned
+feed_one_by_one (struct test_ctx *ctx, unsigned count)
+{
+    unsigned n, n_processed;
+
+    n_processed = 0;
+    for (n = 0; n < count; ++n)
+        n_processed += 0 == lsquic_engine_packet_in(ctx->engine,
+                ctx->specs[n].buf, ctx->specs[n].sz, ctx->specs[n].local_sa,
+                ctx->specs[n].peer_sa, ctx->specs[n].peer_ctx);
+    return n_processed;
+}
+
+
+static void
+test_batch (unsigned n_conns, int use_tcid0, unsigned count, unsigned run_len)
+{
+    struct test_ctx *ctx;
+    unsigned n_one, n_batch;
+
+    ctx = malloc(sizeof(*ctx));
+    init_test_ctx(ctx, n_conns, use_tcid0, 0);
+
+    gen_packets(ctx, count, run_len, count);
+    n_one = feed_one_by_one(ctx, count);
+    n_batch = lsquic_engine_packets_in(ctx->engine, ctx->specs, count);
+    assert(n_one == count);
+    assert(n_batch == n_one);
+
+    if (!use_tcid0)
+    {
+        /* Packet for unknown connection is dropped */
+        gen_packets(ctx, count, run_len, count / 2);
+        n_one = feed_one_by_one(ctx, count);
+        n_batch = lsquic_engine_packets_in(ctx->engine, ctx->specs, count);
+        assert(n_one == count - 1);
+        assert(n_batch == n_one);
+    }
+
+    /* Packet that is too large is skipped */
+    gen_packets(ctx, count, run_len, count);
+    ctx->specs[0].sz = 0x10000;
+    n_batch = lsquic_engine_packets_in(ctx->engine, ctx->specs, count);
+    assert(n_batch == count - 1);
+
+    n_batch = lsquic_engine_packets_in(ctx->engine, ctx->specs, 0);
+    assert(n_batch == 0);
+
+    lsquic_engine_destroy(ctx->engine);
+    free(ctx);
+}
+
+
+/* When the library owns incoming packet buffers, each buffer is released
+ * exactly once, whether the packet is processed or dropped.
+ */
+static void
+test_ownership (unsigned n_conns, int use_tcid0, unsigned count)
+{
+    struct test_ctx *ctx;
+    unsigned n;
+
+    ctx = malloc(sizeof(*ctx));
+    init_test_ctx(ctx, n_conns, use_tcid0, 1);
+
+    gen_packets(ctx, count, 1, use_tcid0 ? count : count / 2);
+    ctx->specs[1].sz = 0x10000;
+    (void) feed_one_by_one(ctx, count);
+    for (n = 0; n < count; ++n)
+        assert(1 == ctx->n_released[n]);
+
+    memset(ctx->n_released, 0, sizeof(ctx->n_released));
+    (void) lsquic_engine_packets_in(ctx->engine, ctx->specs, count);
+    for (n = 0; n < count; ++n)
+        assert(1 == ctx->n_released[n]);
+
+    lsquic_engine_destroy(ctx->engine);
+    for (n = 0; n < count; ++n)
+        assert(1 == ctx->n_released[n]);
+    free(ctx);
+}
+
+
+static const struct conn_iface *orig_conn_iface;
+static lsquic_time_t last_received;
+
+
+static void
+record_packet_in (lsquic_conn_t *lconn, struct lsquic_packet_in *packet_in)
+{
+    last_received = packet_in->pi_received;
+    orig_conn_iface->ci_packet_in(lconn, packet_in);
+}
+
+
+/* Receive time passed by the user becomes packet's receive time, unless
+ * it is not set or is in the future.
+ */
+static void
+test_received (void)
+{
+    struct test_ctx *ctx;
+    struct conn_iface conn_iface;
+    lsquic_time_t received, before;
+    unsigned n;
+    int s;
+
+    ctx = malloc(sizeof(*ctx));
+    init_test_ctx(ctx, 1, 0, 0);
+    orig_conn_iface = ctx->conns[0]->cn_if;
+    conn_iface = *orig_conn_iface;
+    conn_iface.ci_packet_in = record_packet_in;
+    ctx->conns[0]->cn_if = &conn_iface;
+
+    received = lsquic_time_now() - 12345;
+    gen_packets(ctx, 1, 1, 1);
+    last_received = 0;
+    s = lsquic_engine_packet_in_ts(ctx->engine, ctx->specs[0].buf,
+            ctx->specs[0].sz, ctx->specs[0].local_sa, ctx->specs[0].peer_sa,
+            ctx->specs[0].peer_ctx, received);
+    assert(0 == s);
+    assert(received == last_received);
+
+    /* Zero and future times are replaced by current time */
+    before = lsquic_time_now();
+    last_received = 0;
+    s = lsquic_engine_packet_in_ts(ctx->engine, ctx->specs[0].buf,
+            ctx->specs[0].sz, ctx->specs[0].local_sa, ctx->specs[0].peer_sa,
+            ctx->specs[0].peer_ctx, before + 10000000);
+    assert(0 == s);
+    assert(last_received >= before && last_received <= lsquic_time_now());
+    last_received = 0;
+    (void) feed_one_by_one(ctx, 1);
+    assert(last_received >= before && last_received <= lsquic_time_now());
+
+    /* Batch: each packet keeps its own receive time */
+    gen_packets(ctx, 8, 1, 8);
+    for (n = 0; n < 8; ++n)
+        ctx->specs[n].received = received + n;
+    n = lsquic_engine_packets_in(ctx->engine, ctx->specs, 8);
+    assert(8 == n);
+    assert(received + 7 == last_received);
+
+    ctx->conns[0]->cn_if = orig_conn_iface;
+    lsquic_engine_destroy(ctx->engine);
+    free(ctx);
+}
+
+
+static void
+run_bench (int mode, unsigned n_iters, unsigned batch_sz, unsigned n_conns,
+                                                            unsigned run_len)
+{
+    struct test_ctx *ctx;
+    unsigned n;
+
+    ctx = malloc(sizeof(*ctx));
+    init_test_ctx(ctx, n_conns, 0, 0);
+    gen_packets(ctx, batch_sz, run_len, batch_sz);
+
+    for (n = 0; n < n_iters; ++n)
+        if (mode == 0)
+            (void) feed_one_by_one(ctx, batch_sz);
+        else
+            (void) lsquic_engine_packets_in(ctx->engine, ctx->specs,
+                                                                batch_sz);
+
+    lsquic_engine_destroy(ctx->engine);
+    free(ctx);
+}
+
+
+int
+main (int argc, char **argv)
+{
+    int opt, mode = -1;
+    unsigned n_iters = 10000, batch_sz = 32, n_conns = 4, run_len = 1;
+
+    while (-1 != (opt = getopt(argc, argv, "s:n:b:c:r:")))
+    {
+        switch (opt)
+        {
+        case 's':
+            mode = atoi(optarg);
+            break;
+        case 'n':
+            n_iters = atoi(optarg);
+            break;
+        case 'b':
+            batch_sz = atoi(optarg);
+            break;
+        case 'c':
+            n_conns = atoi(optarg);
+            break;
+        case 'r':
+            run_len = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-s mode] [-n iterations] "
+                "[-b batch size] [-c connections] [-r run length]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    if (batch_sz < 1 || batch_sz > MAX_BATCH || n_conns < 1
+                                    || n_conns > MAX_CONNS || run_len < 1)
+    {
+        fprintf(stderr, "error: invalid parameters\n");
+        exit(2);
+    }
+
+    if (0 != lsquic_global_init(LSQUIC_GLOBAL_CLIENT))
+        exit(EXIT_FAILURE);
+
+    switch (mode)
+    {
+    case -1:
+        test_batch(1, 0, 32, 1);
+        test_batch(4, 0, 32, 1);
+        test_batch(4, 0, 100, 3);
+        test_batch(3, 1, 32, 2);
+        test_batch(3, 0, 200, 7);
+        test_ownership(4, 0, 32);
+        test_ownership(2, 1, 32);
+        test_received();
+        break;
+    case 0:
+    case 1:
+        run_bench(mode, n_iters, batch_sz, n_conns, run_len);
+        break;
+    default:
+        fprintf(stderr, "error: invalid mode %d\n", mode);
+        exit(2);
+    }
+
+    lsquic_global_cleanup();
+    return 0;
+}
@@ -0,0 +1,312 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * Test the packet out ring buffer allocator.
+ *
+ * Without arguments, functional tests are run.  To benchmark, specify
+ * mode using -s: 0 uses malloc(3) and free(3), 1 uses the ring.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef WIN32
+#include <unistd.h>
+#else
+#include <getopt.h>
+#endif
+
+#include "lsquic_int_types.h"
+#include "lsquic_util.h"
+#include "lsquic_pkt_ring.h"
+
+#define MAX_BUFS 1024
+
+
+static int
+in_ring (const struct pkt_ring *ring, const void *buf)
+{
+    return ring->pr_buf
+        && (uintptr_t) buf - (uintptr_t) ring->pr_buf
+                        < (uintptr_t) ring->pr_n_slots * PKT_RING_SLOT_SZ;
+}
+
+
+/* Consecutive allocations are contiguous */
+static void
+test_contiguous (void)
+{
+    struct pkt_ring ring;
+    unsigned char *bufs[8];
+    unsigned n;
+
+    lsquic_pkt_ring_init(&ring, 7);
+    assert(ring.pr_n_slots == 8);
+    assert(!ring.pr_buf);
+
+    for (n = 0; n < 8; ++n)
+    {
+        bufs[n] = lsquic_pkt_ring_alloc(&ring, 1200);
+        assert(in_ring(&ring, bufs[n]));
+        memset(bufs[n], n, 1200);
+        if (n > 0)
+            assert(bufs[n] == bufs[n - 1] + PKT_RING_SLOT_SZ);
+    }
+    assert(lsquic_pkt_ring_n_used(&ring) == 8);
+    assert(ring.pr_n_fallbacks == 0);
+
+    /* Ring is full: fall back to malloc */
+    bufs[0] = lsquic_pkt_ring_alloc(&ring, 1200);
+    assert(!in_ring(&ring, bufs[0]));
+    assert(ring.pr_n_fallbacks == 1);
+    lsquic_pkt_ring_release(&ring, bufs[0]);
+
+    for (n = 1; n < 8; ++n)
+        lsquic_pkt_ring_release(&ring, bufs[n]);
+    lsquic_pkt_ring_release(&ring, ring.pr_buf);
+    lsquic_pkt_ring_reclaim(&ring);
+    assert(lsquic_pkt_ring_n_used(&ring) == 0);
+
+    lsquic_pkt_ring_cleanup(&ring);
+}
+
+
+/* Slots released out of order cannot be reclaimed until the oldest slot
+ * is released, but they are reused when the ring is full.
+ */
+static void
+test_out_of_order (void)
+{
+    struct pkt_ring ring;
+    unsigned char *bufs[4], *buf;
+
+    lsquic_pkt_ring_init(&ring, 4);
+    bufs[0] = lsquic_pkt_ring_alloc(&ring, 100);
+    bufs[1] = lsquic_pkt_ring_alloc(&ring, 100);
+    bufs[2] = lsquic_pkt_ring_alloc(&ring, 100);
+    bufs[3] = lsquic_pkt_ring_alloc(&ring, 100);
+
+    lsquic_pkt_ring_release(&ring, bufs[2]);
+    lsquic_pkt_ring_release(&ring, bufs[1]);
+    lsquic_pkt_ring_reclaim(&ring);
+    assert(lsquic_pkt_ring_n_used(&ring) == 4);
+    buf = lsquic_pkt_ring_alloc(&ring, 100);
+    assert(buf == bufs[1]);
+    assert(ring.pr_n_reused == 1);
+
+    /* Two slots are needed, but only one is free */
+    bufs[2] = lsquic_pkt_ring_alloc(&ring, PKT_RING_SLOT_SZ + 1);
+    assert(!in_ring(&ring, bufs[2]));
+    assert(ring.pr_n_fallbacks == 1);
+    free(bufs[2]);
+    bufs[2] = lsquic_pkt_ring_alloc(&ring, 100);
+    assert(bufs[2] == bufs[1] + PKT_RING_SLOT_SZ);
+    assert(ring.pr_n_reused == 2);
+
+    lsquic_pkt_ring_release(&ring, bufs[2]);
+    lsquic_pkt_ring_release(&ring, buf);
+    lsquic_pkt_ring_reclaim(&ring);
+    assert(lsquic_pkt_ring_n_used(&ring) == 4);
+    lsquic_pkt_ring_release(&ring, bufs[0]);
+    lsquic_pkt_ring_reclaim(&ring);
+    assert(lsquic_pkt_ring_n_used(&ring) == 1);
+
+    /* Wrap around */
+    buf = lsquic_pkt_ring_alloc(&ring, 100);
+    assert(buf == bufs[0]);
+    lsquic_pkt_ring_release(&ring, buf);
+    lsquic_pkt_ring_release(&ring, bufs[3]);
+    lsquic_pkt_ring_reclaim(&ring);
+    assert(lsquic_pkt_ring_n_used(&ring) == 0);
+
+    lsquic_pkt_ring_cleanup(&ring);
+}
+
+
+/* Allocations larger than one slot span contiguous slots and do not wrap */
+static void
+test_multi_slot (void)
+{
+    struct pkt_ring ring;
+    unsigned char *bufs[3], *buf;
+
+    lsquic_pkt_ring_init(&ring, 8);
+    bufs[0] = lsquic_pkt_ring_alloc(&ring, PKT_RING_SLOT_SZ * 2 + 1);
+    assert(in_ring(&ring, bufs[0]));
+    memset(bufs[0], 0, PKT_RING_SLOT_SZ * 2 + 1);
+    assert(lsquic_pkt_ring_n_used(&ring) == 3);
+    bufs[1] = lsquic_pkt_ring_alloc(&ring, PKT_RING_SLOT_SZ * 3);
+    assert(bufs[1] == bufs[0] + PKT_RING_SLOT_SZ * 3);
+    assert(lsquic_pkt_ring_n_used(&ring) == 6);
+
+    lsquic_pkt_ring_release(&ring, bufs[0]);
+    lsquic_pkt_ring_reclaim(&ring);
+    assert(lsquic_pkt_ring_n_used(&ring) == 3);
+
+    /* Two slots left at the end of the ring are skipped */
+    bufs[2] = lsquic_pkt_ring_alloc(&ring, PKT_RING_SLOT_SZ * 3);
+    assert(bufs[2] == ring.pr_buf);
+    assert(lsquic_pkt_ring_n_used(&ring) == 8);
+
+    lsquic_pkt_ring_release(&ring, bufs[1]);
+    lsquic_pkt_ring_reclaim(&ring);
+    assert(lsquic_pkt_ring_n_used(&ring) == 3);
+
+    /* Too large */
+    buf = lsquic_pkt_ring_alloc(&ring, PKT_RING_SLOT_SZ * 5);
+    assert(!in_ring(&ring, buf));
+    memset(buf, 0, PKT_RING_SLOT_SZ * 5);
+    lsquic_pkt_ring_release(&ring, buf);
+
+    lsquic_pkt_ring_release(&ring, bufs[2]);
+    lsquic_pkt_ring_reclaim(&ring);
+    assert(lsquic_pkt_ring_n_used(&ring) == 0);
+
+    lsquic_pkt_ring_cleanup(&ring);
+}
+
+
+/* Mimic the engine: allocate a batch, release it, reclaim in bulk */
+static void
+test_batches (unsigned n_slots, unsigned batch_sz, unsigned n_iters)
+{
+    struct pkt_ring ring;
+    unsigned char *bufs[MAX_BUFS];
+    unsigned n, i;
+
+    assert(batch_sz <= MAX_BUFS);
+    lsquic_pkt_ring_init(&ring, n_slots);
+    for (i = 0; i < n_iters; ++i)
+    {
+        for (n = 0; n < batch_sz; ++n)
+        {
+            bufs[n] = lsquic_pkt_ring_alloc(&ring, 1 + (i + n) % 1370);
+            memset(bufs[n], 0, 1 + (i + n) % 1370);
+        }
+        for (n = 0; n < batch_sz; ++n)
+            lsquic_pkt_ring_release(&ring, bufs[batch_sz - 1 - n]);
+        lsquic_pkt_ring_reclaim(&ring);
+        assert(lsquic_pkt_ring_n_used(&ring) == 0);
+    }
+    assert(ring.pr_n_fallbacks == (batch_sz > ring.pr_n_slots ?
+                        (batch_sz - ring.pr_n_slots) * n_iters : 0));
+    lsquic_pkt_ring_cleanup(&ring);
+}
+
+
+/* Ring backed by huge pages is aligned on huge page boundary */
+static void
+test_huge_pages (void)
+{
+    struct pkt_ring ring;
+    unsigned char *bufs[2];
+
+    lsquic_pkt_ring_init(&ring, 1024);
+    ring.pr_huge_pages = 1;
+    bufs[0] = lsquic_pkt_ring_alloc(&ring, 1370);
+    bufs[1] = lsquic_pkt_ring_alloc(&ring, 1370);
+    assert(in_ring(&ring, bufs[0]) && in_ring(&ring, bufs[1]));
+    assert(0 == (uintptr_t) ring.pr_buf % LSQUIC_HUGE_PAGE_SZ);
+    assert(bufs[1] == bufs[0] + PKT_RING_SLOT_SZ);
+    memset(bufs[0], 0, 1370);
+    memset(bufs[1], 0, 1370);
+    lsquic_pkt_ring_release(&ring, bufs[0]);
+    lsquic_pkt_ring_release(&ring, bufs[1]);
+    lsquic_pkt_ring_reclaim(&ring);
+    assert(lsquic_pkt_ring_n_used(&ring) == 0);
+    assert(ring.pr_n_fallbacks == 0);
+    lsquic_pkt_ring_cleanup(&ring);
+}
+
+
+static void
+run_bench (int mode, unsigned n_iters, unsigned batch_sz)
+{
+    struct pkt_ring ring;
+    unsigned char *bufs[MAX_BUFS];
+    unsigned n, i;
+
+    lsquic_pkt_ring_init(&ring, batch_sz);
+    for (i = 0; i < n_iters; ++i)
+    {
+        if (mode == 0)
+        {
+            for (n = 0; n < batch_sz; ++n)
+            {
+                bufs[n] = malloc(1370);
+                bufs[n][0] = n;
+            }
+            for (n = 0; n < batch_sz; ++n)
+                free(bufs[n]);
+        }
+        else
+        {
+            for (n = 0; n < batch_sz; ++n)
+            {
+                bufs[n] = lsquic_pkt_ring_alloc(&ring, 1370);
+                bufs[n][0] = n;
+            }
+            for (n = 0; n < batch_sz; ++n)
+                lsquic_pkt_ring_release(&ring, bufs[n]);
+            lsquic_pkt_ring_reclaim(&ring);
+        }
+    }
+    lsquic_pkt_ring_cleanup(&ring);
+}
+
+
+int
+main (int argc, char **argv)
+{
+    int opt, mode = -1;
+    unsigned n_iters = 100000, batch_sz = 32;
+
+    while (-1 != (opt = getopt(argc, argv, "s:n:b:")))
+    {
+        switch (opt)
+        {
+        case 's':
+            mode = atoi(optarg);
+            break;
+        case 'n':
+            n_iters = atoi(optarg);
+            break;
+        case 'b':
+            batch_sz = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-s mode] [-n iterations] "
+                                            "[-b batch size]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    if (batch_sz < 1 || batch_sz > MAX_BUFS)
+    {
+        fprintf(stderr, "error: invalid parameters\n");
+        exit(2);
+    }
+
+    switch (mode)
+    {
+    case -1:
+        test_contiguous();
+        test_out_of_order();
+        test_multi_slot();
+        test_batches(32, 32, 100);
+        test_batches(64, 17, 100);
+        test_batches(16, 40, 10);
+        test_huge_pages();
+        break;
+    case 0:
+    case 1:
+        run_bench(mode, n_iters, batch_sz);
+        break;
+    default:
+        fprintf(stderr, "error: invalid mode %d\n", mode);
+        exit(2);
+    }
+
+    return 0;
+}
@@ -21,13 +21,41 @@ main (void)
 
     RESET();
     sent = TV(2, 0), received = TV(3, 0);
-    lsquic_rtt_stats_update(&stats, received - sent, 0);
+    lsquic_rtt_stats_update(&stats, received, received - sent, 0);
     assert(("Initial RTT checks out",
                             1000000 == lsquic_rtt_stats_get_srtt(&stats)));
     sent = TV(2, 500000), received = TV(3, 0);
-    lsquic_rtt_stats_update(&stats, received - sent, 0);
+    lsquic_rtt_stats_update(&stats, received, received - sent, 0);
     assert(("Second RTT checks out",
                             937500 == lsquic_rtt_stats_get_srtt(&stats)));
+    assert(("Latest RTT checks out",
+                            500000 == lsquic_rtt_stats_get_latest_rtt(&stats)));
+    assert(("Min RTT checks out",
+                            500000 == lsquic_rtt_stats_get_min_rtt(&stats)));
+
+    /* ACK delay is subtracted only if the result is not below min RTT */
+    RESET();
+    sent = TV(2, 0), received = TV(2, 100000);
+    lsquic_rtt_stats_update(&stats, received, received - sent, 0);
+    sent = TV(3, 0), received = TV(3, 150000);
+    lsquic_rtt_stats_update(&stats, received, received - sent, 40000);
+    assert(("ACK delay is subtracted",
+        100000 - (100000 >> 3) + (110000 >> 3)
+                                    == lsquic_rtt_stats_get_srtt(&stats)));
+    sent = TV(4, 0), received = TV(4, 150000);
+    lsquic_rtt_stats_update(&stats, received, received - sent, 100000);
+    assert(("Inflated ACK delay is ignored",
+                    150000 == lsquic_rtt_stats_get_latest_rtt(&stats)));
+    assert(("Inflated ACK delay does not affect min RTT",
+                    100000 == lsquic_rtt_stats_get_min_rtt(&stats)));
+    assert(("Max RTT is latest RTT when RTT grows",
+                    150000 == lsquic_rtt_stats_get_max_rtt(&stats)));
+
+    /* Min RTT expires */
+    sent = TV(20, 0), received = TV(20, 200000);
+    lsquic_rtt_stats_update(&stats, received, received - sent, 0);
+    assert(("Old min RTT sample expires",
+                    200000 == lsquic_rtt_stats_get_min_rtt(&stats)));
 
     return 0;
 }
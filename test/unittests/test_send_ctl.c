@@ -0,0 +1,585 @@
+/* Copyright (c) 2017 - 2019 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * Test processing of ACK frames by the send controller.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+
+#include "lsquic.h"
+
+#include "lsquic_types.h"
+#include "lsquic_int_types.h"
+#include "lsquic_alarmset.h"
+#include "lsquic_packet_common.h"
+#include "lsquic_conn_flow.h"
+#include "lsquic_rtt.h"
+#include "lsquic_sfcw.h"
+#include "lsquic_stream.h"
+#include "lsquic_malo.h"
+#include "lsquic_mm.h"
+#include "lsquic_conn_public.h"
+#include "lsquic_logger.h"
+#include "lsquic_util.h"
+#include "lsquic_parse.h"
+#include "lsquic_conn.h"
+#include "lsquic_engine_public.h"
+#include "lsquic_cubic.h"
+#include "lsquic_minmax.h"
+#include "lsquic_bw_sampler.h"
+#include "lsquic_bbr.h"
+#include "lsquic_pacer.h"
+#include "lsquic_senhist.h"
+#include "lsquic_send_ctl.h"
+#include "lsquic_ver_neg.h"
+#include "lsquic_packet_out.h"
+
+#define MAX_PACKETS 20000
+
+
+struct test_objs
+{
+    struct lsquic_engine_public eng_pub;
+    struct lsquic_conn          lconn;
+    struct lsquic_conn_public   conn_pub;
+    struct lsquic_send_ctl      send_ctl;
+    struct lsquic_alarmset      alset;
+    struct ver_neg              ver_neg;
+    unsigned char               state[MAX_PACKETS + 1];
+};
+
+
+/* Packet states tracked by the test */
+enum { PS_NONE, PS_UNACKED, PS_ACKED, PS_LOST, PS_LOST_ACKED, };
+
+
+static void
+init_test_objs (struct test_objs *tobjs, int rack)
+{
+    memset(tobjs, 0, sizeof(*tobjs));
+    tobjs->eng_pub.enp_settings.es_rack = rack;
+    tobjs->lconn.cn_pf = select_pf_by_ver(LSQVER_043);
+    tobjs->lconn.cn_version = LSQVER_043;
+    tobjs->lconn.cn_pack_size = 1370;
+    tobjs->lconn.cn_flags = LSCONN_HANDSHAKE_DONE;
+    lsquic_mm_init(&tobjs->eng_pub.enp_mm);
+    lsquic_alarmset_init(&tobjs->alset, 0);
+    tobjs->conn_pub.mm = &tobjs->eng_pub.enp_mm;
+    tobjs->conn_pub.lconn = &tobjs->lconn;
+    tobjs->conn_pub.enpub = &tobjs->eng_pub;
+    tobjs->conn_pub.send_ctl = &tobjs->send_ctl;
+    tobjs->conn_pub.packet_out_malo =
+                        lsquic_malo_create(sizeof(struct lsquic_packet_out));
+    lsquic_send_ctl_init(&tobjs->send_ctl, &tobjs->alset, &tobjs->eng_pub,
+        &tobjs->ver_neg, &tobjs->conn_pub, tobjs->lconn.cn_pack_size);
+}
+
+
+static void
+deinit_test_objs (struct test_objs *tobjs)
+{
+    lsquic_send_ctl_cleanup(&tobjs->send_ctl);
+    lsquic_malo_destroy(tobjs->conn_pub.packet_out_malo);
+    lsquic_mm_cleanup(&tobjs->eng_pub.enp_mm);
+}
+
+
+static void
+send_packets_at (struct test_objs *tobjs, unsigned count, lsquic_time_t now)
+{
+    struct lsquic_packet_out *packet_out;
+    int s;
+
+    while (count-- > 0)
+    {
+        packet_out = lsquic_mm_get_packet_out(&tobjs->eng_pub.enp_mm, NULL,
+                                                    QUIC_MAX_PAYLOAD_SZ);
+        assert(packet_out);
+        packet_out->po_packno = ++tobjs->send_ctl.sc_cur_packno;
+        assert(packet_out->po_packno <= MAX_PACKETS);
+        packet_out->po_frame_types = 1 << QUIC_FRAME_WINDOW_UPDATE;
+        packet_out->po_data_sz = 10;
+        lsquic_send_ctl_scheduled_one(&tobjs->send_ctl, packet_out);
+        packet_out = lsquic_send_ctl_next_packet_to_send(&tobjs->send_ctl);
+        assert(packet_out);
+        packet_out->po_sent = now;
+        s = lsquic_send_ctl_sent_packet(&tobjs->send_ctl, packet_out, 1);
+        assert(0 == s);
+        tobjs->state[ packet_out->po_packno ] = PS_UNACKED;
+    }
+}
+
+
+static void
+send_packets (struct test_objs *tobjs, unsigned count)
+{
+    send_packets_at(tobjs, count, lsquic_time_now());
+}
+
+
+/* Verify that the state kept by the test matches that of the send
+ * controller.
+ */
+static void
+verify_state (struct test_objs *tobjs)
+{
+    const struct lsquic_packet_out *packet_out;
+    unsigned char seen[MAX_PACKETS + 1];
+    lsquic_packno_t packno;
+
+    memset(seen, PS_NONE, sizeof(seen));
+    TAILQ_FOREACH(packet_out, &tobjs->send_ctl.sc_unacked_packets, po_next)
+        seen[ packet_out->po_packno ] = PS_UNACKED;
+    TAILQ_FOREACH(packet_out, &tobjs->send_ctl.sc_lost_packets, po_next)
+        seen[ packet_out->po_packno ] = PS_LOST;
+
+    for (packno = 1; packno <= tobjs->send_ctl.sc_cur_packno; ++packno)
+    {
+        if (seen[packno] == PS_NONE)
+        {
+            /* Acked lost packets are dropped from the lost queue */
+            assert(tobjs->state[packno] == PS_ACKED
+                                || tobjs->state[packno] == PS_LOST_ACKED);
+            tobjs->state[packno] = PS_ACKED;
+            continue;
+        }
+        /* ...unless the packet is too old to be remembered */
+        if (seen[packno] == PS_LOST && tobjs->state[packno] == PS_LOST_ACKED)
+            continue;
+        if (seen[packno] == PS_LOST)
+            tobjs->state[packno] = PS_LOST;
+        assert(tobjs->state[packno] == seen[packno]);
+    }
+}
+
+
+/* Ranges are specified from highest to lowest as in the ACK frame */
+static void
+ack_ranges_at (struct test_objs *tobjs,
+                const struct lsquic_packno_range *ranges, unsigned n_ranges,
+                lsquic_time_t now)
+{
+    struct ack_info *acki;
+    lsquic_packno_t packno;
+    unsigned n;
+    int s;
+
+    acki = calloc(1, sizeof(*acki));
+    acki->n_ranges = n_ranges;
+    memcpy(acki->ranges, ranges, n_ranges * sizeof(ranges[0]));
+    for (n = 0; n < n_ranges; ++n)
+    {
+        assert(ranges[n].low <= ranges[n].high);
+        assert(n == 0 || ranges[n].high < ranges[n - 1].low);
+        for (packno = ranges[n].low; packno <= ranges[n].high; ++packno)
+            if (tobjs->state[packno] == PS_UNACKED)
+                tobjs->state[packno] = PS_ACKED;
+            else if (tobjs->state[packno] == PS_LOST)
+                tobjs->state[packno] = PS_LOST_ACKED;
+    }
+
+    s = lsquic_send_ctl_got_ack(&tobjs->send_ctl, acki, now);
+    assert(0 == s);
+    free(acki);
+    verify_state(tobjs);
+}
+
+
+static void
+ack_ranges (struct test_objs *tobjs, const struct lsquic_packno_range *ranges,
+                                                            unsigned n_ranges)
+{
+    ack_ranges_at(tobjs, ranges, n_ranges, lsquic_time_now());
+}
+
+
+static void
+test_simple_ranges (void)
+{
+    struct test_objs tobjs;
+
+    init_test_objs(&tobjs, 0);
+    send_packets(&tobjs, 100);
+
+    ack_ranges(&tobjs, (struct lsquic_packno_range[]) {
+        { 97, 100, }, { 50, 60, }, { 1, 10, }, }, 3);
+    assert(tobjs.send_ctl.sc_largest_acked_packno == 100);
+
+    /* The same ACK again does not change anything */
+    ack_ranges(&tobjs, (struct lsquic_packno_range[]) {
+        { 97, 100, }, { 50, 60, }, { 1, 10, }, }, 3);
+
+    send_packets(&tobjs, 10);
+    ack_ranges(&tobjs, (struct lsquic_packno_range[]) {
+        { 105, 110, }, { 1, 100, }, }, 2);
+    assert(tobjs.send_ctl.sc_largest_acked_packno == 110);
+
+    deinit_test_objs(&tobjs);
+}
+
+
+/* The ring of unacked packets grows when many packets are in flight */
+static void
+test_many_in_flight (void)
+{
+    struct test_objs tobjs;
+    struct lsquic_packno_range ranges[256];
+    unsigned n;
+
+    init_test_objs(&tobjs, 0);
+    send_packets(&tobjs, 5000);
+    assert(tobjs.send_ctl.sc_unacked_ring_mask + 1 >= 5000);
+
+    /* Ack every other packet at the top */
+    for (n = 0; n < 256; ++n)
+    {
+        ranges[n].high = 5000 - n * 2;
+        ranges[n].low  = ranges[n].high;
+    }
+    ack_ranges(&tobjs, ranges, 256);
+
+    /* Ack everything at once, including packets acked already */
+    send_packets(&tobjs, 1000);
+    ranges[0].low  = 1;
+    ranges[0].high = 6000;
+    ack_ranges(&tobjs, ranges, 1);
+    assert(TAILQ_EMPTY(&tobjs.send_ctl.sc_unacked_packets));
+    assert(0 == tobjs.send_ctl.sc_n_in_flight_all);
+
+    deinit_test_objs(&tobjs);
+}
+
+
+static void
+send_packet_no (struct test_objs *tobjs, lsquic_packno_t packno)
+{
+    struct lsquic_packet_out *packet_out;
+    int s;
+
+    packet_out = lsquic_mm_get_packet_out(&tobjs->eng_pub.enp_mm, NULL,
+                                                    QUIC_MAX_PAYLOAD_SZ);
+    assert(packet_out);
+    packet_out->po_packno = packno;
+    packet_out->po_frame_types = 1 << QUIC_FRAME_WINDOW_UPDATE;
+    packet_out->po_data_sz = 10;
+    lsquic_send_ctl_scheduled_one(&tobjs->send_ctl, packet_out);
+    packet_out = lsquic_send_ctl_next_packet_to_send(&tobjs->send_ctl);
+    assert(packet_out && packet_out->po_packno == packno);
+    packet_out->po_sent = lsquic_time_now();
+    s = lsquic_send_ctl_sent_packet(&tobjs->send_ctl, packet_out, 1);
+    assert(0 == s);
+}
+
+
+/* Return true if packet is on the unacked or on the lost queue */
+static int
+packet_in_flight (struct test_objs *tobjs, lsquic_packno_t packno)
+{
+    const struct lsquic_packet_out *packet_out;
+
+    TAILQ_FOREACH(packet_out, &tobjs->send_ctl.sc_unacked_packets, po_next)
+        if (packet_out->po_packno == packno)
+            return 1;
+    TAILQ_FOREACH(packet_out, &tobjs->send_ctl.sc_lost_packets, po_next)
+        if (packet_out->po_packno == packno)
+            return 1;
+    return 0;
+}
+
+
+/* If the range of unacked packet numbers becomes too large to index, ACKs
+ * are processed by walking the unacked queue.  Once the range shrinks, the
+ * index is used again.
+ */
+static void
+test_unacked_list (void)
+{
+    struct test_objs tobjs;
+    struct ack_info *acki;
+    lsquic_packno_t packno;
+    int s;
+
+    init_test_objs(&tobjs, 0);
+    send_packets(&tobjs, 10);
+    assert(tobjs.send_ctl.sc_unacked_ring);
+
+    send_packet_no(&tobjs, 1000000);
+    assert(!tobjs.send_ctl.sc_unacked_ring);
+    assert(tobjs.send_ctl.sc_flags & SC_UNACKED_LIST);
+    assert(11 == tobjs.send_ctl.sc_n_in_flight_all);
+
+    acki = calloc(1, sizeof(*acki));
+    acki->n_ranges = 3;
+    acki->ranges[0] = (struct lsquic_packno_range) { 1000000, 1000000, };
+    acki->ranges[1] = (struct lsquic_packno_range) { 8, 8, };
+    acki->ranges[2] = (struct lsquic_packno_range) { 3, 5, };
+    s = lsquic_send_ctl_got_ack(&tobjs.send_ctl, acki, lsquic_time_now());
+    assert(0 == s);
+    for (packno = 1; packno <= 10; ++packno)
+        assert(packet_in_flight(&tobjs, packno)
+                        == !((packno >= 3 && packno <= 5) || packno == 8));
+    assert(!packet_in_flight(&tobjs, 1000000));
+
+    acki->n_ranges = 1;
+    acki->ranges[0] = (struct lsquic_packno_range) { 1, 1000000, };
+    s = lsquic_send_ctl_got_ack(&tobjs.send_ctl, acki, lsquic_time_now());
+    assert(0 == s);
+    assert(TAILQ_EMPTY(&tobjs.send_ctl.sc_unacked_packets));
+    free(acki);
+
+    send_packet_no(&tobjs, 1000001);
+    assert(tobjs.send_ctl.sc_unacked_ring);
+    assert(!(tobjs.send_ctl.sc_flags & SC_UNACKED_LIST));
+
+    deinit_test_objs(&tobjs);
+}
+
+
+/* Random ACK frames, possibly overlapping previous ACKs and covering
+ * packets declared lost.
+ */
+static void
+test_random (unsigned n_iters, int rack)
+{
+    struct test_objs tobjs;
+    struct lsquic_packno_range ranges[256];
+    lsquic_packno_t high;
+    unsigned n, n_ranges, gap, len;
+
+    init_test_objs(&tobjs, rack);
+    srand(n_iters);
+
+    for (n = 0; n < n_iters
+                && tobjs.send_ctl.sc_cur_packno + 200 <= MAX_PACKETS; ++n)
+    {
+        send_packets(&tobjs, 1 + rand() % 200);
+        high = tobjs.send_ctl.sc_cur_packno - rand() % 10;
+        n_ranges = 0;
+        while (n_ranges < 1 + (unsigned) rand() % 256)
+        {
+            len = rand() % 20;
+            if (len >= high)
+                len = high - 1;
+            ranges[n_ranges].high = high;
+            ranges[n_ranges].low  = high - len;
+            ++n_ranges;
+            gap = 2 + rand() % 30;
+            if (high - len <= gap)
+                break;
+            high = high - len - gap;
+        }
+        ack_ranges(&tobjs, ranges, n_ranges);
+    }
+
+    deinit_test_objs(&tobjs);
+}
+
+
+/* Delivery rate is sampled when packets are acked */
+static void
+test_bandwidth (void)
+{
+    struct test_objs tobjs;
+    struct lsquic_conn_info info;
+    const lsquic_time_t t0 = 1000000, rtt = 100000;
+
+    init_test_objs(&tobjs, 0);
+    lsquic_send_ctl_get_info(&tobjs.send_ctl, &info);
+    assert(0 == info.lci_bw_estimate);
+    assert(0 == info.lci_bytes_delivered);
+    assert(info.lci_cwnd > 0);
+
+    send_packets_at(&tobjs, 10, t0);
+    lsquic_send_ctl_get_info(&tobjs.send_ctl, &info);
+    assert(info.lci_bytes_in_flight > 0);
+
+    ack_ranges_at(&tobjs, (struct lsquic_packno_range[]) { { 1, 10, }, }, 1,
+                                                                    t0 + rtt);
+    lsquic_send_ctl_get_info(&tobjs.send_ctl, &info);
+    assert(0 == info.lci_bytes_in_flight);
+    assert(info.lci_bytes_delivered > 0);
+    /* Ten packets delivered over one round trip */
+    assert(info.lci_bw_estimate
+                            == info.lci_bytes_delivered * 1000000 / rtt);
+    assert(info.lci_bw_sample == info.lci_bw_estimate);
+    assert(info.lci_srtt == rtt);
+    assert(info.lci_min_rtt == rtt);
+    assert(info.lci_latest_rtt == rtt);
+    assert(info.lci_pacing_rate > 0);
+
+    /* A lower sample does not lower the estimate */
+    send_packets_at(&tobjs, 1, t0 + rtt);
+    ack_ranges_at(&tobjs, (struct lsquic_packno_range[]) { { 1, 11, }, }, 1,
+                                                                t0 + 3 * rtt);
+    lsquic_send_ctl_get_info(&tobjs.send_ctl, &info);
+    assert(info.lci_bw_sample < info.lci_bw_estimate);
+
+    deinit_test_objs(&tobjs);
+}
+
+
+/* In RACK mode, reordered packets are not declared lost right away.  If
+ * a packet declared lost is acked later, the loss event is undone.
+ */
+static void
+test_rack (void)
+{
+    struct test_objs tobjs;
+    struct lsquic_conn_info info;
+    const lsquic_time_t rtt = 100000;
+    lsquic_time_t t;
+    uint64_t cwnd;
+
+    init_test_objs(&tobjs, 1);
+    assert(tobjs.send_ctl.sc_flags & SC_RACK);
+
+    t = 1000000;
+    send_packets_at(&tobjs, 10, t);
+    t += rtt;
+    ack_ranges_at(&tobjs, (struct lsquic_packno_range[]) { { 1, 10, }, }, 1,
+                                                                            t);
+
+    /* Packet 11 is reordered: it is not lost yet and the loss timer is
+     * set to a quarter of min RTT.
+     */
+    send_packets_at(&tobjs, 10, t);
+    t += rtt;
+    ack_ranges_at(&tobjs, (struct lsquic_packno_range[]) { { 12, 20, }, }, 1,
+                                                                            t);
+    assert(tobjs.state[11] == PS_UNACKED);
+    assert(tobjs.send_ctl.sc_loss_to == rtt / 4);
+    ack_ranges_at(&tobjs, (struct lsquic_packno_range[]) { { 11, 20, }, }, 1,
+                                                                    t + 1000);
+    assert(tobjs.state[11] == PS_ACKED);
+
+    /* Packet 21 is declared lost, which reduces the congestion window */
+    lsquic_send_ctl_get_info(&tobjs.send_ctl, &info);
+    cwnd = info.lci_cwnd;
+    send_packets_at(&tobjs, 1, t);
+    send_packets_at(&tobjs, 9, t + rtt / 2);
+    t += rtt / 2 + rtt;
+    ack_ranges_at(&tobjs, (struct lsquic_packno_range[]) { { 22, 30, }, }, 1,
+                                                                            t);
+    assert(tobjs.state[21] == PS_LOST);
+    lsquic_send_ctl_get_info(&tobjs.send_ctl, &info);
+    assert(info.lci_cwnd < cwnd);
+
+    /* ...but it turns out that the packet was delivered */
+    ack_ranges_at(&tobjs, (struct lsquic_packno_range[]) { { 21, 30, }, }, 1,
+                                                                    t + 1000);
+    assert(tobjs.state[21] == PS_ACKED);
+    lsquic_send_ctl_get_info(&tobjs.send_ctl, &info);
+    assert(info.lci_cwnd >= cwnd);
+    assert(info.lci_n_spurious_losses == 1);
+    assert(tobjs.send_ctl.sc_reo_wnd_mult == 2);
+
+    deinit_test_objs(&tobjs);
+}
+
+
+/* Packets declared lost by packet-number threshold are reordered: the
+ * loss event is undone when they are acked.
+ */
+static void
+test_spurious_fack (void)
+{
+    struct test_objs tobjs;
+    struct lsquic_conn_info info;
+    const lsquic_time_t rtt = 100000;
+    lsquic_time_t t;
+    uint64_t cwnd;
+
+    init_test_objs(&tobjs, 0);
+    t = 1000000;
+    send_packets_at(&tobjs, 10, t);
+    t += rtt;
+    ack_ranges_at(&tobjs, (struct lsquic_packno_range[]) { { 1, 10, }, }, 1,
+                                                                            t);
+    lsquic_send_ctl_get_info(&tobjs.send_ctl, &info);
+    cwnd = info.lci_cwnd;
+
+    send_packets_at(&tobjs, 10, t);
+    t += rtt;
+    ack_ranges_at(&tobjs, (struct lsquic_packno_range[]) { { 15, 20, }, }, 1,
+                                                                            t);
+    assert(tobjs.state[11] == PS_LOST);
+    assert(tobjs.state[14] == PS_LOST);
+    lsquic_send_ctl_get_info(&tobjs.send_ctl, &info);
+    assert(info.lci_cwnd < cwnd);
+
+    /* Three out of four is not enough to undo */
+    ack_ranges_at(&tobjs, (struct lsquic_packno_range[]) { { 12, 20, }, }, 1,
+                                                                    t + 1000);
+    lsquic_send_ctl_get_info(&tobjs.send_ctl, &info);
+    assert(info.lci_cwnd < cwnd);
+    assert(info.lci_n_spurious_losses == 3);
+
+    ack_ranges_at(&tobjs, (struct lsquic_packno_range[]) { { 11, 20, }, }, 1,
+                                                                    t + 2000);
+    lsquic_send_ctl_get_info(&tobjs.send_ctl, &info);
+    assert(info.lci_cwnd >= cwnd);
+    assert(info.lci_n_spurious_losses == 4);
+    assert(TAILQ_EMPTY(&tobjs.send_ctl.sc_lost_packets));
+
+    deinit_test_objs(&tobjs);
+}
+
+
+/* Packets that were declared lost and rescheduled, but not yet sent, are
+ * dropped from the scheduled queue when the originals are acked.
+ */
+static void
+test_spurious_resched (void)
+{
+    struct test_objs tobjs;
+    const lsquic_time_t rtt = 100000;
+    lsquic_time_t t;
+    unsigned n;
+
+    init_test_objs(&tobjs, 0);
+    t = 1000000;
+    send_packets_at(&tobjs, 10, t);
+    t += rtt;
+    ack_ranges_at(&tobjs, (struct lsquic_packno_range[]) { { 1, 10, }, }, 1,
+                                                                            t);
+
+    send_packets_at(&tobjs, 10, t);
+    t += rtt;
+    ack_ranges_at(&tobjs, (struct lsquic_packno_range[]) { { 15, 20, }, }, 1,
+                                                                            t);
+    assert(tobjs.state[11] == PS_LOST);
+    assert(tobjs.state[14] == PS_LOST);
+
+    n = lsquic_send_ctl_reschedule_packets(&tobjs.send_ctl);
+    assert(4 == n);
+    assert(4 == tobjs.send_ctl.sc_n_scheduled);
+    assert(TAILQ_EMPTY(&tobjs.send_ctl.sc_lost_packets));
+
+    ack_ranges_at(&tobjs, (struct lsquic_packno_range[]) { { 11, 20, }, }, 1,
+                                                                    t + 1000);
+    assert(0 == tobjs.send_ctl.sc_n_scheduled);
+    assert(0 == tobjs.send_ctl.sc_bytes_scheduled);
+    assert(TAILQ_EMPTY(&tobjs.send_ctl.sc_scheduled_packets));
+    assert(20 == tobjs.send_ctl.sc_cur_packno);
+
+    deinit_test_objs(&tobjs);
+}
+
+
+int
+main (void)
+{
+    test_simple_ranges();
+    test_many_in_flight();
+    test_unacked_list();
+    test_random(300, 0);
+    test_random(300, 1);
+    test_bandwidth();
+    test_rack();
+    test_spurious_fack();
+    test_spurious_resched();
+    return 0;
+}
@@ -16,10 +16,9 @@
 #include "lsquic_conn.h"
 
 
-int
-main (void)
+static void
+test_window (void)
 {
-    lsquic_global_init(LSQUIC_GLOBAL_SERVER);
     const unsigned INIT_WINDOW_SIZE = 16 * 1024;
     struct lsquic_sfcw fc;
     struct lsquic_conn lconn;
@@ -55,6 +54,61 @@ main (void)
     recv_off = lsquic_sfcw_get_fc_recv_off(&fc);
     assert(("Updated flow control receive window checks out",
         INIT_WINDOW_SIZE * 5 / 3 == recv_off));
+}
+
+
+/* Receive window is capped by what is left of connection's memory budget */
+static void
+test_budget (void)
+{
+    const unsigned WINDOW_SIZE = 64 * 1024;
+    struct lsquic_sfcw fc;
+    struct lsquic_conn lconn;
+    struct lsquic_conn_public conn_pub;
+    uint64_t recv_off;
+    int s;
+
+    memset(&lconn, 0, sizeof(lconn));
+    memset(&conn_pub, 0, sizeof(conn_pub));
+    conn_pub.lconn = &lconn;
+    conn_pub.mem_budget = 100 * 1024;
+    conn_pub.mem_used = 60 * 1024;
+    lsquic_sfcw_init(&fc, WINDOW_SIZE, NULL, &conn_pub, 123);
+
+    recv_off = lsquic_sfcw_get_fc_recv_off(&fc);
+    assert(("Window is what is left of the budget", 40 * 1024 == recv_off));
 
+    s = lsquic_sfcw_set_max_recv_off(&fc, recv_off);
+    assert(s);
+    lsquic_sfcw_consume_rem(&fc);
+
+    conn_pub.mem_used = 120 * 1024;
+    s = lsquic_sfcw_fc_offsets_changed(&fc);
+    assert(s);
+    recv_off = lsquic_sfcw_get_fc_recv_off(&fc);
+    assert(("Over budget, window is at its minimum",
+                                        (40 + 16) * 1024 == recv_off));
+    s = lsquic_sfcw_fc_offsets_changed(&fc);
+    assert(!s);
+
+    s = lsquic_sfcw_set_max_recv_off(&fc, recv_off);
+    assert(s);
+    lsquic_sfcw_consume_rem(&fc);
+
+    conn_pub.mem_used = 0;
+    s = lsquic_sfcw_fc_offsets_changed(&fc);
+    assert(s);
+    recv_off = lsquic_sfcw_get_fc_recv_off(&fc);
+    assert(("Back under budget, window is restored",
+                                    (40 + 16) * 1024 + WINDOW_SIZE == recv_off));
+}
+
+
+int
+main (void)
+{
+    lsquic_global_init(LSQUIC_GLOBAL_SERVER);
+    test_window();
+    test_budget();
     return 0;
 }
@@ -32,6 +32,9 @@
 #include "lsquic_conn.h"
 #include "lsquic_engine_public.h"
 #include "lsquic_cubic.h"
+#include "lsquic_minmax.h"
+#include "lsquic_bw_sampler.h"
+#include "lsquic_bbr.h"
 #include "lsquic_pacer.h"
 #include "lsquic_senhist.h"
 #include "lsquic_send_ctl.h"
@@ -1978,6 +1981,69 @@ test_writing_to_stream_outside_callback (void)
 }
 
 
+/* Over memory budget, no more than one packet is buffered per queue and
+ * connection receive window shrinks to its minimum.
+ */
+static void
+test_writing_over_budget (void)
+{
+    ssize_t nw;
+    struct test_objs tobjs;
+    struct lsquic_stream *stream;
+    unsigned char buf[0x1000];
+    unsigned mem_used;
+    int s;
+
+    init_test_ctl_settings(&g_ctl_settings);
+    g_ctl_settings.tcs_schedule_stream_packets_immediately = 0;
+    g_ctl_settings.tcs_bp_type = BPT_OTHER_PRIO;
+    const struct buf_packet_q *const bpq =
+            &tobjs.send_ctl.sc_buffered_packets[g_ctl_settings.tcs_bp_type];
+
+    init_test_objs(&tobjs, 0x10000, 0x10000, NULL);
+    n_closed = 0;
+    /* Header blocks use up all but a part of a packet's worth */
+    tobjs.conn_pub.mem_budget = 0x10000;
+    tobjs.conn_pub.mem_used = 0x10000 - 1000;
+    mem_used = tobjs.conn_pub.mem_used;
+    stream = new_stream(&tobjs, 123);
+    assert(("Stream initialized", stream));
+
+    /* The first packet is buffered even if it goes over budget */
+    init_buf(buf, sizeof(buf));
+    nw = lsquic_stream_write(stream, buf, sizeof(buf));
+    assert(nw > 0);
+    s = lsquic_stream_flush(stream);
+    assert(0 == s);
+    assert(("one packet buffered", 1 == bpq->bpq_count));
+    assert(("buffered packet is charged",
+        tobjs.conn_pub.mem_used == mem_used + tobjs.send_ctl.sc_pack_size));
+    assert(lsquic_conn_pub_over_budget(&tobjs.conn_pub));
+
+    /* More data does not add packets */
+    nw = lsquic_stream_write(stream, buf, sizeof(buf));
+    s = lsquic_stream_flush(stream);
+    assert(("still one packet buffered", 1 == bpq->bpq_count));
+
+    /* Connection window is capped */
+    lsquic_cfcw_init(&tobjs.conn_pub.cfcw, &tobjs.conn_pub, 0x10000);
+    assert(("connection window is at its minimum",
+                0x4000 == lsquic_cfcw_get_fc_recv_off(&tobjs.conn_pub.cfcw)));
+
+    /* Once buffered packet is scheduled, budget is released */
+    g_ctl_settings.tcs_schedule_stream_packets_immediately = 1;
+    lsquic_send_ctl_schedule_buffered(&tobjs.send_ctl,
+                                                g_ctl_settings.tcs_bp_type);
+    assert(0 == bpq->bpq_count);
+    assert(tobjs.conn_pub.mem_used == mem_used);
+    assert(1 == lsquic_send_ctl_n_scheduled(&tobjs.send_ctl));
+
+    lsquic_stream_destroy(stream);
+    assert(("on_close called", 1 == n_closed));
+    deinit_test_objs(&tobjs);
+}
+
+
 /* Test window update logic, connection-limited */
 static void
 test_window_update1 (void)
@@ -2731,6 +2797,7 @@ main (int argc, char **argv)
 
     test_writing_to_stream_schedule_stream_packets_immediately();
     test_writing_to_stream_outside_callback();
+    test_writing_over_budget();
     test_window_update1();
     test_window_update2();
     test_forced_flush_when_conn_blocked();